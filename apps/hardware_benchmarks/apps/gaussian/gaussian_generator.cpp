@@ -19,7 +19,7 @@ public:
     Output<Buffer<uint8_t>> output{"output", 2};
 
   //Input<int32_t> tilesize{"tilesize", 64, 8, 128}; // default 64. bounded between 8 and 128
-    int tilesize = imgSize;
+    GeneratorParam<int> tilesize{"tilesize", imgSize, 8, 128};  // swept by `make search`
 
     void generate() {
         /* THE ALGORITHM */
@@ -86,7 +86,7 @@ public:
 
           hw_output
             //            .compute_at(output, xo)
-            .tile(x, y, xo, yo, xi, yi, imgSize, imgSize)
+            .tile(x, y, xo, yo, xi, yi, tilesize, tilesize)
             .hw_accelerate(xi, xo);
 
           blur_unnormalized.update()
@@ -6,7 +6,6 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <assert.h>
-#include <hls_stream.h>
 
 using hls::stream;
 
@@ -41,13 +40,8 @@ static void call(stream<PackedStencil<T, IN_EXTENT_0, EXTENT_1, EXTENT_2, EXTENT
         buffer[BUFFER_EXTENT - 1] = in_stencil;
         if (i >= OUT_EXTENT_0 - IN_EXTENT_0) {
             // convert buffer to out_stencil, doing bit shuffling essentially
-            for (size_t idx_3 = 0; idx_3 < EXTENT_3; idx_3++)
-            for (size_t idx_2 = 0; idx_2 < EXTENT_2; idx_2++)
-            for (size_t idx_1 = 0; idx_1 < EXTENT_1; idx_1++)
-            for (size_t idx_0 = 0; idx_0 < IN_EXTENT_0; idx_0++)
             for (size_t idx_buffer = 0; idx_buffer < BUFFER_EXTENT; idx_buffer++) {
-                out_stencil(idx_0+idx_buffer*IN_EXTENT_0, idx_1, idx_2, idx_3)
-                    = buffer[idx_buffer](idx_0, idx_1, idx_2, idx_3);
+                copy_into_stencil(out_stencil, buffer[idx_buffer], idx_buffer*IN_EXTENT_0);
             }
             out_stream.write(out_stencil);
         }
@@ -102,12 +96,7 @@ static void call(stream<PackedStencil<T, IN_EXTENT_0, EXTENT_1, EXTENT_2, EXTENT
             PackedStencil<T, IMG_EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> out;
             // convert the array of stencils to a longer packed stencil
             for (size_t i = 0; i < BUFFER_EXTENT_0; i++)
-            for (size_t st_idx_3 = 0; st_idx_3 < EXTENT_3; st_idx_3++)
-            for (size_t st_idx_2 = 0; st_idx_2 < EXTENT_2; st_idx_2++)
-            for (size_t st_idx_1 = 0; st_idx_1 < EXTENT_1; st_idx_1++)
-            for (size_t st_idx_0 = 0; st_idx_0 < IN_EXTENT_0; st_idx_0++)
-                out(st_idx_0 + i*IN_EXTENT_0, st_idx_1, st_idx_2, st_idx_3)
-                    = buffer[i](st_idx_0, st_idx_1, st_idx_2, st_idx_3);
+                copy_into_stencil(out, buffer[i], i*IN_EXTENT_0);
 
             out_stream.write(out);
         }
@@ -171,6 +160,11 @@ static void call(stream<PackedStencil<T, IN_EXTENT_0, IN_EXTENT_1, EXTENT_2, EXT
     stream<PackedStencil<T, IN_EXTENT_0, OUT_EXTENT_1, EXTENT_2, EXTENT_3> > slice_stream;
 #pragma HLS STREAM variable=slice_stream depth=1
 #pragma HLS RESOURCE variable=slice_stream core=FIFO_SRL
+#ifdef HALIDE_DATAFLOW_THREADS
+    slice_stream.set_depth(1);
+    hls::dataflow processes;
+    processes.spawn([&]() {
+#endif
 
     size_t write_idx_1 = 0; // the line index of coming stencil in the linebuffer
  LB2D_buf:for (size_t row = 0; row < IDX_EXTENT_1; row++) {
@@ -189,26 +183,19 @@ static void call(stream<PackedStencil<T, IN_EXTENT_0, IN_EXTENT_1, EXTENT_2, EXT
                     size_t idx_line_in_buffer = idx_line + write_idx_1;
                     if (idx_line_in_buffer >= BUFFER_EXTENT_1)
                         idx_line_in_buffer -= BUFFER_EXTENT_1;
-                    for (size_t st_idx_3 = 0; st_idx_3 < EXTENT_3; st_idx_3++)
-                    for (size_t st_idx_2 = 0; st_idx_2 < EXTENT_2; st_idx_2++)
-                    for (size_t st_idx_1 = 0; st_idx_1 < IN_EXTENT_1; st_idx_1++)
-                    for (size_t st_idx_0 = 0; st_idx_0 < IN_EXTENT_0; st_idx_0++)
-                        slice(st_idx_0, idx_line*IN_EXTENT_1 + st_idx_1, st_idx_2, st_idx_3)
-                            = buffer[idx_line_in_buffer][col](st_idx_0, st_idx_1, st_idx_2, st_idx_3);
+                    copy_into_stencil(slice, buffer[idx_line_in_buffer][col], 0, idx_line*IN_EXTENT_1);
                 }
                 // pass data from input
-                for (size_t st_idx_3 = 0; st_idx_3 < EXTENT_3; st_idx_3++)
-                for (size_t st_idx_2 = 0; st_idx_2 < EXTENT_2; st_idx_2++)
-                for (size_t st_idx_1 = 0; st_idx_1 < IN_EXTENT_1; st_idx_1++)
-                for (size_t st_idx_0 = 0; st_idx_0 < IN_EXTENT_0; st_idx_0++)
-                    slice(st_idx_0, BUFFER_EXTENT_1*IN_EXTENT_1 + st_idx_1, st_idx_2, st_idx_3)
-                        = in_stencil(st_idx_0, st_idx_1, st_idx_2, st_idx_3);
+                copy_into_stencil(slice, in_stencil, 0, BUFFER_EXTENT_1*IN_EXTENT_1);
                 slice_stream.write(slice);
             }
             buffer[write_idx_1][col] = in_stencil;  // store the input in the buffer
         }
         write_idx_1++;
     }
+#ifdef HALIDE_DATAFLOW_THREADS
+    });
+#endif
 
     // feed the column stencil stream to 1D line buffer
     const size_t NUM_OF_OUTPUT_1 = (IMG_EXTENT_1 - OUT_EXTENT_1) / IN_EXTENT_1 + 1;
@@ -269,13 +256,8 @@ static void call(stream<PackedStencil<T, EXTENT_0, IN_EXTENT_1, EXTENT_2, EXTENT
         buffer[BUFFER_EXTENT - 1] = in_stencil;
         if (i >= OUT_EXTENT_1 - IN_EXTENT_1) {
             // convert buffer to out_stencil, doing bit shuffling essentially
-            for (size_t idx_3 = 0; idx_3 < EXTENT_3; idx_3++)
-            for (size_t idx_2 = 0; idx_2 < EXTENT_2; idx_2++)
-            for (size_t idx_1 = 0; idx_1 < IN_EXTENT_1; idx_1++)
-            for (size_t idx_0 = 0; idx_0 < EXTENT_0; idx_0++)
             for (size_t idx_buffer = 0; idx_buffer < BUFFER_EXTENT; idx_buffer++) {
-                out_stencil(idx_0, idx_1+idx_buffer*IN_EXTENT_1, idx_2, idx_3)
-                    = buffer[idx_buffer](idx_0, idx_1, idx_2, idx_3);
+                copy_into_stencil(out_stencil, buffer[idx_buffer], 0, idx_buffer*IN_EXTENT_1);
             }
             out_stream.write(out_stencil);
         }
@@ -360,12 +342,7 @@ static void call(stream<PackedStencil<T, IN_EXTENT_0, IN_EXTENT_1, EXTENT_2, EXT
                 // convert the array of stencils to a longer packed stencil
                 for (size_t i = 0; i < BUFFER_EXTENT_1; i++)
                 for (size_t j = 0; j < BUFFER_EXTENT_0; j++)
-                for (size_t st_idx_3 = 0; st_idx_3 < EXTENT_3; st_idx_3++)
-                for (size_t st_idx_2 = 0; st_idx_2 < EXTENT_2; st_idx_2++)
-                for (size_t st_idx_1 = 0; st_idx_1 < IN_EXTENT_1; st_idx_1++)
-                for (size_t st_idx_0 = 0; st_idx_0 < IN_EXTENT_0; st_idx_0++)
-                    out(st_idx_0 + j*IN_EXTENT_0, st_idx_1 + i*IN_EXTENT_1, st_idx_2, st_idx_3)
-                        = buffer[i][j](st_idx_0, st_idx_1, st_idx_2, st_idx_3);
+                    copy_into_stencil(out, buffer[i][j], j*IN_EXTENT_0, i*IN_EXTENT_1);
 
                 out_stream.write(out);
             }
@@ -431,6 +408,11 @@ void linebuffer_3D(stream<PackedStencil<T, IN_EXTENT_0, IN_EXTENT_1, IN_EXTENT_2
     stream<PackedStencil<T, IN_EXTENT_0, IN_EXTENT_1, OUT_EXTENT_2, EXTENT_3> > slice_stream;
 #pragma HLS STREAM variable=slice_stream depth=1
 #pragma HLS RESOURCE variable=slice_stream core=FIFO_SRL
+#ifdef HALIDE_DATAFLOW_THREADS
+    slice_stream.set_depth(1);
+    hls::dataflow processes;
+    processes.spawn([&]() {
+#endif
 
     size_t write_idx_2 = 0; // the line index of coming stencil in the linebuffer
  LB3D_buf:for (size_t idx_2 = 0; idx_2 < IDX_EXTENT_2; idx_2++) {
@@ -450,20 +432,10 @@ void linebuffer_3D(stream<PackedStencil<T, IN_EXTENT_0, IN_EXTENT_1, IN_EXTENT_2
                         size_t idx_2_in_buffer = idx_2 + write_idx_2;
                         if (idx_2_in_buffer >= BUFFER_EXTENT_2)
                             idx_2_in_buffer -= BUFFER_EXTENT_2;
-                        for (size_t st_idx_3 = 0; st_idx_3 < EXTENT_3; st_idx_3++)
-                        for (size_t st_idx_2 = 0; st_idx_2 < IN_EXTENT_2; st_idx_2++)
-                        for (size_t st_idx_1 = 0; st_idx_1 < IN_EXTENT_1; st_idx_1++)
-                        for (size_t st_idx_0 = 0; st_idx_0 < IN_EXTENT_0; st_idx_0++)
-                            slice(st_idx_0, st_idx_1, idx_2*IN_EXTENT_2 + st_idx_2, st_idx_3)
-                                = buffer[idx_2_in_buffer][idx_1][idx_0](st_idx_0, st_idx_1, st_idx_2, st_idx_3);
+                        copy_into_stencil(slice, buffer[idx_2_in_buffer][idx_1][idx_0], 0, 0, idx_2*IN_EXTENT_2);
                     }
                     // pass data from input
-                    for (size_t st_idx_3 = 0; st_idx_3 < EXTENT_3; st_idx_3++)
-                    for (size_t st_idx_2 = 0; st_idx_2 < IN_EXTENT_2; st_idx_2++)
-                    for (size_t st_idx_1 = 0; st_idx_1 < IN_EXTENT_1; st_idx_1++)
-                    for (size_t st_idx_0 = 0; st_idx_0 < IN_EXTENT_0; st_idx_0++)
-                        slice(st_idx_0, st_idx_1, BUFFER_EXTENT_2*IN_EXTENT_2 + st_idx_2, st_idx_3)
-                                = in_stencil(st_idx_0, st_idx_1, st_idx_2, st_idx_3);
+                    copy_into_stencil(slice, in_stencil, 0, 0, BUFFER_EXTENT_2*IN_EXTENT_2);
                     slice_stream.write(slice);
                 }
                 buffer[write_idx_2][idx_1][idx_0] = in_stencil;  // store the input in the buffer
@@ -471,6 +443,9 @@ void linebuffer_3D(stream<PackedStencil<T, IN_EXTENT_0, IN_EXTENT_1, IN_EXTENT_2
         }
         write_idx_2++;
     }
+#ifdef HALIDE_DATAFLOW_THREADS
+    });
+#endif
 
     // feed the column stencil stream to 2D line buffer
     const size_t NUM_OF_OUTPUT_2 = (IMG_EXTENT_2 - OUT_EXTENT_2) / IN_EXTENT_2 + 1;
@@ -544,6 +519,11 @@ void linebuffer(stream<AxiPackedStencil<T, IN_EXTENT_0, IN_EXTENT_1, IN_EXTENT_2
     stream<PackedStencil<T, IN_EXTENT_0, IN_EXTENT_1, IN_EXTENT_2, IN_EXTENT_3> > in_stream;
 #pragma HLS STREAM variable=in_stream depth=1
 #pragma HLS RESOURCE variable=in_stream core=FIFO_SRL
+#ifdef HALIDE_DATAFLOW_THREADS
+    in_stream.set_depth(1);
+    hls::dataflow processes;
+    processes.spawn([&]() {
+#endif
 
     for (size_t idx_3 = 0; idx_3 < IMG_EXTENT_3 / IN_EXTENT_3; idx_3++)
     for (size_t idx_2 = 0; idx_2 < IMG_EXTENT_2 / IN_EXTENT_2; idx_2++)
@@ -551,6 +531,9 @@ void linebuffer(stream<AxiPackedStencil<T, IN_EXTENT_0, IN_EXTENT_1, IN_EXTENT_2
     for (size_t idx_0 = 0; idx_0 < IMG_EXTENT_0 / IN_EXTENT_0; idx_0++)
 #pragma HLS PIPELINE II=1
         in_stream.write(in_axi_stream.read());
+#ifdef HALIDE_DATAFLOW_THREADS
+    });
+#endif
 
     linebuffer<IMG_EXTENT_0, IMG_EXTENT_1, IMG_EXTENT_2, IMG_EXTENT_3>(in_stream, out_stream);
 }
@@ -5,12 +5,24 @@
 #include <stdint.h>
 #include <assert.h>
 
+#ifdef HALIDE_DATAFLOW_THREADS
+// threaded emulation of streams and dataflow regions, see hls_dataflow.h
+#include "hls_dataflow.h"
+#else
+#include <hls_stream.h>
+#endif
+
 ///Forward declarations
 template <typename T, size_t EXTENT_0, size_t EXTENT_1, size_t EXTENT_2, size_t EXTENT_3> struct Stencil;
 template <typename T, size_t EXTENT_0, size_t EXTENT_1, size_t EXTENT_2, size_t EXTENT_3> struct PackedStencil;
 template <typename T, size_t EXTENT_0, size_t EXTENT_1, size_t EXTENT_2, size_t EXTENT_3> struct AxiPackedStencil;
 
 
+#if defined(HALIDE_STENCIL_CSIM) && !defined(__SYNTHESIS__)
+// contiguous element storage for software simulation, see Stencil_csim.h
+#include "Stencil_csim.h"
+#else
+
 #ifndef AP_INT_MAX_W
 //#define AP_INT_MAX_W 32768
 #define AP_INT_MAX_W 4554
@@ -207,6 +219,28 @@ public:
     }
 };
 
+/** copy all of src into dst, starting at (offset_0, offset_1, offset_2)
+ */
+template <typename T, size_t DST_EXTENT_0, size_t DST_EXTENT_1, size_t DST_EXTENT_2, size_t EXTENT_3,
+          size_t SRC_EXTENT_0, size_t SRC_EXTENT_1, size_t SRC_EXTENT_2>
+inline void copy_into_stencil(PackedStencil<T, DST_EXTENT_0, DST_EXTENT_1, DST_EXTENT_2, EXTENT_3> &dst,
+                              const PackedStencil<T, SRC_EXTENT_0, SRC_EXTENT_1, SRC_EXTENT_2, EXTENT_3> &src,
+                              size_t offset_0, size_t offset_1 = 0, size_t offset_2 = 0) {
+#pragma HLS INLINE
+    for (size_t idx_3 = 0; idx_3 < EXTENT_3; idx_3++)
+#pragma HLS UNROLL
+    for (size_t idx_2 = 0; idx_2 < SRC_EXTENT_2; idx_2++)
+#pragma HLS UNROLL
+    for (size_t idx_1 = 0; idx_1 < SRC_EXTENT_1; idx_1++)
+#pragma HLS UNROLL
+    for (size_t idx_0 = 0; idx_0 < SRC_EXTENT_0; idx_0++) {
+#pragma HLS UNROLL
+        dst(idx_0 + offset_0, idx_1 + offset_1, idx_2 + offset_2, idx_3) = src(idx_0, idx_1, idx_2, idx_3);
+    }
+}
+
+#endif // HALIDE_STENCIL_CSIM
+
 #ifndef HALIDE_ATTRIBUTE_ALIGN
   #ifdef _MSC_VER
     #define HALIDE_ATTRIBUTE_ALIGN(x) __declspec(align(x))
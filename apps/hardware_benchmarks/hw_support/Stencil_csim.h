@@ -0,0 +1,146 @@
+#ifndef STENCIL_CSIM_H
+#define STENCIL_CSIM_H
+
+// Software simulation of Stencil, PackedStencil and AxiPackedStencil.
+//
+// Included by Stencil.h when HALIDE_STENCIL_CSIM is defined (the process
+// builds in hardware_targets.mk set it). The HLS versions keep packed
+// stencils in one wide ap_uint, so every element access is a bit range
+// select and every conversion a loop over all elements. Here all three
+// types store their elements as the same contiguous, aligned array, with
+// the innermost dimension contiguous: conversions are a single memcpy and
+// copy_into_stencil moves whole rows, which the compiler turns into vector
+// loads and stores. The interface is the one the generated code and
+// Linebuffer.h use, so they compile unchanged.
+
+#include <string.h>
+
+/** alignment of a stencil holding the given number of bytes: the largest
+ *  power of two that fits, up to a cache line, so small stencils stay
+ *  densely packed in line buffers
+ */
+constexpr size_t stencil_alignment(size_t bytes, size_t align = 64) {
+    return (align > 1 && align > bytes) ? stencil_alignment(bytes, align / 2) : align;
+}
+
+template <typename T, size_t EXTENT_0, size_t EXTENT_1 = 1, size_t EXTENT_2 = 1, size_t EXTENT_3 = 1>
+struct alignas(stencil_alignment(sizeof(T)*EXTENT_3*EXTENT_2*EXTENT_1*EXTENT_0)) PackedStencil {
+    T value[EXTENT_3][EXTENT_2][EXTENT_1][EXTENT_0];
+
+    /** writer
+     */
+    inline T& operator()(size_t index_0, size_t index_1 = 0, size_t index_2 = 0, size_t index_3 = 0) {
+        assert(index_0 < EXTENT_0 && index_1 < EXTENT_1 && index_2 < EXTENT_2 && index_3 < EXTENT_3);
+        return value[index_3][index_2][index_1][index_0];
+    }
+
+    /** reader
+     */
+    inline const T& operator()(size_t index_0, size_t index_1 = 0, size_t index_2 = 0, size_t index_3 = 0) const {
+        assert(index_0 < EXTENT_0 && index_1 < EXTENT_1 && index_2 < EXTENT_2 && index_3 < EXTENT_3);
+        return value[index_3][index_2][index_1][index_0];
+    }
+
+    // convert to Stencil
+    operator Stencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3>() const {
+        Stencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> res;
+        memcpy(res.value, value, sizeof(value));
+        return res;
+    }
+
+    // convert to AxiPackedStencil
+    operator AxiPackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3>() const {
+        AxiPackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> res;
+        memcpy(res.value, value, sizeof(value));
+        res.last = 0;
+        return res;
+    }
+};
+
+template <typename T, size_t EXTENT_0, size_t EXTENT_1 = 1, size_t EXTENT_2 = 1, size_t EXTENT_3 = 1>
+struct alignas(stencil_alignment(sizeof(T)*EXTENT_3*EXTENT_2*EXTENT_1*EXTENT_0)) AxiPackedStencil {
+    T value[EXTENT_3][EXTENT_2][EXTENT_1][EXTENT_0];
+    uint8_t last;
+
+    // convert to PackedStencil
+    operator PackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3>() const {
+        PackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> res;
+        memcpy(res.value, value, sizeof(value));
+        return res;
+    }
+
+    // convert to Stencil
+    operator Stencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3>() const {
+        Stencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> res;
+        memcpy(res.value, value, sizeof(value));
+        return res;
+    }
+};
+
+/** multi-dimension (up-to 4 dimensions) stencil struct
+ */
+template <typename T, size_t EXTENT_0, size_t EXTENT_1 = 1, size_t EXTENT_2 = 1, size_t EXTENT_3 = 1>
+struct alignas(stencil_alignment(sizeof(T)*EXTENT_3*EXTENT_2*EXTENT_1*EXTENT_0)) Stencil {
+public:
+    T value[EXTENT_3][EXTENT_2][EXTENT_1][EXTENT_0];
+
+    /** writer
+     */
+    inline T& operator()(size_t index_0, size_t index_1 = 0, size_t index_2 = 0, size_t index_3 = 0) {
+        assert(index_0 < EXTENT_0 && index_1 < EXTENT_1 && index_2 < EXTENT_2 && index_3 < EXTENT_3);
+        return value[index_3][index_2][index_1][index_0];
+    }
+
+    /** reader
+     */
+    inline const T& operator()(size_t index_0, size_t index_1 = 0, size_t index_2 = 0, size_t index_3 = 0) const {
+        assert(index_0 < EXTENT_0 && index_1 < EXTENT_1 && index_2 < EXTENT_2 && index_3 < EXTENT_3);
+        return value[index_3][index_2][index_1][index_0];
+    }
+
+    // convert to PackedStencil
+    operator PackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3>() const {
+        PackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> res;
+        memcpy(res.value, value, sizeof(value));
+        return res;
+    }
+
+    // convert to AxiPackedStencil
+    operator AxiPackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3>() const {
+        AxiPackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> res;
+        memcpy(res.value, value, sizeof(value));
+        res.last = 0;
+        return res;
+    }
+};
+
+/** copy all of src into dst, starting at (offset_0, offset_1, offset_2)
+ *
+ *  Rows along dimension 0 are contiguous in both stencils; when src spans
+ *  the full width of dst, whole planes are contiguous and move at once.
+ */
+template <typename T, size_t DST_EXTENT_0, size_t DST_EXTENT_1, size_t DST_EXTENT_2, size_t EXTENT_3,
+          size_t SRC_EXTENT_0, size_t SRC_EXTENT_1, size_t SRC_EXTENT_2>
+inline void copy_into_stencil(PackedStencil<T, DST_EXTENT_0, DST_EXTENT_1, DST_EXTENT_2, EXTENT_3> &dst,
+                              const PackedStencil<T, SRC_EXTENT_0, SRC_EXTENT_1, SRC_EXTENT_2, EXTENT_3> &src,
+                              size_t offset_0, size_t offset_1 = 0, size_t offset_2 = 0) {
+    assert(offset_0 + SRC_EXTENT_0 <= DST_EXTENT_0 &&
+           offset_1 + SRC_EXTENT_1 <= DST_EXTENT_1 &&
+           offset_2 + SRC_EXTENT_2 <= DST_EXTENT_2);
+    if (SRC_EXTENT_0 == DST_EXTENT_0) {
+        for (size_t idx_3 = 0; idx_3 < EXTENT_3; idx_3++)
+        for (size_t idx_2 = 0; idx_2 < SRC_EXTENT_2; idx_2++) {
+            memcpy(&dst.value[idx_3][idx_2 + offset_2][offset_1][0], &src.value[idx_3][idx_2][0][0],
+                   sizeof(T) * SRC_EXTENT_0 * SRC_EXTENT_1);
+        }
+        return;
+    }
+    for (size_t idx_3 = 0; idx_3 < EXTENT_3; idx_3++)
+    for (size_t idx_2 = 0; idx_2 < SRC_EXTENT_2; idx_2++)
+    for (size_t idx_1 = 0; idx_1 < SRC_EXTENT_1; idx_1++) {
+        memcpy(&dst.value[idx_3][idx_2 + offset_2][idx_1 + offset_1][offset_0], &src.value[idx_3][idx_2][idx_1][0],
+               sizeof(T) * SRC_EXTENT_0);
+    }
+}
+
+#endif
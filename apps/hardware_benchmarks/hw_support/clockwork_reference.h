@@ -0,0 +1,316 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Runtime for the reference model that the clockwork backend emits next to
+// the memory program (<app>_reference.cpp and clockwork_reference.cpp).
+//
+// The model runs the unoptimized schedule of each accelerator: every loop
+// nest of the memory program in order, with the compute units of
+// <app>_compute.h. Outermost loops whose iterations touch disjoint slices of
+// the buffers they write are split into tiles that run on separate threads.
+// This header stands in for clockwork's hw_classes.h, so the model builds
+// with only a C++ compiler:
+//   c++ -std=c++17 -O2 -DCLOCKWORK_REFERENCE -I<hw_support> clockwork_reference.cpp -pthread
+//
+// Values are carried as raw bits, including floating point values.
+
+template <int N>
+class hw_uint {
+public:
+  static constexpr int num_words = (N + 63) / 64;
+  uint64_t words[num_words];
+
+  hw_uint() { clear(); }
+
+  template <typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+  hw_uint(T value) {
+    clear();
+    words[0] = (uint64_t) value;
+    mask();
+  }
+  hw_uint(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    clear();
+    words[0] = bits;
+    mask();
+  }
+  hw_uint(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    clear();
+    words[0] = bits;
+    mask();
+  }
+
+  template <typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+  explicit operator T() const { return (T) words[0]; }
+  explicit operator float() const {
+    uint32_t bits = (uint32_t) words[0];
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+  explicit operator double() const {
+    double value;
+    memcpy(&value, &words[0], sizeof(value));
+    return value;
+  }
+
+  // Bits [lo, lo+width) for widths up to 64
+  uint64_t get_bits(int lo, int width) const {
+    int w = lo / 64;
+    int b = lo % 64;
+    uint64_t value = words[w] >> b;
+    if (b != 0 && b + width > 64 && w + 1 < num_words) {
+      value |= words[w + 1] << (64 - b);
+    }
+    return width == 64 ? value : value & ((1ull << width) - 1);
+  }
+  void set_bits(int lo, int width, uint64_t value) {
+    uint64_t m = width == 64 ? ~0ull : (1ull << width) - 1;
+    int w = lo / 64;
+    int b = lo % 64;
+    value &= m;
+    words[w] = (words[w] & ~(m << b)) | (value << b);
+    if (b != 0 && b + width > 64) {
+      words[w + 1] = (words[w + 1] & ~(m >> (64 - b))) | (value >> (64 - b));
+    }
+  }
+
+  template <int lo, int hi>
+  hw_uint<hi - lo + 1> extract() const {
+    static_assert(0 <= lo && lo <= hi && hi < N, "extract out of range");
+    hw_uint<hi - lo + 1> result;
+    for (int i = 0; i <= hi - lo; i += 64) {
+      int width = hi - lo + 1 - i < 64 ? hi - lo + 1 - i : 64;
+      result.set_bits(i, width, get_bits(lo + i, width));
+    }
+    return result;
+  }
+
+  bool operator==(const hw_uint<N>& other) const {
+    return memcmp(words, other.words, sizeof(words)) == 0;
+  }
+  bool operator!=(const hw_uint<N>& other) const { return !(*this == other); }
+
+private:
+  void clear() { memset(words, 0, sizeof(words)); }
+  void mask() {
+    if (N % 64 != 0) {
+      words[num_words - 1] &= (1ull << (N % 64)) - 1;
+    }
+  }
+};
+
+template <int lo, int N, int W>
+void set_at(hw_uint<N>& dst, const hw_uint<W>& src) {
+  static_assert(lo + W <= N, "set_at out of range");
+  for (int i = 0; i < W; i += 64) {
+    int width = W - i < 64 ? W - i : 64;
+    dst.set_bits(lo + i, width, src.words[i / 64]);
+  }
+}
+
+// Concatenate the loads a compute unit reads from one buffer, first load in
+// the low bits
+template <int N, int W>
+hw_uint<N> reference_pack(std::initializer_list<hw_uint<W>> values) {
+  hw_uint<N> result;
+  int lo = 0;
+  for (const auto& value : values) {
+    for (int i = 0; i < W; i += 64) {
+      int width = W - i < 64 ? W - i : 64;
+      result.set_bits(lo + i, width, value.words[i / 64]);
+    }
+    lo += W;
+  }
+  return result;
+}
+
+// Helpers called by the generated compute units
+template <typename A, typename B>
+inline typename std::common_type<A, B>::type min(A a, B b) { return a < b ? a : b; }
+template <typename A, typename B>
+inline typename std::common_type<A, B>::type max(A a, B b) { return a > b ? a : b; }
+template <typename T>
+inline T halide_cpp_min(const T& a, const T& b) { return (a < b) ? a : b; }
+template <typename T>
+inline T halide_cpp_max(const T& a, const T& b) { return (a > b) ? a : b; }
+inline float float_from_bits(uint32_t bits) {
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// A buffer of the memory program, indexed with the innermost dimension
+// first. Elements are read and written as buf[x][y]...; every access is
+// bounds checked.
+template <int W>
+class reference_buffer {
+public:
+  static constexpr int max_dims = 8;
+
+  class element {
+  public:
+    element(reference_buffer& buf, int index) : buf(buf), dims(1) { idx[0] = index; }
+    element(const element& outer, int index) : buf(outer.buf), dims(outer.dims + 1) {
+      if (dims > max_dims) {
+        buf.fail("too many dimensions", outer.idx, outer.dims);
+      }
+      memcpy(idx, outer.idx, sizeof(idx));
+      idx[dims - 1] = index;
+    }
+
+    element operator[](int index) const { return element(*this, index); }
+
+    operator hw_uint<W>() const { return buf.values[buf.offset(idx, dims)]; }
+    template <typename T, typename std::enable_if<std::is_arithmetic<T>::value, int>::type = 0>
+    operator T() const { return (T) buf.values[buf.offset(idx, dims)]; }
+
+    const element& operator=(const hw_uint<W>& value) const {
+      buf.values[buf.offset(idx, dims)] = value;
+      return *this;
+    }
+
+  private:
+    reference_buffer& buf;
+    int idx[max_dims];
+    int dims;
+  };
+
+  reference_buffer(const std::string& name, std::vector<int> mins, std::vector<int> extents)
+    : name(name), mins(mins), extents(extents) {
+    size_t size = 1;
+    for (int extent : extents) {
+      strides.push_back((int) size);
+      size *= extent > 0 ? extent : 0;
+    }
+    values.resize(size);
+  }
+
+  element operator[](int index) { return element(*this, index); }
+
+  // Host buffers have the same layout, innermost dimension first
+  template <typename T>
+  void copy_from(const T* host) {
+    for (size_t i = 0; i < values.size(); ++i) {
+      values[i] = hw_uint<W>(host[i]);
+    }
+  }
+  template <typename T>
+  void copy_to(T* host) const {
+    for (size_t i = 0; i < values.size(); ++i) {
+      host[i] = (T) values[i];
+    }
+  }
+
+private:
+  std::string name;
+  std::vector<int> mins;
+  std::vector<int> extents;
+  std::vector<int> strides;
+  std::vector<hw_uint<W>> values;
+
+  size_t offset(const int* idx, int dims) const {
+    if (dims != (int) extents.size()) {
+      fail("wrong number of dimensions", idx, dims);
+    }
+    size_t offset = 0;
+    for (int i = 0; i < dims; ++i) {
+      int pos = idx[i] - mins[i];
+      if (pos < 0 || pos >= extents[i]) {
+        fail("out of bounds", idx, dims);
+      }
+      offset += (size_t) pos * strides[i];
+    }
+    return offset;
+  }
+
+  [[noreturn]] void fail(const char* what, const int* idx, int dims) const {
+    fprintf(stderr, "reference model: access to %s is %s at (", name.c_str(), what);
+    for (int i = 0; i < dims; ++i) {
+      fprintf(stderr, "%s%d", i == 0 ? "" : ", ", idx[i]);
+    }
+    fprintf(stderr, ")\n");
+    abort();
+  }
+};
+
+// Number of threads from HL_NUM_THREADS, like the Halide runtime
+inline int reference_num_threads() {
+  const char* env = getenv("HL_NUM_THREADS");
+  if (env != nullptr && atoi(env) > 0) {
+    return atoi(env);
+  }
+  int cores = (int) std::thread::hardware_concurrency();
+  return cores > 0 ? cores : 1;
+}
+
+// Run body(i) for i in [min, max), split into one contiguous tile per thread
+template <typename F>
+void reference_for(int min, int max, int num_threads, const F& body) {
+  int extent = max - min;
+  if (num_threads > extent) {
+    num_threads = extent;
+  }
+  if (num_threads <= 1) {
+    for (int i = min; i < max; ++i) {
+      body(i);
+    }
+    return;
+  }
+
+  std::vector<std::thread> workers;
+  for (int t = 0; t < num_threads; ++t) {
+    int lo = min + (int) ((int64_t) extent * t / num_threads);
+    int hi = min + (int) ((int64_t) extent * (t + 1) / num_threads);
+    workers.emplace_back([&body, lo, hi]() {
+      for (int i = lo; i < hi; ++i) {
+        body(i);
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+template <typename T>
+bool reference_read_raw(const std::string& filename, std::vector<T>& data) {
+  FILE* file = fopen(filename.c_str(), "rb");
+  if (file == nullptr) {
+    fprintf(stderr, "reference model: could not open %s\n", filename.c_str());
+    return false;
+  }
+  size_t count = fread(data.data(), sizeof(T), data.size(), file);
+  fclose(file);
+  if (count != data.size()) {
+    fprintf(stderr, "reference model: %s holds %zu of %zu values\n",
+            filename.c_str(), count, data.size());
+    return false;
+  }
+  return true;
+}
+
+template <typename T>
+bool reference_write_raw(const std::string& filename, const std::vector<T>& data) {
+  FILE* file = fopen(filename.c_str(), "wb");
+  if (file == nullptr) {
+    fprintf(stderr, "reference model: could not write %s\n", filename.c_str());
+    return false;
+  }
+  size_t count = fwrite(data.data(), sizeof(T), data.size(), file);
+  fclose(file);
+  return count == data.size();
+}
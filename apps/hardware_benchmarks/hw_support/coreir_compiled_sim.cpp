@@ -0,0 +1,683 @@
+#include <cstdlib>
+#include <dlfcn.h>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <unistd.h>
+
+#include "coreir_compiled_sim.h"
+
+using namespace std;
+using namespace CoreIR;
+
+namespace {
+
+const set<string> binary_ops = {
+  "coreir.add", "coreir.sub", "coreir.mul", "coreir.and", "coreir.or", "coreir.xor",
+  "coreir.shl", "coreir.lshr", "coreir.ashr", "coreir.udiv", "coreir.urem",
+  "corebit.and", "corebit.or", "corebit.xor"};
+
+const set<string> compare_ops = {
+  "coreir.eq", "coreir.neq", "coreir.ult", "coreir.ule", "coreir.ugt", "coreir.uge",
+  "coreir.slt", "coreir.sle", "coreir.sgt", "coreir.sge"};
+
+const set<string> unary_ops = {
+  "coreir.not", "coreir.neg", "coreir.wire", "coreir.slice", "coreir.zext", "coreir.sext",
+  "coreir.andr", "coreir.orr", "coreir.xorr", "corebit.not", "corebit.wire"};
+
+const set<string> other_ops = {
+  "coreir.mux", "corebit.mux", "coreir.const", "corebit.const", "coreir.concat",
+  "coreir.reg", "coreir.reg_arst", "corebit.reg", "coreir.mem",
+  "coreir.term", "corebit.term", "coreir.undriven", "corebit.undriven"};
+
+bool is_supported_op(const string& op) {
+  return binary_ops.count(op) > 0 || compare_ops.count(op) > 0 ||
+    unary_ops.count(op) > 0 || other_ops.count(op) > 0;
+}
+
+bool is_register_op(const string& op) {
+  return op == "coreir.reg" || op == "coreir.reg_arst" || op == "corebit.reg";
+}
+
+bool is_clock_type(Type* t) {
+  return t->getKind() == Type::TK_Named;
+}
+
+string mask_str(const int width) {
+  if (width >= 64) {
+    return "0xffffffffffffffffull";
+  }
+  ostringstream ss;
+  ss << "0x" << hex << ((1ull << width) - 1) << "ull";
+  return ss.str();
+}
+
+int gen_arg_int(Module* ref, const string& name, const int default_value) {
+  if (ref->isGenerated() && ref->getGenArgs().count(name) > 0) {
+    return ref->getGenArgs().at(name)->get<int>();
+  }
+  return default_value;
+}
+
+}
+
+bool use_compiled_simulation() {
+  const char* mode = getenv("COREIR_SIM_MODE");
+  return mode != nullptr && string(mode) == "compiled";
+}
+
+CompiledCoreIRSimulator::CompiledCoreIRSimulator(Module* m, const map<string, SimModelBuilder>& plugins) :
+  mod(m), plugin_builders(plugins), num_slots(0), num_mem_words(0),
+  lib_handle(nullptr), comb_fn(nullptr), seq_fn(nullptr), reset_fn(nullptr) {
+  buildNetlist();
+}
+
+CompiledCoreIRSimulator::~CompiledCoreIRSimulator() {
+  if (lib_handle != nullptr) {
+    dlclose(lib_handle);
+  }
+  for (auto& plugin : plugin_insts) {
+    delete plugin.state;
+  }
+  if (temp_dir != "") {
+    unlink((temp_dir + "/design_simulated.cpp").c_str());
+    unlink((temp_dir + "/design_simulated.so").c_str());
+    rmdir(temp_dir.c_str());
+  }
+}
+
+// The plugin gets a module with the same interface as its instance, so that
+// its own interpreter can drive the instance from the compiled design
+void CompiledCoreIRSimulator::addPluginInstance(Primitive& p) {
+  Context* c = mod->getContext();
+  Module* ref = p.inst->getModuleRef();
+  Module* wrapper = c->getGlobal()->newModuleDecl("sim_" + p.name + "_" + c->getUnique(), ref->getType());
+  ModuleDef* def = wrapper->newModuleDef();
+  Instance* inst = def->addInstance("plugin", ref);
+
+  PluginInstance plugin;
+  plugin.name = p.name;
+  vector<string> clocks;
+  for (auto field : ref->getType()->getRecord()) {
+    def->connect(def->sel("self")->sel(field.first), inst->sel(field.first));
+    if (is_clock_type(field.second)) {
+      clocks.push_back("self." + field.first);
+    } else if (field.second->isInput()) {
+      plugin.inputs.push_back(field.first);
+    } else {
+      plugin.outputs.push_back(field.first);
+    }
+  }
+  wrapper->setDef(def);
+
+  plugin.state = new SimulatorState(wrapper, plugin_builders);
+  for (auto clk : clocks) {
+    plugin.state->setClock(clk, 0, 1);
+  }
+  for (auto in : plugin.inputs) {
+    plugin.state->setValue("self." + in, BitVector(ref->getType()->getRecord().at(in)->getSize(), 0));
+  }
+
+  p.plugin = plugin_insts.size();
+  plugin_insts.push_back(plugin);
+}
+
+void CompiledCoreIRSimulator::buildNetlist() {
+  auto def = mod->getDef();
+  assert(def != nullptr);
+
+  // slot 0 always holds zero and backs undriven inputs
+  num_slots = 1;
+
+  for (auto field : mod->getType()->getRecord()) {
+    Type* t = field.second;
+    if (is_clock_type(t)) {
+      continue;
+    }
+    string name = "self." + field.first;
+    Port p;
+    p.width = t->getSize();
+    p.owner = -1;
+    p.is_source = t->isInput();
+    p.slot = p.is_source ? num_slots++ : -1;
+    ports[name] = p;
+    if (p.width > 64) {
+      unsupported.push_back(name + " is wider than 64 bits");
+    }
+  }
+
+  for (auto inst_pair : def->getInstances()) {
+    Instance* inst = inst_pair.second;
+    Module* ref = inst->getModuleRef();
+    string op = ref->isGenerated() ? ref->getGenerator()->getRefName() : ref->getRefName();
+
+    bool has_plugin = plugin_builders.count(op) > 0;
+    if (!is_supported_op(op) && !has_plugin) {
+      unsupported.push_back(inst_pair.first + " : " + op);
+      continue;
+    }
+    if (op == "coreir.mem" && ref->getGenArgs().count("has_init") > 0 &&
+        ref->getGenArgs().at("has_init")->get<bool>()) {
+      unsupported.push_back(inst_pair.first + " : initialized " + op);
+      continue;
+    }
+
+    Primitive p;
+    p.name = inst_pair.first;
+    p.op = op;
+    p.width = gen_arg_int(ref, "width", 1);
+    p.inst = inst;
+    p.is_sequential = is_register_op(op);
+    p.plugin = -1;
+    prims.push_back(p);
+
+    if (op == "coreir.mem") {
+      mem_base[p.name] = num_mem_words;
+      num_mem_words += gen_arg_int(ref, "depth", 1);
+    }
+
+    for (auto field : ref->getType()->getRecord()) {
+      Type* t = field.second;
+      if (is_clock_type(t)) {
+        continue;
+      }
+      Port port;
+      port.width = t->getSize();
+      port.owner = prims.size() - 1;
+      port.is_source = t->isOutput();
+      port.slot = port.is_source ? num_slots++ : -1;
+      ports[p.name + "." + field.first] = port;
+      if (port.width > 64) {
+        unsupported.push_back(p.name + "." + field.first + " is wider than 64 bits");
+      }
+    }
+  }
+
+  for (auto conx : def->getConnections()) {
+    vector<string> path_a = conx.first->getSelectPath();
+    vector<string> path_b = conx.second->getSelectPath();
+    if (path_a.size() < 2 || path_b.size() < 2 || path_a.size() > 3 || path_b.size() > 3) {
+      unsupported.push_back("connection " + conx.first->toString() + " <-> " + conx.second->toString());
+      continue;
+    }
+
+    string port_a = path_a[0] + "." + path_a[1];
+    string port_b = path_b[0] + "." + path_b[1];
+    if (ports.count(port_a) == 0 || ports.count(port_b) == 0) {
+      // clocks and ports of unsupported instances
+      continue;
+    }
+
+    int bit_a = path_a.size() == 3 ? stoi(path_a[2]) : -1;
+    int bit_b = path_b.size() == 3 ? stoi(path_b[2]) : -1;
+    if (ports[port_b].is_source) {
+      swap(port_a, port_b);
+      swap(bit_a, bit_b);
+    }
+    assert(ports[port_a].is_source && !ports[port_b].is_source);
+    ports[port_b].drivers.push_back({bit_b, ports[port_a].slot, bit_a});
+  }
+
+  // Sinks driven by exactly one whole source share its slot, undriven
+  // sinks read the zero slot, and everything else is assembled from bits.
+  for (auto& port_pair : ports) {
+    Port& p = port_pair.second;
+    if (p.is_source) {
+      continue;
+    }
+    if (p.drivers.size() == 0) {
+      p.slot = 0;
+    } else if (p.drivers.size() == 1 && p.drivers[0].sink_bit == -1 && p.drivers[0].source_bit == -1) {
+      p.slot = p.drivers[0].source_slot;
+    } else {
+      p.slot = num_slots++;
+    }
+  }
+
+  for (auto& port_pair : ports) {
+    if (port_pair.first.substr(0, 5) == "self.") {
+      self_ports[port_pair.first] = port_pair.second.slot;
+    }
+  }
+
+  state = vector<uint64_t>(num_slots, 0);
+  mem = vector<uint64_t>(max(num_mem_words, 1), 0);
+}
+
+// Inputs of a primitive that its outputs depend on within the same cycle
+static vector<string> combinational_inputs(const string& op) {
+  if (is_register_op(op)) {
+    return {};
+  }
+  if (op == "coreir.mem") {
+    return {"raddr"};
+  }
+  if (op == "coreir.mux" || op == "corebit.mux") {
+    return {"in0", "in1", "sel"};
+  }
+  if (binary_ops.count(op) > 0 || compare_ops.count(op) > 0 || op == "coreir.concat") {
+    return {"in0", "in1"};
+  }
+  if (unary_ops.count(op) > 0) {
+    return {"in"};
+  }
+  return {};
+}
+
+// Inputs that are only sampled on the clock edge
+static vector<string> sequential_inputs(const string& op) {
+  if (op == "coreir.reg_arst") {
+    return {"in", "arst"};
+  }
+  if (is_register_op(op)) {
+    return {"in"};
+  }
+  if (op == "coreir.mem") {
+    return {"wdata", "waddr", "wen"};
+  }
+  return {};
+}
+
+vector<string> CompiledCoreIRSimulator::combinationalInputs(const Primitive& p) const {
+  // any input of a plugin may be read in the same cycle
+  if (plugin_builders.count(p.op) > 0) {
+    vector<string> inputs;
+    for (auto field : p.inst->getModuleRef()->getType()->getRecord()) {
+      if (!is_clock_type(field.second) && field.second->isInput()) {
+        inputs.push_back(field.first);
+      }
+    }
+    return inputs;
+  }
+  return combinational_inputs(p.op);
+}
+
+vector<int> CompiledCoreIRSimulator::levelize() {
+  map<int, int> slot_owner;
+  for (auto& port_pair : ports) {
+    if (port_pair.second.is_source && port_pair.second.owner >= 0) {
+      slot_owner[port_pair.second.slot] = port_pair.second.owner;
+    }
+  }
+
+  vector<set<int> > deps(prims.size());
+  vector<set<int> > users(prims.size());
+  for (int i = 0; i < (int) prims.size(); i++) {
+    for (auto in : combinationalInputs(prims[i])) {
+      string pname = prims[i].name + "." + in;
+      if (ports.count(pname) == 0) {
+        continue;
+      }
+      for (auto d : ports.at(pname).drivers) {
+        if (slot_owner.count(d.source_slot) > 0) {
+          int src = slot_owner.at(d.source_slot);
+          // register outputs are state, not a same cycle dependence
+          if (!prims[src].is_sequential && src != i) {
+            deps[i].insert(src);
+            users[src].insert(i);
+          }
+        }
+      }
+    }
+  }
+
+  vector<int> order;
+  vector<int> ready;
+  vector<int> remaining(prims.size());
+  for (int i = 0; i < (int) prims.size(); i++) {
+    remaining[i] = deps[i].size();
+    if (remaining[i] == 0) {
+      ready.push_back(i);
+    }
+  }
+  while (ready.size() > 0) {
+    int next = ready.back();
+    ready.pop_back();
+    order.push_back(next);
+    for (auto u : users[next]) {
+      remaining[u]--;
+      if (remaining[u] == 0) {
+        ready.push_back(u);
+      }
+    }
+  }
+
+  if (order.size() != prims.size()) {
+    unsupported.push_back("combinational loop in " + mod->getName());
+  }
+  return order;
+}
+
+string CompiledCoreIRSimulator::slotRef(const string& port_name) const {
+  return "s[" + to_string(ports.at(port_name).slot) + "]";
+}
+
+// Expression that assembles a sink port from the bits that drive it
+string CompiledCoreIRSimulator::inputExpr(const string& port_name) const {
+  const Port& p = ports.at(port_name);
+  string expr = "0";
+  for (auto d : p.drivers) {
+    string src = "s[" + to_string(d.source_slot) + "]";
+    if (d.source_bit >= 0) {
+      src = "((" + src + " >> " + to_string(d.source_bit) + ") & 1ull)";
+    }
+    if (d.sink_bit >= 0) {
+      src = "((" + src + " & 1ull) << " + to_string(d.sink_bit) + ")";
+    }
+    expr += " | " + src;
+  }
+  return "(" + expr + ") & " + mask_str(p.width);
+}
+
+string CompiledCoreIRSimulator::primitiveExpr(const Primitive& p) const {
+  const string& op = p.op;
+  string w = to_string(p.width);
+  string m = mask_str(p.width);
+  Module* ref = p.inst->getModuleRef();
+  auto in = [&](const string& port) { return slotRef(p.name + "." + port); };
+
+  if (op == "coreir.add") { return "(" + in("in0") + " + " + in("in1") + ") & " + m; }
+  if (op == "coreir.sub") { return "(" + in("in0") + " - " + in("in1") + ") & " + m; }
+  if (op == "coreir.mul") { return "(" + in("in0") + " * " + in("in1") + ") & " + m; }
+  if (op == "coreir.and" || op == "corebit.and") { return in("in0") + " & " + in("in1"); }
+  if (op == "coreir.or" || op == "corebit.or") { return in("in0") + " | " + in("in1"); }
+  if (op == "coreir.xor" || op == "corebit.xor") { return in("in0") + " ^ " + in("in1"); }
+  if (op == "coreir.shl") { return "(" + in("in1") + " >= " + w + " ? 0 : (" + in("in0") + " << " + in("in1") + ")) & " + m; }
+  if (op == "coreir.lshr") { return in("in1") + " >= " + w + " ? 0 : (" + in("in0") + " >> " + in("in1") + ")"; }
+  if (op == "coreir.ashr") {
+    return "((uint64_t) (sx(" + in("in0") + ", " + w + ") >> (" + in("in1") + " >= " + w + " ? " +
+      to_string(p.width - 1) + " : " + in("in1") + "))) & " + m;
+  }
+  if (op == "coreir.udiv") { return in("in1") + " == 0 ? " + m + " : " + in("in0") + " / " + in("in1"); }
+  if (op == "coreir.urem") { return in("in1") + " == 0 ? " + in("in0") + " : " + in("in0") + " % " + in("in1"); }
+
+  if (op == "coreir.eq") { return "(uint64_t) (" + in("in0") + " == " + in("in1") + ")"; }
+  if (op == "coreir.neq") { return "(uint64_t) (" + in("in0") + " != " + in("in1") + ")"; }
+  if (op == "coreir.ult") { return "(uint64_t) (" + in("in0") + " < " + in("in1") + ")"; }
+  if (op == "coreir.ule") { return "(uint64_t) (" + in("in0") + " <= " + in("in1") + ")"; }
+  if (op == "coreir.ugt") { return "(uint64_t) (" + in("in0") + " > " + in("in1") + ")"; }
+  if (op == "coreir.uge") { return "(uint64_t) (" + in("in0") + " >= " + in("in1") + ")"; }
+  if (op == "coreir.slt") { return "(uint64_t) (sx(" + in("in0") + ", " + w + ") < sx(" + in("in1") + ", " + w + "))"; }
+  if (op == "coreir.sle") { return "(uint64_t) (sx(" + in("in0") + ", " + w + ") <= sx(" + in("in1") + ", " + w + "))"; }
+  if (op == "coreir.sgt") { return "(uint64_t) (sx(" + in("in0") + ", " + w + ") > sx(" + in("in1") + ", " + w + "))"; }
+  if (op == "coreir.sge") { return "(uint64_t) (sx(" + in("in0") + ", " + w + ") >= sx(" + in("in1") + ", " + w + "))"; }
+
+  if (op == "coreir.not" || op == "corebit.not") { return "(~" + in("in") + ") & " + m; }
+  if (op == "coreir.neg") { return "(0 - " + in("in") + ") & " + m; }
+  if (op == "coreir.wire" || op == "corebit.wire") { return in("in"); }
+  if (op == "coreir.slice") {
+    int lo = gen_arg_int(ref, "lo", 0);
+    int hi = gen_arg_int(ref, "hi", p.width);
+    return "(" + in("in") + " >> " + to_string(lo) + ") & " + mask_str(hi - lo);
+  }
+  if (op == "coreir.zext") { return in("in"); }
+  if (op == "coreir.sext") {
+    return "((uint64_t) sx(" + in("in") + ", " + to_string(gen_arg_int(ref, "width_in", 1)) + ")) & " +
+      mask_str(gen_arg_int(ref, "width_out", 1));
+  }
+  if (op == "coreir.andr") { return "(uint64_t) (" + in("in") + " == " + m + ")"; }
+  if (op == "coreir.orr") { return "(uint64_t) (" + in("in") + " != 0)"; }
+  if (op == "coreir.xorr") { return "(uint64_t) __builtin_parityll(" + in("in") + ")"; }
+  if (op == "coreir.concat") {
+    return in("in0") + " | (" + in("in1") + " << " + to_string(gen_arg_int(ref, "width0", 1)) + ")";
+  }
+
+  if (op == "coreir.mux" || op == "corebit.mux") {
+    return "(" + in("sel") + " & 1ull) ? " + in("in1") + " : " + in("in0");
+  }
+  if (op == "coreir.const") {
+    return to_string(p.inst->getModArgs().at("value")->get<BitVector>().to_type<uint64_t>()) + "ull";
+  }
+  if (op == "corebit.const") {
+    return p.inst->getModArgs().at("value")->get<bool>() ? "1ull" : "0ull";
+  }
+  if (op == "coreir.mem") {
+    return "mem[" + to_string(mem_base.at(p.name)) + " + (" + in("raddr") + " % " +
+      to_string(gen_arg_int(ref, "depth", 1)) + ")]";
+  }
+  if (op == "coreir.undriven" || op == "corebit.undriven") {
+    return "0ull";
+  }
+
+  assert(false);
+  return "";
+}
+
+void CompiledCoreIRSimulator::emitCode(ostream& os, const vector<int>& order) const {
+  os << "// Compiled simulation model of " << mod->getName() << "\n";
+  os << "#include <cstdint>\n\n";
+  os << "// set by the simulator to evaluate the instances with plugins\n";
+  os << "extern \"C\" void (*coreir_plugin_comb)(void*, int, uint64_t*) = 0;\n";
+  os << "extern \"C\" void* coreir_plugin_sim = 0;\n\n";
+  os << "static inline int64_t sx(uint64_t v, int w) {\n";
+  os << "  return w >= 64 ? (int64_t) v : ((int64_t) (v << (64 - w))) >> (64 - w);\n";
+  os << "}\n\n";
+
+  auto emit_inputs = [&](const Primitive& p, const vector<string>& inputs) {
+    for (auto in : inputs) {
+      string pname = p.name + "." + in;
+      if (ports.count(pname) == 0) {
+        continue;
+      }
+      const Port& port = ports.at(pname);
+      if (port.slot != 0 && (port.drivers.size() > 1 || (port.drivers.size() == 1 &&
+          (port.drivers[0].sink_bit >= 0 || port.drivers[0].source_bit >= 0)))) {
+        os << "  " << slotRef(pname) << " = " << inputExpr(pname) << ";\n";
+      }
+    }
+  };
+
+  os << "extern \"C\" void coreir_comb(uint64_t* s, uint64_t* mem) {\n";
+  for (int i : order) {
+    const Primitive& p = prims[i];
+    if (p.is_sequential || p.op == "coreir.term" || p.op == "corebit.term") {
+      continue;
+    }
+    emit_inputs(p, combinationalInputs(p));
+    if (p.plugin >= 0) {
+      os << "  coreir_plugin_comb(coreir_plugin_sim, " << p.plugin << ", s);\n";
+      continue;
+    }
+    string out = p.name + ".out";
+    if (p.op == "coreir.mem") {
+      out = p.name + ".rdata";
+    }
+    if (ports.count(out) > 0) {
+      os << "  " << slotRef(out) << " = " << primitiveExpr(p) << ";\n";
+    }
+  }
+  for (auto& p : prims) {
+    emit_inputs(p, sequential_inputs(p.op));
+  }
+  for (auto& port_pair : ports) {
+    const Port& port = port_pair.second;
+    if (port_pair.first.substr(0, 5) == "self." && !port.is_source && port.slot != 0 &&
+        (port.drivers.size() > 1 || (port.drivers.size() == 1 &&
+         (port.drivers[0].sink_bit >= 0 || port.drivers[0].source_bit >= 0)))) {
+      os << "  " << slotRef(port_pair.first) << " = " << inputExpr(port_pair.first) << ";\n";
+    }
+  }
+  os << "}\n\n";
+
+  // Sample every register and memory input before committing, so that
+  // registers feeding other registers see the values from before the edge
+  os << "extern \"C\" void coreir_seq(uint64_t* s, uint64_t* mem) {\n";
+  int n = 0;
+  for (auto& p : prims) {
+    string pn = p.name + ".";
+    if (p.op == "coreir.reg_arst") {
+      bool posedge = !p.inst->getModuleRef()->getGenArgs().count("arst_posedge") ||
+        p.inst->getModuleRef()->getGenArgs().at("arst_posedge")->get<bool>();
+      string init = to_string(p.inst->getModArgs().at("init")->get<BitVector>().to_type<uint64_t>()) + "ull";
+      os << "  uint64_t n" << n++ << " = ((" << slotRef(pn + "arst") << " & 1ull) == " << (posedge ? 1 : 0)
+         << ") ? " << init << " : " << slotRef(pn + "in") << ";\n";
+    } else if (is_register_op(p.op)) {
+      os << "  uint64_t n" << n++ << " = " << slotRef(pn + "in") << ";\n";
+    } else if (p.op == "coreir.mem") {
+      os << "  uint64_t n" << n++ << " = " << slotRef(pn + "wen") << " & 1ull;\n";
+      os << "  uint64_t n" << n++ << " = " << mem_base.at(p.name) << " + (" << slotRef(pn + "waddr") << " % "
+         << gen_arg_int(p.inst->getModuleRef(), "depth", 1) << ");\n";
+      os << "  uint64_t n" << n++ << " = " << slotRef(pn + "wdata") << ";\n";
+    }
+  }
+  n = 0;
+  for (auto& p : prims) {
+    if (is_register_op(p.op)) {
+      os << "  " << slotRef(p.name + ".out") << " = n" << n++ << ";\n";
+    } else if (p.op == "coreir.mem") {
+      os << "  if (n" << n << ") { mem[n" << n + 1 << "] = n" << n + 2 << "; }\n";
+      n += 3;
+    }
+  }
+  os << "}\n\n";
+
+  os << "extern \"C\" void coreir_reset(uint64_t* s, uint64_t* mem) {\n";
+  for (auto& p : prims) {
+    if (p.op == "corebit.reg") {
+      bool init = p.inst->getModArgs().count("init") > 0 && p.inst->getModArgs().at("init")->get<bool>();
+      os << "  " << slotRef(p.name + ".out") << " = " << (init ? "1ull" : "0ull") << ";\n";
+    } else if (is_register_op(p.op)) {
+      uint64_t init = p.inst->getModArgs().count("init") > 0 ?
+        p.inst->getModArgs().at("init")->get<BitVector>().to_type<uint64_t>() : 0;
+      os << "  " << slotRef(p.name + ".out") << " = " << init << "ull;\n";
+    }
+  }
+  os << "}\n";
+}
+
+bool CompiledCoreIRSimulator::compile(const string& cpp_file, const string& lib_file) {
+  vector<int> order = levelize();
+  if (!isSupported()) {
+    cout << "compiled simulation does not support:" << endl;
+    for (auto u : unsupported) {
+      cout << "\t" << u << endl;
+    }
+    return false;
+  }
+
+  // only set up the plugins once the design is known to be supported, so
+  // the interpreter fallback does not see their wrapper modules
+  if (plugin_insts.size() == 0) {
+    for (auto& p : prims) {
+      if (plugin_builders.count(p.op) > 0) {
+        addPluginInstance(p);
+      }
+    }
+  }
+
+  ofstream code(cpp_file);
+  emitCode(code, order);
+  code.close();
+
+  const char* cxx = getenv("CXX");
+  string cmd = string(cxx != nullptr ? cxx : "c++") + " -O2 -shared -fPIC " + cpp_file + " -o " + lib_file;
+  cout << "building compiled simulator: " << cmd << endl;
+  if (system(cmd.c_str()) != 0) {
+    cout << "could not build " << cpp_file << endl;
+    return false;
+  }
+
+  string lib_path = lib_file.find('/') == string::npos ? "./" + lib_file : lib_file;
+  lib_handle = dlopen(lib_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (lib_handle == nullptr) {
+    cout << "could not load " << lib_path << ": " << dlerror() << endl;
+    return false;
+  }
+
+  comb_fn = (SimFunction) dlsym(lib_handle, "coreir_comb");
+  seq_fn = (SimFunction) dlsym(lib_handle, "coreir_seq");
+  reset_fn = (SimFunction) dlsym(lib_handle, "coreir_reset");
+  auto plugin_fn = (PluginFunction*) dlsym(lib_handle, "coreir_plugin_comb");
+  auto plugin_sim = (void**) dlsym(lib_handle, "coreir_plugin_sim");
+  if (plugin_fn == nullptr || plugin_sim == nullptr) {
+    return false;
+  }
+  *plugin_fn = &CompiledCoreIRSimulator::evaluatePlugin;
+  *plugin_sim = this;
+  return comb_fn != nullptr && seq_fn != nullptr && reset_fn != nullptr;
+}
+
+bool CompiledCoreIRSimulator::compile() {
+  if (temp_dir == "") {
+    const char* tmp = getenv("TMPDIR");
+    string dir_template = string(tmp != nullptr ? tmp : "/tmp") + "/coreir_sim_XXXXXX";
+    vector<char> dir(dir_template.begin(), dir_template.end());
+    dir.push_back('\0');
+    if (mkdtemp(dir.data()) == nullptr) {
+      cout << "could not create a directory for " << dir_template << endl;
+      return false;
+    }
+    temp_dir = dir.data();
+  }
+  return compile(temp_dir + "/design_simulated.cpp", temp_dir + "/design_simulated.so");
+}
+
+// Copies the inputs of a plugin instance from the compiled state, runs its
+// combinational logic, and copies the outputs back
+void CompiledCoreIRSimulator::evaluatePlugin(void* sim, int plugin, uint64_t* s) {
+  auto csim = static_cast<CompiledCoreIRSimulator*>(sim);
+  PluginInstance& inst = csim->plugin_insts[plugin];
+  for (auto& in : inst.inputs) {
+    const Port& port = csim->ports.at(inst.name + "." + in);
+    BitVector value(port.width, 0);
+    for (int i = 0; i < port.width; i++) {
+      value.set(i, (s[port.slot] >> i) & 1);
+    }
+    inst.state->setValue("self." + in, value);
+  }
+  inst.state->exeCombinational();
+  for (auto& out : inst.outputs) {
+    const Port& port = csim->ports.at(inst.name + "." + out);
+    s[port.slot] = inst.state->getBitVec("self." + out).to_type<uint64_t>();
+  }
+}
+
+bool CompiledCoreIRSimulator::hasPort(const string& port_name) const {
+  return ports.count(port_name) > 0;
+}
+
+void CompiledCoreIRSimulator::setValue(const string& port_name, const BitVector& value) {
+  assert(self_ports.count(port_name) > 0);
+  const Port& p = ports.at(port_name);
+  assert(p.is_source);
+  uint64_t mask = p.width >= 64 ? ~0ull : ((1ull << p.width) - 1);
+  state[p.slot] = value.to_type<uint64_t>() & mask;
+}
+
+BitVector CompiledCoreIRSimulator::getBitVec(const string& port_name) const {
+  assert(hasPort(port_name));
+  const Port& p = ports.at(port_name);
+  BitVector value(p.width, 0);
+  for (int i = 0; i < p.width; i++) {
+    value.set(i, (state[p.slot] >> i) & 1);
+  }
+  return value;
+}
+
+void CompiledCoreIRSimulator::resetCircuit() {
+  fill(mem.begin(), mem.end(), 0);
+  reset_fn(state.data(), mem.data());
+  // plugins see the design's inputs while they reset
+  exeCombinational();
+  for (auto& plugin : plugin_insts) {
+    plugin.state->resetCircuit();
+  }
+  exeCombinational();
+}
+
+void CompiledCoreIRSimulator::exeCombinational() {
+  comb_fn(state.data(), mem.data());
+}
+
+void CompiledCoreIRSimulator::exeSequential() {
+  seq_fn(state.data(), mem.data());
+  for (auto& plugin : plugin_insts) {
+    plugin.state->exeSequential();
+  }
+}
+
+void CompiledCoreIRSimulator::execute() {
+  exeSequential();
+  exeCombinational();
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "coreir.h"
+#include "coreir/simulator/interpreter.h"
+
+// Compiled simulator for flattened CoreIR designs.
+//
+// The design is levelized into a straight-line C++ function that evaluates
+// every primitive once per cycle on a packed array of 64 bit state slots.
+// The generated code is built into a shared library and loaded with dlopen.
+// The interface mirrors the parts of CoreIR::SimulatorState used by the
+// testbench, so the same cycle loop can drive either simulator.
+//
+// Instances of generators with a simulator plugin, such as unified buffers,
+// are evaluated by their plugin on an interpreter of their own, which the
+// compiled code calls back into. Designs that contain other primitives
+// without a compiled model (floating point units, ...) are reported as
+// unsupported, and the caller is expected to fall back to the interpreter.
+class CompiledCoreIRSimulator {
+public:
+  CompiledCoreIRSimulator(CoreIR::Module* m,
+                          const std::map<std::string, CoreIR::SimModelBuilder>& plugins = {});
+  ~CompiledCoreIRSimulator();
+
+  bool isSupported() const { return unsupported.size() == 0; }
+  const std::vector<std::string>& unsupportedInstances() const { return unsupported; }
+
+  // Emit the levelized design to cpp_file and build it into lib_file.
+  // Returns false if the design is unsupported or cannot be built.
+  bool compile(const std::string& cpp_file, const std::string& lib_file);
+  // Same, in a temporary directory that is removed with the simulator
+  bool compile();
+
+  // Any interface or primitive port can be read; only inputs on the
+  // interface can be set
+  bool hasPort(const std::string& port_name) const;
+  void setValue(const std::string& port_name, const BitVector& value);
+  BitVector getBitVec(const std::string& port_name) const;
+
+  void resetCircuit();
+  void exeCombinational();
+  void exeSequential();
+  void execute();
+
+private:
+  struct PortDriver {
+    int sink_bit;     // -1 if the whole sink is driven
+    int source_slot;  // -1 if undriven
+    int source_bit;   // -1 if the whole source drives the sink
+  };
+
+  struct Port {
+    int slot;
+    int width;
+    int owner;        // index of the primitive, or -1 for the interface
+    bool is_source;
+    std::vector<PortDriver> drivers;
+  };
+
+  struct Primitive {
+    std::string name;
+    std::string op;
+    int width;
+    CoreIR::Instance* inst;
+    bool is_sequential;
+    int plugin;       // index into plugin_insts, or -1
+  };
+
+  // An instance simulated by its plugin, wrapped in a module of its own
+  struct PluginInstance {
+    std::string name;
+    CoreIR::SimulatorState* state;
+    std::vector<std::string> inputs;
+    std::vector<std::string> outputs;
+  };
+
+  typedef void (*SimFunction)(uint64_t*, uint64_t*);
+  typedef void (*PluginFunction)(void*, int, uint64_t*);
+
+  CoreIR::Module* mod;
+  std::vector<std::string> unsupported;
+  std::map<std::string, CoreIR::SimModelBuilder> plugin_builders;
+  std::vector<Primitive> prims;
+  std::vector<PluginInstance> plugin_insts;
+  std::map<std::string, Port> ports;
+  std::map<std::string, int> mem_base;
+  std::unordered_map<std::string, int> self_ports;
+  int num_slots;
+  int num_mem_words;
+
+  std::vector<uint64_t> state;
+  std::vector<uint64_t> mem;
+
+  std::string temp_dir;
+  void* lib_handle;
+  SimFunction comb_fn;
+  SimFunction seq_fn;
+  SimFunction reset_fn;
+
+  void buildNetlist();
+  void addPluginInstance(Primitive& p);
+  std::vector<int> levelize();
+  std::vector<std::string> combinationalInputs(const Primitive& p) const;
+  static void evaluatePlugin(void* sim, int plugin, uint64_t* s);
+
+  std::string slotRef(const std::string& port_name) const;
+  std::string inputExpr(const std::string& port_name) const;
+  std::string primitiveExpr(const Primitive& p) const;
+  void emitCode(std::ostream& os, const std::vector<int>& order) const;
+};
+
+bool use_compiled_simulation();
@@ -2,7 +2,15 @@
 #include "coreir/libs/float.h"
 #include "coreir/passes/transform/rungenerators.h"
 
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "coreir_compiled_sim.h"
 #include "coreir_interpret.h"
+#include "coreir_sim_profiler.h"
 #include "lakelib.h"
 #include "ubuf_coreirsim.h"
 
@@ -329,7 +337,7 @@ void read_for_cycle(
   state.exeSequential();
 }
 
-template<typename T>
+template<typename T, typename SimState>
 void run_for_cycle(CoordinateVector<int>& writeIdx,
     CoordinateVector<int>& readIdx,
     bool uses_inputenable,
@@ -342,7 +350,7 @@ void run_for_cycle(CoordinateVector<int>& writeIdx,
     string inen_name,
     string output_name,
 
-    CoreIR::SimulatorState& state,
+    SimState& state,
     ImageWriter<T>& coreir_img_writer,
     bool uses_valid
     ) {
@@ -440,6 +448,66 @@ void run_for_cycle(CoordinateVector<int>& writeIdx,
   //state.exeSequential();
 }
 
+// An upper bound on the cycles the design takes to stream the input
+// image through and the output image out: one pixel per cycle each way,
+// plus buffered latency of up to the larger image, plus a cycle for each
+// instance on the path from input to output.
+template<typename T>
+int simulation_cycle_bound(Module* m,
+                           Halide::Runtime::Buffer<T> input,
+                           ImageWriter<T>& coreir_img_writer) {
+  int64_t input_size = input.number_of_elements();
+  int64_t output_size = (int64_t) coreir_img_writer.getWidth() * coreir_img_writer.getHeight() *
+    coreir_img_writer.getChannels();
+  int64_t pipeline_size = m->hasDef() ? m->getDef()->getInstances().size() : 0;
+  int64_t bound = input_size + output_size + std::max(input_size, output_size) + pipeline_size;
+  return (int) std::min<int64_t>(bound, std::numeric_limits<int>::max());
+}
+
+// Streams the input image through the simulator until the whole
+// output image has been read back, or max_cycles have passed.
+template<typename T, typename SimState>
+void run_image_on_simulator(SimState& state,
+                            Halide::Runtime::Buffer<T> input,
+                            Halide::Runtime::Buffer<T> output,
+                            string input_name,
+                            string inen_name,
+                            string output_name,
+                            bool has_float_input,
+                            bool has_float_output,
+                            bool uses_valid,
+                            bool uses_inputenable,
+                            int max_cycles,
+                            ImageWriter<T>& coreir_img_writer,
+                            SimulationProfiler* profiler = nullptr) {
+  int cycles = 0;
+
+  CoordinateVector<int> writeIdx({"y", "x", "c"}, {input.height() - 1, input.width() - 1, input.channels() - 1});
+
+  // TODO: Need to get imagewriter bounds?
+  CoordinateVector<int> readIdx({"y", "x", "c"}, {((int)coreir_img_writer.getHeight() - 1), ((int)coreir_img_writer.getWidth()) - 1, ((int) coreir_img_writer.getChannels()) - 1});
+  while (cycles < max_cycles && !readIdx.allDone()) {
+    //cout << "Read index = " << readIdx.coordString() << endl;
+    //cout << "Cycles     = " << cycles << endl;
+    run_for_cycle(writeIdx, readIdx,
+        uses_inputenable, has_float_input, has_float_output, input, output, input_name, inen_name, output_name, state, coreir_img_writer, uses_valid);
+    if (profiler != nullptr) {
+      profiler->sample(state, cycles);
+    }
+    cycles++;
+  }
+
+  if (!readIdx.allDone()) {
+    cout << "stopped the simulation after " << cycles
+         << " cycles, before the whole output was read" << endl;
+  }
+
+  if (profiler != nullptr) {
+    profiler->finish(cycles);
+  }
+  coreir_img_writer.print_coords();
+}
+
 std::vector<std::string> get_seg_list(std::string str, char token) {
     std::stringstream st(str);
     std::vector<std::string> seglist;
@@ -600,6 +668,19 @@ void run_coreir_on_interpreter(string coreir_design,
 }
 
 
+// Simulation models for the generators that the interpreter
+// cannot flatten into primitives
+map<std::string, SimModelBuilder> simulator_plugins() {
+  auto ubufBuilder = [](WireNode& wd) {
+    //UnifiedBuffer* ubufModel = std::make_shared<UnifiedBuffer>(UnifiedBuffer()).get();
+    UnifiedBuffer_new* ubufModel = new UnifiedBuffer_new();
+    return ubufModel;
+  };
+
+  map<std::string, SimModelBuilder> qualifiedNamesToSimPlugins{{string("lakelib.new_unified_buffer"), ubufBuilder}, {string("lakelib.unified_buffer"), ubufBuilder}};
+  return qualifiedNamesToSimPlugins;
+}
+
 template<typename T>
 void run_coreir_module_on_interpreter(Module* m,
                                Halide::Runtime::Buffer<T> input,
@@ -612,19 +693,41 @@ void run_coreir_module_on_interpreter(Module* m,
   m->getType()->print();
   string inen_name = "self.in_en_arg_0";
   parse_input_name(m, input_name, inen_name);
+  string profile_filename = simulation_profile_filename();
+
+  if (use_compiled_simulation()) {
+    bool simulated = false;
+    {
+      // the plugin interpreters must be gone before the context is deleted
+      CompiledCoreIRSimulator csim(m, simulator_plugins());
+      if (csim.compile()) {
+        bool uses_valid = circuit_uses_valid(m);
+        bool uses_inputenable = circuit_uses_inputenable(m, inen_name);
+
+        cout << "starting compiled coreir simulation" << endl;
+        csim.resetCircuit();
+        ImageWriter<T> coreir_img_writer(output);
+        SimulationProfiler profiler(m);
+        run_image_on_simulator(csim, input, output, input_name, inen_name, output_name,
+                               has_float_input, has_float_output, uses_valid, uses_inputenable,
+                               simulation_cycle_bound(m, input, coreir_img_writer), coreir_img_writer,
+                               profile_filename != "" ? &profiler : nullptr);
+        if (profile_filename != "") {
+          profiler.saveReport(profile_filename);
+        }
+        simulated = true;
+      }
+    }
+    if (simulated) {
+      deleteContext(m->getContext());
+      printf("finished running compiled CoreIR code\n");
+      return;
+    }
+    cout << "falling back to the coreir interpreter" << endl;
+  }
 
   // Build the simulator with the new model
-  auto ubufBuilder = [](WireNode& wd) {
-    //UnifiedBuffer* ubufModel = std::make_shared<UnifiedBuffer>(UnifiedBuffer()).get();
-    UnifiedBuffer_new* ubufModel = new UnifiedBuffer_new();
-    return ubufModel;
-  };
-
-
-
-  map<std::string, SimModelBuilder> qualifiedNamesToSimPlugins{{string("lakelib.new_unified_buffer"), ubufBuilder}, {string("lakelib.unified_buffer"), ubufBuilder}};
-
-  SimulatorState state(m, qualifiedNamesToSimPlugins);
+  SimulatorState state(m, simulator_plugins());
 
   auto c = m->getContext();
   auto g = c->getGlobal();
@@ -677,27 +780,102 @@ void run_coreir_module_on_interpreter(Module* m,
           std::cout << "y=" << y << ",x=" << x << " " << hex << "in=" << ((int)input(x,y,c) & 0xff) << " out=" << output_value << dec << endl;
         }
       }}}*/
-  int maxCycles = 5000;
-  int cycles = 0;
+  SimulationProfiler profiler(m);
+  run_image_on_simulator(state, input, output, input_name, inen_name, output_name,
+                         has_float_input, has_float_output, uses_valid, uses_inputenable,
+                         simulation_cycle_bound(m, input, coreir_img_writer), coreir_img_writer,
+                         profile_filename != "" ? &profiler : nullptr);
+  if (profile_filename != "") {
+    profiler.saveReport(profile_filename);
+  }
 
-  CoordinateVector<int> writeIdx({"y", "x", "c"}, {input.height() - 1, input.width() - 1, input.channels() - 1});
+  deleteContext(c);
+  printf("finished running CoreIR code\n");
 
-  // TODO: Need to get imagewriter bounds?
-  CoordinateVector<int> readIdx({"y", "x", "c"}, {((int)coreir_img_writer.getHeight() - 1), ((int)coreir_img_writer.getWidth()) - 1, ((int) coreir_img_writer.getChannels()) - 1});
-  while (cycles < maxCycles && !readIdx.allDone()) {
-    //cout << "Read index = " << readIdx.coordString() << endl;
-    //cout << "Cycles     = " << cycles << endl;
-    run_for_cycle(writeIdx, readIdx,
-        uses_inputenable, has_float_input, has_float_output, input, output, input_name, inen_name, output_name, state, coreir_img_writer, uses_valid);
-    cycles++;
+}
+
+template<typename T>
+void run_coreir_batch_on_interpreter(std::string coreir_design,
+                                     std::vector<Halide::Runtime::Buffer<T>> inputs,
+                                     std::vector<Halide::Runtime::Buffer<T>> outputs,
+                                     std::string input_name,
+                                     std::string output_name,
+                                     bool has_float_input,
+                                     bool has_float_output,
+                                     int num_threads) {
+  assert(inputs.size() == outputs.size());
+
+  // Load and elaborate the design once. Workers only read from it.
+  Context* c = newContext();
+  Namespace* g = c->getGlobal();
+
+  CoreIRLoadLibrary_commonlib(c);
+  CoreIRLoadLibrary_lakelib(c);
+  CoreIRLoadLibrary_float(c);
+  if (!loadFromFile(c, coreir_design)) {
+    cout << "Could not load " << coreir_design
+         << " from json!!" << endl;
+    c->die();
   }
 
+  c->runPasses({"rungenerators", "flattentypes", "flatten", "wireclocks-coreir"});
 
-  coreir_img_writer.print_coords();
+  Module* m = g->getModule("DesignTop");
+  assert(m != nullptr);
 
-  deleteContext(c);
-  printf("finished running CoreIR code\n");
+  string inen_name = "self.in_en_arg_0";
+  parse_input_name(m, input_name, inen_name);
+  bool uses_inputenable = circuit_uses_inputenable(m, inen_name);
+
+  // Selects are created lazily the first time a wire is looked up, so
+  // build and reset one simulator serially before any thread reads the module
+  bool uses_valid = false;
+  {
+    SimulatorState warmup(m, simulator_plugins());
+    uses_valid = reset_coreir_circuit(warmup, m);
+    warmup.resetCircuit();
+  }
 
+  if (num_threads <= 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  num_threads = std::min(num_threads, (int) inputs.size());
+  cout << "simulating " << inputs.size() << " images on " << num_threads << " threads" << endl;
+
+  std::atomic<int> next_image(0);
+  std::mutex elaboration_lock;
+  auto worker = [&]() {
+    while (true) {
+      int i = next_image++;
+      if (i >= (int) inputs.size()) {
+        break;
+      }
+
+      std::unique_ptr<SimulatorState> state;
+      {
+        std::lock_guard<std::mutex> lock(elaboration_lock);
+        state.reset(new SimulatorState(m, simulator_plugins()));
+        reset_coreir_circuit(*state, m);
+        state->resetCircuit();
+      }
+
+      ImageWriter<T> coreir_img_writer(outputs[i]);
+      run_image_on_simulator(*state, inputs[i], outputs[i], input_name, inen_name, output_name,
+                             has_float_input, has_float_output, uses_valid, uses_inputenable,
+                             simulation_cycle_bound(m, inputs[i], coreir_img_writer), coreir_img_writer);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (int t = 0; t < num_threads; t++) {
+    workers.emplace_back(worker);
+  }
+  for (auto& t : workers) {
+    t.join();
+  }
+
+  deleteContext(c);
+  printf("finished running CoreIR code on %d images\n", (int) inputs.size());
 }
 
 // declare which types will be used with template function
@@ -773,3 +951,56 @@ template void run_coreir_on_interpreter<bool>(std::string coreir_design,
                                               bool has_float_input,
                                               bool has_float_output);
 
+template void run_coreir_batch_on_interpreter<float>(std::string coreir_design,
+                                                    std::vector<Halide::Runtime::Buffer<float>> inputs,
+                                                    std::vector<Halide::Runtime::Buffer<float>> outputs,
+                                                    std::string input_name,
+                                                    std::string output_name,
+                                                    bool has_float_input,
+                                                    bool has_float_output,
+                                                    int num_threads);
+
+template void run_coreir_batch_on_interpreter<uint32_t>(std::string coreir_design,
+                                                    std::vector<Halide::Runtime::Buffer<uint32_t>> inputs,
+                                                    std::vector<Halide::Runtime::Buffer<uint32_t>> outputs,
+                                                    std::string input_name,
+                                                    std::string output_name,
+                                                    bool has_float_input,
+                                                    bool has_float_output,
+                                                    int num_threads);
+
+template void run_coreir_batch_on_interpreter<uint16_t>(std::string coreir_design,
+                                                    std::vector<Halide::Runtime::Buffer<uint16_t>> inputs,
+                                                    std::vector<Halide::Runtime::Buffer<uint16_t>> outputs,
+                                                    std::string input_name,
+                                                    std::string output_name,
+                                                    bool has_float_input,
+                                                    bool has_float_output,
+                                                    int num_threads);
+
+template void run_coreir_batch_on_interpreter<int16_t>(std::string coreir_design,
+                                                    std::vector<Halide::Runtime::Buffer<int16_t>> inputs,
+                                                    std::vector<Halide::Runtime::Buffer<int16_t>> outputs,
+                                                    std::string input_name,
+                                                    std::string output_name,
+                                                    bool has_float_input,
+                                                    bool has_float_output,
+                                                    int num_threads);
+
+template void run_coreir_batch_on_interpreter<uint8_t>(std::string coreir_design,
+                                                    std::vector<Halide::Runtime::Buffer<uint8_t>> inputs,
+                                                    std::vector<Halide::Runtime::Buffer<uint8_t>> outputs,
+                                                    std::string input_name,
+                                                    std::string output_name,
+                                                    bool has_float_input,
+                                                    bool has_float_output,
+                                                    int num_threads);
+
+template void run_coreir_batch_on_interpreter<int8_t>(std::string coreir_design,
+                                                    std::vector<Halide::Runtime::Buffer<int8_t>> inputs,
+                                                    std::vector<Halide::Runtime::Buffer<int8_t>> outputs,
+                                                    std::string input_name,
+                                                    std::string output_name,
+                                                    bool has_float_input,
+                                                    bool has_float_output,
+                                                    int num_threads);
@@ -60,3 +60,16 @@ void run_coreir_rewrite_on_interpreter(std::string coreir_design,
                                std::string output_name,
                                bool has_float_input=false,
                                bool has_float_output=false);
+
+// Simulates each input image on its own simulator instance, spread over
+// num_threads workers (all hardware threads if num_threads <= 0). The
+// design is loaded and elaborated once and shared by every worker.
+template<typename T>
+void run_coreir_batch_on_interpreter(std::string coreir_design,
+                                     std::vector<Halide::Runtime::Buffer<T>> inputs,
+                                     std::vector<Halide::Runtime::Buffer<T>> outputs,
+                                     std::string input_name,
+                                     std::string output_name,
+                                     bool has_float_input=false,
+                                     bool has_float_output=false,
+                                     int num_threads=0);
@@ -0,0 +1,164 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#include "coreir_sim_profiler.h"
+
+using namespace std;
+using namespace CoreIR;
+
+namespace {
+
+bool starts_with(const string& str, const string& prefix) {
+  return str.compare(0, prefix.size(), prefix) == 0;
+}
+
+Json activity_json(const string& name, int active_cycles, int first_active, int last_active, int total_cycles) {
+  Json j;
+  j["name"] = name;
+  j["active_cycles"] = active_cycles;
+  j["duty_cycle"] = total_cycles > 0 ? ((double) active_cycles) / total_cycles : 0.0;
+  j["first_active_cycle"] = first_active;
+  j["last_active_cycle"] = last_active;
+  return j;
+}
+
+}
+
+std::string simulation_profile_filename() {
+  const char* filename = getenv("COREIR_SIM_PROFILE");
+  return filename == nullptr ? "" : string(filename);
+}
+
+SimulationProfiler::SignalActivity SimulationProfiler::newActivity(const string& name) {
+  return {name, 0, -1, -1};
+}
+
+void SimulationProfiler::record(SignalActivity& activity, const bool active, const int cycle) {
+  if (!active) {
+    return;
+  }
+  activity.active_cycles++;
+  if (activity.first_active < 0) {
+    activity.first_active = cycle;
+  }
+  activity.last_active = cycle;
+}
+
+SimulationProfiler::StreamActivity SimulationProfiler::newStream(const string& valid_name, const string& ready_name) {
+  return {newActivity(valid_name), newActivity(ready_name), ready_name != "", 0};
+}
+
+SimulationProfiler::SimulationProfiler(Module* m) : total_cycles(0) {
+  // The ready of a stream is named like its valid, with the prefix
+  // replaced by ready, and flows the other way
+  map<string, bool> ready_is_input;
+  for (auto field : m->getType()->getRecord()) {
+    if (field.second->getSize() == 1 && starts_with(field.first, "ready")) {
+      ready_is_input[field.first] = field.second->isInput();
+    }
+  }
+  auto ready_port = [&](const string& valid, const string& prefix, const bool valid_is_input) {
+    string ready = "ready" + valid.substr(prefix.size());
+    bool found = ready_is_input.count(ready) > 0 && ready_is_input.at(ready) != valid_is_input;
+    return found ? "self." + ready : string("");
+  };
+
+  for (auto field : m->getType()->getRecord()) {
+    string name = field.first;
+    if (field.second->getSize() != 1) {
+      continue;
+    }
+    if (field.second->isInput() && starts_with(name, "in_en")) {
+      inputs.push_back(newStream("self." + name, ready_port(name, "in_en", true)));
+    } else if (field.second->isOutput() && starts_with(name, "valid")) {
+      outputs.push_back(newStream("self." + name, ready_port(name, "valid", false)));
+    }
+  }
+
+  // Any instance with a write enable and an output valid (or read enable)
+  // is treated as a buffer between two stages
+  for (auto inst_pair : m->getDef()->getInstances()) {
+    auto ports = inst_pair.second->getModuleRef()->getType()->getRecord();
+    if (ports.count("wen") == 0) {
+      continue;
+    }
+    string read_port = ports.count("valid") > 0 ? "valid" : (ports.count("ren") > 0 ? "ren" : "");
+    if (read_port == "") {
+      continue;
+    }
+
+    BufferActivity buf;
+    buf.name = inst_pair.first;
+    buf.write = newActivity(inst_pair.first + ".wen");
+    buf.read = newActivity(inst_pair.first + "." + read_port);
+    buf.outstanding = 0;
+    buf.max_outstanding = 0;
+    buffers.push_back(buf);
+  }
+
+  cout << "profiling " << inputs.size() << " input streams, " << outputs.size()
+       << " output streams and " << buffers.size() << " buffers" << endl;
+}
+
+void SimulationProfiler::finish(const int cycles) {
+  total_cycles = cycles;
+}
+
+void SimulationProfiler::saveReport(const string& filename) const {
+  Json report;
+  report["total_cycles"] = total_cycles;
+
+  int first_output = -1;
+  int last_output = -1;
+  int output_cycles = 0;
+  for (auto& out : outputs) {
+    output_cycles += out.valid.active_cycles;
+    if (out.valid.first_active >= 0 && (first_output < 0 || out.valid.first_active < first_output)) {
+      first_output = out.valid.first_active;
+    }
+    last_output = max(last_output, out.valid.last_active);
+  }
+  report["first_output_cycle"] = first_output;
+  report["last_output_cycle"] = last_output;
+  report["outputs_per_cycle"] = total_cycles > 0 ? ((double) output_cycles) / total_cycles : 0.0;
+
+  auto stream_json = [&](const StreamActivity& stream, const string& direction) {
+    const SignalActivity& valid = stream.valid;
+    Json j = activity_json(valid.name, valid.active_cycles, valid.first_active, valid.last_active, total_cycles);
+    j["direction"] = direction;
+    if (stream.has_ready) {
+      const SignalActivity& ready = stream.ready;
+      j["ready"] = activity_json(ready.name, ready.active_cycles, ready.first_active, ready.last_active, total_cycles);
+    }
+    // cycles the stream had data that the other side did not take
+    j["stall_cycles"] = stream.stall_cycles;
+    return j;
+  };
+  auto& streams = report["streams"];
+  for (auto& in : inputs) {
+    streams.push_back(stream_json(in, "input"));
+  }
+  for (auto& out : outputs) {
+    streams.push_back(stream_json(out, "output"));
+  }
+
+  auto& bufs = report["buffers"];
+  for (auto& buf : buffers) {
+    Json j;
+    j["name"] = buf.name;
+    j["write"] = activity_json(buf.write.name, buf.write.active_cycles, buf.write.first_active, buf.write.last_active, total_cycles);
+    j["read"] = activity_json(buf.read.name, buf.read.active_cycles, buf.read.first_active, buf.read.last_active, total_cycles);
+    // Fill: first write to first valid read. Drain: last write to last valid read.
+    bool both_active = buf.write.first_active >= 0 && buf.read.first_active >= 0;
+    j["fill_latency"] = both_active ? buf.read.first_active - buf.write.first_active : -1;
+    j["drain_latency"] = both_active ? buf.read.last_active - buf.write.last_active : -1;
+    j["max_outstanding"] = buf.max_outstanding;
+    bufs.push_back(j);
+  }
+
+  ofstream out(filename);
+  out << report.dump(2) << endl;
+  out.close();
+  cout << "wrote simulation profile to " << filename << endl;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "coreir.h"
+
+// Cycle-accurate activity profiler for simulated accelerators.
+//
+// The profiler watches the 1 bit handshake signals of a flattened design:
+// the valids (input enables and output valids) and readies of the streams
+// on the interface, and the write enable / valid (or read enable) ports of
+// every buffer instance. The testbench calls sample() after each simulated
+// cycle and finish() with the number of cycles simulated. saveReport()
+// then writes a JSON report with per-stream valid and ready duty cycles,
+// per-buffer fill and drain latencies, and the cycles to the first and
+// last output.
+class SimulationProfiler {
+public:
+  SimulationProfiler(CoreIR::Module* m);
+
+  template<typename SimState>
+  void sample(SimState& state, const int cycle);
+
+  void finish(const int total_cycles);
+  void saveReport(const std::string& filename) const;
+
+private:
+  struct SignalActivity {
+    std::string name;
+    int active_cycles;
+    int first_active;
+    int last_active;
+  };
+
+  // A stream moves data on the cycles both its valid and its ready are
+  // high. Streams without a ready port are always ready.
+  struct StreamActivity {
+    SignalActivity valid;
+    SignalActivity ready;
+    bool has_ready;
+    int stall_cycles;
+  };
+
+  struct BufferActivity {
+    std::string name;
+    SignalActivity write;
+    SignalActivity read;
+    int outstanding;
+    int max_outstanding;
+  };
+
+  std::vector<StreamActivity> inputs;
+  std::vector<StreamActivity> outputs;
+  std::vector<BufferActivity> buffers;
+  int total_cycles;
+
+  static SignalActivity newActivity(const std::string& name);
+  static StreamActivity newStream(const std::string& valid_name, const std::string& ready_name);
+  static void record(SignalActivity& activity, const bool active, const int cycle);
+
+  template<typename SimState>
+  static void recordStream(StreamActivity& stream, SimState& state, const int cycle);
+};
+
+template<typename SimState>
+void SimulationProfiler::recordStream(StreamActivity& stream, SimState& state, const int cycle) {
+  bool valid = state.getBitVec(stream.valid.name).template to_type<bool>();
+  bool ready = true;
+  if (stream.has_ready) {
+    ready = state.getBitVec(stream.ready.name).template to_type<bool>();
+    record(stream.ready, ready, cycle);
+  }
+  record(stream.valid, valid, cycle);
+  if (valid && !ready) {
+    stream.stall_cycles++;
+  }
+}
+
+template<typename SimState>
+void SimulationProfiler::sample(SimState& state, const int cycle) {
+  for (auto& in : inputs) {
+    recordStream(in, state, cycle);
+  }
+  for (auto& out : outputs) {
+    recordStream(out, state, cycle);
+  }
+  for (auto& buf : buffers) {
+    bool write = state.getBitVec(buf.write.name).template to_type<bool>();
+    bool read = state.getBitVec(buf.read.name).template to_type<bool>();
+    record(buf.write, write, cycle);
+    record(buf.read, read, cycle);
+    buf.outstanding += (write ? 1 : 0) - (read ? 1 : 0);
+    if (buf.outstanding > buf.max_outstanding) {
+      buf.max_outstanding = buf.outstanding;
+    }
+  }
+}
+
+// Name of the report file requested through COREIR_SIM_PROFILE, or "" if
+// profiling is disabled.
+std::string simulation_profile_filename();
@@ -34,6 +34,8 @@ EXT ?= png
 # set this for Halide generator arguments
 HALIDE_GEN_ARGS ?= 
 HALIDE_GEN_SIZE_ARGS ?= 
+# memory footprint and bandwidth of each hwbuffer, written by the design targets
+HWBUFFER_ESTIMATES ?= $(BIN)/hwbuffer_estimates.json
 
 # =========================== RDAI Configuration  ===================================
 
@@ -66,7 +68,13 @@ else
 endif
 
 
-HLS_PROCESS_CXX_FLAGS = -DC_TEST -Wno-unknown-pragmas -Wno-unused-label -Wno-uninitialized -Wno-literal-suffix
+HLS_PROCESS_CXX_FLAGS = -DC_TEST -DHALIDE_STENCIL_CSIM -Wno-unknown-pragmas -Wno-unused-label -Wno-uninitialized -Wno-literal-suffix
+# set to 1 to run each dataflow process of the vhls kernel on its own thread,
+# with FIFOs bounded to their HLS depths (see hw_support/hls_dataflow.h)
+HLS_DATAFLOW_THREADS ?= 0
+ifeq ($(HLS_DATAFLOW_THREADS), 1)
+  HLS_PROCESS_CXX_FLAGS += -DHALIDE_DATAFLOW_THREADS -pthread
+endif
 
 THIS_MAKEFILE = $(realpath $(filter %Makefile, $(MAKEFILE_LIST)))
 ROOT_DIR = $(strip $(shell dirname $(THIS_MAKEFILE)))
@@ -93,6 +101,14 @@ $(HWSUPPORT)/$(BIN)/coreir_sim_plugins.o: $(HWSUPPORT)/coreir_sim_plugins.cpp $(
 	@#env LD_LIBRARY_PATH=$(COREIR_DIR)/lib $(CXX) $(CXXFLAGS) -I$(HWSUPPORT) -c $< -o $@ $(LDFLAGS)
 	$(CXX) $(CXXFLAGS) -I$(HWSUPPORT) -c $< $(LDFLAGS) -o $@
 
+$(HWSUPPORT)/$(BIN)/coreir_compiled_sim.o: $(HWSUPPORT)/coreir_compiled_sim.cpp $(HWSUPPORT)/coreir_compiled_sim.h
+	@-mkdir -p $(HWSUPPORT)/$(BIN)
+	$(CXX) $(CXXFLAGS) -I$(HWSUPPORT) -c $< $(LDFLAGS) -o $@
+
+$(HWSUPPORT)/$(BIN)/coreir_sim_profiler.o: $(HWSUPPORT)/coreir_sim_profiler.cpp $(HWSUPPORT)/coreir_sim_profiler.h
+	@-mkdir -p $(HWSUPPORT)/$(BIN)
+	$(CXX) $(CXXFLAGS) -I$(HWSUPPORT) -c $< $(LDFLAGS) -o $@
+
 
 .PHONY: generator
 generator $(BIN)/$(TESTNAME).generator: $(TESTNAME)_generator.cpp $(GENERATOR_DEPS)
@@ -114,6 +130,16 @@ coreir design-coreir: $(BIN)/$(TESTNAME).generator
 	 make design-coreir-no_valid; \
 	fi
 
+# Sweeps generator params and reports the Pareto-best schedules, for example
+#   make search SEARCH_PARAMS="--param tilesize=31,62 --image 62x62"
+# Tile sizes that do not divide the image are costed as partial edge tiles
+SEARCH_PARAMS ?=
+SEARCH_TECHLIB ?= $(HWSUPPORT)/default_techlib.json
+search $(BIN)/tile_search.json: $(BIN)/$(TESTNAME).generator
+	@-mkdir -p $(BIN)/search
+	python3 $(HWSUPPORT)/tile_search.py $< -g $(TESTGENNAME) -f $(TESTNAME) --target $(HL_TARGET)-coreir \
+	  --techlib $(SEARCH_TECHLIB) --workdir $(BIN)/search --out $(BIN)/tile_search.json $(SEARCH_PARAMS)
+
 coreir_to_dot $(HWSUPPORT)/$(BIN)/coreir_to_dot: $(HWSUPPORT)/coreir_to_dot.cpp $(HWSUPPORT)/coreir_to_dot.h
 	@-mkdir -p $(HWSUPPORT)/$(BIN)
 	@#env LD_LIBRARY_PATH=$(COREIR_DIR)/lib $(CXX) $(CXXFLAGS) -I$(HWSUPPORT) -c $< -o $@ $(LDFLAGS) 
@@ -128,17 +154,18 @@ $(BIN)/design_top.txt: $(HWSUPPORT)/$(BIN)/coreir_to_dot
 
 design-coreir-no_valid: $(BIN)/$(TESTNAME).generator
 	@-mkdir -p $(BIN)
-	$^ -g $(TESTGENNAME) -f $(TESTNAME) target=$(HL_TARGET)-coreir -e coreir $(HALIDE_DEBUG_REDIRECT) $(HALIDE_GEN_ARGS) -o $(BIN)
+	HL_HWBUFFER_ESTIMATES=$(HWBUFFER_ESTIMATES) $^ -g $(TESTGENNAME) -f $(TESTNAME) target=$(HL_TARGET)-coreir -e coreir $(HALIDE_DEBUG_REDIRECT) $(HALIDE_GEN_ARGS) -o $(BIN)
 
 design-coreir-valid design-coreir_valid: $(BIN)/$(TESTNAME).generator
 	@-mkdir -p $(BIN)
-	$^ -g $(TESTGENNAME) -f $(TESTNAME) target=$(HL_TARGET)-coreir-coreir_valid-use_extract_hw_kernel -e coreir,html $(HALIDE_GEN_ARGS) $(HALIDE_DEBUG_REDIRECT) -o $(BIN)
+	HL_HWBUFFER_ESTIMATES=$(HWBUFFER_ESTIMATES) $^ -g $(TESTGENNAME) -f $(TESTNAME) target=$(HL_TARGET)-coreir-coreir_valid-use_extract_hw_kernel -e coreir,html $(HALIDE_GEN_ARGS) $(HALIDE_DEBUG_REDIRECT) -o $(BIN)
 
 $(BIN)/$(TESTNAME)_clockwork.cpp $(BIN)/$(TESTNAME)_clockwork.h \
 $(BIN)/clockwork_testscript.h $(BIN)/clockwork_testscript.cpp $(BIN)/clockwork_codegen.cpp \
+$(BIN)/clockwork_reference.cpp $(BIN)/$(TESTNAME)_reference.cpp \
 clockwork design-clockwork $(BIN)/$(TESTNAME)_memory.cpp $(BIN)/$(TESTNAME)_compute.h: $(BIN)/$(TESTNAME).generator $(BIN)/halide_gen_args
 	@-mkdir -p $(BIN)
-	$< -g $(TESTGENNAME) -f $(TESTNAME) target=$(HL_TARGET)-clockwork -e clockwork,html $(HALIDE_GEN_SIZE_ARGS) $(HALIDE_GEN_ARGS) $(HALIDE_DEBUG_REDIRECT) -o $(BIN)
+	HL_HWBUFFER_ESTIMATES=$(HWBUFFER_ESTIMATES) $< -g $(TESTGENNAME) -f $(TESTNAME) target=$(HL_TARGET)-clockwork -e clockwork,html $(HALIDE_GEN_SIZE_ARGS) $(HALIDE_GEN_ARGS) $(HALIDE_DEBUG_REDIRECT) -o $(BIN)
 
 
 #: $(BIN)/$(TESTNAME)_memory.cpp $(BIN)/$(TESTNAME)_compute.h
@@ -162,6 +189,14 @@ $(BIN)/optimized_$(TESTNAME).cpp opt-clockwork clockwork-opt opt: $(BIN)/clockwo
 	./clockwork_codegen opt 1>mem_cout 2> >(tee -a mem_cout >&2); \
 	EXIT_CODE=$$?; cd ..; exit $$EXIT_CODE
 
+# standalone reference model of the unoptimized schedule, built without clockwork.
+# Reads the raw inputs in $(BIN) and writes the outputs to $(BIN)/reference
+$(BIN)/clockwork_reference: $(BIN)/clockwork_reference.cpp $(BIN)/$(TESTNAME)_reference.cpp $(BIN)/$(TESTNAME)_compute.h
+	$(CXX) -std=c++17 -O2 -DCLOCKWORK_REFERENCE -I$(BIN) -I$(HWSUPPORT) $< -pthread -o $@
+reference-clockwork clockwork-reference: $(BIN)/clockwork_reference
+	@mkdir -p $(BIN)/reference
+	$(BIN)/clockwork_reference $(BIN) $(BIN)/reference
+
 compile_mem compile-mem mem-clockwork clockwork-mem $(BIN)/map_result/$(TESTNAME)/$(TESTNAME).json: $(BIN)/clockwork_codegen
 	@mkdir -p $(BIN)/coreir_compute && cp $(BIN)/$(TESTNAME)_compute.json $(BIN)/coreir_compute/$(TESTNAME)_compute.json
 	cd $(BIN) && \
@@ -272,8 +307,10 @@ ifneq ("$(wildcard $(BIN)/design_top.json)","")
   WITH_COREIR = 1
 endif
 ifeq ($(WITH_COREIR),1)
-  PROCESS_DEPS += $(HWSUPPORT)/$(BIN)/coreir_interpret.o 
+  PROCESS_DEPS += $(HWSUPPORT)/$(BIN)/coreir_interpret.o $(HWSUPPORT)/$(BIN)/coreir_compiled_sim.o \
+                  $(HWSUPPORT)/$(BIN)/coreir_sim_profiler.o
   PROCESS_TARGETS += -DWITH_COREIR
+  LDFLAGS += -ldl
 endif
 
 #$(BIN)/process: process.cpp \
@@ -430,6 +467,19 @@ run-coreir $(BIN)/output_coreir.$(EXT): $(BIN)/design_top.json
 	$(MAKE) $(BIN)/process WITH_COREIR=1
 	$(HALIDE_GEN_ARGS) EXT=$(EXT) $(BIN)/process run coreir input.png $(HALIDE_DEBUG_REDIRECT)
 
+# Same as run-coreir, but simulates a levelized design compiled to C++
+# instead of using the CoreIR interpreter (falls back if unsupported)
+run-coreir-compiled: $(BIN)/design_top.json
+	@-mkdir -p $(BIN)
+	$(MAKE) $(BIN)/process WITH_COREIR=1
+	$(HALIDE_GEN_ARGS) COREIR_SIM_MODE=compiled EXT=$(EXT) $(BIN)/process run coreir input.png $(HALIDE_DEBUG_REDIRECT)
+
+# Runs the CoreIR simulation and records stream and buffer activity
+profile-coreir $(BIN)/simulation_profile.json: $(BIN)/design_top.json
+	@-mkdir -p $(BIN)
+	$(MAKE) $(BIN)/process WITH_COREIR=1
+	$(HALIDE_GEN_ARGS) COREIR_SIM_PROFILE=$(BIN)/simulation_profile.json EXT=$(EXT) $(BIN)/process run coreir input.png $(HALIDE_DEBUG_REDIRECT)
+
 run-rewrite $(BIN)/output_rewrite.png: $(BIN)/design_top.json
 	@-mkdir -p $(BIN)
 	$(MAKE) $(BIN)/process WITH_COREIR=1
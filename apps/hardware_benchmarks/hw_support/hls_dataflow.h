@@ -0,0 +1,221 @@
+#ifndef HLS_DATAFLOW_H
+#define HLS_DATAFLOW_H
+
+// Threaded software emulation of hls::stream and dataflow regions.
+//
+// Included by Stencil.h in place of <hls_stream.h> when HALIDE_DATAFLOW_THREADS
+// is defined (HLS_DATAFLOW_THREADS=1 in hardware_targets.mk). The generated
+// vhls kernels then run every process of a dataflow region on its own thread
+// (hls::dataflow), and the streams between processes are bounded to the FIFO
+// depths from the HLS STREAM pragmas (stream::set_depth). A write to a full
+// FIFO blocks like it does in hardware, so a FIFO that is too shallow shows up
+// as a stall instead of going unnoticed. A read or write that makes no
+// progress for HL_DATAFLOW_TIMEOUT seconds (default 10) reports the stream
+// and aborts.
+//
+// Every element through a depth-1 FIFO is a handoff between two threads,
+// which is slow when there are fewer cores than processes.
+// HL_DATAFLOW_DEPTH_SCALE multiplies all FIFO depths to batch the handoffs,
+// at the cost of hiding stalls that only the exact depths would show.
+//
+// Bounded streams are single-producer single-consumer ring buffers without
+// locks. Streams that are never bounded (kernel arguments, which the
+// testbench fills before the kernel starts and drains after it returns)
+// grow without bound and must only be used by one thread at a time.
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace hls {
+
+inline double stream_timeout_seconds() {
+    static const double timeout = []() {
+        const char *env = getenv("HL_DATAFLOW_TIMEOUT");
+        return (env != nullptr && atof(env) > 0) ? atof(env) : 10.0;
+    }();
+    return timeout;
+}
+
+inline size_t stream_depth_scale() {
+    static const size_t scale = []() {
+        const char *env = getenv("HL_DATAFLOW_DEPTH_SCALE");
+        return (env != nullptr && atoi(env) > 0) ? (size_t)atoi(env) : 1;
+    }();
+    return scale;
+}
+
+template<typename T>
+class stream {
+public:
+    stream() {
+        static std::atomic<unsigned> counter(1);
+        _name = "hls_stream." + std::to_string(counter++);
+    }
+
+    stream(const std::string name) : _name(name) {}
+
+    ~stream() {
+        if (size() != 0) {
+            std::cout << "WARNING: Hls::stream '" << _name
+                      << "' contains leftover data,"
+                      << " which may result in RTL simulation hanging."
+                      << std::endl;
+        }
+    }
+
+    /** bound the FIFO to depth elements (times HL_DATAFLOW_DEPTH_SCALE);
+     *  call before the stream is used
+     */
+    void set_depth(size_t depth) {
+        assert(depth > 0 && _data.empty() && _head == _tail);
+        _depth = depth * stream_depth_scale();
+        _ring.resize(_depth);
+    }
+
+    size_t depth() const { return _depth; }
+
+    void operator >> (T &rdata) { read(rdata); }
+    void operator << (const T &wdata) { write(wdata); }
+
+    bool empty() {
+        if (_depth == 0) {
+            return _data.empty();
+        }
+        return _head.load(std::memory_order_relaxed) == _tail.load(std::memory_order_acquire);
+    }
+
+    bool full() {
+        if (_depth == 0) {
+            return false;
+        }
+        return _tail.load(std::memory_order_relaxed) - _head.load(std::memory_order_acquire) == _depth;
+    }
+
+    size_t size() {
+        if (_depth == 0) {
+            return _data.size();
+        }
+        return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+    }
+
+    /// Blocking read
+    void read(T &head) { head = read(); }
+
+    T read() {
+        if (_depth == 0) {
+            if (_data.empty()) {
+                std::cout << "WARNING: Hls::stream '" << _name
+                          << "' is read while empty,"
+                          << " which may result in RTL simulation hanging."
+                          << std::endl;
+                return T();
+            }
+            T elem = _data.front();
+            _data.pop_front();
+            return elem;
+        }
+        size_t head = _head.load(std::memory_order_relaxed);
+        wait("read from an empty", [&]() { return _tail.load(std::memory_order_acquire) != head; });
+        T elem = _ring[head % _depth];
+        _head.store(head + 1, std::memory_order_release);
+        return elem;
+    }
+
+    /// Blocking write
+    void write(const T &tail) {
+        if (_depth == 0) {
+            _data.push_back(tail);
+            return;
+        }
+        size_t pos = _tail.load(std::memory_order_relaxed);
+        wait("write to a full", [&]() { return pos - _head.load(std::memory_order_acquire) < _depth; });
+        _ring[pos % _depth] = tail;
+        _tail.store(pos + 1, std::memory_order_release);
+    }
+
+    /// Nonblocking read
+    bool read_nb(T &head) {
+        if (empty()) {
+            head = T();
+            return false;
+        }
+        head = read();
+        return true;
+    }
+
+    /// Nonblocking write
+    bool write_nb(const T &tail) {
+        if (full()) {
+            return false;
+        }
+        write(tail);
+        return true;
+    }
+
+    stream(const stream<T> &) = delete;
+    stream &operator=(const stream<T> &) = delete;
+
+private:
+    // Spin briefly, then yield, until ready() holds
+    template<typename Ready>
+    void wait(const char *what, Ready ready) {
+        for (int spin = 0; spin < 64; spin++) {
+            if (ready()) {
+                return;
+            }
+        }
+        auto start = std::chrono::steady_clock::now();
+        while (!ready()) {
+            std::this_thread::yield();
+            std::chrono::duration<double> waited = std::chrono::steady_clock::now() - start;
+            if (waited.count() > stream_timeout_seconds()) {
+                std::cerr << "ERROR: Hls::stream '" << _name << "' blocked on a " << what
+                          << " FIFO (depth " << _depth << ") for " << waited.count() << "s."
+                          << " The dataflow region deadlocked, or the FIFO is too shallow."
+                          << std::endl;
+                abort();
+            }
+        }
+    }
+
+    std::string _name;
+    size_t _depth = 0;       // 0 while unbounded
+    std::deque<T> _data;     // elements while unbounded
+    std::vector<T> _ring;    // elements once bounded
+    alignas(64) std::atomic<size_t> _head{0};  // count of reads, owned by the consumer
+    alignas(64) std::atomic<size_t> _tail{0};  // count of writes, owned by the producer
+};
+
+/** the processes of one dataflow region, each running on its own thread
+ */
+class dataflow {
+public:
+    template<typename F>
+    void spawn(F process) {
+        _processes.emplace_back(process);
+    }
+
+    void join() {
+        for (auto &process : _processes) {
+            process.join();
+        }
+        _processes.clear();
+    }
+
+    ~dataflow() { join(); }
+
+private:
+    std::vector<std::thread> _processes;
+};
+
+} // namespace hls
+
+#endif
@@ -14,6 +14,7 @@ def parseArguments():
     # Optional arguments
     parser.add_argument("--top", help="design_top.json: parse out address sequence", type=str, default=None)
     parser.add_argument("--place", help="design.place: parse IO placement", type=str, default=None)
+    parser.add_argument("--profile", help="simulation_profile.json: add simulated throughput", type=str, default=None)
 
     # Parse arguments
     args = parser.parse_args()
@@ -109,6 +110,30 @@ def parseDesignPlace(meta, filename: str):
                 tileOut["valid_name"] = validName
 
 
+def parseSimulationProfile(meta, filename: str):
+    print("parsing simulation profile", filename)
+    meta["testing"]["profile"] = os.path.basename(filename)
+
+    with open(filename, "r") as readFile:
+        profile = json.load(readFile)
+        meta["profile"] = {
+            "total_cycles": profile["total_cycles"],
+            "first_output_cycle": profile["first_output_cycle"],
+            "last_output_cycle": profile["last_output_cycle"],
+            "outputs_per_cycle": profile["outputs_per_cycle"],
+        }
+
+        # valid and ready activity of each interface stream
+        meta["profile"]["streams"] = profile.get("streams", [])
+
+        # the buffer with the lowest read duty cycle limits throughput
+        buffers = profile.get("buffers", [])
+        if len(buffers) > 0:
+            slowest = min(buffers, key=lambda b: b["read"]["duty_cycle"])
+            meta["profile"]["limiting_buffer"] = slowest["name"]
+        meta["profile"]["buffers"] = buffers
+
+
 def main():
     args = parseArguments()
 
@@ -128,6 +153,9 @@ def main():
         if args.place != None:
             parseDesignPlace(meta, args.place)
 
+        if args.profile != None:
+            parseSimulationProfile(meta, args.profile)
+
     outputName = 'bin/design_meta.json'
     with open(outputName, 'w', encoding='utf-8') as fileout:
         # pprint.pprint(meta, fileout, indent=2, compact=True)
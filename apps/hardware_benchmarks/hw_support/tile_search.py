@@ -0,0 +1,241 @@
+import argparse
+import itertools
+import json
+import os
+import subprocess
+import sys
+
+# Sweeps the GeneratorParams of a hardware generator (tile sizes, unroll
+# factors, memory placements, ...), builds the CoreIR design for each point,
+# and scores it with a cost model made from the HWBuffer estimates and the
+# per-op delays of a techlib. The Pareto-best points over execution time,
+# compute units and memory banks are reported as HALIDE_GEN_ARGS.
+#
+# The estimates describe one run of the accelerator, on one tile. With
+# --image, traffic and time are scaled to the whole image by the number of
+# tiles, ceil(image/tile) in each dimension, since partial tiles at the edge
+# are shifted inwards and still cost a full run.
+
+# primitives that hold state and break combinational paths
+SEQUENTIAL_OPS = {"reg", "reg_arst", "dff", "mem", "rom", "rom2"}
+# primitives that do not take a compute unit
+FREE_OPS = {"const", "wire", "term", "slice", "concat", "zext", "sext", "reg", "reg_arst", "dff", "mem"}
+OUTPUT_PORTS = {"out", "valid", "rdata", "data_out", "output"}
+
+def parseArguments():
+    parser = argparse.ArgumentParser()
+
+    parser.add_argument("Generator", help="bin/<app>.generator: the generator to sweep", type=str)
+    parser.add_argument("-g", "--name", help="generator name", type=str, required=True)
+    parser.add_argument("-f", "--function", help="function name", type=str, default=None)
+    parser.add_argument("--target", help="halide target", type=str, default="host-coreir")
+    parser.add_argument("--param", help="name=v0,v1,...: generator param values to sweep", action="append", default=[])
+    parser.add_argument("--image", help="WxH: output image size, to cost every tile of it", type=str, default=None)
+    parser.add_argument("--tile-param", help="generator param giving the tile size, as W or WxH", type=str, default="tilesize")
+    parser.add_argument("--techlib", help="json with per-op cycleLatency and criticalPath", type=str, default=None)
+    parser.add_argument("--workdir", help="directory for the generated designs", type=str, default="bin/search")
+    parser.add_argument("--out", help="json report of every point", type=str, default="bin/tile_search.json")
+
+    return parser.parse_args()
+
+def parseParams(paramArgs):
+    params = []
+    for paramArg in paramArgs:
+        name, success, values = paramArg.partition("=")
+        assert success, "params are given as name=v0,v1,..."
+        params.append((name, values.split(",")))
+    return params
+
+def parseSize(size):
+    dims = [int(d) for d in size.split("x")]
+    assert len(dims) in (1, 2), "sizes are given as W or WxH"
+    return dims if len(dims) == 2 else dims * 2
+
+# Accelerator runs needed to cover the image with the tile of this point
+def numTiles(args, point):
+    if args.image == None:
+        return 1
+    params = dict(point)
+    if args.tile_param not in params:
+        return 1
+    image = parseSize(args.image)
+    tile = parseSize(params[args.tile_param])
+    return ((image[0] + tile[0] - 1) // tile[0]) * ((image[1] + tile[1] - 1) // tile[1])
+
+def loadTechlib(filename):
+    techlib = {"cycleLatency": {}, "criticalPath": {}, "clockPeriod": 0}
+    if filename != None:
+        with open(filename, "r") as readFile:
+            techlib.update(json.load(readFile))
+    return techlib
+
+def opName(inst):
+    ref = inst["genref"] if "genref" in inst else inst.get("modref", "")
+    namespace, _, op = ref.partition(".")
+    return namespace, op
+
+def isOutputPort(port):
+    return port in OUTPUT_PORTS or port.startswith("out") or port.startswith("data_out")
+
+# Longest combinational delay, pipeline depth and unit counts of a
+# flattened CoreIR design
+def parseDesign(filename, techlib):
+    with open(filename, "r") as readFile:
+        design = json.load(readFile)
+    topName = design["top"].partition("global.")[2]
+    top = design["namespaces"]["global"]["modules"][topName]
+    instances = top.get("instances", {})
+
+    ops = {}
+    units = {}
+    for name, inst in instances.items():
+        namespace, op = opName(inst)
+        sequential = op in SEQUENTIAL_OPS or namespace not in ("coreir", "corebit", "commonlib", "float")
+        ops[name] = (op, sequential)
+        if op not in FREE_OPS and not sequential:
+            units[op] = units.get(op, 0) + 1
+
+    fanout = {name: [] for name in instances}
+    for conx in top.get("connections", []):
+        ends = [c.split(".") for c in conx]
+        if ends[0][0] == "self" or ends[1][0] == "self":
+            continue
+        if isOutputPort(ends[1][1]) and not isOutputPort(ends[0][1]):
+            ends.reverse()
+        if ends[0][0] in fanout and ends[1][0] in fanout:
+            fanout[ends[0][0]].append(ends[1][0])
+
+    # longest path leaving each node through combinational sinks
+    def longestPaths(weight):
+        lengths = {}
+        def pathFrom(name, visiting):
+            if name in lengths:
+                return lengths[name]
+            if name in visiting:
+                return 0
+            visiting.add(name)
+            worst = 0
+            for sink in fanout[name]:
+                if not ops[sink][1]:
+                    worst = max(worst, pathFrom(sink, visiting))
+            visiting.discard(name)
+            lengths[name] = weight.get(ops[name][0], 0) + worst
+            return lengths[name]
+
+        longest = 0
+        for name in instances:
+            longest = max(longest, pathFrom(name, set()))
+        return longest
+
+    sys.setrecursionlimit(max(10000, 4 * len(instances)))
+    criticalPath = longestPaths(techlib["criticalPath"])
+    # cycles added once the scheduler registers each multicycle op
+    pipelineDepth = longestPaths(techlib["cycleLatency"])
+    return criticalPath, units, pipelineDepth
+
+def parseEstimates(filename):
+    with open(filename, "r") as readFile:
+        estimates = json.load(readFile)
+
+    banks = 0
+    capacityBytes = 0
+    offchipBytes = 0
+    logicalWords = 0
+    frameCycles = 0
+    fillCycles = 0
+    for xcel in estimates["accelerators"]:
+        banks += xcel["total_banks"]
+        capacityBytes += xcel["total_capacity_bytes"]
+        offchipBytes += xcel["offchip_bytes_per_frame"]
+        for hwbuffer in xcel["hwbuffers"]:
+            logicalWords += hwbuffer["logical_words"]
+            writes = max(hwbuffer["writes_per_cycle"], 1)
+            if hwbuffer["offchip_write_words"] > 0:
+                frameCycles = max(frameCycles, hwbuffer["offchip_write_words"] // writes)
+            # double-buffered inputs fill while the previous tile computes
+            if hwbuffer["capacity_words"] > 0 and not hwbuffer.get("double_buffered", False):
+                fillCycles = max(fillCycles, hwbuffer["capacity_words"] // writes)
+    return banks, capacityBytes, offchipBytes, logicalWords, frameCycles, fillCycles
+
+def runPoint(args, techlib, point):
+    label = "_".join(name + "-" + value for name, value in point) or "default"
+    pointDir = os.path.join(args.workdir, label)
+    binDir = os.path.join(pointDir, "bin")
+    os.makedirs(binDir, exist_ok=True)
+
+    genArgs = [name + "=" + value for name, value in point]
+    command = [os.path.abspath(args.Generator), "-g", args.name, "-o", "bin",
+               "-e", "coreir", "target=" + args.target] + genArgs
+    if args.function != None:
+        command += ["-f", args.function]
+
+    # the generator only writes the buffer estimates when asked to
+    estimateFile = os.path.abspath(os.path.join(binDir, "hwbuffer_estimates.json"))
+    env = dict(os.environ, HL_HWBUFFER_ESTIMATES=estimateFile)
+
+    print("search point:", " ".join(genArgs))
+    with open(os.path.join(pointDir, "generator.log"), "w") as log:
+        status = subprocess.call(command, cwd=pointDir, env=env, stdout=log, stderr=subprocess.STDOUT)
+
+    result = {"params": dict(point), "halide_gen_args": " ".join(genArgs), "dir": pointDir}
+    designFile = os.path.join(binDir, "design_flattened.json")
+    if not os.path.exists(designFile):
+        designFile = os.path.join(binDir, "design_top.json")
+    if status != 0 or not os.path.exists(estimateFile) or not os.path.exists(designFile):
+        result["error"] = "generator failed, see " + os.path.join(pointDir, "generator.log")
+        return result
+
+    banks, capacityBytes, offchipBytes, logicalWords, frameCycles, fillCycles = parseEstimates(estimateFile)
+    criticalPath, units, pipelineDepth = parseDesign(designFile, techlib)
+    period = max(criticalPath, techlib["clockPeriod"], 1)
+    # the buffers and units are reused by every tile, the traffic is not
+    tiles = numTiles(args, point)
+    cycles = tiles * (frameCycles + fillCycles + pipelineDepth)
+
+    result.update({
+        "tiles": tiles,
+        "cycles": cycles,
+        "critical_path": criticalPath,
+        "exec_time": cycles * period,
+        "compute_units": sum(units.values()),
+        "units": units,
+        "mem_banks": banks,
+        "mem_capacity_bytes": capacityBytes,
+        "offchip_bytes_per_frame": tiles * offchipBytes,
+        "logical_words_per_frame": tiles * logicalWords,
+    })
+    return result
+
+def dominates(a, b):
+    keys = ["exec_time", "compute_units", "mem_banks"]
+    return all(a[k] <= b[k] for k in keys) and any(a[k] < b[k] for k in keys)
+
+def main():
+    args = parseArguments()
+    techlib = loadTechlib(args.techlib)
+    params = parseParams(args.param)
+
+    names = [name for name, _ in params]
+    results = []
+    for values in itertools.product(*[values for _, values in params]):
+        results.append(runPoint(args, techlib, list(zip(names, values))))
+
+    valid = [r for r in results if "error" not in r]
+    for r in valid:
+        r["pareto"] = not any(dominates(other, r) for other in valid)
+
+    with open(args.out, "w", encoding="utf-8") as fileout:
+        print("writing to", args.out)
+        json.dump({"techlib": techlib, "points": results}, fileout, indent=2)
+
+    pareto = sorted([r for r in valid if r["pareto"]], key=lambda r: r["exec_time"])
+    print("pareto-best schedules (exec_time, compute units, memory banks):")
+    for r in pareto:
+        print("  HALIDE_GEN_ARGS=\"%s\"  %d  %d  %d" %
+              (r["halide_gen_args"], r["exec_time"], r["compute_units"], r["mem_banks"]))
+    for r in results:
+        if "error" in r:
+            print("  failed:", r["halide_gen_args"], "-", r["error"])
+
+if __name__ == "__main__":
+    main()
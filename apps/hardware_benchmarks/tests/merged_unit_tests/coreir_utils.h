@@ -8,6 +8,11 @@
 #include "coreir.h"
 #include "coreir/simulator/interpreter.h"
 
+#include "coreir_compiled_sim.h"
+
+#include <chrono>
+#include <limits>
+
 using namespace CoreIR;
 using namespace Halide;
 using namespace Halide::Tools;
@@ -55,4 +60,116 @@ CoreIR::Module* buildModule(CoreIR::Context* context, const std::string& name, s
   return buildModule(info, false, context, name, args, fName, hwOutput);
 }
 
+// Drives the same random inputs into the interpreter and the compiled
+// simulator for cycles cycles after a reset, and checks that every output of
+// m matches bit for bit on every cycle
+static
+bool compiledSimulationMatches(CoreIR::Module* m, const map<string, SimModelBuilder>& plugins, const int cycles) {
+  CompiledCoreIRSimulator csim(m, plugins);
+  if (!csim.compile()) {
+    cout << "Error: could not compile " << m->getName() << " for simulation" << endl;
+    return false;
+  }
+  SimulatorState state(m, plugins);
+
+  vector<pair<string, int> > inputs;
+  vector<string> outputs;
+  for (auto field : m->getType()->getRecord()) {
+    string name = "self." + field.first;
+    if (field.second->getKind() == Type::TK_Named) {
+      state.setClock(name, 0, 1);
+    } else if (field.second->isInput()) {
+      inputs.push_back({name, (int) field.second->getSize()});
+    } else {
+      outputs.push_back(name);
+    }
+  }
+
+  for (auto in : inputs) {
+    BitVector value(in.second, in.first == "self.reset" ? 1 : 0);
+    state.setValue(in.first, value);
+    csim.setValue(in.first, value);
+  }
+  state.resetCircuit();
+  csim.resetCircuit();
+
+  srand(1);
+  for (int cycle = 0; cycle < cycles; cycle++) {
+    for (auto in : inputs) {
+      BitVector value(in.second, 0);
+      for (int i = 0; i < in.second && in.first != "self.reset"; i++) {
+        value.set(i, rand() & 1);
+      }
+      state.setValue(in.first, value);
+      csim.setValue(in.first, value);
+    }
+    state.exeCombinational();
+    csim.exeCombinational();
+
+    for (auto out : outputs) {
+      if (!(state.getBitVec(out) == csim.getBitVec(out))) {
+        cout << "Error: " << out << " is " << csim.getBitVec(out).to_type<uint64_t>()
+             << " in the compiled simulation, but " << state.getBitVec(out).to_type<uint64_t>()
+             << " in the interpreter on cycle " << cycle << endl;
+        return false;
+      }
+    }
+    state.exeSequential();
+    csim.exeSequential();
+  }
+  return true;
+}
+
+// Resets a simulator of m, with its clocks already set, and runs it for
+// cycles cycles on random inputs. Returns the seconds the cycles took.
+template<typename SimState>
+static double timeSimulation(SimState& state, CoreIR::Module* m, const int cycles) {
+  vector<pair<string, int> > inputs;
+  for (auto field : m->getType()->getRecord()) {
+    string name = "self." + field.first;
+    if (field.second->getKind() != Type::TK_Named && field.second->isInput()) {
+      inputs.push_back({name, (int) field.second->getSize()});
+      state.setValue(name, BitVector(field.second->getSize(), field.first == "reset" ? 1 : 0));
+    }
+  }
+  state.resetCircuit();
+
+  srand(1);
+  auto start = std::chrono::steady_clock::now();
+  for (int cycle = 0; cycle < cycles; cycle++) {
+    for (auto in : inputs) {
+      BitVector value(in.second, 0);
+      for (int i = 0; i < in.second && in.first != "self.reset"; i++) {
+        value.set(i, rand() & 1);
+      }
+      state.setValue(in.first, value);
+    }
+    state.exeCombinational();
+    state.exeSequential();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
 
+// How many times faster the compiled simulator runs cycles cycles of m
+// than the interpreter. Compiling the simulator is not counted.
+static
+double compiledSimulationSpeedup(CoreIR::Module* m, const map<string, SimModelBuilder>& plugins, const int cycles) {
+  CompiledCoreIRSimulator csim(m, plugins);
+  if (!csim.compile()) {
+    cout << "Error: could not compile " << m->getName() << " for simulation" << endl;
+    return 0;
+  }
+  SimulatorState state(m, plugins);
+  for (auto field : m->getType()->getRecord()) {
+    if (field.second->getKind() == Type::TK_Named) {
+      state.setClock("self." + field.first, 0, 1);
+    }
+  }
+
+  double interpreted = timeSimulation(state, m, cycles);
+  double compiled = timeSimulation(csim, m, cycles);
+  cout << cycles << " cycles took " << interpreted << "s in the interpreter and "
+       << compiled << "s compiled" << endl;
+  return compiled > 0 ? interpreted / compiled : std::numeric_limits<double>::infinity();
+}
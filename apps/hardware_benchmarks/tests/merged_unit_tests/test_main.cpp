@@ -8,6 +8,8 @@
 #include "test_utils.h"
 #include "coreir_utils.h"
 #include "ubuffer_tests.h"
+#include "coreir_interpret.h"
+#include "CoreIRCompute.h"
 
 using namespace CoreIR;
 using namespace Halide;
@@ -1885,6 +1887,454 @@ void runSoC(Func hw_output, vector<Argument>& args, const std::string& name) {
   cout << "Ran executable" << endl;
 }
 
+int numGeneratorInstances(CoreIR::Module* m, const std::string& genName) {
+  int num = 0;
+  for (auto inst : m->getDef()->getInstances()) {
+    auto ref = inst.second->getModuleRef();
+    if (ref->isGenerated() && ref->getGenerator()->getRefName() == genName) {
+      num++;
+    }
+  }
+  return num;
+}
+
+// Feeds in one pixel and returns the cycle its result is valid in, along with the result
+std::pair<int, int> pointwiseLatency(CoreIR::Module* m, const int in) {
+  SimulatorState state(m);
+  state.setValue("self.in_en", BitVector(1, 0));
+  state.setValue("self.in_arg_0_0_0", BitVector(16, 0));
+  state.setClock("self.clk", 0, 1);
+  state.setValue("self.reset", BitVector(1, 1));
+
+  state.resetCircuit();
+  state.setValue("self.reset", BitVector(1, 0));
+
+  for (int cycle = 0; cycle < 40; cycle++) {
+    state.setValue("self.in_en", BitVector(1, cycle == 0));
+    state.setValue("self.in_arg_0_0_0", BitVector(16, cycle == 0 ? in : 0));
+    state.exeCombinational();
+
+    if (state.getBitVec("self.valid").to_type<bool>()) {
+      return {cycle, state.getBitVec("self.out_0_0").to_type<int>()};
+    }
+    state.exeSequential();
+  }
+  assert(false);
+  return {-1, -1};
+}
+
+void critical_path_target_test() {
+  auto buildChain = [](Context* context, const int criticalPath) {
+    ImageParam input(type_of<uint16_t>(), 2);
+    Func output;
+
+    Var x, y;
+
+    Func hw_input, hw_output;
+    Func chain("chain");
+    hw_input(x, y) = cast<uint16_t>(input(x, y));
+
+    chain(x, y) = (hw_input(x, y)*3 + 7)*hw_input(x, y) + 11;
+    hw_output(x, y) = chain(x, y);
+    output(x, y) = hw_output(x, y);
+
+    Var xi,yi, xo,yo;
+
+    hw_input.compute_root();
+    hw_output.compute_root();
+
+    hw_output.tile(x,y, xo,yo, xi,yi, 1, 1)
+      .hw_accelerate(xi, xo);
+    if (criticalPath > 0) {
+      hw_output.hw_critical_path(criticalPath);
+    }
+    hw_output.bound(x, 0, 1);
+    hw_output.bound(y, 0, 1);
+
+    output.bound(x, 0, 1);
+    output.bound(y, 0, 1);
+    hw_input.stream_to_accelerator();
+
+    vector<Argument> args{input};
+    return buildModule(true, context, "coreir_chain", args, "chain", output);
+  };
+
+  int in = 9;
+  uint16_t expected = (in*3 + 7)*in + 11;
+
+  Context* context = hwContext();
+  auto unconstrained = buildChain(context, 0);
+  int unconstrainedRegs = numGeneratorInstances(unconstrained, "coreir.reg");
+  auto unconstrainedRes = pointwiseLatency(unconstrained, in);
+  deleteContext(context);
+
+  // Each multiply alone fits in the default techlib, but chaining an add onto it doesn't
+  context = hwContext();
+  auto constrained = buildChain(context, 300);
+  int constrainedRegs = numGeneratorInstances(constrained, "coreir.reg");
+  auto constrainedRes = pointwiseLatency(constrained, in);
+  deleteContext(context);
+
+  cout << "Unconstrained: " << unconstrainedRegs << " registers, latency " << unconstrainedRes.first << endl;
+  cout << "Constrained  : " << constrainedRegs << " registers, latency " << constrainedRes.first << endl;
+
+  assert(unconstrainedRes.second == expected);
+  assert(constrainedRes.second == expected);
+  assert(constrainedRegs > unconstrainedRegs);
+  assert(constrainedRes.first > unconstrainedRes.first);
+
+  PRINT_PASSED("Critical path target");
+}
+
+void shared_multiplier_test() {
+
+    ImageParam input(type_of<uint16_t>(), 2);
+    Func output;
+
+    Var x, y;
+
+    Func hw_input, hw_output;
+    Func poly("poly");
+    hw_input(x, y) = cast<uint16_t>(input(x, y));
+
+    // Three multiplies, but only one multiplier allowed
+    poly(x, y) = hw_input(x, y)*3 + hw_input(x, y)*hw_input(x, y)*5;
+    hw_output(x, y) = poly(x, y);
+    output(x, y) = hw_output(x, y);
+
+    Var xi,yi, xo,yo;
+
+    hw_input.compute_root();
+    hw_output.compute_root();
+
+    hw_output.tile(x,y, xo,yo, xi,yi, 1, 1)
+      .hw_accelerate(xi, xo);
+    hw_output.hw_unit_limit("mul", 1);
+    hw_output.bound(x, 0, 1);
+    hw_output.bound(y, 0, 1);
+
+    output.bound(x, 0, 1);
+    output.bound(y, 0, 1);
+    hw_input.stream_to_accelerator();
+
+    Context* context = hwContext();
+
+    vector<Argument> args{input};
+    auto m = buildModule(true, context, "coreir_shared_mul", args, "shared_mul", output);
+
+    int numMuls = numGeneratorInstances(m, "coreir.mul");
+    cout << "# of multipliers = " << numMuls << endl;
+    assert(numMuls == 1);
+
+    json j;
+    ifstream inFile("accel_interface_info.json");
+    inFile >> j;
+    auto iis = j["initiationIntervals"];
+    assert(iis.size() == 1);
+    int II = begin(iis)->get<int>();
+    cout << "II = " << II << endl;
+    assert(II == 3);
+
+    SimulatorState state(m);
+    state.setValue("self.in_en", BitVector(1, 0));
+    state.setValue("self.in_arg_0_0_0", BitVector(16, 0));
+    state.setClock("self.clk", 0, 1);
+    state.setValue("self.reset", BitVector(1, 1));
+
+    state.resetCircuit();
+    state.setValue("self.reset", BitVector(1, 0));
+
+    // Issue a pixel every II cycles and check each result
+    vector<int> inputs{7, 12, 200};
+    vector<int> outputs;
+    for (int cycle = 0; cycle < 40 && outputs.size() < inputs.size(); cycle++) {
+      int issue = cycle / II;
+      bool issuing = cycle % II == 0 && issue < (int) inputs.size();
+      state.setValue("self.in_en", BitVector(1, issuing));
+      state.setValue("self.in_arg_0_0_0", BitVector(16, issuing ? inputs[issue] : 0));
+      state.exeCombinational();
+
+      if (state.getBitVec("self.valid").to_type<bool>()) {
+        outputs.push_back(state.getBitVec("self.out_0_0").to_type<int>());
+      }
+      state.exeSequential();
+    }
+
+    assert(outputs.size() == inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++) {
+      uint16_t v = inputs[i];
+      uint16_t expected = v*3 + v*v*5;
+      cout << "out[" << i << "] = " << outputs[i] << ", expected " << expected << endl;
+      assert(outputs[i] == expected);
+    }
+
+    deleteContext(context);
+
+    PRINT_PASSED("Shared multiplier");
+}
+
+void compiled_simulation_test() {
+
+    ImageParam input(type_of<uint16_t>(), 2);
+    Func output;
+
+    Var x, y;
+
+    Func hw_input, hw_output;
+    Func poly("poly");
+    hw_input(x, y) = cast<uint16_t>(input(x, y));
+    poly(x, y) = hw_input(x, y)*3 + hw_input(x, y)*hw_input(x, y)*5;
+    hw_output(x, y) = poly(x, y);
+    output(x, y) = hw_output(x, y);
+
+    Var xi,yi, xo,yo;
+
+    hw_input.compute_root();
+    hw_output.compute_root();
+
+    hw_output.tile(x,y, xo,yo, xi,yi, 1, 1)
+      .hw_accelerate(xi, xo);
+    hw_output.hw_unit_limit("mul", 1);
+    hw_output.bound(x, 0, 1);
+    hw_output.bound(y, 0, 1);
+
+    output.bound(x, 0, 1);
+    output.bound(y, 0, 1);
+    hw_input.stream_to_accelerator();
+
+    Context* context = hwContext();
+
+    vector<Argument> args{input};
+    auto m = buildModule(true, context, "coreir_compiled_sim", args, "compiled_sim", output);
+
+    assert(compiledSimulationMatches(m, {}, 100));
+
+    // Simulating the design compiled must be much faster than interpreting it
+    double speedup = compiledSimulationSpeedup(m, {}, 20000);
+    cout << "compiled simulation speedup = " << speedup << "x" << endl;
+    assert(speedup >= 100);
+
+    deleteContext(context);
+
+    PRINT_PASSED("Compiled simulation");
+}
+
+void batch_simulation_test() {
+
+    ImageParam input(type_of<uint16_t>(), 2);
+    Func output;
+
+    Var x, y;
+
+    Func hw_input, hw_output;
+    Func poly("poly");
+    hw_input(x, y) = cast<uint16_t>(input(x, y));
+    poly(x, y) = hw_input(x, y)*3 + hw_input(x, y)*hw_input(x, y)*5;
+    hw_output(x, y) = poly(x, y);
+    output(x, y) = hw_output(x, y);
+
+    Var xi,yi, xo,yo;
+
+    hw_input.compute_root();
+    hw_output.compute_root();
+
+    hw_output.tile(x,y, xo,yo, xi,yi, 1, 1)
+      .hw_accelerate(xi, xo);
+    hw_output.bound(x, 0, 1);
+    hw_output.bound(y, 0, 1);
+
+    output.bound(x, 0, 1);
+    output.bound(y, 0, 1);
+    hw_input.stream_to_accelerator();
+
+    // Writes the design to conv_3_3_app.json, which the batch reloads
+    Context* context = hwContext();
+    vector<Argument> args{input};
+    buildModule(true, context, "coreir_batch_sim", args, "batch_sim", output);
+    deleteContext(context);
+
+    // More images than threads, so that workers pick up several each
+    vector<int> values{7, 12, 200, 1, 0, 65535, 300, 41};
+    vector<Halide::Runtime::Buffer<uint16_t> > inputs;
+    vector<Halide::Runtime::Buffer<uint16_t> > outputs;
+    for (int v : values) {
+      Halide::Runtime::Buffer<uint16_t> in(1, 1, 1);
+      in(0, 0, 0) = v;
+      inputs.push_back(in);
+      outputs.push_back(Halide::Runtime::Buffer<uint16_t>(1, 1, 1));
+    }
+    run_coreir_batch_on_interpreter<uint16_t>("conv_3_3_app.json", inputs, outputs,
+                                              "self.in_arg_0_0_0", "self.out_0_0", false, false, 3);
+
+    for (size_t i = 0; i < values.size(); i++) {
+      uint16_t v = values[i];
+      uint16_t expected = v*3 + v*v*5;
+      cout << "out[" << i << "] = " << outputs[i](0, 0, 0) << ", expected " << expected << endl;
+      assert(outputs[i](0, 0, 0) == expected);
+    }
+
+    PRINT_PASSED("Batch simulation");
+}
+
+void simulation_profiler_test() {
+
+    ImageParam input(type_of<uint16_t>(), 2);
+    Func output;
+
+    Var x, y;
+
+    Func hw_input, hw_output;
+    hw_input(x, y) = cast<uint16_t>(input(x, y));
+    hw_output(x, y) = hw_input(x, y)*3 + 1;
+    output(x, y) = hw_output(x, y);
+
+    Var xi,yi, xo,yo;
+
+    hw_input.compute_root();
+    hw_output.compute_root();
+
+    hw_output.tile(x,y, xo,yo, xi,yi, 4, 4)
+      .hw_accelerate(xi, xo);
+    hw_output.bound(x, 0, 4);
+    hw_output.bound(y, 0, 4);
+
+    output.bound(x, 0, 4);
+    output.bound(y, 0, 4);
+    hw_input.stream_to_accelerator();
+
+    // Writes the design to conv_3_3_app.json, which the simulation reloads
+    Context* context = hwContext();
+    vector<Argument> args{input};
+    buildModule(true, context, "coreir_profiled_sim", args, "profiled_sim", output);
+    deleteContext(context);
+
+    const int pixels = 16;
+    Halide::Runtime::Buffer<uint16_t> in(4, 4, 1);
+    Halide::Runtime::Buffer<uint16_t> out(4, 4, 1);
+    for (int i = 0; i < pixels; i++) {
+      in(i % 4, i / 4, 0) = i;
+    }
+    system("mkdir -p bin");
+    setenv("COREIR_SIM_PROFILE", "bin/simulation_profile.json", 1);
+    run_coreir_on_interpreter<uint16_t>("conv_3_3_app.json", in, out,
+                                        "self.in_arg_0_0_0", "self.out_0_0", false, false);
+    unsetenv("COREIR_SIM_PROFILE");
+
+    for (int i = 0; i < pixels; i++) {
+      assert(out(i % 4, i / 4, 0) == i*3 + 1);
+    }
+
+    // A pointwise design produces an output every cycle once the first
+    // one is out, and the simulation stops after the last
+    json profile;
+    ifstream profileFile("bin/simulation_profile.json");
+    profileFile >> profile;
+    int total = profile["total_cycles"].get<int>();
+    int first = profile["first_output_cycle"].get<int>();
+    int last = profile["last_output_cycle"].get<int>();
+    cout << "outputs from cycle " << first << " to " << last << " of " << total << endl;
+    assert(first >= 0);
+    assert(last == first + pixels - 1);
+    assert(total == last + 1);
+
+    bool found_output = false;
+    for (auto& stream : profile["streams"]) {
+      if (stream["direction"] == "output") {
+        found_output = true;
+        assert(stream["active_cycles"].get<int>() == pixels);
+        assert(stream["first_active_cycle"].get<int>() == first);
+        assert(std::abs(stream["duty_cycle"].get<double>() - ((double) pixels) / total) < 1e-9);
+        assert(stream["stall_cycles"].get<int>() == 0);
+      }
+    }
+    assert(found_output);
+
+    // The report is added to the design metadata
+    ofstream metaFile("bin/design_meta_halide.json");
+    metaFile << "{\"testing\": {}}" << endl;
+    metaFile.close();
+    int status = system("python3 ../../hw_support/parse_design_meta.py bin/design_meta_halide.json "
+                        "--profile bin/simulation_profile.json");
+    assert(status == 0);
+    json meta;
+    ifstream metaOut("bin/design_meta.json");
+    metaOut >> meta;
+    assert(meta["testing"]["profile"] == "simulation_profile.json");
+    assert(meta["profile"]["first_output_cycle"].get<int>() == first);
+    assert(meta["profile"]["last_output_cycle"].get<int>() == last);
+    assert(meta["profile"]["streams"].size() == profile["streams"].size());
+
+    PRINT_PASSED("Simulation profiler");
+}
+
+// Builds the clockwork compute kernel for e, which reads a and b, with its
+// units shared over a window of share_cycles
+CoreIR::Module* clockworkComputeKernel(Context* context, const std::string& name, Expr e, const int share_cycles) {
+  Halide::Internal::CoreIR_Interface iface;
+  iface.name = name;
+  iface.output = {"y", 16, false};
+  iface.inputs.push_back({"in", 32, {{"a", 16, false}, {"b", 16, false}}});
+  iface.share_cycles = share_cycles;
+  Halide::Internal::convert_compute_to_coreir(e, iface, context);
+
+  context->runPasses({"rungenerators", "flattentypes", "flatten"});
+  return context->getNamespace("global")->getModule(name);
+}
+
+void shared_compute_kernel_test() {
+  Expr a = Halide::Internal::Variable::make(UInt(16), "a");
+  Expr b = Halide::Internal::Variable::make(UInt(16), "b");
+  Expr e = a*b + b*7 - a*5;
+  vector<pair<int, int> > inputs{{3, 4}, {100, 7}, {65535, 2}, {1234, 4321}};
+  const int II = 3;
+
+  Context* context = hwContext();
+  auto unshared = clockworkComputeKernel(context, "hcompute_unshared", e, 1);
+  auto shared = clockworkComputeKernel(context, "hcompute_shared", e, II);
+  assert(numGeneratorInstances(unshared, "coreir.mul") == 3);
+  assert(numGeneratorInstances(shared, "coreir.mul") == 1);
+
+  vector<BitVector> expected;
+  SimulatorState unsharedState(unshared);
+  for (auto in : inputs) {
+    unsharedState.setValue("self.in0_in_0", BitVector(16, in.first));
+    unsharedState.setValue("self.in0_in_1", BitVector(16, in.second));
+    unsharedState.exeCombinational();
+    expected.push_back(unsharedState.getBitVec("self.out_y"));
+  }
+
+  SimulatorState state(shared);
+  state.setClock("self.clk", 0, 1);
+  state.setValue("self.in0_in_0", BitVector(16, 0));
+  state.setValue("self.in0_in_1", BitVector(16, 0));
+
+  // Start off the window the registers reset to, so the kernel has to
+  // follow its issues rather than count from reset
+  state.setValue("self.in_en", BitVector(1, 0));
+  state.exeCombinational();
+  state.exeSequential();
+
+  for (size_t i = 0; i < inputs.size(); i++) {
+    for (int step = 0; step < II; step++) {
+      state.setValue("self.in_en", BitVector(1, step == 0));
+      state.setValue("self.in0_in_0", BitVector(16, inputs[i].first));
+      state.setValue("self.in0_in_1", BitVector(16, inputs[i].second));
+      state.exeCombinational();
+
+      // The output is valid in the last cycle of the window
+      if (step == II - 1) {
+        cout << "out[" << i << "] = " << state.getBitVec("self.out_y").to_type<int>() << ", unshared " << expected[i].to_type<int>() << endl;
+        assert(state.getBitVec("self.out_y") == expected[i]);
+      }
+      state.exeSequential();
+    }
+  }
+
+  deleteContext(context);
+
+  PRINT_PASSED("Shared compute kernel");
+}
+
 void accel_soc_test() {
   ImageParam input(type_of<uint16_t>(), 2);
   ImageParam output(type_of<uint16_t>(), 3);
@@ -3142,6 +3592,13 @@ int main(int argc, char **argv) {
   //small_conv_3_3_not_unrolled_test();
   ubuffer_conv_3_3_reduce_test();
   ubuffer_small_conv_3_3_test();
+  shared_multiplier_test();
+  critical_path_target_test();
+  shared_compute_kernel_test();
+  compiled_simulation_test();
+  batch_simulation_test();
+  simulation_profiler_test();
+  ubuffer_compiled_simulation_test();
 
   //small_conv_3_3_critical_path_test();
   //control_path_test();
@@ -352,3 +352,26 @@ void ubuffer_small_conv_3_3_test() {
   //assert(false);
 }
 
+
+void ubuffer_compiled_simulation_test() {
+  // uses the unified buffers generated by ubuffer_small_conv_3_3_test
+  auto context = hwContext();
+  system("cp ../conv_3_3/ubuffers.json .");
+  if (!loadFromFile(context, "./ubuffers.json")) {
+    cout << "Error: Could not load json for ubuffer test!" << endl;
+    context->die();
+  }
+  context->runPasses({"rungenerators", "flattentypes", "flatten", "wireclocks-coreir"});
+  CoreIR::Module* m = context->getNamespace("global")->getModule("hw_input_ubuffer");
+
+  auto ubufBuilder = [](WireNode& wd) {
+    UnifiedBuffer_new* ubufModel = new UnifiedBuffer_new();
+    return ubufModel;
+  };
+  map<std::string, SimModelBuilder> qualifiedNamesToSimPlugins{{string("lakelib.unified_buffer"), ubufBuilder}};
+
+  assert(compiledSimulationMatches(m, qualifiedNamesToSimPlugins, 64*64));
+  deleteContext(context);
+
+  cout << GREEN << "UBuffer compiled simulation test passed" << RESET << endl;
+}
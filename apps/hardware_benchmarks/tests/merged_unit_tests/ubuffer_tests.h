@@ -2,3 +2,4 @@
 
 void ubuffer_small_conv_3_3_test();
 void ubuffer_conv_3_3_reduce_test();
+void ubuffer_compiled_simulation_test();
@@ -495,6 +495,8 @@ function(_halide_runtime_target_name HALIDE_TARGET OUTVAR)
         embed_bitcode
         disable_llvm_loop_vectorize
         disable_llvm_loop_unroll
+        pool_allocator
+        perfect_hw_loops
       )
     # Synthesize a one-or-two-char abbreviation based on the feature's position
     # in the KNOWN_FEATURES list.
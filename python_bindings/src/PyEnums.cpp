@@ -142,6 +142,8 @@ void define_enums(py::module &m) {
         .value("EmbedBitcode", Target::Feature::EmbedBitcode)
         .value("DisableLLVMLoopVectorize", Target::Feature::DisableLLVMLoopVectorize)
         .value("DisableLLVMLoopUnroll", Target::Feature::DisableLLVMLoopUnroll)
+        .value("PoolAllocator", Target::Feature::PoolAllocator)
+        .value("PerfectHWLoops", Target::Feature::PerfectHWLoops)
         .value("FeatureEnd", Target::Feature::FeatureEnd);
 
     py::enum_<halide_type_code_t>(m, "TypeCode")
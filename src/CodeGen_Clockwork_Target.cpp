@@ -9,6 +9,7 @@
 #include "CoreIRCompute.h"
 #include "HWBufferUtils.h"
 #include "HWBufferSimplifications.h"
+#include "HWScheduleTargets.h"
 #include "IR.h"
 #include "IREquality.h"
 #include "IRMutator.h"
@@ -17,6 +18,7 @@
 #include "Param.h"
 #include "Simplify.h"
 #include "Substitute.h"
+#include "Util.h"
 #include "Var.h"
 
 namespace Halide {
@@ -348,9 +350,11 @@ CodeGen_Clockwork_Target::CodeGen_Clockwork_Target(const string &name, const Tar
 
 
 void print_clockwork_codegen(string appname, vector<string> xcels, ofstream& stream, bool enable_ponds);
+void print_clockwork_reference(string appname, const map<string,vector<HW_Arg>>& closure_args, ofstream& stream);
 void print_clockwork_execution_header(string appname, vector<string> xcels, ofstream& stream);
 void print_clockwork_execution_cpp(string appname, const map<string,vector<HW_Arg>>& closure_args, ofstream& stream);
 void print_combined_unoptimized_file(vector<string> xcels, ofstream& stream);
+string reference_c_expr(Expr e);
 
 CodeGen_Clockwork_Target::~CodeGen_Clockwork_Target() {
     hdr_stream << "#endif\n";
@@ -367,6 +371,7 @@ CodeGen_Clockwork_Target::~CodeGen_Clockwork_Target() {
     string clk_memory_name = output_base_path + target_name + "_memory.cpp";
     string clk_memory_header_name = output_base_path + target_name + "_memory.h";
     string clk_compute_name = output_base_path + target_name + "_compute.h";
+    string clk_reference_name = output_base_path + target_name + "_reference.cpp";
 
     //ofstream src_file(src_name.c_str());
     //ofstream hdr_file(hdr_name.c_str());
@@ -374,6 +379,7 @@ CodeGen_Clockwork_Target::~CodeGen_Clockwork_Target() {
     ofstream clk_memory_file(clk_memory_name.c_str());
     ofstream clk_memory_header_file(clk_memory_header_name.c_str());
     ofstream clk_compute_file(clk_compute_name.c_str());
+    ofstream clk_reference_file(clk_reference_name.c_str());
 
     //src_file << src_stream.str() << endl;
     //hdr_file << hdr_stream.str() << endl;
@@ -381,6 +387,10 @@ CodeGen_Clockwork_Target::~CodeGen_Clockwork_Target() {
     clk_memory_file << clkc.memory_oss.str() << endl;
     clk_memory_header_file << "prog " << target_name << "();" << std::endl;
     clk_compute_file << clkc.compute_oss.str() << endl;
+    clk_reference_file << "#include \"clockwork_reference.h\"" << endl
+                       << "#include \"" << target_name << "_compute.h\"" << endl
+                       << endl
+                       << clkc.reference_oss.str() << endl;
 
     //src_file.close();
     //hdr_file.close();
@@ -388,6 +398,7 @@ CodeGen_Clockwork_Target::~CodeGen_Clockwork_Target() {
     clk_memory_file.close();
     clk_memory_header_file.close();
     clk_compute_file.close();
+    clk_reference_file.close();
 
     saveToFile(clkc.context->getGlobal(), output_base_path + target_name + "_compute.json", NULL);
 
@@ -399,9 +410,20 @@ CodeGen_Clockwork_Target::~CodeGen_Clockwork_Target() {
     ofstream clk_exec_h_file(clk_exec_h_name.c_str());
     ofstream clk_exec_cpp_file(clk_exec_cpp_name.c_str());
 
-    print_clockwork_codegen(target_name, xcel_names, clk_codegen_file, enable_ponds);
+    // Buffers stored in ponds need pond mapping even without the target feature
+    bool use_ponds = enable_ponds;
+    for (const auto &level_pair : clkc.memory_levels) {
+      use_ponds = use_ponds || level_pair.second == MemoryType::Pond;
+    }
+    print_clockwork_codegen(target_name, xcel_names, clk_codegen_file, use_ponds);
     std::cout << "printed codegen" << std::endl;
 
+    string clk_reference_main_name = output_base_path + "clockwork_reference.cpp";
+    ofstream clk_reference_main_file(clk_reference_main_name.c_str());
+    print_clockwork_reference(target_name, closure_args, clk_reference_main_file);
+    clk_reference_main_file.close();
+    std::cout << "printed reference model" << std::endl;
+
     print_clockwork_execution_header(target_name, xcel_names, clk_exec_h_file);
     std::cout << "printed execution header" << std::endl;
 
@@ -473,8 +495,12 @@ void CodeGen_Clockwork_Target::init_module() {
 
     // initialize the clockwork compute file
     clkc.compute_stream << "#pragma once" << endl
+                        << "#ifdef CLOCKWORK_REFERENCE" << endl
+                        << "#include \"clockwork_reference.h\"" << endl
+                        << "#else" << endl
                         << "#include \"hw_classes.h\"" << endl
-                        << "#include \"clockwork_standard_compute_units.h\"" << endl << endl;
+                        << "#include \"clockwork_standard_compute_units.h\"" << endl
+                        << "#endif" << endl << endl;
 
     // initialize the clockwork memory file
     clkc.memory_stream << "#include \"app.h\"\n"
@@ -536,6 +562,14 @@ void CodeGen_Clockwork_Target::CodeGen_Clockwork_C::add_kernel(Stmt stmt,
                                                                const string &xcel_name,
                                                                const vector<HW_Arg> &args) {
 
+    // stages with a target initiation interval share their compute units
+    for (auto& targets : collect_hw_schedule_targets(stmt)) {
+      if (targets.second.initiation_interval > 1) {
+        initiation_intervals[targets.first] = targets.second.initiation_interval;
+      }
+    }
+    stmt = remove_hw_schedule_targets(stmt);
+
     if (is_clockwork) {
       //stream << "prog " << name << "() {" << std::endl;
       memory_stream << "prog " << xcel_name << "() {" << endl
@@ -545,6 +579,18 @@ void CodeGen_Clockwork_Target::CodeGen_Clockwork_C::add_kernel(Stmt stmt,
                     << std::endl;
       loop_list.emplace_back("prg");
       //mem_bodyname = "prg";
+
+      // the reference model reads and writes host buffers
+      reference_stream << "void reference_" << xcel_name << "(";
+      for (size_t i = 0; i < args.size(); i++) {
+        if (args[i].is_stencil) {
+          reference_stream << (args[i].is_output ? "" : "const ")
+                           << type_to_c_type(args[i].stencil_type.elemType) << " *"
+                           << strip_stream(printname(args[i].name)) << "_host, ";
+        }
+      }
+      reference_stream << "int num_threads) {" << endl;
+      reference_indent = 2;
     }
 
     //stream << "void " << name << "(\n";
@@ -623,6 +669,20 @@ void CodeGen_Clockwork_Target::CodeGen_Clockwork_C::add_kernel(Stmt stmt,
                   inputs.push_back(io_name);
                 }
                 add_buffer(io_name, stype.elemType.bits());
+
+                reference_line() << "reference_buffer<" << stype.elemType.bits() << "> " << io_name
+                                 << "(\"" << io_name << "\", {";
+                for (size_t j = 0; j < stype.bounds.size(); j++) {
+                  reference_stream << (j == 0 ? "" : ", ") << reference_c_expr(simplify(stype.bounds[j].min));
+                }
+                reference_stream << "}, {";
+                for (size_t j = 0; j < stype.bounds.size(); j++) {
+                  reference_stream << (j == 0 ? "" : ", ") << reference_c_expr(simplify(stype.bounds[j].extent));
+                }
+                reference_stream << "});" << endl;
+                if (!args[i].is_output) {
+                  reference_line() << io_name << ".copy_from(" << io_name << "_host);" << endl;
+                }
                 //add_buffer(io_name, 16);
                 stream << print_stencil_type(args[i].stencil_type) << " &"
                        << printname(args[i].name) << " = " << arg_name << ";\n";
@@ -639,6 +699,16 @@ void CodeGen_Clockwork_Target::CodeGen_Clockwork_C::add_kernel(Stmt stmt,
         // print body
         print(stmt);
 
+        if (is_clockwork) {
+          for (size_t i = 0; i < args.size(); i++) {
+            if (args[i].is_stencil && args[i].is_output) {
+              string io_name = strip_stream(printname(args[i].name));
+              reference_line() << io_name << ".copy_to(" << io_name << "_host);" << endl;
+            }
+          }
+          reference_stream << "}" << endl << endl;
+        }
+
         close_scope("kernel hls_target" + printname(xcel_name));
     }
     //stream << "\n";
@@ -711,6 +781,62 @@ void print_clockwork_codegen(string appname, vector<string> xcels, ofstream& str
          << "}" << endl;
 }
 
+// Main for the standalone reference model. Inputs are read from the raw files
+// that clockwork_testscript writes, in the directory given by argv[1], and
+// the outputs are written to argv[2].
+void print_clockwork_reference(string appname, const map<string,vector<HW_Arg>>& closure_map, ofstream& stream) {
+  stream << "#include \"" << appname << "_reference.cpp\"" << endl
+         << endl
+         << "int main(int argc, char **argv) {" << endl
+         << "  std::string input_dir = argc > 1 ? argv[1] : \".\";" << endl
+         << "  std::string output_dir = argc > 2 ? argv[2] : input_dir;" << endl
+         << "  int num_threads = reference_num_threads();" << endl;
+
+  for (auto& xcel_closure_pair : closure_map) {
+    auto& xcel = xcel_closure_pair.first;
+    auto& closure_args = xcel_closure_pair.second;
+
+    stream << endl
+           << "  { // " << xcel << endl;
+    vector<string> call_args;
+    for (auto& arg : closure_args) {
+      if (!arg.is_stencil) { continue; }
+      string buffer_name = strip_stream(printname(arg.name));
+      string extension = arg.stencil_type.elemType.bits() == 8 ? ".raw" : ".leraw";
+      string filename = printname(arg.name) + extension;
+      int size = 1;
+      for (auto& bound : arg.stencil_type.bounds) {
+        size *= to_int(bound.extent);
+      }
+
+      stream << "    std::vector<" << type_to_c_type(arg.stencil_type.elemType) << "> "
+             << buffer_name << "(" << size << ");" << endl;
+      if (!arg.is_output) {
+        stream << "    if (!reference_read_raw(input_dir + \"/" << filename << "\", "
+               << buffer_name << ")) { return 1; }" << endl;
+      }
+      call_args.emplace_back(buffer_name + ".data()");
+    }
+
+    stream << "    reference_" << xcel << "(";
+    for (auto& call_arg : call_args) {
+      stream << call_arg << ", ";
+    }
+    stream << "num_threads);" << endl;
+
+    for (auto& arg : closure_args) {
+      if (!arg.is_stencil || !arg.is_output) { continue; }
+      string extension = arg.stencil_type.elemType.bits() == 8 ? ".raw" : ".leraw";
+      stream << "    if (!reference_write_raw(output_dir + \"/" << printname(arg.name) << extension << "\", "
+             << strip_stream(printname(arg.name)) << ")) { return 1; }" << endl;
+    }
+    stream << "  }" << endl;
+  }
+
+  stream << "  return 0;" << endl
+         << "}" << endl;
+}
+
 void print_clockwork_execution_header(string appname, vector<string> xcels, ofstream& stream) {
   stream << "#ifndef RDAI_CLOCKWORK_WRAPPER\n"
          << "#define RDAI_CLOCKWORK_WRAPPER\n"
@@ -1555,6 +1681,57 @@ string return_c_stmt(Stmt s) {
   return arg_print.str();
 }
 
+// C++ for an expression evaluated in place by the reference model.
+// Expressions that need temporaries are wrapped in a lambda.
+string reference_c_expr(Expr e) {
+  string body = return_c_expr(e);
+  size_t ret = body.find("return ");
+  if (ret != string::npos && body.find(';') + 1 == body.size()) {
+    return body.substr(ret + 7, body.size() - ret - 8);
+  } else {
+    return "[&]() {\n" + body + "\n}()";
+  }
+}
+
+// Iterations of the outermost loop of a nest can run on separate threads
+// when each one stores to its own slice of every buffer written in the
+// nest, and only reads back from that slice.
+bool is_parallel_nest(const string& loopname,
+                      const map<string, vector<vector<Expr>>>& stores,
+                      const map<string, vector<vector<Expr>>>& loads) {
+  Expr loopvar = Variable::make(Int(32), loopname);
+  for (auto& store_pair : stores) {
+    vector<vector<Expr>> accesses = store_pair.second;
+    if (loads.count(store_pair.first) > 0) {
+      auto& buffer_loads = loads.at(store_pair.first);
+      accesses.insert(accesses.end(), buffer_loads.begin(), buffer_loads.end());
+    }
+
+    size_t num_dims = accesses[0].size();
+    bool found_slice = false;
+    for (size_t dim = 0; dim < num_dims && !found_slice; ++dim) {
+      Expr slice_offset;
+      found_slice = true;
+      for (auto& access : accesses) {
+        if (access.size() != num_dims) {
+          return false;
+        }
+        Expr offset = simplify(access[dim] - loopvar);
+        if (!is_const(offset) || (slice_offset.defined() && !equal(offset, slice_offset))) {
+          found_slice = false;
+          break;
+        }
+        slice_offset = offset;
+      }
+    }
+
+    if (!found_slice) {
+      return false;
+    }
+  }
+  return true;
+}
+
 string rom_to_c(ROM_data rom) {
   auto produce = ProducerConsumer::make_produce(rom.name, rom.produce);
   if (const Realize* rom_r = rom.stmt.as<Realize>()) {
@@ -1602,6 +1779,14 @@ void CodeGen_Clockwork_Target::CodeGen_Clockwork_C::visit(const Provide *op) {
   // Find what the interface of this Provide is by using a closure
   CoreIR_Interface iface;
   iface.name = func_name;
+
+  // Kernels that only need an output every few cycles share their units.
+  // Provides are named after their function, as in func.stencil.
+  for (auto& ii : initiation_intervals) {
+    if (op->name == ii.first || starts_with(op->name, ii.first + ".")) {
+      iface.share_cycles = ii.second;
+    }
+  }
   set<string> rom_set;
   for (auto rom_pair : roms) {
     rom_set.emplace(rom_pair.first);
@@ -1615,6 +1800,12 @@ void CodeGen_Clockwork_Target::CodeGen_Clockwork_C::visit(const Provide *op) {
     string buffer_name = printname(arg.bufname);
     add_buffer(buffer_name, arg.type.bits());
 
+    vector<Expr> load_args;
+    for (auto index : arg.args) {
+      load_args.emplace_back(simplify(expand_expr(index, scope)));
+    }
+    reference_nest.loads[buffer_name].emplace_back(load_args);
+
     if (arg.is_dynamic) { //(contains_call(arg.args)) {
       memory_stream << "  " << func_name << "->add_dynamic_load(\""
                     << buffer_name << "\"";
@@ -1642,8 +1833,15 @@ void CodeGen_Clockwork_Target::CodeGen_Clockwork_C::visit(const Provide *op) {
   uint store_size = op->values[0].type().bits();
   add_buffer(printname(op->name), store_size);
 
+  vector<Expr> store_args;
+  for (auto arg : op->args) {
+    store_args.emplace_back(simplify(expand_expr(arg, scope)));
+  }
+  reference_nest.stores[printname(op->name)].emplace_back(store_args);
+
   vector<bool> dynamic_stores_found;
   if (contains_call(op->args, dynamic_stores_found)) {
+    reference_nest.has_dynamic_store = true;
     memory_stream << "  " << func_name << "->add_dynamic_store(\""
                   << printname(op->name) << "\"";
     std::cout << "  " << func_name << "->add_dynamic_load(\""
@@ -1741,9 +1939,16 @@ void CodeGen_Clockwork_Target::CodeGen_Clockwork_C::visit(const Provide *op) {
   auto found_roms = contains_call(new_expr, rom_set);
   vector<CoreIR_Inst_Args> coreir_insts;
   output_roms(found_roms, roms, compute_stream, coreir_insts, context);
+  int compute_latency = iface.share_cycles - 1;
   if (found_roms.size() > 0) {
     memory_stream << "  //" << func_name << "->index_variable_prefetch_cycle(1);" << std::endl;
-    memory_stream << "  " << func_name << "->add_latency(1);" << std::endl;
+    compute_latency += 1;
+  }
+  if (compute_latency > 0) {
+    memory_stream << "  " << func_name << "->add_latency(" << compute_latency << ");" << std::endl;
+  }
+  if (iface.share_cycles > 1) {
+    memory_stream << "  //" << func_name << " issues at most once every " << iface.share_cycles << " cycles" << std::endl;
   }
 
   // Output the c expr to the compute
@@ -1754,6 +1959,49 @@ void CodeGen_Clockwork_Target::CodeGen_Clockwork_C::visit(const Provide *op) {
   // Output the compute to a coreir module
   convert_compute_to_coreir(new_expr, iface, coreir_insts, context);
 
+  // Output the loads, compute and store to the reference model
+  reference_line() << "{ // " << func_name << endl;
+  reference_indent += 2;
+  vector<string> reference_args;
+  for (size_t i=0; i<arg_order.size(); ++i) {
+    auto& arg_components = merged_args[arg_order[i]];
+    string arg_var = "_arg" + std::to_string(i);
+
+    uint total_bitwidth = 0;
+    bool is_dynamic = false;
+    for (auto arg : arg_components) {
+      total_bitwidth += arg.type.bits();
+      is_dynamic = is_dynamic || arg.is_dynamic;
+    }
+    if (is_dynamic) {
+      reference_line() << "hw_uint<64> " << arg_var << "_ignore;" << endl;
+      reference_args.emplace_back(arg_var + "_ignore");
+    }
+
+    reference_line() << "hw_uint<" << total_bitwidth << "> " << arg_var << " = reference_pack<"
+                     << total_bitwidth << ", " << arg_components[0].type.bits() << ">({";
+    for (size_t j=0; j<arg_components.size(); ++j) {
+      reference_stream << (j == 0 ? "" : ", ") << reference_c_expr(arg_components[j].call);
+    }
+    reference_stream << "});" << endl;
+    reference_args.emplace_back(arg_var);
+  }
+  for (auto loopname_pair : loopname_map) {
+    reference_args.emplace_back(CodeGen_C::print_name(loopname_pair.first));
+  }
+
+  reference_line() << printname(op->name);
+  for (auto arg : store_args) {
+    reference_stream << "[" << reference_c_expr(arg) << "]";
+  }
+  reference_stream << " = " << func_name << "(";
+  for (size_t i=0; i<reference_args.size(); ++i) {
+    reference_stream << (i == 0 ? "" : ", ") << reference_args[i];
+  }
+  reference_stream << ");" << endl;
+  reference_indent -= 2;
+  reference_line() << "}" << endl;
+
   CodeGen_Clockwork_Base::visit(op);
 }
 
@@ -1769,6 +2017,11 @@ void CodeGen_Clockwork_Target::CodeGen_Clockwork_C::add_buffer(const string& buf
   }
 }
 
+std::ostream& CodeGen_Clockwork_Target::CodeGen_Clockwork_C::reference_line() {
+  reference_stream << string(reference_indent, ' ');
+  return reference_stream;
+}
+
 void CodeGen_Clockwork_Target::CodeGen_Clockwork_C::visit(const ProducerConsumer *op) {
   if (op->is_producer) {
     memory_stream << "////producing " << op->name << endl;
@@ -1833,6 +2086,25 @@ void CodeGen_Clockwork_Target::CodeGen_Clockwork_C::visit(const For *op) {
     //loops.emplace(op->name);
     loops.emplace(loopname);
 
+    // Top-level loop nests of the reference model are lambdas, so that the
+    // outermost loop can be split into tiles run by separate threads
+    Expr reference_min = is_const(op->min) ? op->min : Expr(0);
+    Expr reference_max = is_const(op->min) ? op->min + op->extent : op->extent;
+    string reference_min_str = reference_c_expr(simplify(expand_expr(reference_min, scope)));
+    string reference_max_str = reference_c_expr(simplify(expand_expr(reference_max, scope)));
+    string reference_loop = CodeGen_C::print_name(loopname);
+    bool is_top_level = bodyname == "prg";
+    if (is_top_level) {
+      reference_nest = ReferenceNest();
+      reference_nest.loop = loopname;
+      reference_line() << "auto " << reference_loop << "_body = [&](int " << reference_loop << ") {\n";
+    } else {
+      reference_line() << "for (int " << reference_loop << " = " << reference_min_str << "; "
+                       << reference_loop << " < " << reference_max_str << "; "
+                       << reference_loop << "++) {\n";
+    }
+    reference_indent += 2;
+
     //string loopname = printname(op->name);
     //add_loop(op);
 
@@ -1851,6 +2123,17 @@ void CodeGen_Clockwork_Target::CodeGen_Clockwork_C::visit(const For *op) {
     loop_list.pop_back();
     //mem_bodyname = bodyname;
 
+    reference_indent -= 2;
+    if (is_top_level) {
+      bool is_parallel = !reference_nest.has_dynamic_store &&
+        is_parallel_nest(loopname, reference_nest.stores, reference_nest.loads);
+      reference_line() << "};\n";
+      reference_line() << "reference_for(" << reference_min_str << ", " << reference_max_str << ", "
+                       << (is_parallel ? "num_threads" : "1") << ", " << reference_loop << "_body);\n";
+    } else {
+      reference_line() << "}\n";
+    }
+
     close_scope("for " + printname(op->name));
 }
 
@@ -1933,6 +2216,23 @@ void CodeGen_Clockwork_Target::CodeGen_Clockwork_C::visit(const Realize *op) {
   }
   auto new_body = shift_realize_bounds(op->body, op->name, realize_mins, scope);
 
+  if (op->memory_type != MemoryType::Auto) {
+    memory_levels[printname(op->name)] = op->memory_type;
+    memory_stream << "  // " << printname(op->name) << " is stored in " << op->memory_type << endl;
+  }
+
+  reference_line() << "reference_buffer<" << op->types[0].bits() << "> " << printname(op->name)
+                   << "(\"" << printname(op->name) << "\", {";
+  for (size_t i = 0; i < op->bounds.size(); i++) {
+    reference_stream << (i == 0 ? "0" : ", 0");
+  }
+  reference_stream << "}, {";
+  for (size_t i = 0; i < op->bounds.size(); i++) {
+    reference_stream << (i == 0 ? "" : ", ")
+                     << reference_c_expr(simplify(expand_expr(op->bounds[i].extent, scope)));
+  }
+  reference_stream << "});" << endl;
+
   for (size_t i = 0; i < op->bounds.size(); i++) {
     stream << "[";
     //print(op->bounds[i].min);
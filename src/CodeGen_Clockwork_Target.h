@@ -74,17 +74,32 @@ protected:
       std::vector<std::string> inputs; // inputs to the function
       std::string output;
 
+      /** Accesses in the current top-level loop nest of the reference model,
+       * used to decide if its iterations can run in parallel */
+      struct ReferenceNest {
+        std::string loop;
+        std::map<std::string, std::vector<std::vector<Expr>>> stores;
+        std::map<std::string, std::vector<std::vector<Expr>>> loads;
+        bool has_dynamic_store = false;
+      };
+      ReferenceNest reference_nest;
+
       /** The stream we're outputting the memory on */
       std::ostringstream memory_oss;
       std::ostream& memory_stream;
       /** The stream we're outputting the compute on */
       std::ostringstream compute_oss;
       std::ostream& compute_stream;
+      /** The stream we're outputting the standalone reference model on */
+      std::ostringstream reference_oss;
+      std::ostream& reference_stream;
+      int reference_indent;
       
       CoreIR::Context* context;
       
       CodeGen_Clockwork_C(std::ostream &s, Target target, OutputKind output_kind) :
-        CodeGen_Clockwork_Base(s, target, output_kind), is_clockwork(false), memory_stream(memory_oss), compute_stream(compute_oss) { }
+        CodeGen_Clockwork_Base(s, target, output_kind), is_clockwork(false), memory_stream(memory_oss), compute_stream(compute_oss),
+        reference_stream(reference_oss), reference_indent(2) { }
         //CodeGen_Clockwork_Base(s, target, output_kind), is_clockwork(false), memory_stream(std::cout), compute_stream(compute_oss) { }
         //CodeGen_Clockwork_Base(s, target, output_kind), is_clockwork(false), memory_stream(memory_oss), compute_stream(std::cout) { }
         //CodeGen_Clockwork_Base(s, target, output_kind), is_clockwork(false), memory_stream(std::cout), compute_stream(std::cout) { }
@@ -92,6 +107,12 @@ protected:
       void set_output_path(std::string pathname) {
         output_base_path = pathname;
       }
+
+      /** Buffers placed in a memory level with Func::store_in */
+      std::map<std::string, MemoryType> memory_levels;
+
+      /** Initiation intervals set with Func::hw_initiation_interval, by function */
+      std::map<std::string, int> initiation_intervals;
   
       void add_kernel(Stmt stmt,
                       const std::string &name,
@@ -103,6 +124,7 @@ protected:
       std::string print_stencil_pragma(const std::string &name);
       std::string output_base_path;
       void add_buffer(const std::string& buffer_name, int width);
+      std::ostream& reference_line();
         
       using CodeGen_Clockwork_Base::visit;
 
@@ -18,6 +18,8 @@
 #include "Simplify.h"
 #include "Debug.h"
 #include "Float16.h"
+#include "Bounds.h"
+#include "HWBitwidth.h"
 #include "IRPrinter.h"
 
 #include "coreir/libs/commonlib.h"
@@ -949,11 +951,27 @@ class NestExtractor : public IRGraphVisitor {
 class HWLoopSchedule {
   public:
     vector<HWInstr*> body;
-    //int II;
+    int II;
 
     std::map<HWInstr*, int> endStages;
     std::map<HWInstr*, int> startStages;
 
+    // Index of the functional unit each instruction is bound to,
+    // among the units of the same operation type
+    std::map<HWInstr*, int> unitAssignment;
+
+    HWLoopSchedule() : II(1) {}
+
+    int numUnits(const std::string& opName) const {
+      int nUnits = 0;
+      for (auto u : unitAssignment) {
+        if (u.first->name == opName && u.second >= nUnits) {
+          nUnits = u.second + 1;
+        }
+      }
+      return nUnits;
+    }
+
     void print() {
       cout << "Schedule" << endl;
       for (int i = 0; i < numStages(); i++) {
@@ -1053,6 +1071,8 @@ class InstructionCollector : public IRGraphVisitor {
 
     std::vector<LoopSpec> activeLoops;
     Scope<std::vector<std::string> > activeRealizations;
+    // ranges of the loop variables and lets, used to size functional units
+    Scope<Interval> ranges;
     
     InstructionCollector() : lastValue(nullptr), currentPredicate(nullptr), activeBlock(nullptr) {}
 
@@ -1082,6 +1102,7 @@ class InstructionCollector : public IRGraphVisitor {
     void visit(const For* lp) override {
 
       activeLoops.push_back({lp->name, lp->min, lp->extent});
+      ranges.push(lp->name, Interval(lp->min, simplify(lp->min + lp->extent - 1)));
       //auto toLoop = newBr();
       //auto fromLoop = newBr();
       
@@ -1093,6 +1114,7 @@ class InstructionCollector : public IRGraphVisitor {
      
       //pushInstr(fromLoop);
       
+      ranges.pop(lp->name);
       activeLoops.pop_back();
       //auto nextBlk = f.newBlk();
       
@@ -1230,24 +1252,36 @@ class InstructionCollector : public IRGraphVisitor {
     }
 
 
+    // Size the functional unit of the last instruction to the values it
+    // computes. Comparisons, min and max are built from signed units, so
+    // unsigned operands need an extra sign bit.
+    void setUnitWidth(const Expr& e, bool addSignBit = false) {
+      int width = datapath_bitwidth(e, ranges) + (addSignBit ? 1 : 0);
+      lastValue->unitWidth = std::min(16, width);
+    }
+
     void visit(const GE* a) override {
       visit_binop("gte", a->a, a->b);
       lastValue->resType = f.mod->getContext()->Bit();
+      setUnitWidth(a, a->a.type().is_uint());
     }
 
     void visit(const LE* a) override {
       visit_binop("lte", a->a, a->b);
       lastValue->resType = f.mod->getContext()->Bit();
+      setUnitWidth(a, a->a.type().is_uint());
     }
     
     void visit(const LT* a) override {
       visit_binop("lt", a->a, a->b);
       lastValue->resType = f.mod->getContext()->Bit();
+      setUnitWidth(a, a->a.type().is_uint());
     }
 
     void visit(const GT* a) override {
       visit_binop("gt", a->a, a->b);
       lastValue->resType = f.mod->getContext()->Bit();
+      setUnitWidth(a, a->a.type().is_uint());
     }
     
     void visit(const And* a) override {
@@ -1273,6 +1307,8 @@ class InstructionCollector : public IRGraphVisitor {
       lastValue = ist;
       internal_assert(tv->resType != nullptr) << *tv << " has null result type\n";
       lastValue->resType = tv->resType;
+      lastValue->setSigned(!(sel->type.is_uint()));
+      setUnitWidth(sel);
       pushInstr(lastValue);
       //instrs.push_back(lastValue);
     }
@@ -1299,7 +1335,9 @@ class InstructionCollector : public IRGraphVisitor {
 
       vars[l->name] = ev;
 
+      ranges.push(l->name, bounds_of_expr_in_scope(l->value, ranges));
       l->body->accept(this);
+      ranges.pop(l->name);
       //IRGraphVisitor::visit(l->body);
       //auto lv = codegen(l->body);
       //internal_assert(lv) << "let body did not produce a value\n";
@@ -1314,7 +1352,9 @@ class InstructionCollector : public IRGraphVisitor {
 
       vars[l->name] = ev;
 
+      ranges.push(l->name, bounds_of_expr_in_scope(l->value, ranges));
       auto lv = codegen(l->body);
+      ranges.pop(l->name);
       internal_assert(lv) << "let body did not produce a value\n";
       lastValue = lv;
 
@@ -1361,52 +1401,61 @@ class InstructionCollector : public IRGraphVisitor {
       visit_binop("min", m->a, m->b);
       lastValue->setSigned(!(m->type.is_uint()));
       lastValue->resType = f.mod->getContext()->Bit()->Arr(16);
+      setUnitWidth(m, m->type.is_uint());
     }
     
     void visit(const Max* m) override {
       visit_binop("max", m->a, m->b);
       lastValue->setSigned(!(m->type.is_uint()));
       lastValue->resType = f.mod->getContext()->Bit()->Arr(16);
+      setUnitWidth(m, m->type.is_uint());
     }
 
     void visit(const Mod* d) override {
       visit_binop("mod", d->a, d->b);
       lastValue->setSigned(!(d->type.is_uint()));
       lastValue->resType = f.mod->getContext()->Bit()->Arr(16);
+      setUnitWidth(d);
     }
 
     void visit(const Div* d) override {
       visit_binop("div", d->a, d->b);
       lastValue->setSigned(!(d->type.is_uint()));
       lastValue->resType = f.mod->getContext()->Bit()->Arr(16);
+      setUnitWidth(d);
     }
 
     void visit(const Add* a) override {
       visit_binop("add", a->a, a->b);
       lastValue->setSigned(!(a->type.is_uint()));
       lastValue->resType = f.mod->getContext()->Bit()->Arr(16);
+      setUnitWidth(a);
     }
 
     void visit(const EQ* a) override {
       visit_binop("eq", a->a, a->b);
       lastValue->resType = f.mod->getContext()->Bit();
+      setUnitWidth(a);
     }
     
     void visit(const NE* a) override {
       visit_binop("neq", a->a, a->b);
       lastValue->resType = f.mod->getContext()->Bit();
+      setUnitWidth(a);
     }
     
     void visit(const Mul* b) override {
       visit_binop("mul", b->a, b->b);
       lastValue->setSigned(!(b->type.is_uint()));
       lastValue->resType = f.mod->getContext()->Bit()->Arr(16);
+      setUnitWidth(b);
     }
 
     void visit(const Sub* b) override {
       visit_binop("sub", b->a, b->b);
       lastValue->setSigned(!(b->type.is_uint()));
       lastValue->resType = f.mod->getContext()->Bit()->Arr(16);
+      setUnitWidth(b);
     }
 
     HWInstr* andHW(HWInstr* a, HWInstr* b) {
@@ -1925,11 +1974,22 @@ class UnitMapping {
     std::map<HWInstr*, CoreIR::Wireable*> instrValues;
     std::map<HWInstr*, vector<int> > stencilRanges;
     std::map<HWInstr*, CoreIR::Instance*> unitMapping;
+    // 16 bit operand ports of the units built narrower than their operands
+    std::map<CoreIR::Instance*, std::map<std::string, CoreIR::Wireable*> > narrowedInputs;
 
     std::map<HWInstr*, std::map<int, CoreIR::Instance*> > pipelineRegisters;
 
+    // Units shared by several instructions, with the value driven onto each
+    // operand port in each cycle of the initiation interval
+    std::map<CoreIR::Instance*, std::map<std::string, std::map<int, CoreIR::Wireable*> > > sharedOperands;
+    std::map<CoreIR::Instance*, int> sharedII;
+
     std::vector<HWInstr*> body;
 
+    bool isShared(CoreIR::Instance* unit) const {
+      return contains_key(unit, sharedOperands);
+    }
+
     int getEndTime(HWInstr* instr) {
       return fSched.getEndTime(instr);
     }
@@ -1945,6 +2005,13 @@ class UnitMapping {
       }
     }
 
+    CoreIR::Wireable* operandPort(CoreIR::Instance* unit, const std::string& port) {
+      if (contains_key(unit, narrowedInputs) && contains_key(port, narrowedInputs[unit])) {
+        return narrowedInputs[unit][port];
+      }
+      return unit->sel(port);
+    }
+
     CoreIR::Wireable* valueAtStart(HWInstr* const arg1, HWInstr* const sourceLocation) {
       internal_assert(contains_key(arg1, hwStartValues)) << *arg1 << " is not in hwStartValues when getting its value at: " << *sourceLocation << "\n";
       internal_assert(contains_key(sourceLocation, map_get(arg1, hwStartValues))) << *sourceLocation << " is not in hwStartValues[" << *arg1 << "]\n";
@@ -1969,6 +2036,71 @@ CoreIR::Instance* pipelineRegister(CoreIR::Context* context, CoreIR::ModuleDef*
   return r;
 }
 
+bool isComparisonUnit(const std::string& name) {
+  vector<string> comparisons = {"eq", "neq", "lt", "gt", "lte", "gte"};
+  return CoreIR::elem(name, comparisons);
+}
+
+// Binary operations whose units the modulo schedule can share between
+// instructions that start in different cycles of the initiation interval
+bool isShareableUnit(const std::string& name) {
+  vector<string> shareable = {"add", "sub", "mul", "min", "max", "and_bv", "absd", "eq", "neq", "lt", "gt", "lte", "gte"};
+  return CoreIR::elem(name, shareable);
+}
+
+int sharedUnitLimit(const HardwareInfo& hwInfo, const std::string& name) {
+  return isShareableUnit(name) ? hwInfo.unitLimit(name) : 0;
+}
+
+bool isNarrowableUnit(const std::string& name) {
+  vector<string> narrowable = {"add", "and_bv", "mul", "sub", "max", "min", "sel", "ashr", "lshr"};
+  return isComparisonUnit(name) || CoreIR::elem(name, narrowable);
+}
+
+// Connect the 16 bit operands of a unit built narrower than them through
+// slices of their low bits, and extend its result back to 16 bits
+void narrowFunctionalUnit(UnitMapping& m, ModuleDef* def, HWInstr* instr) {
+  auto context = def->getContext();
+  auto unit = CoreIR::map_find(instr, m.unitMapping);
+  int width = instr->unitWidth;
+  for (auto port : {"in0", "in1"}) {
+    auto slice = def->addInstance(unit->getInstname() + "_" + port + "_slice", "coreir.slice",
+        {{"width", COREMK(context, 16)}, {"lo", COREMK(context, 0)}, {"hi", COREMK(context, width)}});
+    def->connect(slice->sel("out"), unit->sel(port));
+    m.narrowedInputs[unit][port] = slice->sel("in");
+  }
+
+  // Comparisons produce a single bit
+  if (!isComparisonUnit(instr->name)) {
+    auto ext = def->addInstance(unit->getInstname() + "_ext", instr->isSigned() ? "coreir.sext" : "coreir.zext",
+        {{"width_in", COREMK(context, width)}, {"width_out", COREMK(context, 16)}});
+    def->connect(unit->sel("out"), ext->sel("in"));
+    m.instrValues[instr] = ext->sel("out");
+  }
+}
+
+// Maps each instruction the modulo schedule bound to a unit that an earlier
+// instruction of its block is also bound to, to that earlier instruction
+std::map<HWInstr*, HWInstr*> sharedUnitOwners(FunctionSchedule& sched) {
+  std::map<HWInstr*, HWInstr*> owners;
+  for (auto& blk : sched.blockSchedules) {
+    HWLoopSchedule& s = blk.second;
+    std::map<std::pair<string, int>, HWInstr*> units;
+    for (auto instr : s.body) {
+      if (!isShareableUnit(instr->name) || !contains_key(instr, s.unitAssignment)) {
+        continue;
+      }
+      auto unit = std::make_pair(instr->name, map_get(instr, s.unitAssignment));
+      if (contains_key(unit, units)) {
+        owners[instr] = map_get(unit, units);
+      } else {
+        units[unit] = instr;
+      }
+    }
+  }
+  return owners;
+}
+
 void createFunctionalUnitsForOperations(StencilInfo& info, UnitMapping& m, FunctionSchedule& sched, ModuleDef* def, CoreIR::Instance* controlPath) {
   auto context = def->getContext();
   int defStage = 0;
@@ -1976,21 +2108,34 @@ void createFunctionalUnitsForOperations(StencilInfo& info, UnitMapping& m, Funct
   auto& instrValues = m.instrValues;
   auto& stencilRanges = m.stencilRanges;
 
+  // Shared units are built at full width, since the values of their
+  // instructions can have different ranges and signs
+  auto owners = sharedUnitOwners(sched);
+  for (auto shared : owners) {
+    shared.first->unitWidth = 16;
+    shared.second->unitWidth = 16;
+  }
+
   for (auto instr : sched.body()) {
+    if (contains_key(instr, owners)) {
+      defStage++;
+      continue;
+    }
+
     if (instr->tp == HWINSTR_TP_INSTR) {
       string name = instr->name;
       //cout << "Creating unit for " << *instr << endl;
       if (name == "add") {
-        auto adder = def->addInstance("add_" + std::to_string(defStage), "coreir.add", {{"width", CoreIR::Const::make(context, 16)}});
+        auto adder = def->addInstance("add_" + std::to_string(defStage), "coreir.add", {{"width", CoreIR::Const::make(context, instr->unitWidth)}});
         instrValues[instr] = adder->sel("out");
         unitMapping[instr] = adder;
       } else if (name == "and_bv") {
-        auto adder = def->addInstance("and_bv_" + std::to_string(defStage), "coreir.and", {{"width", CoreIR::Const::make(context, 16)}});
+        auto adder = def->addInstance("and_bv_" + std::to_string(defStage), "coreir.and", {{"width", CoreIR::Const::make(context, instr->unitWidth)}});
         instrValues[instr] = adder->sel("out");
         unitMapping[instr] = adder;
 
       } else if (name == "mul") {
-        auto mul = def->addInstance("mul_" + std::to_string(defStage), "coreir.mul", {{"width", CoreIR::Const::make(context, 16)}});
+        auto mul = def->addInstance("mul_" + std::to_string(defStage), "coreir.mul", {{"width", CoreIR::Const::make(context, instr->unitWidth)}});
         instrValues[instr] = mul->sel("out");
         unitMapping[instr] = mul;
       } else if (name == "abs") {
@@ -2006,7 +2151,7 @@ void createFunctionalUnitsForOperations(StencilInfo& info, UnitMapping& m, Funct
         instrValues[instr] = mul->sel("out");
         unitMapping[instr] = mul;
       } else if (name == "sub") {
-        auto mul = def->addInstance("sub_" + std::to_string(defStage), "coreir.sub", {{"width", CoreIR::Const::make(context, 16)}});
+        auto mul = def->addInstance("sub_" + std::to_string(defStage), "coreir.sub", {{"width", CoreIR::Const::make(context, instr->unitWidth)}});
         instrValues[instr] = mul->sel("out");
         unitMapping[instr] = mul;
       } else if (name == "div") {
@@ -2014,32 +2159,32 @@ void createFunctionalUnitsForOperations(StencilInfo& info, UnitMapping& m, Funct
         instrValues[instr] = mul->sel("out");
         unitMapping[instr] = mul;
       } else if (name == "max") {
-        auto mul = def->addInstance("max_" + std::to_string(defStage), "commonlib.smax", {{"width", CoreIR::Const::make(context, 16)}});
+        auto mul = def->addInstance("max_" + std::to_string(defStage), "commonlib.smax", {{"width", CoreIR::Const::make(context, instr->unitWidth)}});
         instrValues[instr] = mul->sel("out");
         unitMapping[instr] = mul;
       } else if (name == "min") {
-        auto mul = def->addInstance("min_" + std::to_string(defStage), "commonlib.smin", {{"width", CoreIR::Const::make(context, 16)}});
+        auto mul = def->addInstance("min_" + std::to_string(defStage), "commonlib.smin", {{"width", CoreIR::Const::make(context, instr->unitWidth)}});
         instrValues[instr] = mul->sel("out");
         unitMapping[instr] = mul;
       } else if (name == "eq") {
-        auto mul = def->addInstance("eq" + std::to_string(defStage), "coreir.eq", {{"width", CoreIR::Const::make(context, 16)}});
+        auto mul = def->addInstance("eq" + std::to_string(defStage), "coreir.eq", {{"width", CoreIR::Const::make(context, instr->unitWidth)}});
         instrValues[instr] = mul->sel("out");
         unitMapping[instr] = mul;
       } else if (name == "neq") {
-        auto mul = def->addInstance("neq" + std::to_string(defStage), "coreir.neq", {{"width", CoreIR::Const::make(context, 16)}});
+        auto mul = def->addInstance("neq" + std::to_string(defStage), "coreir.neq", {{"width", CoreIR::Const::make(context, instr->unitWidth)}});
         instrValues[instr] = mul->sel("out");
         unitMapping[instr] = mul;
 
       } else if (name == "lt") {
-        auto mul = def->addInstance("lt_" + std::to_string(defStage), "coreir.slt", {{"width", CoreIR::Const::make(context, 16)}});
+        auto mul = def->addInstance("lt_" + std::to_string(defStage), "coreir.slt", {{"width", CoreIR::Const::make(context, instr->unitWidth)}});
         instrValues[instr] = mul->sel("out");
         unitMapping[instr] = mul;
       } else if (name == "gt") {
-        auto mul = def->addInstance("gt_" + std::to_string(defStage), "coreir.sgt", {{"width", CoreIR::Const::make(context, 16)}});
+        auto mul = def->addInstance("gt_" + std::to_string(defStage), "coreir.sgt", {{"width", CoreIR::Const::make(context, instr->unitWidth)}});
         instrValues[instr] = mul->sel("out");
         unitMapping[instr] = mul;
       } else if (name == "lte") {
-        auto mul = def->addInstance("lte_" + std::to_string(defStage), "coreir.sle", {{"width", CoreIR::Const::make(context, 16)}});
+        auto mul = def->addInstance("lte_" + std::to_string(defStage), "coreir.sle", {{"width", CoreIR::Const::make(context, instr->unitWidth)}});
         instrValues[instr] = mul->sel("out");
         unitMapping[instr] = mul;
       } else if (name == "and") {
@@ -2047,7 +2192,7 @@ void createFunctionalUnitsForOperations(StencilInfo& info, UnitMapping& m, Funct
         instrValues[instr] = mul->sel("out");
         unitMapping[instr] = mul;
       } else if (name == "sel") {
-        auto sel = def->addInstance("sel_" + std::to_string(defStage), "coreir.mux", {{"width", CoreIR::Const::make(context, 16)}});
+        auto sel = def->addInstance("sel_" + std::to_string(defStage), "coreir.mux", {{"width", CoreIR::Const::make(context, instr->unitWidth)}});
         instrValues[instr] = sel->sel("out");
         unitMapping[instr] = sel;
       } else if (name == "cast") {
@@ -2215,11 +2360,11 @@ void createFunctionalUnitsForOperations(StencilInfo& info, UnitMapping& m, Funct
           unitMapping[instr] = cS;
         }
       } else if (name == "ashr") {
-        auto shr = def->addInstance("ashr" + std::to_string(defStage), "coreir.ashr", {{"width", CoreIR::Const::make(context, 16)}});
+        auto shr = def->addInstance("ashr" + std::to_string(defStage), "coreir.ashr", {{"width", CoreIR::Const::make(context, instr->unitWidth)}});
         instrValues[instr] = shr->sel("out");
         unitMapping[instr] = shr;
       } else if (name == "lshr") {
-        auto shr = def->addInstance("lshr" + std::to_string(defStage), "coreir.lshr", {{"width", CoreIR::Const::make(context, 16)}});
+        auto shr = def->addInstance("lshr" + std::to_string(defStage), "coreir.lshr", {{"width", CoreIR::Const::make(context, instr->unitWidth)}});
         instrValues[instr] = shr->sel("out");
         unitMapping[instr] = shr;
       } else if (name == "load") {
@@ -2253,11 +2398,24 @@ void createFunctionalUnitsForOperations(StencilInfo& info, UnitMapping& m, Funct
       } else {
         internal_assert(false) << "no functional unit generation code for " << *instr << "\n";
       }
+
+      if (instr->unitWidth < 16 && isNarrowableUnit(name)) {
+        narrowFunctionalUnit(m, def, instr);
+      }
     }
 
     defStage++;
   }
 
+  for (auto shared : owners) {
+    HWInstr* instr = shared.first;
+    CoreIR::Instance* unit = map_get(shared.second, unitMapping);
+    unitMapping[instr] = unit;
+    instrValues[instr] = map_get(shared.second, instrValues);
+    m.sharedOperands[unit] = {};
+    m.sharedII[unit] = sched.getContainerBlock(instr).II;
+  }
+
   // Constants and pre-bound instructions / variables
   // are always bound to the same wire
   //
@@ -2507,6 +2665,69 @@ Expr startTime(HWInstr* instr, FunctionSchedule& sched) {
   return cs + bd + sched.getStartStage(instr);
 }
 
+// Cycle of the initiation interval the kernel is in: zero in the cycle an
+// iteration issues (in_en is high), counting up to II - 1 after it. Issues
+// must be II cycles apart while earlier iterations are still in flight.
+CoreIR::Wireable* issuePhase(CoreIR::ModuleDef* def, const int II) {
+  auto context = def->getContext();
+  int width = 1;
+  while ((1 << width) < II) {
+    width++;
+  }
+
+  string name = "issue_phase_" + std::to_string(II);
+  auto zero = mkConst(def, name + "_zero", width, 0);
+  auto phaseReg = def->addInstance(name + "_reg", "coreir.reg", {{"width", COREMK(context, width)}});
+  auto phase = def->addInstance(name, "coreir.mux", {{"width", COREMK(context, width)}});
+  def->connect(phase->sel("in0"), phaseReg->sel("out"));
+  def->connect(phase->sel("in1"), zero->sel("out"));
+  def->connect(phase->sel("sel"), def->sel("self")->sel("in_en"));
+
+  auto inc = def->addInstance(name + "_inc", "coreir.add", {{"width", COREMK(context, width)}});
+  def->connect(inc->sel("in0"), phase->sel("out"));
+  def->connect(inc->sel("in1"), mkConst(def, name + "_one", width, 1)->sel("out"));
+  auto atLast = def->addInstance(name + "_at_last", "coreir.eq", {{"width", COREMK(context, width)}});
+  def->connect(atLast->sel("in0"), phase->sel("out"));
+  def->connect(atLast->sel("in1"), mkConst(def, name + "_last", width, II - 1)->sel("out"));
+  auto next = def->addInstance(name + "_next", "coreir.mux", {{"width", COREMK(context, width)}});
+  def->connect(next->sel("in0"), inc->sel("out"));
+  def->connect(next->sel("in1"), zero->sel("out"));
+  def->connect(next->sel("sel"), atLast->sel("out"));
+  def->connect(next->sel("out"), phaseReg->sel("in"));
+
+  return phase->sel("out");
+}
+
+// Instructions that share a unit take turns on it: in each cycle of the
+// initiation interval the unit's operands come from the instruction
+// scheduled to start in that cycle
+void wireSharedUnits(UnitMapping& m, CoreIR::ModuleDef* def) {
+  auto context = def->getContext();
+  std::map<int, CoreIR::Wireable*> phases;
+  for (auto& shared : m.sharedOperands) {
+    CoreIR::Instance* unit = shared.first;
+    int II = map_get(unit, m.sharedII);
+    internal_assert(II > 1) << unit->getInstname() << " is shared, but its initiation interval is " << II << "\n";
+    if (!contains_key(II, phases)) {
+      phases[II] = issuePhase(def, II);
+    }
+
+    for (auto& port : shared.second) {
+      internal_assert(port.second.size() > 0);
+      auto mux = def->addInstance(unit->getInstname() + "_" + port.first + "_mux", "commonlib.muxn",
+          {{"width", COREMK(context, 16)}, {"N", COREMK(context, II)}});
+      def->connect(mux->sel("in")->sel("sel"), map_get(II, phases));
+      for (int slot = 0; slot < II; slot++) {
+        // No instruction uses the unit in this cycle
+        CoreIR::Wireable* val = contains_key(slot, port.second) ?
+          map_get(slot, port.second) : begin(port.second)->second;
+        def->connect(mux->sel("in")->sel("data")->sel(slot), val);
+      }
+      def->connect(mux->sel("out"), m.operandPort(unit, port.first));
+    }
+  }
+}
+
 void emitCoreIR(HWFunction& f, StencilInfo& info, FunctionSchedule& sched) {
   internal_assert(sched.blockSchedules.size() > 0);
 
@@ -2585,8 +2806,14 @@ void emitCoreIR(HWFunction& f, StencilInfo& info, FunctionSchedule& sched) {
       auto arg0 = instr->getOperand(0);
       auto arg1 = instr->getOperand(1);
 
-      def->connect(unit->sel("in0"), m.valueAtStart(arg0, instr));
-      def->connect(unit->sel("in1"), m.valueAtStart(arg1, instr));
+      if (m.isShared(unit)) {
+        int slot = sched.getStartStage(instr) % sched.getContainerBlock(instr).II;
+        m.sharedOperands[unit]["in0"][slot] = m.valueAtStart(arg0, instr);
+        m.sharedOperands[unit]["in1"][slot] = m.valueAtStart(arg1, instr);
+      } else {
+        def->connect(m.operandPort(unit, "in0"), m.valueAtStart(arg0, instr));
+        def->connect(m.operandPort(unit, "in1"), m.valueAtStart(arg1, instr));
+      }
 
     } else if (instr->name == "abs") {
       auto arg = instr->getOperand(0);
@@ -2621,14 +2848,14 @@ void emitCoreIR(HWFunction& f, StencilInfo& info, FunctionSchedule& sched) {
     } else if (instr->name == "sel") {
 
       def->connect(unit->sel("sel"), m.valueAtStart(instr->getOperand(0), instr));
-      def->connect(unit->sel("in1"), m.valueAtStart(instr->getOperand(1), instr));
-      def->connect(unit->sel("in0"), m.valueAtStart(instr->getOperand(2), instr));
+      def->connect(m.operandPort(unit, "in1"), m.valueAtStart(instr->getOperand(1), instr));
+      def->connect(m.operandPort(unit, "in0"), m.valueAtStart(instr->getOperand(2), instr));
 
     } else if (starts_with(instr->name, "init_stencil")) {
       // No inputs
     } else if ((instr->name == "ashr") || (instr->name == "lshr")) {
-      def->connect(unit->sel("in1"), m.valueAtStart(instr->getOperand(1), instr));
-      def->connect(unit->sel("in0"), m.valueAtStart(instr->getOperand(0), instr));
+      def->connect(m.operandPort(unit, "in1"), m.valueAtStart(instr->getOperand(1), instr));
+      def->connect(m.operandPort(unit, "in0"), m.valueAtStart(instr->getOperand(0), instr));
 
     } else if (instr->name == "load") {
       internal_assert(instr->getOperand(0)->tp == HWINSTR_TP_CONST);
@@ -2643,6 +2870,7 @@ void emitCoreIR(HWFunction& f, StencilInfo& info, FunctionSchedule& sched) {
       internal_assert(false) << "no wiring procedure for " << *instr << "\n";
     }
   }
+  wireSharedUnits(m, def);
   cout << "Done building connections in body" << endl;
 }
 
@@ -2925,6 +3153,157 @@ HWLoopSchedule asapSchedule(std::vector<HWInstr*>& instrs) {
   return sched;
 }
 
+// Operands of a phi that are defined lexically after the phi come from the
+// previous iteration of the loop
+bool isLoopCarriedOperand(HWInstr* instr, HWInstr* op, const std::vector<HWInstr*>& instrs) {
+  if (instr->name != "phi") {
+    return false;
+  }
+  for (auto iVal : instrs) {
+    if (*iVal == *op) {
+      return false;
+    }
+    if (*iVal == *instr) {
+      return true;
+    }
+  }
+  return true;
+}
+
+// Lower bound on the initiation interval imposed by the number of
+// functional units available for each operation type
+int resourceMinII(const std::vector<HWInstr*>& instrs, const HardwareInfo& hwInfo) {
+  std::map<string, int> opCounts;
+  for (auto instr : instrs) {
+    if (instr->tp == HWINSTR_TP_INSTR) {
+      opCounts[instr->name]++;
+    }
+  }
+
+  int resMII = 1;
+  for (auto opCount : opCounts) {
+    int limit = sharedUnitLimit(hwInfo, opCount.first);
+    if (limit > 0) {
+      resMII = std::max(resMII, (opCount.second + limit - 1) / limit);
+    }
+  }
+  return resMII;
+}
+
+// Try to build a modulo schedule with the given II. Instructions are placed
+// in topological order at the earliest cycle at which all their operands are
+// available and the modulo reservation table still has a free unit of the
+// right type. Fails if a loop carried value is not ready in time for the
+// next iteration.
+bool tryModuloSchedule(std::vector<HWInstr*>& instrs, const HardwareInfo& hwInfo, const int II, HWLoopSchedule& sched) {
+  sched.body = instrs;
+  sched.II = II;
+  sched.startStages.clear();
+  sched.endStages.clear();
+  sched.unitAssignment.clear();
+
+  DirectedGraph<HWInstr*, int> blockGraph;
+  map<HWInstr*, vdisc> iNodes;
+  for (auto instr : sched.body) {
+    iNodes[instr] = blockGraph.addVertex(instr);
+  }
+  for (auto instr : sched.body) {
+    auto v = map_get(instr, iNodes);
+    for (auto op : instr->operands) {
+      if (op->tp == HWINSTR_TP_INSTR &&
+          contains_key(op, iNodes) &&
+          !isLoopCarriedOperand(instr, op, instrs)) {
+        blockGraph.addEdge(map_get(op, iNodes), v);
+      }
+    }
+  }
+
+  // Modulo reservation table: units of each type in use in each slot
+  std::map<string, vector<int> > reservations;
+  for (auto v : topologicalSort(blockGraph)) {
+    HWInstr* instr = blockGraph.getNode(v);
+    int earliest = 0;
+    for (auto dep : dependencies(instr, iNodes, blockGraph)) {
+      earliest = std::max(earliest, sched.getEndTime(dep));
+    }
+
+    int start = earliest;
+    int limit = sharedUnitLimit(hwInfo, instr->name);
+    if (limit > 0) {
+      auto& slots = reservations[instr->name];
+      if (slots.size() == 0) {
+        slots.resize(II, 0);
+      }
+      bool foundSlot = false;
+      for (int t = earliest; t < earliest + II; t++) {
+        if (slots[t % II] < limit) {
+          start = t;
+          foundSlot = true;
+          break;
+        }
+      }
+      if (!foundSlot) {
+        return false;
+      }
+      sched.unitAssignment[instr] = slots[start % II];
+      slots[start % II]++;
+    } else {
+      sched.unitAssignment[instr] = sched.numUnits(instr->name);
+    }
+
+    sched.setStartTime(instr, start);
+    sched.setEndTime(instr, start + instr->latency);
+  }
+
+  for (auto instr : sched.body) {
+    for (auto op : instr->operands) {
+      if (contains_key(op, iNodes) && isLoopCarriedOperand(instr, op, instrs)) {
+        if (sched.getEndTime(op) > sched.getStartTime(instr) + II) {
+          cout << "Recurrence through " << *instr << " not satisfied at II = " << II << endl;
+          return false;
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
+// Iterative modulo scheduler: start at the larger of the requested II
+// and the resource constrained minimum II, and increase the II until
+// a legal schedule is found
+HWLoopSchedule moduloSchedule(std::vector<HWInstr*>& instrs, const HardwareInfo& hwInfo) {
+  int minII = resourceMinII(instrs, hwInfo);
+  if (hwInfo.hasTargetII) {
+    minII = std::max(minII, hwInfo.targetII);
+  }
+
+  // Once the II exceeds the sum of all latencies every recurrence fits
+  int maxII = minII;
+  for (auto instr : instrs) {
+    maxII += instr->latency + 1;
+  }
+
+  HWLoopSchedule sched;
+  for (int II = minII; II <= maxII; II++) {
+    if (tryModuloSchedule(instrs, hwInfo, II, sched)) {
+      break;
+    }
+    internal_assert(II < maxII) << "could not find a modulo schedule with II <= " << maxII << "\n";
+  }
+
+  cout << "Modulo schedule with II = " << sched.II << " (resource min II = " << resourceMinII(instrs, hwInfo) << ")" << endl;
+  sched.print();
+
+  internal_assert(sched.startStages.size() == sched.endStages.size()) << "not every instruction with a start has an end\n";
+  for (auto instr : instrs) {
+    internal_assert(sched.isScheduled(instr)) << "instruction: " << *instr << " is not scheduled!\n";
+    internal_assert((sched.getEndTime(instr) - sched.getStartTime(instr)) == instr->latency) << "latency in schedule does not match for " << *instr << "\n";
+  }
+
+  return sched;
+}
+
 HWLoopSchedule asapSchedule(HWFunction& f) {
   auto cpy = f.structuredOrder();
   auto sched = asapSchedule(cpy);
@@ -2952,13 +3331,14 @@ int tailLatencyInt(const std::string& name, HWFunction& f, FunctionSchedule& fSc
   return 0;
 }
 
-FunctionSchedule buildFunctionSchedule(HWFunction& f) {
+FunctionSchedule buildFunctionSchedule(HardwareInfo& hwInfo, HWFunction& f) {
   auto instrGroups = group_unary(f.structuredOrder(), [](const HWInstr* i) { return i->surroundingLoops.size(); });
   // Check if we are in a perfect loop nest
   FunctionSchedule fSched;
   fSched.f = &f;
   for (auto group : instrGroups) {
-    HWLoopSchedule sched = asapSchedule(group);
+    HWLoopSchedule sched = hwInfo.usesModuloScheduling() ?
+      moduloSchedule(group, hwInfo) : asapSchedule(group);
     fSched.blockSchedules[head(group)] = sched;
   }
 
@@ -2987,7 +3367,8 @@ FunctionSchedule buildFunctionSchedule(HWFunction& f) {
   vector<NestSchedule> schedules;
   int tc0 = tripCountInt(nestVars[0], f);
   int latency0 = fSched.getScheduleFor(head(deepest)).cycleLatency();
-  schedules.push_back({nestVars[0], 1, latency0, tc0});
+  int II0 = fSched.getScheduleFor(head(deepest)).II;
+  schedules.push_back({nestVars[0], II0, latency0, tc0});
 
   for (int i = 1; i < (int) nestVars.size(); i++) {
     // Create nest schedule
@@ -3056,7 +3437,7 @@ FunctionSchedule buildFunctionSchedule(HWFunction& f) {
   return fSched;
 }
 
-ComputeKernel moduleForKernel(StencilInfo& info, HWFunction& f) {
+ComputeKernel moduleForKernel(HardwareInfo& hwInfo, StencilInfo& info, HWFunction& f) {
   internal_assert(f.mod != nullptr) << "no module in HWFunction\n";
 
   // Check that all instructions resTypes
@@ -3076,7 +3457,7 @@ ComputeKernel moduleForKernel(StencilInfo& info, HWFunction& f) {
   cout << "Hardware function is..." << endl;
   cout << f << endl;
 
-  FunctionSchedule fSched = buildFunctionSchedule(f);
+  FunctionSchedule fSched = buildFunctionSchedule(hwInfo, f);
   internal_assert(fSched.blockSchedules.size() > 0);
 
   emitCoreIR(f, info, fSched);
@@ -5211,46 +5592,67 @@ void flattenExcluding(CoreIR::Context* c, vector<string>& generatorNames) {
   }
 }
 
-// Heuristic method to hit the critical path: Add a register in front of
-// every operation that has a critical path that is "large", meaning at
-// least 1/3 of the critical path in this case
+// Combinational delay from the most recent register to the output of
+// instr. Constants, variables and values from outside the function start
+// at a register, and instructions with non-zero latency register their outputs.
+int combinationalArrival(HWInstr* instr, const std::map<HWInstr*, int>& arrival) {
+  if (instr->tp != HWINSTR_TP_INSTR || instr->latency > 0) {
+    return 0;
+  }
+  if (!contains_key(instr, arrival)) {
+    return 0;
+  }
+  return map_get(instr, arrival);
+}
+
+// Retiming pass that chains combinational operations until the techlib
+// delay of the chain would exceed the critical path target, and only then
+// registers the operand that is too late. Each operand gets at most one
+// register, which is shared by every user that needs the registered value.
 void insertCriticalPathTargetRegisters(HardwareInfo& hwInfo, HWFunction& f) {
   if (!hwInfo.hasCriticalPathTarget) {
     return;
   }
   int cp = hwInfo.criticalPathTarget;
-  set<HWInstr*> delayInsertionSites;
-  for (auto instr : f.structuredOrder()) {
-    if (hwInfo.criticalPath(instr->name) > (cp / 3)) {
-      delayInsertionSites.insert(instr);
-    }
-  }
+  internal_assert(cp > 0) << "critical path target must be positive\n";
 
+  std::map<HWInstr*, int> arrival;
   std::map<HWInstr*, HWInstr*> delayRegister;
-  for (auto s : delayInsertionSites) {
-    auto delay = f.newI();
-    delay->name = "delay";
-    delay->latency = 1;
-    delay->surroundingLoops = s->surroundingLoops;
-    delay->resType = f.mod->getContext()->Bit()->Arr(16);
-    delayRegister[s] = delay;
-  }
-
-  for (auto s : delayRegister) {
-    f.insertAfter(s.first, s.second);
-    f.replaceAllUsesWith(s.first, s.second);
-  }
+  for (auto instr : f.structuredOrder()) {
+    if (instr->tp != HWINSTR_TP_INSTR) {
+      continue;
+    }
 
-  for (auto s : delayRegister) {
-    s.second->operands.push_back(s.first);
+    int opDelay = hwInfo.criticalPath(instr->name);
+    if (opDelay > cp) {
+      cout << "Warning: " << *instr << " has delay " << opDelay << ", which exceeds the critical path target " << cp << endl;
+    }
+
+    int inputArrival = 0;
+    for (size_t i = 0; i < instr->operands.size(); i++) {
+      HWInstr* op = instr->operands[i];
+      int opArrival = combinationalArrival(op, arrival);
+      if (opArrival > 0 && opArrival + opDelay > cp) {
+        if (!contains_key(op, delayRegister)) {
+          auto delay = f.newI();
+          delay->name = "delay";
+          delay->latency = 1;
+          delay->surroundingLoops = op->surroundingLoops;
+          delay->resType = op->resType != nullptr ? op->resType : f.mod->getContext()->Bit()->Arr(16);
+          delay->operands.push_back(op);
+          f.insertAfter(op, delay);
+          delayRegister[op] = delay;
+        }
+        instr->operands[i] = map_get(op, delayRegister);
+        opArrival = 0;
+      }
+      inputArrival = std::max(inputArrival, opArrival);
+    }
+    arrival[instr] = inputArrival + opDelay;
   }
 
-  // Now: For each delay register: insert it after its replacement
-  // then: replace all uses of target with delay register
-  // then: connect each delay
-
   if (delayRegister.size() > 0) {
-    cout << "Function after delay register insertion..." << endl;
+    cout << "Function after inserting " << delayRegister.size() << " critical path registers..." << endl;
     cout << f << endl;
   }
 }
@@ -5312,7 +5714,7 @@ CoreIR::Module* createCoreIRForStmt(CoreIR::Context* context,
           args,
           stCollector);
 
-    ComputeKernel compK = moduleForKernel(scl.info, f);
+    ComputeKernel compK = moduleForKernel(hwInfo, scl.info, f);
 
     auto compute_mod = def->addInstance("compute_kernel", compK.mod);
     topMod->setDef(def);
@@ -5361,10 +5763,6 @@ CoreIR::Module* createCoreIRForStmt(CoreIR::Context* context,
         }
       }
     }
-    ofstream interfaceInfo("accel_interface_info.json");
-    interfaceInfo << aliasInfo;
-    interfaceInfo.close();
-
     stmt = preprocessHWLoops(stmt);
 
     cout << "After substitution..." << endl;
@@ -5420,11 +5818,18 @@ CoreIR::Module* createCoreIRForStmt(CoreIR::Context* context,
       auto lp = fp.first;
       HWFunction& f = fp.second;
       insertCriticalPathTargetRegisters(hwInfo, f);
-      ComputeKernel compK = moduleForKernel(scl.info, f);
+      ComputeKernel compK = moduleForKernel(hwInfo, scl.info, f);
       auto m = compK.mod;
       cout << "Created module for kernel.." << endl;
       kernelModules[lp] = compK;
 
+      // Cycles between issues of the kernel, which its driver has to respect
+      int II = 1;
+      for (auto& blk : compK.sched.blockSchedules) {
+        II = std::max(II, blk.second.II);
+      }
+      aliasInfo["initiationIntervals"][m->getName()] = II;
+
       cout << "Module before optimization" << endl;
       m->print();
 
@@ -5443,6 +5848,10 @@ CoreIR::Module* createCoreIRForStmt(CoreIR::Context* context,
     vector<string> generatorNames{"lakelib.unified_buffer", "lakelib.linebuffer", "commonlib.linebuffer", "commonlib.rom2", "memory.rom2"};
     flattenExcluding(context, generatorNames);
     context->runPasses({"deletedeadinstances"});
+    ofstream interfaceInfo("accel_interface_info.json");
+    interfaceInfo << aliasInfo;
+    interfaceInfo.close();
+
     cout << "Kernels size before buildAppGraph = " << kernels.size() << endl;
     AppGraph appGraph = buildAppGraph(functions, kernelModules, kernels, args, ifc, scl);
     computeDelaysForAppGraph(appGraph);
@@ -65,7 +65,10 @@ class HWInstr {
     CoreIR::Type* resType;
     bool signedNum;
 
-    HWInstr() : tp(HWINSTR_TP_INSTR), preBound(false), latency(0), predicate(nullptr), resType(nullptr), signedNum(false) {}
+    // Width of the functional unit, which can be narrower than its 16 bit operands
+    int unitWidth;
+
+    HWInstr() : tp(HWINSTR_TP_INSTR), preBound(false), latency(0), predicate(nullptr), resType(nullptr), signedNum(false), unitWidth(16) {}
 
     bool isSigned() const {
       return signedNum;
@@ -251,6 +254,7 @@ class HWFunction {
       i->surroundingLoops = instr->surroundingLoops;
       i->resType = instr->resType;
       i->setSigned(instr->isSigned());
+      i->unitWidth = instr->unitWidth;
       i->name = instr->name;
       i->tp = instr->tp;
       return i;
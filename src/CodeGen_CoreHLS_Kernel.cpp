@@ -5,6 +5,7 @@
 #include "CodeGen_CoreHLS_Kernel.h"
 #include "CodeGen_CoreHLS.h"
 #include "CodeGen_CoreIR_Testbench.h"
+#include "HWScheduleTargets.h"
 #include "Substitute.h"
 #include "IROperator.h"
 #include "Param.h"
@@ -27,12 +28,41 @@ using std::pair;
 using std::map;
 
 
+  // The kernels of an accelerator are scheduled with one HardwareInfo, so
+  // they get the tightest of the targets set on its functions
+  HardwareInfo withScheduleTargets(const HardwareInfo& info, const std::map<std::string, HWScheduleTargets>& targets) {
+    HardwareInfo scheduled = info;
+    for (auto& t : targets) {
+      std::cout << "Scheduling targets from " << t.first << std::endl;
+      if (t.second.initiation_interval > 0) {
+        scheduled.targetII = scheduled.hasTargetII ?
+          std::max(scheduled.targetII, t.second.initiation_interval) :
+          t.second.initiation_interval;
+        scheduled.hasTargetII = true;
+      }
+      if (t.second.critical_path_target > 0) {
+        scheduled.criticalPathTarget = scheduled.hasCriticalPathTarget ?
+          std::min(scheduled.criticalPathTarget, t.second.critical_path_target) :
+          t.second.critical_path_target;
+        scheduled.hasCriticalPathTarget = true;
+      }
+      for (auto& limit : t.second.unit_limits) {
+        auto& unitLimits = scheduled.techlib.unitLimits;
+        unitLimits[limit.first] = unitLimits.count(limit.first) > 0 ?
+          std::min(unitLimits[limit.first], limit.second) :
+          limit.second;
+      }
+    }
+    return scheduled;
+  }
+
   void CodeGen_CoreHLS_Kernel::visit(const ProducerConsumer *op) {
     string target_prefix = "_hls_target.";
     if (starts_with(op->name, target_prefix)) {
       if (op->is_producer) {
         std::cout << "found a pc for generating coreir" << std::endl;
-        Stmt hw_body = op->body;
+        HardwareInfo hwInfo = withScheduleTargets(info, collect_hw_schedule_targets(op->body));
+        Stmt hw_body = remove_hw_schedule_targets(op->body);
         std::cout << hw_body << std::endl;
 
         debug(1) << "compute the closure for " << op->name << '\n';
@@ -51,7 +81,7 @@ using std::map;
         CoreIRLoadLibrary_lakelib(context);
         CoreIRLoadLibrary_float(context);
         // TODO: Move save to json file from CodeGen_CoreHLS.cpp to here
-        createCoreIRForStmt(context, info, hw_body, ip_name, args);
+        createCoreIRForStmt(context, hwInfo, hw_body, ip_name, args);
         CoreIR::deleteContext(context);
 
         // emits the target function call
@@ -14,6 +14,8 @@
 #include "Lerp.h"
 #include "Simplify.h"
 #include "Debug.h"
+#include "Bounds.h"
+#include "HWBitwidth.h"
 
 #include "coreir.h"
 #include "coreir/libs/commonlib.h"
@@ -401,7 +403,8 @@ CodeGen_CoreIR_Target::CodeGen_CoreIR_Target(const string &name, Target target)
                                            "ult", "ugt", "ule", "uge",
                                            "slt", "sgt", "sle", "sge",
                                            "shl", "ashr", "lshr",
-                                           "mux", "const", "wire"};
+                                           "mux", "const", "wire",
+                                           "slice", "zext", "sext"};
 
   for (auto gen_name : corelib_gen_names) {
     gens[gen_name] = "coreir." + gen_name;
@@ -1411,7 +1414,33 @@ bool CodeGen_CoreIR_Target::CodeGen_CoreIR_C::connect_linebuffer(std::string con
 
 }
 
-void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit_unaryop(Type t, Expr a, const char*  op_sym, string op_name) {
+// The width of the unit computing op, which reads and produces wires of wire_bitwidth
+uint CodeGen_CoreIR_Target::CodeGen_CoreIR_C::unit_bitwidth(Expr op, uint wire_bitwidth) {
+  return (uint)Internal::unit_bitwidth(op, wire_bitwidth, datapath_ranges);
+}
+
+CoreIR::Wireable* CodeGen_CoreIR_Target::CodeGen_CoreIR_C::narrow_wire(string name, CoreIR::Wireable* wire,
+                                                                       uint width_in, uint width_out) {
+  CoreIR::Wireable* slice_inst = def->addInstance(name + "_slice", gens["slice"],
+                                                  {{"width", CoreIR::Const::make(context,width_in)},
+                                                   {"lo", CoreIR::Const::make(context,0)},
+                                                   {"hi", CoreIR::Const::make(context,width_out)}});
+  def->connect(wire, slice_inst->sel("in"));
+  return slice_inst->sel("out");
+}
+
+CoreIR::Wireable* CodeGen_CoreIR_Target::CodeGen_CoreIR_C::extend_wire(string name, CoreIR::Wireable* wire,
+                                                                       uint width_in, uint width_out, bool is_signed) {
+  stream << "// " << name << " computed with " << width_in << " bits\n";
+  CoreIR::Wireable* ext_inst = def->addInstance(name + "_ext", is_signed ? gens["sext"] : gens["zext"],
+                                                {{"width_in", CoreIR::Const::make(context,width_in)},
+                                                 {"width_out", CoreIR::Const::make(context,width_out)}});
+  def->connect(wire, ext_inst->sel("in"));
+  return ext_inst->sel("out");
+}
+
+void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit_unaryop(Expr op, Expr a, const char*  op_sym, string op_name) {
+  Type t = op.type();
   string a_name = print_expr(a);
   string print_sym = op_sym;
   string out_var = print_assignment(t, print_sym + "(" + a_name + ")");
@@ -1423,6 +1452,7 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit_unaryop(Type t, Expr a, cons
   if (a_wire != NULL) {
     string unaryop_name = op_name + a_name;
     CoreIR::Wireable* coreir_inst;
+    CoreIR::Wireable* out_wire = NULL;
 
     // properly cast to generator or module
     internal_assert(gens.count(op_name) > 0) << op_name << " is not one of the names Halide recognizes\n";
@@ -1436,7 +1466,12 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit_unaryop(Type t, Expr a, cons
     } else if (context->hasGenerator(gens[op_name])) {
       internal_assert(context->getGenerator(gens[op_name]));
       uint bw = inst_bitwidth(a.type().bits());
-      coreir_inst = def->addInstance(unaryop_name, gens[op_name], {{"width", CoreIR::Const::make(context,bw)}});
+      uint unit_bw = unit_bitwidth(op, bw);
+      coreir_inst = def->addInstance(unaryop_name, gens[op_name], {{"width", CoreIR::Const::make(context,unit_bw)}});
+      if (unit_bw < bw) {
+        a_wire = narrow_wire(unaryop_name + "_in", a_wire, bw, unit_bw);
+        out_wire = extend_wire(unaryop_name + "_out", coreir_inst->sel("out"), unit_bw, bw, t.is_int());
+      }
 
     } else {
       internal_assert(context->getModule(gens[op_name]));
@@ -1444,7 +1479,7 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit_unaryop(Type t, Expr a, cons
     }
 
     def->connect(a_wire, coreir_inst->sel("in"));
-    add_wire(out_var, coreir_inst->sel("out"));
+    add_wire(out_var, out_wire != NULL ? out_wire : coreir_inst->sel("out"));
 
   } else {
     // invalid operand
@@ -1459,7 +1494,8 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit_unaryop(Type t, Expr a, cons
 }
 
 
-void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit_binop(Type t, Expr a, Expr b, const char*  op_sym, string op_name) {
+void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit_binop(Expr op, Expr a, Expr b, const char*  op_sym, string op_name) {
+  Type t = op.type();
   string a_name = print_expr(a);
   string b_name = print_expr(b);
   string out_var = print_assignment(t, a_name + " " + op_sym + " " + b_name);
@@ -1477,6 +1513,7 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit_binop(Type t, Expr a, Expr b
     uint bw = inst_bitwidth(a.type().bits());
     string binop_name = op_name + a_name + b_name + out_var;
     CoreIR::Wireable* coreir_inst;
+    CoreIR::Wireable* out_wire = NULL;
 
     // properly cast to generator or module
     internal_assert(gens.count(op_name) > 0) << op_name << " is not one of the names Halide recognizes\n";
@@ -1485,14 +1522,23 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit_binop(Type t, Expr a, Expr b
                                      {{"exp_bits", CoreIR::Const::make(context,8)},
                                          {"frac_bits", CoreIR::Const::make(context,7)}});
     } else if (context->hasGenerator(gens[op_name])) {
-      coreir_inst = def->addInstance(binop_name, gens[op_name], {{"width", CoreIR::Const::make(context,bw)}});
+      uint unit_bw = unit_bitwidth(op, bw);
+      coreir_inst = def->addInstance(binop_name, gens[op_name], {{"width", CoreIR::Const::make(context,unit_bw)}});
+      if (unit_bw < bw) {
+        a_wire = narrow_wire(binop_name + "_in0", a_wire, bw, unit_bw);
+        b_wire = narrow_wire(binop_name + "_in1", b_wire, bw, unit_bw);
+        // comparisons produce a single bit
+        if (t.bits() != 1) {
+          out_wire = extend_wire(binop_name + "_out", coreir_inst->sel("out"), unit_bw, bw, t.is_int());
+        }
+      }
     } else {
       coreir_inst = def->addInstance(binop_name, gens[op_name]);
     }
 
     def->connect(a_wire, coreir_inst->sel("in0"));
     def->connect(b_wire, coreir_inst->sel("in1"));
-    add_wire(out_var, coreir_inst->sel("out"));
+    add_wire(out_var, out_wire != NULL ? out_wire : coreir_inst->sel("out"));
 
   } else {
     out_var = "";
@@ -1505,7 +1551,8 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit_binop(Type t, Expr a, Expr b
   stream << "o: " << out_var << " with obitwidth:" << t.bits() << endl;
 }
 
-void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit_ternop(Type t, Expr a, Expr b, Expr c, const char*  op_sym1, const char* op_sym2, string op_name) {
+void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit_ternop(Expr op, Expr a, Expr b, Expr c, const char*  op_sym1, const char* op_sym2, string op_name) {
+  Type t = op.type();
   string a_name = print_expr(a);
   string b_name = print_expr(b);
   string c_name = print_expr(c);
@@ -1523,6 +1570,7 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit_ternop(Type t, Expr a, Expr
     uint inst_bw = inst_bitwidth(b.type().bits());
     string ternop_name = op_name + a_name + b_name + c_name;
     CoreIR::Wireable* coreir_inst;
+    CoreIR::Wireable* out_wire = NULL;
 
     // properly cast to generator or module
 
@@ -1532,7 +1580,17 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit_ternop(Type t, Expr a, Expr
                                      {{"exp_bits", CoreIR::Const::make(context,8)},
                                          {"frac_bits", CoreIR::Const::make(context,7)}});
     } else if (context->hasGenerator(gens[op_name])) {
-      coreir_inst = def->addInstance(ternop_name, gens[op_name], {{"width", CoreIR::Const::make(context,inst_bw)}});
+      uint unit_bw = unit_bitwidth(op, inst_bw);
+      coreir_inst = def->addInstance(ternop_name, gens[op_name], {{"width", CoreIR::Const::make(context,unit_bw)}});
+      if (unit_bw < inst_bw) {
+        // the mux select stays a single bit
+        if (op_name.compare("mux") != 0) {
+          a_wire = narrow_wire(ternop_name + "_in0", a_wire, inst_bw, unit_bw);
+        }
+        b_wire = narrow_wire(ternop_name + "_in1", b_wire, inst_bw, unit_bw);
+        c_wire = narrow_wire(ternop_name + "_in2", c_wire, inst_bw, unit_bw);
+        out_wire = extend_wire(ternop_name + "_out", coreir_inst->sel("out"), unit_bw, inst_bw, t.is_int());
+      }
     } else {
       coreir_inst = def->addInstance(ternop_name, gens[op_name]);
     }
@@ -1547,7 +1605,7 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit_ternop(Type t, Expr a, Expr
       def->connect(b_wire, coreir_inst->sel("in1"));
       def->connect(c_wire, coreir_inst->sel("in2"));
     }
-    add_wire(out_var, coreir_inst->sel("out"));
+    add_wire(out_var, out_wire != NULL ? out_wire : coreir_inst->sel("out"));
 
   } else {
     out_var = "";
@@ -1567,26 +1625,26 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit_ternop(Type t, Expr a, Expr
 void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const Mul *op) {
   internal_assert(op->a.type() == op->b.type());
   if (op->a.type().is_float()) {
-    visit_binop(op->type, op->a, op->b, "f*", "fmul");
+    visit_binop(op, op->a, op->b, "f*", "fmul");
   } else {
-    visit_binop(op->type, op->a, op->b, "*", "mul");
+    visit_binop(op, op->a, op->b, "*", "mul");
   }
 }
 void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const Add *op) {
   internal_assert(op->a.type() == op->b.type());
   if (op->a.type().is_float()) {
-    visit_binop(op->type, op->a, op->b, "f+", "fadd");
+    visit_binop(op, op->a, op->b, "f+", "fadd");
   } else {
-    visit_binop(op->type, op->a, op->b, "+", "add");
+    visit_binop(op, op->a, op->b, "+", "add");
   }
   // check if we can instantiate a MAD instead
   /*
     if (const Mul* mul = op->a.as<Mul>()) {
-    visit_ternop(op->type, mul->a, mul->b, op->b, "*", "+", "MAD");
+    visit_ternop(op, mul->a, mul->b, op->b, "*", "+", "MAD");
     } else if (const Mul* mul = op->b.as<Mul>()) {
-    visit_ternop(op->type, mul->a, mul->b, op->a, "*", "+", "MAD");
+    visit_ternop(op, mul->a, mul->b, op->a, "*", "+", "MAD");
     } else {
-    visit_binop(op->type, op->a, op->b, "+", "add");
+    visit_binop(op, op->a, op->b, "+", "add");
     }
   */
 
@@ -1594,9 +1652,9 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const Add *op) {
 void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const Sub *op) {
   internal_assert(op->a.type() == op->b.type());
   if (op->a.type().is_float()) {
-    visit_binop(op->type, op->a, op->b, "f-", "fsub");
+    visit_binop(op, op->a, op->b, "f-", "fsub");
   } else {
-    visit_binop(op->type, op->a, op->b, "-", "sub");
+    visit_binop(op, op->a, op->b, "-", "sub");
   }
 }
 
@@ -1607,15 +1665,15 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const Div *op) {
     Expr shift_expr = UIntImm::make(UInt(param_bitwidth), shift_amt);
     if (op->a.type().is_uint()) {
       internal_assert(op->b.type().is_uint());
-      visit_binop(op->type, op->a, shift_expr, ">>", "lshr");
+      visit_binop(op, op->a, shift_expr, ">>", "lshr");
     } else {
       internal_assert(!op->b.type().is_uint());
-      visit_binop(op->type, op->a, shift_expr, ">>", "ashr");
+      visit_binop(op, op->a, shift_expr, ">>", "ashr");
     }
   } else {
     stream << "// divide is not fully supported" << endl;
     user_warning << "WARNING: divide is not fully supported!!!!\n";
-    visit_binop(op->type, op->a, op->b, "/", "div");
+    visit_binop(op, op->a, op->b, "/", "div");
   }
 }
 
@@ -1626,14 +1684,14 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const Mod *op) {
     uint param_bitwidth = op->a.type().bits();
     uint mask = (1<<num_bits) - 1;
     Expr mask_expr = UIntImm::make(UInt(param_bitwidth), mask);
-    visit_binop(op->type, op->a, mask_expr, "&", "and");
+    visit_binop(op, op->a, mask_expr, "&", "and");
 
   } else if (op->type.is_int()) {
     stream << "// mod is not fully supported" << endl;
     //print_expr(lower_euclidean_mod(op->a, op->b));
   } else {
     stream << "// mod is not fully supported" << endl;
-    //visit_binop(op->type, op->a, op->b, "%", "mod");
+    //visit_binop(op, op->a, op->b, "%", "mod");
   }
 
 }
@@ -1641,17 +1699,17 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const Mod *op) {
 void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const And *op) {
   if (op->a.type().bits() == 1) {
     internal_assert(op->b.type().bits() == 1);
-    visit_binop(op->type, op->a, op->b, "&&", "bitand");
+    visit_binop(op, op->a, op->b, "&&", "bitand");
   } else {
-    visit_binop(op->type, op->a, op->b, "&&", "and");
+    visit_binop(op, op->a, op->b, "&&", "and");
   }
 }
 void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const Or *op) {
   if (op->a.type().bits() == 1) {
     internal_assert(op->b.type().bits() == 1);
-    visit_binop(op->type, op->a, op->b, "||", "bitor");
+    visit_binop(op, op->a, op->b, "||", "bitor");
   } else {
-    visit_binop(op->type, op->a, op->b, "||", "or");
+    visit_binop(op, op->a, op->b, "||", "or");
   }
 }
 
@@ -1659,12 +1717,12 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const EQ *op) {
   internal_assert(op->a.type().bits() == op->b.type().bits());
   internal_assert(op->a.type() == op->b.type());
   if (op->a.type().is_float()) {
-    visit_binop(op->type, op->a, op->b, "f==", "feq");
+    visit_binop(op, op->a, op->b, "f==", "feq");
   } else {
     if (op->a.type().bits() == 1) {
-      visit_binop(op->type, op->a, op->b, "~^", "bitxnor");
+      visit_binop(op, op->a, op->b, "~^", "bitxnor");
     } else {
-      visit_binop(op->type, op->a, op->b, "==", "eq");
+      visit_binop(op, op->a, op->b, "==", "eq");
     }
   }
 }
@@ -1672,12 +1730,12 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const NE *op) {
   internal_assert(op->a.type().bits() == op->b.type().bits());
   internal_assert(op->a.type() == op->b.type());
   if (op->a.type().is_float()) {
-    visit_binop(op->type, op->a, op->b, "f!=", "fneq");
+    visit_binop(op, op->a, op->b, "f!=", "fneq");
   } else {
     if (op->a.type().bits() == 1) {
-      visit_binop(op->type, op->a, op->b, "^", "bitxor");
+      visit_binop(op, op->a, op->b, "^", "bitxor");
     } else {
-      visit_binop(op->type, op->a, op->b, "!=", "neq");
+      visit_binop(op, op->a, op->b, "!=", "neq");
     }
   }
 }
@@ -1686,85 +1744,85 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const LT *op) {
   internal_assert(op->a.type() == op->b.type());
 
   if (op->a.type().is_float()) {
-    visit_binop(op->type, op->a, op->b, "f<", "flt");
+    visit_binop(op, op->a, op->b, "f<", "flt");
 
   } else if (op->a.type().is_uint()) {
     internal_assert(op->a.type().bits() == op->b.type().bits());
     if (op->a.type().bits() == 1) {
       Expr not_a = Not::make(op->a);
-      visit_binop(op->type, not_a, op->b, "&&", "bitand");
+      visit_binop(op, not_a, op->b, "&&", "bitand");
       stream << "// created ~a * b for bitlt" << std::endl;
     } else {
-      visit_binop(op->type, op->a, op->b, "<", "ult");
+      visit_binop(op, op->a, op->b, "<", "ult");
     }
 
   } else {
     internal_assert(!op->b.type().is_uint());
     internal_assert(op->a.type().bits() > 1);
-    visit_binop(op->type, op->a, op->b, "s<", "slt");
+    visit_binop(op, op->a, op->b, "s<", "slt");
   }
 }
 void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const LE *op) {
   internal_assert(op->a.type() == op->b.type());
 
   if (op->a.type().is_float()) {
-    visit_binop(op->type, op->a, op->b, "f<=", "fle");
+    visit_binop(op, op->a, op->b, "f<=", "fle");
 
   } else if (op->a.type().is_uint()) {
     internal_assert(op->a.type().bits() == op->b.type().bits());
     if (op->a.type().bits() == 1) {
       Expr not_a = Not::make(op->a);
-      visit_binop(op->type, op->a, op->b, "||", "bitor");
+      visit_binop(op, op->a, op->b, "||", "bitor");
       stream << "// created ~a + b for bitle" << std::endl;
     } else {
-      visit_binop(op->type, op->a, op->b, "<=", "ule");
+      visit_binop(op, op->a, op->b, "<=", "ule");
     }
   } else {
     internal_assert(!op->b.type().is_uint());
     internal_assert(op->a.type().bits() > 1);
-    visit_binop(op->type, op->a, op->b, "s<=", "sle");
+    visit_binop(op, op->a, op->b, "s<=", "sle");
   }
 }
 void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const GT *op) {
   internal_assert(op->a.type() == op->b.type());
 
   if (op->a.type().is_float()) {
-    visit_binop(op->type, op->a, op->b, "f>", "fgt");
+    visit_binop(op, op->a, op->b, "f>", "fgt");
 
   } else if (op->a.type().is_uint()) {
     internal_assert(op->a.type().bits() == op->b.type().bits());
     if (op->a.type().bits() == 1) {
       Expr not_b = Not::make(op->b);
-      visit_binop(op->type, op->a, not_b, "&&", "bitand");
+      visit_binop(op, op->a, not_b, "&&", "bitand");
       stream << "// created a * ~b for bitgt" << std::endl;
     } else {
-      visit_binop(op->type, op->a, op->b, ">", "ugt");
+      visit_binop(op, op->a, op->b, ">", "ugt");
     }
   } else {
     internal_assert(!op->b.type().is_uint());
     internal_assert(op->a.type().bits() > 1);
-    visit_binop(op->type, op->a, op->b, "s>", "sgt");
+    visit_binop(op, op->a, op->b, "s>", "sgt");
   }
 }
 void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const GE *op) {
   internal_assert(op->a.type() == op->b.type());
 
   if (op->a.type().is_float()) {
-    visit_binop(op->type, op->a, op->b, "f>=", "fge");
+    visit_binop(op, op->a, op->b, "f>=", "fge");
 
   } else if (op->a.type().is_uint()) {
     internal_assert(op->a.type().bits() == op->b.type().bits());
     if (op->a.type().bits() == 1) {
       Expr not_b = Not::make(op->b);
-      visit_binop(op->type, op->a, not_b, "||", "bitor");
+      visit_binop(op, op->a, not_b, "||", "bitor");
       stream << "// created a + ~b for bitge" << std::endl;
     } else {
-      visit_binop(op->type, op->a, op->b, ">=", "uge");
+      visit_binop(op, op->a, op->b, ">=", "uge");
     }
   } else {
     internal_assert(!op->b.type().is_uint());
     internal_assert(op->a.type().bits() > 1);
-    visit_binop(op->type, op->a, op->b, "s>=", "sge");
+    visit_binop(op, op->a, op->b, "s>=", "sge");
   }
 }
 
@@ -1772,40 +1830,40 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const Max *op) {
   internal_assert(op->a.type() == op->b.type());
 
   if (op->a.type().is_float()) {
-    visit_binop(op->type, op->a, op->b, "<fmax>",  "fmax");
+    visit_binop(op, op->a, op->b, "<fmax>",  "fmax");
   } else if (op->type.is_uint()) {
-    visit_binop(op->type, op->a, op->b, "<max>",  "umax");
+    visit_binop(op, op->a, op->b, "<max>",  "umax");
   } else {
-    visit_binop(op->type, op->a, op->b, "<smax>", "smax");
+    visit_binop(op, op->a, op->b, "<smax>", "smax");
   }
 }
 void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const Min *op) {
   internal_assert(op->a.type() == op->b.type());
 
   if (op->a.type().is_float()) {
-    visit_binop(op->type, op->a, op->b, "<fmin>",  "fmin");
+    visit_binop(op, op->a, op->b, "<fmin>",  "fmin");
   } else if (op->type.is_uint()) {
-    visit_binop(op->type, op->a, op->b, "<min>",  "umin");
+    visit_binop(op, op->a, op->b, "<min>",  "umin");
   } else {
-    visit_binop(op->type, op->a, op->b, "<smin>", "smin");
+    visit_binop(op, op->a, op->b, "<smin>", "smin");
   }
 }
 void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const Not *op) {
   // operator must have a one-bit/bool input
   assert(op->a.type().bits() == 1);
-  visit_unaryop(op->type, op->a, "!", "bitnot");
+  visit_unaryop(op, op->a, "!", "bitnot");
 }
 
 void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const Select *op) {
   internal_assert(op->true_value.type() == op->false_value.type());
 
   if (op->true_value.type().is_float()) {
-    visit_ternop(op->type, op->condition, op->true_value, op->false_value, "f?",":", "fmux");
+    visit_ternop(op, op->condition, op->true_value, op->false_value, "f?",":", "fmux");
   } else if (op->type.bits() == 1) {
     // use a special op for bitwidth 1
-    visit_ternop(op->type, op->condition, op->true_value, op->false_value, "?",":", "bitmux");
+    visit_ternop(op, op->condition, op->true_value, op->false_value, "?",":", "bitmux");
   } else {
-    visit_ternop(op->type, op->condition, op->true_value, op->false_value, "?",":", "mux");
+    visit_ternop(op, op->condition, op->true_value, op->false_value, "?",":", "mux");
   }
 }
 
@@ -1819,13 +1877,13 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const Cast *op) {
     stream << "// casting from 1 to 16 bits" << endl;
     Expr one_uint16 = UIntImm::make(UInt(16), 1);
     Expr zero_uint16 = UIntImm::make(UInt(16), 0);
-    visit_ternop(op->type, op->value, one_uint16, zero_uint16, "?", ":", "mux");
+    visit_ternop(op, op->value, one_uint16, zero_uint16, "?", ":", "mux");
 
   // casting from 16 to 1 bit
   } else if (op->type.bits() == 1 && op->value.type().bits() > 1) {
     stream << "// casting from 16 to 1 bit" << endl;
     Expr zero_uint16 = UIntImm::make(UInt(op->value.type().bits()), 0);
-    visit_binop(op->type, op->value, zero_uint16, "!=", "neq");
+    visit_binop(op, op->value, zero_uint16, "!=", "neq");
 
   } else if (!is_const(in_var)) {
     // only add to list, don't duplicate constants
@@ -1967,6 +2025,7 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const Provide *op) {
 void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const For *op) {
   internal_assert(op->for_type == ForType::Serial)
     << "Can only emit serial for loops to CoreIR C\n";
+  datapath_ranges.push(op->name, Interval(op->min, simplify(op->min + op->extent - 1)));
 
   string id_min = print_expr(op->min);
   string id_extent = print_expr(op->extent);
@@ -2046,6 +2105,7 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const For *op) {
       CoreIR::Select* inner_for_loop = static_cast<CoreIR::Select*>(get_wire(varname, Expr()));
       CoreIR::Wireable* inner_overflow = inner_for_loop->getParent()->sel("overflow");
       def->connect(inner_overflow, counter_inst->sel("en"));
+      datapath_ranges.pop(op->name);
       return;
 
     } else if (lb_kernel_map.count(op->name)) {
@@ -2065,7 +2125,19 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const For *op) {
 
   op->body.accept(this);
   close_scope("for " + print_name(op->name));
+  datapath_ranges.pop(op->name);
+}
 
+void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const Let *op) {
+  datapath_ranges.push(op->name, bounds_of_expr_in_scope(op->value, datapath_ranges));
+  CodeGen_CoreIR_Base::visit(op);
+  datapath_ranges.pop(op->name);
+}
+
+void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const LetStmt *op) {
+  datapath_ranges.push(op->name, bounds_of_expr_in_scope(op->value, datapath_ranges));
+  CodeGen_CoreIR_Base::visit(op);
+  datapath_ranges.pop(op->name);
 }
 
 class RenameAllocation : public IRMutator {
@@ -2242,9 +2314,9 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const Call *op) {
     Expr b = op->args[1];
     if (op->type.bits() == 1) {
       // use a special op for bitwidth 1
-      visit_binop(op->type, a, b, "&&", "bitand");
+      visit_binop(op, a, b, "&&", "bitand");
     } else {
-      visit_binop(op->type, a, b, "&", "and");
+      visit_binop(op, a, b, "&", "and");
     }
   } else if (op->is_intrinsic(Call::bitwise_or)) {
     internal_assert(op->args.size() == 2);
@@ -2252,9 +2324,9 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const Call *op) {
     Expr b = op->args[1];
     if (op->type.bits() == 1) {
       // use a special op for bitwidth 1
-      visit_binop(op->type, a, b, "||", "bitor");
+      visit_binop(op, a, b, "||", "bitor");
     } else {
-      visit_binop(op->type, a, b, "|", "or");
+      visit_binop(op, a, b, "|", "or");
     }
   } else if (op->is_intrinsic(Call::bitwise_xor)) {
     internal_assert(op->args.size() == 2);
@@ -2262,18 +2334,18 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const Call *op) {
     Expr b = op->args[1];
     if (op->type.bits() == 1) {
       // use a special op for bitwidth 1
-      visit_binop(op->type, a, b, "^", "bitxor");
+      visit_binop(op, a, b, "^", "bitxor");
     } else {
-      visit_binop(op->type, a, b, "^", "xor");
+      visit_binop(op, a, b, "^", "xor");
     }
   } else if (op->is_intrinsic(Call::bitwise_not)) {
     internal_assert(op->args.size() == 1);
     Expr a = op->args[0];
     if (op->type.bits() == 1) {
       // use a special op for bitwidth 1
-      visit_unaryop(op->type, a, "!", "bitnot");
+      visit_unaryop(op, a, "!", "bitnot");
     } else {
-      visit_unaryop(op->type, a, "~", "not");
+      visit_unaryop(op, a, "~", "not");
     }
 
   } else if (op->is_intrinsic(Call::shift_left)) {
@@ -2281,7 +2353,7 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const Call *op) {
     Expr a = op->args[0];
     Expr b = op->args[1];
     stream << "[shift left] ";
-    visit_binop(op->type, a, b, "<<", "shl");
+    visit_binop(op, a, b, "<<", "shl");
   } else if (op->is_intrinsic(Call::shift_right)) {
     internal_assert(op->args.size() == 2);
     Expr a = op->args[0];
@@ -2289,22 +2361,22 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const Call *op) {
     stream << "[shift right] ";
     if (a.type().is_uint()) {
       internal_assert(b.type().is_uint());
-      visit_binop(op->type, a, b, ">>", "lshr");
+      visit_binop(op, a, b, ">>", "lshr");
     } else {
       internal_assert(!b.type().is_uint());
-      visit_binop(op->type, a, b, ">>", "ashr");
+      visit_binop(op, a, b, ">>", "ashr");
     }
   } else if (op->is_intrinsic(Call::abs)) {
     internal_assert(op->args.size() == 1);
     Expr a = op->args[0];
     stream << "[abs] ";
-    visit_unaryop(op->type, a, "abs", "abs");
+    visit_unaryop(op, a, "abs", "abs");
   } else if (op->is_intrinsic(Call::absd)) {
     internal_assert(op->args.size() == 2);
     Expr a = op->args[0];
     Expr b = op->args[1];
     stream << "[absd] ";
-    visit_binop(op->type, a, b, "|-|", "absd");
+    visit_binop(op, a, b, "|-|", "absd");
 
   } else if (op->is_intrinsic(Call::reinterpret)) {
     string in_var = print_expr(op->args[0]);
@@ -2342,6 +2414,10 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit(const Call *op) {
   } else if (op->name == "dispatch_stream") {
     visit_dispatch_stream(op);
 
+  } else if (op->name == "hw_schedule") {
+    // scheduling targets are used by the CoreHLS kernel generator
+    stream << "// hardware schedule " << Expr(op) << endl;
+
   } else {
     stream << "couldn't find op named " << op->name << endl;
     cout << "couldn't find op named " << op->name << endl;
@@ -2573,6 +2649,62 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit_hwbuffer(const Call *op) {
     stream << "\n";
   }
 
+  // banking for each consumer stream, if the buffer was banked
+  map<string, nlohmann::json> banking_map;
+  for (auto consumer_name : consumer_names) {
+    if ((size_t)cur_idx >= op->args.size()) {
+      break;
+    }
+    static const vector<string> partition_names = {"unbanked", "cyclic", "block"};
+    nlohmann::json banking_json;
+    banking_json["partition"] = partition_names.at(id_const_value(op->args[cur_idx++]));
+    banking_json["num_banks"] = id_const_value(op->args[cur_idx++]);
+    vector<int> coefficients(num_dims);
+    for (size_t i = 0; i < num_dims; ++cur_idx, ++i) {
+      coefficients[i] = id_const_value(op->args[cur_idx]);
+    }
+    banking_json["coefficients"] = coefficients;
+    banking_json["block_dim"] = id_const_value(op->args[cur_idx++]);
+    banking_json["block_size"] = id_const_value(op->args[cur_idx++]);
+    size_t num_ports = id_const_value(op->args[cur_idx++]);
+    vector<int> port_banks(num_ports);
+    for (size_t i = 0; i < num_ports; ++cur_idx, ++i) {
+      port_banks[i] = id_const_value(op->args[cur_idx]);
+    }
+    banking_json["port_banks"] = port_banks;
+    stream << "// " << consumer_name << " banking=" << banking_json << std::endl;
+    banking_map[consumer_name] = banking_json;
+  }
+
+  // words live at once, which sizes the physical memory behind the logical buffer
+  if ((size_t)cur_idx < op->args.size()) {
+    int min_capacity = id_const_value(op->args[cur_idx++]);
+    if (min_capacity > 0) {
+      logical_json["min_capacity"] = min_capacity;
+      stream << "// min_capacity=" << min_capacity << std::endl;
+    }
+  }
+
+  // two copies of the buffer, written and read on alternating tiles
+  if ((size_t)cur_idx < op->args.size()) {
+    bool double_buffered = id_const_value(op->args[cur_idx++]) != 0;
+    if (double_buffered) {
+      logical_json["num_buffers"] = 2;
+      stream << "// double buffered" << std::endl;
+    }
+  }
+
+  // memory level the buffer was placed in, if any
+  if ((size_t)cur_idx < op->args.size()) {
+    MemoryType memory_level = (MemoryType)id_const_value(op->args[cur_idx++]);
+    if (memory_level != MemoryType::Auto) {
+      ostringstream level_name;
+      level_name << memory_level;
+      logical_json["memory_level"] = level_name.str();
+      stream << "// memory_level=" << memory_level << std::endl;
+    }
+  }
+
   auto &input_ports = input_block;
 
   stream << "hwbuffer: " << a0 << std::endl
@@ -2823,6 +2955,9 @@ void CodeGen_CoreIR_Target::CodeGen_CoreIR_C::visit_hwbuffer(const Call *op) {
     ostream_json[consumer_name]["output_block"] = output_blocks[consumer_name];
     ostream_json[consumer_name]["num_stencil_acc_dim"] = 0;
     ostream_json[consumer_name]["stencil_width"] = vector<size_t>(access_ranges_map[consumer_name].size(), 0);// default: used only after hw mapping
+    if (banking_map.count(consumer_name)) {
+      ostream_json[consumer_name]["banking"] = banking_map.at(consumer_name);
+    }
   }
   stream << ostream_json << std::endl;
 
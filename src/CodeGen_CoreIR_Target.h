@@ -7,6 +7,7 @@
  */
 #include "CodeGen_CoreIR_Base.h"
 #include "Module.h"
+#include "Interval.h"
 #include "Scope.h"
 
 #include "coreir.h"
@@ -141,10 +142,16 @@ namespace Halide {
         void rename_wire(std::string new_name, std::string in_name, Expr in_expr, std::vector<uint> indices={});
         void add_wire(std::string name, CoreIR::Wireable* wire, std::vector<uint> indices={});
 
+        // size datapath units to the range of values they compute, see HWBitwidth.h
+        Scope<Interval> datapath_ranges;
+        uint unit_bitwidth(Expr op, uint wire_bitwidth);
+        CoreIR::Wireable* narrow_wire(std::string name, CoreIR::Wireable* wire, uint width_in, uint width_out);
+        CoreIR::Wireable* extend_wire(std::string name, CoreIR::Wireable* wire, uint width_in, uint width_out, bool is_signed);
+
         // coreir operators
-        void visit_unaryop(Type t, Expr a, const char* op_sym, std::string op_name);
+        void visit_unaryop(Expr op, Expr a, const char* op_sym, std::string op_name);
         void visit(const Not *op);
-        void visit_binop(Type t, Expr a, Expr b, const char* op_sym, std::string op_name);
+        void visit_binop(Expr op, Expr a, Expr b, const char* op_sym, std::string op_name);
         void visit(const Mul *op);
         void visit(const Div *op);
         void visit(const Mod *op);
@@ -161,10 +168,12 @@ namespace Halide {
         void visit(const Max *op);
         void visit(const Min *op);
         void visit(const Cast *op);
-        void visit_ternop(Type t, Expr a, Expr b, Expr c, const char*  op_sym1, const char* op_sym2, std::string op_name);
+        void visit_ternop(Expr op, Expr a, Expr b, Expr c, const char*  op_sym1, const char* op_sym2, std::string op_name);
         void visit(const Select *op);
 
         void visit(const For *op);               // create counter with loop
+        void visit(const Let *op);               // track value ranges for the datapath widths
+        void visit(const LetStmt *op);
         void visit(const Realize *op);           // create reusable variable, create passthrough for indirection, 
         void visit(const Call *op);              // bitwise, streams, etc
         void visit(const Allocate *op);          // allocate an array (unused so far)
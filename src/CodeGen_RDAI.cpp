@@ -12,6 +12,7 @@ namespace Halide::Internal {
 using std::string;
 using std::ostream;
 using std::vector;
+using std::map;
 using std::pair;
 using std::ofstream;
 using std::ostringstream;
@@ -59,11 +60,96 @@ protected:
     const string& output_name;
 };
 
-CodeGen_RDAI::CodeGen_RDAI(ostream& pipeline_stream, const Target& target, string pipeline_name)
-    : CodeGen_C(pipeline_stream, target, CPlusPlusImplementation, ""),
+namespace {
+// Emitted once into the host code. Device lookup is done on the first run
+// and cached for the life of the program. Runs on a device are issued in
+// order on a worker thread, so the host can stage the next frame while the
+// current one runs; each run is waited on where its output is consumed.
+const char *rdai_session_preamble = R"(
+#include <assert.h>
+#include <future>
+#include <mutex>
+#include <vector>
+
+namespace {
+class RDAI_Session {
+public:
+    RDAI_Device *device(RDAI_PlatformType platform_type, RDAI_VLNV vlnv) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!devices) {
+            platforms = RDAI_get_platforms_with_type(&platform_type);
+            if (platforms && platforms[0]) {
+                devices = RDAI_get_devices_with_vlnv(platforms[0], &vlnv);
+            }
+            if (!devices || !devices[0]) {
+                free_lists();
+                return NULL;
+            }
+        }
+        return devices[0];
+    }
+
+    // The run also waits on runs of other devices that produce its inputs
+    std::shared_future<RDAI_Status> submit(RDAI_Device *device, RDAI_MemObject **mem_obj_list,
+                                           std::vector<std::shared_future<RDAI_Status>> inputs = {}) {
+        std::vector<RDAI_MemObject *> mem_objs;
+        for (RDAI_MemObject **mem_obj = mem_obj_list; *mem_obj; mem_obj++) {
+            mem_objs.push_back(*mem_obj);
+        }
+        mem_objs.push_back(NULL);
+
+        std::lock_guard<std::mutex> guard(lock);
+        std::shared_future<RDAI_Status> previous = last_run;
+        last_run = std::async(std::launch::async, [device, mem_objs, previous, inputs]() mutable {
+            if (previous.valid()) {
+                previous.wait();
+            }
+            for (auto &input : inputs) {
+                input.wait();
+            }
+            return RDAI_device_run(device, mem_objs.data());
+        }).share();
+        return last_run;
+    }
+
+    ~RDAI_Session() {
+        if (last_run.valid()) {
+            last_run.wait();
+        }
+        free_lists();
+    }
+
+private:
+    std::mutex lock;
+    RDAI_Platform **platforms = NULL;
+    RDAI_Device **devices = NULL;
+    std::shared_future<RDAI_Status> last_run;
+
+    void free_lists() {
+        if (devices) {
+            RDAI_free_device_list(devices);
+        }
+        if (platforms) {
+            RDAI_free_platform_list(platforms);
+        }
+        devices = NULL;
+        platforms = NULL;
+    }
+};
+}  // namespace
+
+)";
+}
+
+CodeGen_RDAI::CodeGen_RDAI(ostream& pipeline_stream, const Target& target, string pipeline_name,
+                           OutputKind output_kind, const string &guard)
+    : CodeGen_C(pipeline_stream, target, output_kind, guard),
       target(target),
       pipeline_name(pipeline_name) {
-    stream << "#include \"rdai_api.h\"\n";
+    if (!is_header()) {
+        stream << "#include \"rdai_api.h\"\n";
+        stream << rdai_session_preamble;
+    }
 }
 
 CodeGen_RDAI::~CodeGen_RDAI() {}
@@ -85,30 +171,38 @@ namespace {
         rdai_stream << "#include \"rdai_api.h\"\n";
         rdai_stream << "\n";
 
-        ostringstream oss;
-        oss << info.devices[0].vendor << "_" << info.devices[0].library <<
-            "_" << info.devices[0].name << "_" << info.devices[0].version;
-
-        string device_name = oss.str();
-
         rdai_stream << "extern RDAI_Platform " << info.platform_name << ";\n";
         rdai_stream << "\n";
 
-        rdai_stream << "static RDAI_Device " << device_name << " = {\n"
-                    << "\t{ 1 },\n"
-                    << "\t{\n"
-                    << "\t\t{ \"" << info.devices[0].vendor  << "\" },\n"
-                    << "\t\t{ \"" << info.devices[0].library << "\"  },\n"
-                    << "\t\t{ \"" << info.devices[0].name  << "\" },\n"
-                    << "\t\t" << info.devices[0].version << ",\n"
-                    << "\t},\n"
-                    << "\t&" << info.platform_name << ",\n"
-                    << "\tNULL,\n"
-                    << "\t" << info.devices[0].num_inputs << "\n"
-                    << "};\n";
-        rdai_stream << "\n";
+        // one device per accelerator, so chained kernels can run at once
+        vector<string> device_names;
+        for (const auto& device : info.devices) {
+            ostringstream oss;
+            oss << device.vendor << "_" << device.library <<
+                "_" << device.name << "_" << device.version;
+            string device_name = oss.str();
+            device_names.push_back(device_name);
+
+            rdai_stream << "static RDAI_Device " << device_name << " = {\n"
+                        << "\t{ 1 },\n"
+                        << "\t{\n"
+                        << "\t\t{ \"" << device.vendor  << "\" },\n"
+                        << "\t\t{ \"" << device.library << "\"  },\n"
+                        << "\t\t{ \"" << device.name  << "\" },\n"
+                        << "\t\t" << device.version << ",\n"
+                        << "\t},\n"
+                        << "\t&" << info.platform_name << ",\n"
+                        << "\tNULL,\n"
+                        << "\t" << device.num_inputs << "\n"
+                        << "};\n";
+            rdai_stream << "\n";
+        }
 
-        rdai_stream << "static RDAI_Device *" << info.platform_name << "_devices[2] = { &" << device_name << ", NULL };\n";
+        rdai_stream << "static RDAI_Device *" << info.platform_name << "_devices[" << device_names.size() + 1 << "] = { ";
+        for (const auto& device_name : device_names) {
+            rdai_stream << "&" << device_name << ", ";
+        }
+        rdai_stream << "NULL };\n";
         rdai_stream << "\n";
 
         rdai_stream << "RDAI_Platform " << info.platform_name << " = {\n"
@@ -195,24 +289,29 @@ void CodeGen_RDAI::visit(const ProducerConsumer *op) {
                   << " xcels in " << pipeline_name << std::endl;
         cg_target->add_kernel(hw_body, num_xcels>1 ? output_name : pipeline_name, args);
 
+        // each accelerator is its own device, named like its kernel
+        string xcel_device = num_xcels>1 ? print_name(output_name).substr(1) : pipeline_name;
+
         // Emit RDAI API
         internal_assert(args.size() > 0) << "no input/output argumnets found for the accelerator\n";
 
+        string session_name = print_name(hw_ip_name) + "_session";
+        string device_name = print_name(hw_ip_name) + "_device";
+        string mem_list_name = print_name(hw_ip_name) + "_mem_objs";
+        string run_name = print_name(hw_ip_name) + "_run";
+
         stream << "\n";
         do_indent();
-        stream << "RDAI_PlatformType platform_type = RDAI_PlatformType::RDAI_CLOCKWORK_PLATFORM;\n";
-        do_indent();
-        stream << "RDAI_Platform **platforms = RDAI_get_platforms_with_type(&platform_type);\n";
+        stream << "static RDAI_Session " << session_name << ";\n";
         do_indent();
-        stream << "assert(platforms && platforms[0]);\n";
+        stream << "RDAI_VLNV " << print_name(hw_ip_name) << "_vlnv = {{\"aha\"}, {\"halide_hardware\"}, {\"" << xcel_device << "\"}, 1};\n";
         do_indent();
-        stream << "RDAI_VLNV device_vlnv = {{\"aha\"}, {\"halide_hardware\"}, {\"" << pipeline_name << "\"}, 1};\n";
+        stream << "RDAI_Device *" << device_name << " = " << session_name
+               << ".device(RDAI_PlatformType::RDAI_CLOCKWORK_PLATFORM, " << print_name(hw_ip_name) << "_vlnv);\n";
         do_indent();
-        stream << "RDAI_Device **devices = RDAI_get_devices_with_vlnv(platforms[0], &device_vlnv);\n";
+        stream << "assert(" << device_name << ");\n";
         do_indent();
-        stream << "assert(devices && devices[0]);\n";
-        do_indent();
-        stream << "RDAI_MemObject *mem_obj_list["<< args.size() + 1 <<"] = {\n";
+        stream << "RDAI_MemObject *" << mem_list_name << "["<< args.size() + 1 <<"] = {\n";
         for(size_t i = 0; i < args.size(); i++) {
             do_indent(); do_indent();
             stream << print_name(args[i].name) << ",\n";
@@ -221,29 +320,97 @@ void CodeGen_RDAI::visit(const ProducerConsumer *op) {
         stream << "NULL\n";
         do_indent();
         stream << "};\n";
+
+        // inputs chained from other accelerators are read once those runs finish
+        vector<string> input_runs;
+        for (const auto &arg : args) {
+            string root = root_stencil(arg.name);
+            if (root != arg.name && stencil_runs.count(root)) {
+                input_runs.push_back(stencil_runs.at(root));
+            }
+            run_buffers[run_name].insert(root);
+        }
+        string output_stencil = output_name.substr(1) + ".stencil";
+        stencil_runs[root_stencil(output_stencil)] = run_name;
+
         do_indent();
-        stream << "RDAI_Status status = RDAI_device_run(devices[0], mem_obj_list);\n";
-        do_indent();
-        stream << "RDAI_free_device_list(devices);\n";
-        do_indent();
-        stream << "RDAI_free_platform_list(platforms);\n";
+        stream << "std::shared_future<RDAI_Status> " << run_name << " = "
+               << session_name << ".submit(" << device_name << ", " << mem_list_name;
+        if (!input_runs.empty()) {
+            stream << ", {";
+            for (size_t i = 0; i < input_runs.size(); i++) {
+                stream << input_runs[i] << (i + 1 < input_runs.size() ? ", " : "");
+            }
+            stream << "}";
+        }
+        stream << ");\n";
         stream << "\n";
+        pending_runs[op->name] = run_name;
 
         // Emit RDAI Info
         rdai_info.platform_type = "RDAI_PlatformType::RDAI_CLOCKWORK_PLATFORM";
         rdai_info.platform_name = "rdai_clockwork_platform";
-        rdai_info.devices.push_back({"aha", "halide_hardware", pipeline_name, 1, args.size() - 1});
+        rdai_info.devices.push_back({"aha", "halide_hardware", xcel_device, 1, args.size() - 1});
 
         render_rdai_data(output_directory, rdai_info, pipeline_name);
 
+    } else if (!op->is_producer && device_resident_xcels.count(op->name)) {
+        do_indent();
+        stream << "// output of " << op->name << " stays in device memory for the next accelerator\n";
+
+    } else if (!op->is_producer && pending_runs.count(op->name)) {
+        // the host only blocks once it needs the accelerator output
+        wait_for_run(op->name);
+        CodeGen_C::visit(op);
+
     } else {
         CodeGen_C::visit(op);
     }
 }
 
+void CodeGen_RDAI::wait_for_run(const string& xcel_name) {
+    string run_name = pending_runs.at(xcel_name);
+    do_indent();
+    stream << "RDAI_Status " << run_name << "_status = " << run_name << ".get();\n";
+    do_indent();
+    stream << "if (" << run_name << "_status.status_code != RDAI_STATUS_OK) {\n";
+    indent += 1;
+    do_indent();
+    stream << "return halide_error_code_device_run_failed;\n";
+    indent -= 1;
+    do_indent();
+    stream << "}\n";
+    pending_runs.erase(xcel_name);
+    run_buffers.erase(run_name);
+}
+
+void CodeGen_RDAI::wait_for_buffer(const string& stencil_name) {
+    vector<string> users;
+    for (const auto &run : pending_runs) {
+        if (run_buffers[run.second].count(stencil_name)) {
+            users.push_back(run.first);
+        }
+    }
+    for (const auto &xcel_name : users) {
+        wait_for_run(xcel_name);
+    }
+}
+
+string CodeGen_RDAI::root_stencil(const string& stencil_name) {
+    string root = stencil_name;
+    while (stencil_aliases.count(root)) {
+        root = stencil_aliases.at(root);
+    }
+    return root;
+}
+
 void CodeGen_RDAI::visit(const Provide *op) {
 
     internal_assert(ends_with(op->name, ".stencil"));
+    if (stencil_aliases.count(op->name)) {
+        // already in the memory object of the accelerator that produced it
+        return;
+    }
 
     string elt_type = print_type(op->values[0].type());
     string op_name = print_name(op->name);
@@ -306,15 +473,29 @@ void CodeGen_RDAI::visit(const Realize *op) {
 
         buf_size = simplify(buf_size);
 
-        do_indent();
-        stream << "// Allocate shared buffer for " << print_name(op->name) << "\n";
-        do_indent();
-        stream << "RDAI_MemObject *" << print_name(op->name) << " = RDAI_mem_shared_allocate(" << buf_size << ");\n";
+        string root = root_stencil(op->name);
+        if (root != op->name) {
+            do_indent();
+            stream << "// Chain " << print_name(op->name) << " to the accelerator output " << print_name(root) << "\n";
+            do_indent();
+            stream << "RDAI_MemObject *" << print_name(op->name) << " = " << print_name(stencil_aliases.at(op->name)) << ";\n";
+        } else {
+            do_indent();
+            stream << "// Allocate shared buffer for " << print_name(op->name) << "\n";
+            do_indent();
+            stream << "RDAI_MemObject *" << print_name(op->name) << " = RDAI_mem_shared_allocate(" << buf_size << ");\n";
+        }
         op->body.accept(this);
-        do_indent();
-        stream << "// Free shared buffer for " << op->name << "\n";
-        do_indent();
-        stream << "RDAI_mem_free(" << print_name(op->name) << ");\n";
+
+        // chained buffers are freed once their last reader is done
+        if (--alias_readers[root] < 0) {
+            // runs still using this buffer must finish before it is freed
+            wait_for_buffer(root);
+            do_indent();
+            stream << "// Free shared buffer for " << root << "\n";
+            do_indent();
+            stream << "RDAI_mem_free(" << print_name(root) << ");\n";
+        }
         //allocations.pop(op->name);
         stencils.pop(op->name);
     } else {
@@ -322,6 +503,235 @@ void CodeGen_RDAI::visit(const Realize *op) {
     }
 }
 
+// Finds accelerator outputs that only reach the next accelerator through a
+// host buffer copy. The next accelerator can then read the same shared
+// memory object, and neither copy is needed on the host.
+class FindAcceleratorChains : public IRVisitor {
+    using IRVisitor::visit;
+
+    struct StencilRealize {
+        const Realize *op;
+        vector<const IRNode *> scope;
+        int order;
+    };
+
+    // B(idx) = X.stencil(vars) in the consumer of an accelerator
+    struct CopyOut {
+        string xcel;
+        string stencil;
+        vector<string> vars;
+        Expr index;
+    };
+
+    // Y.stencil(vars) = B(idx)
+    struct CopyIn {
+        string stencil;
+        string buffer;
+        vector<string> vars;
+        Expr index;
+    };
+
+    const string target_prefix = "_hls_target";
+    vector<const IRNode *> scope;
+    string current_consumer;
+    string current_copy_in;
+
+    map<string, StencilRealize> realizes;
+    map<string, vector<const IRNode *>> producer_scopes;
+    map<string, vector<CopyOut>> copy_outs;
+    map<string, std::set<string>> consumer_stores;
+    std::set<string> impure_consumers;
+    vector<CopyIn> copy_ins;
+    map<string, int> num_loads;
+    map<string, int> num_stores;
+    map<string, int> num_provides;
+    std::set<string> allocations;
+
+    static bool as_vars(const vector<Expr> &args, vector<string> &vars) {
+        for (const auto &arg : args) {
+            const Variable *var = arg.as<Variable>();
+            if (!var) {
+                return false;
+            }
+            vars.push_back(var->name);
+        }
+        return true;
+    }
+
+    void visit_scope(const IRNode *op, const Stmt &body) {
+        scope.push_back(op);
+        body.accept(this);
+        scope.pop_back();
+    }
+
+    void visit(const For *op) override {
+        op->min.accept(this);
+        op->extent.accept(this);
+        visit_scope(op, op->body);
+    }
+
+    void visit(const IfThenElse *op) override {
+        op->condition.accept(this);
+        visit_scope(op, op->then_case);
+        if (op->else_case.defined()) {
+            visit_scope(op, op->else_case);
+        }
+    }
+
+    void visit(const Allocate *op) override {
+        allocations.insert(op->name);
+        for (const auto &extent : op->extents) {
+            extent.accept(this);
+        }
+        visit_scope(op, op->body);
+    }
+
+    void visit(const Fork *op) override {
+        visit_scope(op, op->first);
+        visit_scope(op, op->rest);
+    }
+
+    void visit(const Acquire *op) override {
+        op->semaphore.accept(this);
+        op->count.accept(this);
+        visit_scope(op, op->body);
+    }
+
+    void visit(const Realize *op) override {
+        if (ends_with(op->name, ".stencil")) {
+            realizes[op->name] = {op, scope, (int)realizes.size()};
+        }
+        IRVisitor::visit(op);
+    }
+
+    void visit(const ProducerConsumer *op) override {
+        if (starts_with(op->name, target_prefix)) {
+            if (op->is_producer) {
+                producer_scopes[op->name] = scope;
+                return;  // the accelerator body runs on the device
+            }
+            string outer_consumer = current_consumer;
+            current_consumer = op->name;
+            op->body.accept(this);
+            current_consumer = outer_consumer;
+        } else {
+            IRVisitor::visit(op);
+        }
+    }
+
+    void visit(const Store *op) override {
+        num_stores[op->name] += 1;
+        if (!current_consumer.empty()) {
+            consumer_stores[current_consumer].insert(op->name);
+            const Call *call = op->value.as<Call>();
+            string output_stencil = current_consumer.substr(target_prefix.length() + 1) + ".stencil";
+            CopyOut copy_out = {current_consumer, output_stencil, {}, op->index};
+            if (call && call->name == output_stencil && op->value.type() == call->type &&
+                is_one(op->predicate) && as_vars(call->args, copy_out.vars)) {
+                copy_outs[op->name].push_back(copy_out);
+            } else {
+                impure_consumers.insert(current_consumer);
+            }
+        }
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Provide *op) override {
+        num_provides[op->name] += 1;
+        if (!current_consumer.empty()) {
+            impure_consumers.insert(current_consumer);
+        }
+        const Load *load = op->values.size() == 1 ? op->values[0].as<Load>() : nullptr;
+        CopyIn copy_in = {op->name, "", {}, Expr()};
+        if (load && ends_with(op->name, ".stencil") && is_one(load->predicate) &&
+            as_vars(op->args, copy_in.vars)) {
+            copy_in.buffer = load->name;
+            copy_in.index = load->index;
+            copy_ins.push_back(copy_in);
+        }
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Evaluate *op) override {
+        if (!current_consumer.empty()) {
+            impure_consumers.insert(current_consumer);
+        }
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Load *op) override {
+        num_loads[op->name] += 1;
+        IRVisitor::visit(op);
+    }
+
+    // Every element of Y.stencil comes from the element of X.stencil at the
+    // same offset from the realized minimum
+    bool same_element(const CopyOut &out, const CopyIn &in) {
+        if (!realizes.count(out.stencil) || !realizes.count(in.stencil)) {
+            return false;
+        }
+        const StencilRealize &x = realizes.at(out.stencil);
+        const StencilRealize &y = realizes.at(in.stencil);
+        if (x.order >= y.order || x.scope != y.scope ||
+            !producer_scopes.count(out.xcel) || producer_scopes.at(out.xcel) != x.scope ||
+            x.op->types != y.op->types || x.op->bounds.size() != y.op->bounds.size() ||
+            out.vars.size() != x.op->bounds.size() || in.vars.size() != y.op->bounds.size()) {
+            return false;
+        }
+
+        map<string, Expr> offset_vars;
+        for (size_t i = 0; i < x.op->bounds.size(); i++) {
+            const Range &xr = x.op->bounds[i];
+            const Range &yr = y.op->bounds[i];
+            if (!is_zero(simplify(xr.extent - yr.extent))) {
+                return false;
+            }
+            Expr y_var = Variable::make(Int(32), in.vars[i]);
+            offset_vars[out.vars[i]] = y_var - yr.min + xr.min;
+        }
+        return is_zero(simplify(substitute(offset_vars, out.index) - in.index));
+    }
+
+public:
+    map<string, string> stencil_aliases;           // Y.stencil -> X.stencil
+    std::set<string> device_resident_buffers;      // host copies that are not needed
+    std::set<string> device_resident_xcels;        // accelerators whose output is not read on the host
+
+    FindAcceleratorChains(Stmt s) {
+        s.accept(this);
+
+        map<string, int> aliased_loads;
+        for (const auto &copy_in : copy_ins) {
+            if (!copy_outs.count(copy_in.buffer) || num_stores[copy_in.buffer] != 1 ||
+                num_provides[copy_in.stencil] != 1) {
+                continue;
+            }
+            const CopyOut &copy_out = copy_outs.at(copy_in.buffer)[0];
+            if (same_element(copy_out, copy_in)) {
+                stencil_aliases[copy_in.stencil] = copy_out.stencil;
+                aliased_loads[copy_in.buffer] += 1;
+            }
+        }
+
+        // A host buffer only read by the chained copies is not needed at all
+        for (const auto &loads : aliased_loads) {
+            const string &buffer = loads.first;
+            if (allocations.count(buffer) && num_loads[buffer] == loads.second) {
+                device_resident_buffers.insert(buffer);
+            }
+        }
+        for (const auto &stores : consumer_stores) {
+            bool all_resident = !impure_consumers.count(stores.first);
+            for (const auto &buffer : stores.second) {
+                all_resident &= device_resident_buffers.count(buffer) > 0;
+            }
+            if (all_resident) {
+                device_resident_xcels.insert(stores.first);
+            }
+        }
+    }
+};
+
 class CountAccelerators : public IRVisitor {
     using IRVisitor::visit;
     void visit(const ProducerConsumer *op) {
@@ -345,10 +755,70 @@ int accelerator_count(Stmt s) {
     return ca.xcels.size();
 }
 
+void CodeGen_RDAI::visit(const Store *op) {
+    if (device_resident_buffers.count(op->name)) {
+        return;
+    }
+    CodeGen_C::visit(op);
+}
+
 void CodeGen_RDAI::compile(const LoweredFunc &func) {
     func_args = func.args;
     num_xcels = accelerator_count(func.body);
+
+    FindAcceleratorChains chains(func.body);
+    stencil_aliases = chains.stencil_aliases;
+    device_resident_buffers = chains.device_resident_buffers;
+    device_resident_xcels = chains.device_resident_xcels;
+    alias_readers.clear();
+    for (const auto &alias : stencil_aliases) {
+        alias_readers[root_stencil(alias.first)] += 1;
+    }
     CodeGen_C::compile(func);
+
+    if (func.linkage == LinkageType::Internal || num_xcels == 0) {
+        return;
+    }
+
+    // Asynchronous entry point: the pipeline runs on its own host thread,
+    // and device runs from successive calls are serialized by the session.
+    // A host can submit frame N+1 before waiting on frame N.
+    set_name_mangling_mode(NameMangling::CPlusPlus);
+    vector<string> namespaces;
+    string simple_name = extract_namespaces(func.name, namespaces);
+    string qualified_name;
+    for (const auto &ns : namespaces) {
+        qualified_name += "::" + ns;
+    }
+    qualified_name += "::" + simple_name;
+
+    stream << "\n";
+    if (is_header()) {
+        // C code including the header only sees the blocking entry point
+        stream << "#ifdef __cplusplus\n";
+        stream << "#include <future>\n";
+    }
+    stream << "std::future<int> " << simple_name << "_submit(";
+    for (size_t i = 0; i < func.args.size(); i++) {
+        if (func.args[i].is_buffer()) {
+            stream << "struct halide_buffer_t *";
+        } else {
+            stream << print_type(func.args[i].type, AppendSpace);
+        }
+        stream << "arg" << i << (i + 1 < func.args.size() ? ", " : "");
+    }
+    if (is_header()) {
+        stream << ");\n";
+        stream << "#endif\n";
+        return;
+    }
+    stream << ") {\n";
+    stream << "    return std::async(std::launch::async, " << qualified_name;
+    for (size_t i = 0; i < func.args.size(); i++) {
+        stream << ", arg" << i;
+    }
+    stream << ");\n";
+    stream << "}\n";
 }
 
 } // namespace Halide::Internal
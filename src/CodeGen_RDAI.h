@@ -6,6 +6,8 @@
  * Defines the code-generator for producing RDAI-compatible wrappers
  */
 #include <iostream>
+#include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -66,7 +68,8 @@ struct RDAI_TargetGenLike
 
 class CodeGen_RDAI : public CodeGen_C {
 public:
-    CodeGen_RDAI(std::ostream &pipeline_stream, const Target& target, string pipeline_name);
+    CodeGen_RDAI(std::ostream &pipeline_stream, const Target& target, string pipeline_name,
+                 OutputKind output_kind = CPlusPlusImplementation, const string &guard = "");
 
     void set_output_folder(const string& out_folder);
 
@@ -83,11 +86,15 @@ protected:
     void visit(const ProducerConsumer *op) override;
     void visit(const Provide *op) override;
     void visit(const Realize *op) override;
+    void visit(const Store *op) override;
 
 
     void compile(const LoweredFunc &func) override;
     
     std::string print_name(const string& name);
+    void wait_for_run(const string& xcel_name);
+    void wait_for_buffer(const string& stencil_name);
+    string root_stencil(const string& stencil_name);
 
 protected:
     Scope<HW_Stencil_Type> stencils;
@@ -100,6 +107,29 @@ protected:
     vector<LoweredArgument> func_args;
     bool inserted_host_buf_calls = false;
     int num_xcels;
+
+    // accelerator runs submitted but not yet waited on, by accelerator name
+    std::map<string, string> pending_runs;
+    std::map<string, std::set<string>> run_buffers;
+    std::map<string, string> stencil_runs;
+
+    // accelerator outputs that are passed to the next accelerator in device memory
+    std::map<string, string> stencil_aliases;
+    std::map<string, int> alias_readers;
+    std::set<string> device_resident_buffers;
+    std::set<string> device_resident_xcels;
+};
+
+/** Emits the header of an RDAI pipeline, which also declares the
+ * asynchronous <name>_submit entry point of the pipeline. */
+class CodeGen_RDAI_Header : public CodeGen_RDAI {
+public:
+    CodeGen_RDAI_Header(std::ostream &header_stream, const Target& target, string pipeline_name,
+                        const string &guard)
+        : CodeGen_RDAI(header_stream, target, pipeline_name, CHeader, guard) {}
+
+    // No accelerator code is generated for a header
+    RDAI_TargetGenLike *get_target_codegen() override { return nullptr; }
 };
 
 }
@@ -288,13 +288,16 @@ void CodeGen_VHLS_Base::visit(const Call *op) {
             consumer_stream_type.depth = std::max(consumer_fifo_depth[i], 1); // HLS tool doesn't support zero-depth FIFO yet
             do_indent();
             stream << print_stencil_type(consumer_stream_type) << ' '
-                   << print_name(consumer_stream_name) << ";\n";
+                   << print_name(consumer_stream_name) << "(\"" << consumer_stream_name << "\");\n";
             // pragma
             stencils.push(consumer_stream_name, consumer_stream_type);
             stream << print_stencil_pragma(consumer_stream_name);
             stencils.pop(consumer_stream_name);
         }
 
+        // the consumer streams are declared outside of the dispatching process
+        bool process = begin_dataflow_process();
+
         // emits for a loop for each dimensions (larger dimension number, outer the loop)
         for (int i = num_of_demensions - 1; i >= 0; i--) {
             string dim_name = "_dim_" + to_string(i);
@@ -342,6 +345,7 @@ void CodeGen_VHLS_Base::visit(const Call *op) {
         }
 
         close_scope("");
+        end_dataflow_process(process);
 
         id = "0"; // skip evaluation
     } else {
@@ -360,7 +364,9 @@ void CodeGen_VHLS_Base::visit(const Realize *op) {
 
         // emits the declaration for the stream
         do_indent();
-        stream << print_stencil_type(stream_type) << ' ' << print_name(op->name) << ";\n";
+        // named, so the simulation can report the stream
+        stream << print_stencil_type(stream_type) << ' ' << print_name(op->name)
+               << "(\"" << op->name << "\");\n";
         stream << print_stencil_pragma(op->name);
 
         // traverse down
@@ -41,6 +41,14 @@ protected:
     virtual std::string print_name(const std::string &name);
     virtual std::string print_stencil_pragma(const std::string &name);
 
+    /** Called around a process of a dataflow region that is emitted
+     * inline, such as the loop that dispatches a stream to its consumers.
+     * Returns whether a process was opened, to be passed to the end call. */
+    // @{
+    virtual bool begin_dataflow_process() { return false; }
+    virtual void end_dataflow_process(bool opened) {}
+    // @}
+
     using CodeGen_C::visit;
 
     void visit(const Call *);
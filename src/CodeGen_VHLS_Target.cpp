@@ -75,7 +75,6 @@ const string vhls_header_includes =
     "#include <assert.h>\n"
     "#include <stdio.h>\n"
     "#include <stdlib.h>\n"
-    "#include <hls_stream.h>\n"
     "#include \"Stencil.h\"\n";
 
 const string local_halide_helpers =
@@ -135,6 +134,10 @@ string CodeGen_VHLS_Target::CodeGen_VHLS_C::print_stencil_pragma(const string &n
             // use shift register implementation when the FIFO is shallow
             oss << "#pragma HLS RESOURCE variable=" << print_name(name) << " core=FIFO_SRL\n\n";
         }
+        // the threaded C simulation bounds the FIFO to the same depth
+        oss << "#ifdef HALIDE_DATAFLOW_THREADS\n"
+            << print_name(name) << ".set_depth(" << stype.depth << ");\n"
+            << "#endif\n";
     } else if (stype.type == Stencil_Type::StencilContainerType::Stencil) {
         oss << "#pragma HLS ARRAY_PARTITION variable=" << print_name(name) << ".value complete dim=0\n\n";
     } else {
@@ -219,8 +222,20 @@ void CodeGen_VHLS_Target::CodeGen_VHLS_C::add_kernel(Stmt stmt,
         }
         stream << "\n";
 
+        stream << "#ifdef HALIDE_DATAFLOW_THREADS\n";
+        do_indent();
+        stream << "hls::dataflow dataflow_processes;\n";
+        stream << "#endif\n";
+
         // print body
+        at_dataflow_level = true;
         print(stmt);
+        at_dataflow_level = false;
+
+        stream << "#ifdef HALIDE_DATAFLOW_THREADS\n";
+        do_indent();
+        stream << "dataflow_processes.join();\n";
+        stream << "#endif\n";
 
         close_scope("kernel hls_target" + print_name(name));
     }
@@ -235,9 +250,76 @@ void CodeGen_VHLS_Target::CodeGen_VHLS_C::add_kernel(Stmt stmt,
     }
 }
 
+// The processes of a dataflow region run concurrently in hardware,
+// connected by FIFOs. The threaded C simulation wraps each one in a lambda
+// that runs on its own thread. Otherwise no scope is added, as it would
+// hide the process from the dataflow analysis of the HLS compiler.
+bool CodeGen_VHLS_Target::CodeGen_VHLS_C::begin_dataflow_process() {
+    if (!at_dataflow_level) {
+        return false;
+    }
+    stream << "#ifdef HALIDE_DATAFLOW_THREADS\n";
+    do_indent();
+    stream << "dataflow_processes.spawn([&]() {\n";
+    stream << "#endif\n";
+    // expressions cached outside the process are not visible inside it
+    cache.clear();
+    at_dataflow_level = false;
+    return true;
+}
+
+void CodeGen_VHLS_Target::CodeGen_VHLS_C::end_dataflow_process(bool opened) {
+    if (!opened) {
+        return;
+    }
+    stream << "#ifdef HALIDE_DATAFLOW_THREADS\n";
+    do_indent();
+    stream << "});\n";
+    stream << "#endif\n";
+    cache.clear();
+    at_dataflow_level = true;
+}
+
+void CodeGen_VHLS_Target::CodeGen_VHLS_C::print_dataflow_process(Stmt s) {
+    bool opened = begin_dataflow_process();
+    s.accept(this);
+    end_dataflow_process(opened);
+}
+
+void CodeGen_VHLS_Target::CodeGen_VHLS_C::visit(const Evaluate *op) {
+    const Call *call = op->value.as<Call>();
+    // dispatch_stream declares its consumer streams before it opens a process
+    if (at_dataflow_level && !is_const(op->value) &&
+        !(call && call->name == "dispatch_stream")) {
+        print_dataflow_process(op);
+    } else {
+        CodeGen_VHLS_Base::visit(op);
+    }
+}
+
+void CodeGen_VHLS_Target::CodeGen_VHLS_C::visit(const IfThenElse *op) {
+    if (at_dataflow_level) {
+        print_dataflow_process(op);
+    } else {
+        CodeGen_VHLS_Base::visit(op);
+    }
+}
+
+void CodeGen_VHLS_Target::CodeGen_VHLS_C::visit(const Provide *op) {
+    if (at_dataflow_level) {
+        print_dataflow_process(op);
+    } else {
+        CodeGen_VHLS_Base::visit(op);
+    }
+}
+
 // almost that same as CodeGen_C::visit(const For *)
 // we just add a 'HLS PIPELINE' pragma after the 'for' statement
 void CodeGen_VHLS_Target::CodeGen_VHLS_C::visit(const For *op) {
+    if (at_dataflow_level) {
+        print_dataflow_process(op);
+        return;
+    }
     internal_assert(op->for_type == ForType::Serial)
         << "Can only emit serial for loops to HLS C\n";
 
@@ -64,11 +64,27 @@ protected:
     protected:
         std::string print_stencil_pragma(const std::string &name);
         std::string output_base_path;
-        
+
+        /** Set while printing the top level of a kernel, whose statements
+         * are the processes of its dataflow region. */
+        bool at_dataflow_level = false;
+
+        /** Print a process of the dataflow region. With
+         * HALIDE_DATAFLOW_THREADS the C simulation runs it on its own
+         * thread. */
+        // @{
+        void print_dataflow_process(Stmt s);
+        bool begin_dataflow_process();
+        void end_dataflow_process(bool opened);
+        // @}
+
         using CodeGen_VHLS_Base::visit;
 
         void visit(const For *op);
         void visit(const Allocate *op);
+        void visit(const Evaluate *op);
+        void visit(const IfThenElse *op);
+        void visit(const Provide *op);
     };
 
     /** A name for the VHLS target */
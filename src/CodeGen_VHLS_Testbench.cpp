@@ -61,7 +61,6 @@ vector<VHLS_Argument> VHLS_Closure::arguments(const Scope<CodeGen_VHLS_Base::Ste
 
 namespace {
     const string vhls_headers =
-        "#include <hls_stream.h>\n"
         "#include \"Stencil.h\"\n"
         "#include \"vhls_target.h\"\n";
 }
@@ -353,6 +353,343 @@ public:
   
 };
 
+// Resource sharing: once a kernel is built, the multipliers, adders and
+// subtractors of the same width are bound onto a few shared units. Each
+// unit serves one operation per cycle of a window of share_cycles cycles,
+// counted from the cycle the kernel issues. Results used in a later cycle
+// are held in registers enabled in the cycle they are computed.
+struct SharedOp {
+  CoreIR::Instance* inst;
+  string op_class;
+  int width;
+  CoreIR::Wireable* in0_driver;
+  CoreIR::Wireable* in1_driver;
+  vector<CoreIR::Wireable*> sinks;
+  std::set<CoreIR::Instance*> succs;
+  int step = -1;
+  int unit = -1;
+};
+
+string instance_gen_name(CoreIR::Instance* inst) {
+  auto mod = inst->getModuleRef();
+  return mod->isGenerated() ? mod->getGenerator()->getRefName() : mod->getRefName();
+}
+
+bool breaks_comb_path(CoreIR::Instance* inst) {
+  string gen_name = instance_gen_name(inst);
+  return gen_name.find("reg") != string::npos || gen_name == "commonlib.counter" ||
+    gen_name.compare(0, 7, "memory.") == 0 || gen_name.compare(0, 8, "lakelib.") == 0;
+}
+
+CoreIR::Wireable* base_of(CoreIR::Wireable* w) {
+  while (CoreIR::isa<CoreIR::Select>(w)) {
+    w = static_cast<CoreIR::Select*>(w)->getParent();
+  }
+  return w;
+}
+
+void connected_sinks(CoreIR::Wireable* w, vector<CoreIR::Wireable*>& sinks) {
+  for (auto c : w->getConnectedWireables()) {
+    if (c->getType()->hasInput()) {
+      sinks.push_back(c);
+    }
+  }
+  for (auto sel : w->getSelects()) {
+    connected_sinks(sel.second, sinks);
+  }
+}
+
+// Only operators wired as whole words are rebound
+bool whole_port_driver(CoreIR::Wireable* port, CoreIR::Wireable*& driver) {
+  if (!port->getSelects().empty() || port->getConnectedWireables().size() != 1) {
+    return false;
+  }
+  driver = *port->getConnectedWireables().begin();
+  return true;
+}
+
+// Shareable operators reached from an operator output through combinational logic
+void shared_successors(CoreIR::Wireable* w, const map<CoreIR::Instance*, SharedOp>& ops,
+                       std::set<CoreIR::Instance*>& visited, std::set<CoreIR::Instance*>& succs) {
+  vector<CoreIR::Wireable*> sinks;
+  connected_sinks(w, sinks);
+  for (auto sink : sinks) {
+    auto base = base_of(sink);
+    if (!CoreIR::isa<CoreIR::Instance>(base)) { continue; }
+    auto inst = static_cast<CoreIR::Instance*>(base);
+    if (ops.count(inst) > 0) {
+      succs.insert(inst);
+    } else if (!breaks_comb_path(inst) && visited.count(inst) == 0) {
+      visited.insert(inst);
+      shared_successors(inst, ops, visited, succs);
+    }
+  }
+}
+
+// List schedule every operator into a window step on one of the units of
+// its class. Returns false if a dependence chain is longer than the window.
+bool schedule_shared_ops(map<CoreIR::Instance*, SharedOp>& ops, int share_cycles,
+                         map<string, int>& num_units) {
+  map<CoreIR::Instance*, int> num_preds;
+  for (auto& op_pair : ops) {
+    for (auto succ : op_pair.second.succs) {
+      num_preds[succ] += 1;
+    }
+  }
+
+  // topological order, with each ready operator taken in name order
+  vector<CoreIR::Instance*> order;
+  vector<CoreIR::Instance*> ready;
+  for (auto& op_pair : ops) {
+    if (num_preds[op_pair.first] == 0) { ready.push_back(op_pair.first); }
+  }
+  while (!ready.empty()) {
+    auto inst = ready.front();
+    ready.erase(ready.begin());
+    order.push_back(inst);
+    for (auto succ : ops.at(inst).succs) {
+      if (--num_preds[succ] == 0) { ready.push_back(succ); }
+    }
+  }
+  internal_assert(order.size() == ops.size()) << "shared operators form a combinational loop\n";
+
+  while (true) {
+    map<string, vector<vector<bool>>> busy;
+    for (auto& units : num_units) {
+      busy[units.first] = vector<vector<bool>>(units.second, vector<bool>(share_cycles, false));
+    }
+    for (auto inst : order) {
+      ops.at(inst).step = 0;
+    }
+
+    string full_class = "";
+    for (auto inst : order) {
+      auto& op = ops.at(inst);
+      auto& class_busy = busy.at(op.op_class);
+      op.unit = -1;
+      for (int step = op.step; step < share_cycles && op.unit < 0; ++step) {
+        for (size_t unit = 0; unit < class_busy.size(); ++unit) {
+          if (!class_busy[unit][step]) {
+            class_busy[unit][step] = true;
+            op.step = step;
+            op.unit = unit;
+            break;
+          }
+        }
+      }
+      if (op.unit < 0) {
+        full_class = op.op_class;
+        break;
+      }
+      for (auto succ : op.succs) {
+        ops.at(succ).step = std::max(ops.at(succ).step, op.step + 1);
+      }
+    }
+
+    if (full_class.empty()) {
+      return true;
+    }
+    int class_size = 0;
+    for (auto& op_pair : ops) {
+      class_size += op_pair.second.op_class == full_class ? 1 : 0;
+    }
+    if (num_units[full_class] >= class_size) {
+      return false;
+    }
+    num_units[full_class] += 1;
+  }
+}
+
+void share_functional_units(CoreIR::ModuleDef* def, int share_cycles,
+                            CoreIR::Context* context, ostream& stream) {
+  auto gens = coreir_generators(context);
+  std::set<string> shareable = {gens["mul"], gens["add"], gens["sub"]};
+
+  map<CoreIR::Instance*, SharedOp> ops;
+  for (auto inst_pair : def->getInstances()) {
+    auto inst = inst_pair.second;
+    string gen_name = instance_gen_name(inst);
+    if (shareable.count(gen_name) == 0) { continue; }
+
+    SharedOp op;
+    op.inst = inst;
+    op.width = inst->getModuleRef()->getGenArgs().at("width")->get<int>();
+    op.op_class = gen_name + std::to_string(op.width);
+    if (!whole_port_driver(inst->sel("in0"), op.in0_driver) ||
+        !whole_port_driver(inst->sel("in1"), op.in1_driver) ||
+        !inst->sel("out")->getSelects().empty()) {
+      continue;
+    }
+    connected_sinks(inst->sel("out"), op.sinks);
+    ops[inst] = op;
+  }
+
+  // Drop classes that cannot save a unit, until the binding is stable
+  map<string, int> num_units;
+  while (true) {
+    for (auto& op_pair : ops) {
+      std::set<CoreIR::Instance*> visited;
+      op_pair.second.succs.clear();
+      shared_successors(op_pair.first->sel("out"), ops, visited, op_pair.second.succs);
+    }
+
+    map<string, int> class_sizes;
+    for (auto& op_pair : ops) {
+      class_sizes[op_pair.second.op_class] += 1;
+    }
+    num_units.clear();
+    for (auto& class_pair : class_sizes) {
+      num_units[class_pair.first] = (class_pair.second + share_cycles - 1) / share_cycles;
+    }
+
+    if (!schedule_shared_ops(ops, share_cycles, num_units)) {
+      stream << "// not sharing units: a dependence chain is longer than "
+             << share_cycles << " cycles" << endl;
+      return;
+    }
+
+    std::set<string> unshared;
+    for (auto& class_pair : class_sizes) {
+      if (num_units[class_pair.first] >= class_pair.second) {
+        unshared.insert(class_pair.first);
+      }
+    }
+    if (unshared.empty()) { break; }
+    for (auto it = ops.begin(); it != ops.end(); ) {
+      it = unshared.count(it->second.op_class) > 0 ? ops.erase(it) : std::next(it);
+    }
+  }
+  if (ops.empty()) { return; }
+
+  // control: the step of the window, which is zero in the cycle the kernel
+  // issues (in_en is high) and counts up after it, and an enable for each step
+  auto self = def->sel("self");
+  uint sel_bits = num_bits(share_cycles - 1);
+  CoreIR::Values sel_width = {{"width", CoreIR::Const::make(context, sel_bits)}};
+  auto window_const = [&](string name, int value) {
+    return def->addInstance(name, gens["const"], sel_width,
+                            {{"value", CoreIR::Const::make(context, BitVector(sel_bits, value))}})->sel("out");
+  };
+  auto step_zero = window_const("share_step_zero", 0);
+  auto step_reg = def->addInstance("share_step_reg", "coreir.reg", sel_width);
+  auto window_step = def->addInstance("share_step", gens["mux"], sel_width);
+  def->connect(step_reg->sel("out"), window_step->sel("in0"));
+  def->connect(step_zero, window_step->sel("in1"));
+  def->connect(self->sel("in_en"), window_step->sel("sel"));
+  def->connect(self->sel("clk"), step_reg->sel("clk"));
+
+  auto step_inc = def->addInstance("share_step_inc", gens["add"], sel_width);
+  def->connect(window_step->sel("out"), step_inc->sel("in0"));
+  def->connect(window_const("share_step_one", 1), step_inc->sel("in1"));
+  auto step_at_last = def->addInstance("share_step_at_last", gens["eq"], sel_width);
+  def->connect(window_step->sel("out"), step_at_last->sel("in0"));
+  def->connect(window_const("share_step_last", share_cycles - 1), step_at_last->sel("in1"));
+  auto step_next = def->addInstance("share_step_next", gens["mux"], sel_width);
+  def->connect(step_inc->sel("out"), step_next->sel("in0"));
+  def->connect(step_zero, step_next->sel("in1"));
+  def->connect(step_at_last->sel("out"), step_next->sel("sel"));
+  def->connect(step_next->sel("out"), step_reg->sel("in"));
+
+  map<int, CoreIR::Wireable*> step_enables;
+  auto step_enable = [&](int step) {
+    if (step_enables.count(step) == 0) {
+      string name = "share_step" + std::to_string(step);
+      auto step_const = def->addInstance(name + "_const", gens["const"], {{"width", CoreIR::Const::make(context, sel_bits)}},
+                                         {{"value", CoreIR::Const::make(context, BitVector(sel_bits, step))}});
+      auto step_eq = def->addInstance(name + "_eq", gens["eq"], {{"width", CoreIR::Const::make(context, sel_bits)}});
+      def->connect(window_step->sel("out"), step_eq->sel("in0"));
+      def->connect(step_const->sel("out"), step_eq->sel("in1"));
+      step_enables[step] = step_eq->sel("out");
+    }
+    return step_enables.at(step);
+  };
+
+  // group the operators of each unit by step
+  map<string, map<int, vector<SharedOp*>>> units;
+  for (auto& op_pair : ops) {
+    auto& op = op_pair.second;
+    units[op.op_class][op.unit].push_back(&op);
+  }
+
+  // results in the last step are read directly, others are registered
+  map<CoreIR::Wireable*, CoreIR::Wireable*> results;
+  map<string, map<int, CoreIR::Instance*>> unit_insts;
+  for (auto& class_pair : units) {
+    for (auto& unit_pair : class_pair.second) {
+      SharedOp* first = unit_pair.second.at(0);
+      string unit_name = "shared_" + class_pair.first + "_u" + std::to_string(unit_pair.first);
+      auto unit = def->addInstance(unit_name, instance_gen_name(first->inst),
+                                   {{"width", CoreIR::Const::make(context, first->width)}});
+      unit_insts[class_pair.first][unit_pair.first] = unit;
+
+      for (auto op : unit_pair.second) {
+        CoreIR::Wireable* result = unit->sel("out");
+        if (op->step < share_cycles - 1) {
+          auto reg = def->addInstance(op->inst->getInstname() + "_reg", "mantle.reg",
+                                      {{"width", CoreIR::Const::make(context, op->width)},
+                                       {"has_en", CoreIR::Const::make(context, true)}});
+          def->connect(unit->sel("out"), reg->sel("in"));
+          def->connect(step_enable(op->step), reg->sel("en"));
+          def->connect(self->sel("clk"), reg->sel("clk"));
+          result = reg->sel("out");
+        }
+        results[op->inst->sel("out")] = result;
+        stream << "// bound " << op->inst->getInstname() << " to " << unit_name
+               << " in step " << op->step << endl;
+      }
+    }
+  }
+
+  // operands are selected by the step of the window
+  auto operand = [&](CoreIR::Wireable* driver) {
+    return results.count(driver) > 0 ? results.at(driver) : driver;
+  };
+  for (auto& class_pair : units) {
+    for (auto& unit_pair : class_pair.second) {
+      SharedOp* first = unit_pair.second.at(0);
+      auto unit = unit_insts.at(class_pair.first).at(unit_pair.first);
+      vector<CoreIR::Wireable*> in0_drivers(share_cycles, operand(first->in0_driver));
+      vector<CoreIR::Wireable*> in1_drivers(share_cycles, operand(first->in1_driver));
+      for (auto op : unit_pair.second) {
+        in0_drivers[op->step] = operand(op->in0_driver);
+        in1_drivers[op->step] = operand(op->in1_driver);
+      }
+
+      for (auto port : {"in0", "in1"}) {
+        auto& drivers = string(port) == "in0" ? in0_drivers : in1_drivers;
+        auto mux = def->addInstance(unit->getInstname() + "_" + port + "_mux", gens["muxn"],
+                                    {{"width", CoreIR::Const::make(context, first->width)},
+                                     {"N", CoreIR::Const::make(context, share_cycles)}});
+        def->connect(window_step->sel("out"), mux->sel("in")->sel("sel"));
+        for (int step = 0; step < share_cycles; ++step) {
+          def->connect(drivers[step], mux->sel("in")->sel("data")->sel(step));
+        }
+        def->connect(mux->sel("out"), unit->sel(port));
+      }
+    }
+  }
+
+  // move the remaining consumers over to the results
+  for (auto& op_pair : ops) {
+    def->disconnect(op_pair.first);
+  }
+  for (auto& op_pair : ops) {
+    auto& op = op_pair.second;
+    auto result = results.at(op.inst->sel("out"));
+    for (auto sink : op.sinks) {
+      auto base = base_of(sink);
+      if (!CoreIR::isa<CoreIR::Instance>(base) || ops.count(static_cast<CoreIR::Instance*>(base)) == 0) {
+        def->connect(result, sink);
+      }
+    }
+  }
+  for (auto& op_pair : ops) {
+    def->removeInstance(op_pair.first);
+  }
+
+  stream << "// shared " << ops.size() << " operators over " << share_cycles << " cycles" << endl;
+}
+
 void add_coreir_compute(Expr e, CoreIR::ModuleDef* def, CoreIR_Interface iface,
                         vector<CoreIR_Inst_Args> coreir_insts, CoreIR::Context* context) {
   //ofstream compute_debug_file("bin/compute_debug_" + iface.name + ".cpp");
@@ -372,6 +709,11 @@ void add_coreir_compute(Expr e, CoreIR::ModuleDef* def, CoreIR_Interface iface,
   //ofstream compute_debug_file("/dev/null");
   ofstream compute_debug_file("bin/clockwork_compute_debug.cpp", std::ios::app);
   ccm.connect_output(e);
+  if (iface.share_cycles > 1) {
+    share_functional_units(def, iface.share_cycles, context, compute_debug_str);
+    // the kernel can't issue more often than once per window
+    def->getModule()->getMetaData()["initiation_interval"] = iface.share_cycles;
+  }
   compute_debug_file << iface.name << "() {" << endl
                      << compute_debug_str.str()
                      << "}" << endl << endl;
@@ -1745,6 +2087,12 @@ CoreIR::Type* interface_to_type(CoreIR_Interface iface, CoreIR::Context* context
     recordparams.push_back({index_name, index_type});
   }
 
+  // shared units are time-multiplexed over the cycles after each issue
+  if (iface.share_cycles > 1) {
+    recordparams.push_back({"clk", context->Named("coreir.clkIn")});
+    recordparams.push_back({"in_en", context->BitIn()});
+  }
+
   return context->Record(recordparams);
 }
 
@@ -29,6 +29,14 @@ struct CoreIR_Interface {
   CoreIR_Port output;
   std::vector<CoreIR_PortBundle> inputs;
   std::vector<CoreIR_Port> indices; // x, y, or c used in computation
+
+  // Cycles the kernel has to produce each output, which is the initiation
+  // interval of its stage. Above 1, the multipliers, adders and subtractors
+  // are bound onto fewer shared units that are time-multiplexed over the
+  // window. The kernel gets an in_en input that is high in the cycle it
+  // issues; the inputs must be held for the whole window, and the output is
+  // valid in its last cycle.
+  int share_cycles = 1;
 };
 
 /** Take a statement with for loops marked for unrolling, and convert
@@ -409,6 +409,13 @@ enum class MemoryType {
 
     /** Global Buffer for cgra */
     GLB,
+
+    /** Memory tile for cgra: banked SRAM, for large line buffers */
+    MemTile,
+
+    /** Pond for cgra: a small register file beside a processing
+     * element, for short reuse buffers */
+    Pond,
 };
 
 namespace Internal {
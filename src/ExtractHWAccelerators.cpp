@@ -1,5 +1,6 @@
 #include "ExtractHWAccelerators.h"
 #include "Func.h"
+#include "HWScheduleTargets.h"
 #include "IRMutator.h"
 
 namespace Halide {
@@ -26,6 +27,7 @@ struct SimpleHWXcel {
   LoopLevel store_level;
   LoopLevel compute_level;
   AccelerateType type;
+  vector<Function> scheduled_funcs;  // functions with hardware scheduling targets
 };
 
 class InsertHWXcel : public IRMutator {
@@ -40,6 +42,7 @@ class InsertHWXcel : public IRMutator {
     bool create_xcel = (xcel.type == AccelerateType::EnclosingFunc) || (xcel.type == AccelerateType::CombinedCallFunc);
       
     if (create_call) {
+      body = add_hw_schedule_targets(body, xcel.scheduled_funcs);
       string name = "_hls_target." + xcel.name;
       Stmt new_body_produce = ProducerConsumer::make_produce(name, body);
       Stmt new_body_consume = ProducerConsumer::make_consume(name, Evaluate::make(0));
@@ -124,6 +127,13 @@ Stmt insert_hwxcel(Stmt s, const SimpleHWXcel &xcel) {
 vector<SimpleHWXcel> find_marked_hwxcels(Stmt s, const map<string, Function> &env) {
   vector<SimpleHWXcel> xcels;
 
+  vector<Function> scheduled_funcs;
+  for (const auto &p : env) {
+    if (hw_schedule_targets(p.second).defined()) {
+      scheduled_funcs.push_back(p.second);
+    }
+  }
+
   // for each accelerated function, build a hardware xcel: a dag of HW kernels
   for (const auto &p : env) {
 
@@ -144,6 +154,7 @@ vector<SimpleHWXcel> find_marked_hwxcels(Stmt s, const map<string, Function> &en
       sched.is_accelerate_call_output() ? AccelerateType::SingleCall :
       sched.is_accelerator_output() ? AccelerateType::EnclosingFunc :
       AccelerateType::Undefined;
+    xcel.scheduled_funcs = scheduled_funcs;
 
     LoopLevel store_locked = xcel.store_level.lock();
     string store_varname =
@@ -1821,6 +1821,7 @@ void extract_hw_xcel_top_parameters(Stmt s, Function func,
     //std::cout << "Our buffer:\n" << kernel << std::endl; // << kernel.my_stmt;
     linearize_address_space(kernel);
     calculate_accumulation(kernel);
+    bank_hwbuffer(kernel);
   }
   //std::cout << "linearized address space" << std::endl;
 
@@ -1831,6 +1832,9 @@ void extract_hw_xcel_top_parameters(Stmt s, Function func,
   for (auto &hwbuffer_pair : xcel->hwbuffers) {
     auto& kernel = hwbuffer_pair.second;
     fixup_hwbuffer(kernel);
+    kernel.min_capacity = reuse_distance_capacity(kernel);
+    kernel.is_double_buffered = kernel.func.get_contents().defined() &&
+      kernel.func.schedule().is_double_buffered();
     //std::cout << hwbuffer_pair.first << " is extracted w/ inline=" << kernel.is_inlined << " and num_dims=" << kernel.dims.size() << std::endl;
     std::cout << "Final buffer:\n" << kernel << std::endl; // << kernel.my_stmt;
     exfile << "Final buffer:\n" << kernel << std::endl;
@@ -2650,6 +2650,12 @@ Func &Func::linebuffer() {
     return *this;
 }
 
+Func &Func::double_buffer() {
+    invalidate_cache();
+    func.schedule().is_double_buffered() = true;
+    return *this;
+}
+
 Func &Func::fifo_depth(Func consumer, int depth) {
     invalidate_cache();
     user_assert(depth > 0) << "Fifo depth must be greater than zero.\n";
@@ -2661,6 +2667,27 @@ Func &Func::fifo_depth(Func consumer, int depth) {
     return *this;
 }
 
+Func &Func::hw_initiation_interval(int ii) {
+    invalidate_cache();
+    user_assert(ii > 0) << "Initiation interval must be greater than zero.\n";
+    func.schedule().hw_initiation_interval() = ii;
+    return *this;
+}
+
+Func &Func::hw_unit_limit(const std::string &op, int n) {
+    invalidate_cache();
+    user_assert(n > 0) << "Unit limit for " << op << " must be greater than zero.\n";
+    func.schedule().hw_unit_limits()[op] = n;
+    return *this;
+}
+
+Func &Func::hw_critical_path(int target) {
+    invalidate_cache();
+    user_assert(target > 0) << "Critical path target must be greater than zero.\n";
+    func.schedule().hw_critical_path_target() = target;
+    return *this;
+}
+
 Func &Func::compute_inline() {
     return compute_at(LoopLevel::inlined());
 }
@@ -2251,10 +2251,47 @@ public:
      */
     Func &linebuffer();
 
-    /** Set the depth of the fifo from this function to consumer
+    /** Keep two copies of this function's hardware buffer (ping-pong)
+     * and alternate between them on successive tiles, so the next tile
+     * streams in while the current one is computed. For the unified
+     * buffer a tile is one run of the accelerator; for Clockwork it is
+     * one iteration of the loop this function is computed at, which
+     * must be inside the loop it is stored at. Each tile computes all
+     * of the function it needs, instead of reusing the values computed
+     * by the previous tile with a sliding window.
+     */
+    Func &double_buffer();
+
+    /** Set the depth of the fifo from this function to consumer.
+     * Stream optimization sizes every fifo from the latency of the
+     * pipeline; a depth set here is a lower bound on that size.
      */
     Func &fifo_depth(Func consumer, int depth);
 
+    /** Ask the hardware kernel computing this function to start a new
+     * iteration every ii cycles. Operations scheduled in different
+     * cycles of the interval may then share a functional unit. The
+     * scheduler raises the interval if the kernel can't meet it. For
+     * clockwork, the compute kernel of the stage shares its multipliers,
+     * adders and subtractors over a window of ii cycles.
+     */
+    Func &hw_initiation_interval(int ii);
+
+    /** Limit the hardware kernel computing this function to n
+     * functional units for the operation op (e.g. "mul" or "add").
+     * The kernel's initiation interval grows until its operations of
+     * that type fit on the units.
+     */
+    Func &hw_unit_limit(const std::string &op, int n);
+
+    /** Pipeline the hardware kernel computing this function so that no
+     * chain of operations between registers is slower than target, in
+     * the delay units of the hardware technology library. Registers
+     * are added only where a chain would exceed the target, so
+     * meeting it costs latency.
+     */
+    Func &hw_critical_path(int target);
+
     /** Aggressively inline all uses of this function. This is the
      * default schedule, so you're unlikely to need to call this. For
      * a Func with an update definition, that means it gets computed
@@ -2288,8 +2325,11 @@ public:
 
     /** Set the type of memory this Func should be stored in. Controls
      * whether allocations go on the stack or the heap on the CPU, and
-     * in global vs shared vs local on the GPU. See the documentation
-     * on MemoryType for more detail. */
+     * in global vs shared vs local on the GPU. In a hardware
+     * accelerator, GLB, MemTile, Pond and Register place the buffer in
+     * that level of the memory hierarchy and Heap keeps it off-chip;
+     * buffers left on Auto are placed from their size and access rate.
+     * See the documentation on MemoryType for more detail. */
     Func &store_in(MemoryType memory_type);
 
     /** Trace all loads from this Func by emitting calls to
@@ -0,0 +1,177 @@
+#include "HWBitwidth.h"
+#include "Bounds.h"
+#include "IROperator.h"
+#include "ModulusRemainder.h"
+#include "Simplify.h"
+
+#include <algorithm>
+
+using std::vector;
+
+namespace Halide {
+namespace Internal {
+
+namespace {
+
+bool get_const_value(const Expr &e, int64_t *value) {
+  if (const int64_t *i = as_const_int(e)) {
+    *value = *i;
+    return true;
+  } else if (const uint64_t *u = as_const_uint(e)) {
+    if (*u > (uint64_t)INT64_MAX) {
+      return false;
+    }
+    *value = (int64_t)*u;
+    return true;
+  }
+  return false;
+}
+
+// Round the bounds of the range in to the nearest values congruent to the
+// remainder, when every value of e has the same remainder
+Interval align_range(const Interval &range, const ModulusRemainder &mod_rem) {
+  int64_t lo, hi;
+  if (mod_rem.modulus <= 1 || !range.is_bounded() ||
+      !get_const_value(range.min, &lo) || !get_const_value(range.max, &hi)) {
+    return range;
+  }
+  int64_t m = mod_rem.modulus;
+  int64_t r = mod_rem.remainder;
+  int64_t lo_aligned = lo + mod_imp(r - lo, m);
+  int64_t hi_aligned = hi - mod_imp(hi - r, m);
+  if (lo_aligned > hi_aligned) {
+    return range;
+  }
+  Type t = range.min.type();
+  return Interval(make_const(t, lo_aligned), make_const(t, hi_aligned));
+}
+
+bool is_low_bit_op(const Expr &e) {
+  if (e.as<Add>() || e.as<Sub>() || e.as<Mul>()) {
+    return true;
+  } else if (const Mod *op = e.as<Mod>()) {
+    int bits;
+    return is_const_power_of_two_integer(op->b, &bits);
+  } else if (const Call *op = e.as<Call>()) {
+    return op->is_intrinsic(Call::bitwise_and) || op->is_intrinsic(Call::bitwise_or) ||
+      op->is_intrinsic(Call::bitwise_xor) || op->is_intrinsic(Call::bitwise_not) ||
+      op->is_intrinsic(Call::shift_left);
+  }
+  return false;
+}
+
+// The operands that a unit needing the bits of its widest operand reads
+vector<Expr> value_operands(const Expr &e) {
+  if (const EQ *op = e.as<EQ>()) {
+    return {op->a, op->b};
+  } else if (const NE *op = e.as<NE>()) {
+    return {op->a, op->b};
+  } else if (const LT *op = e.as<LT>()) {
+    return {op->a, op->b};
+  } else if (const LE *op = e.as<LE>()) {
+    return {op->a, op->b};
+  } else if (const GT *op = e.as<GT>()) {
+    return {op->a, op->b};
+  } else if (const GE *op = e.as<GE>()) {
+    return {op->a, op->b};
+  } else if (const Min *op = e.as<Min>()) {
+    return {op->a, op->b};
+  } else if (const Max *op = e.as<Max>()) {
+    return {op->a, op->b};
+  } else if (const Select *op = e.as<Select>()) {
+    return {op->true_value, op->false_value};
+  } else if (const Cast *op = e.as<Cast>()) {
+    // a cast to bool is built as a compare against zero
+    if (op->type.bits() == 1) {
+      return {op->value};
+    }
+  } else if (const Div *op = e.as<Div>()) {
+    int bits;
+    if (is_const_power_of_two_integer(op->b, &bits)) {
+      return {op->a, op->b};
+    }
+  } else if (const Call *op = e.as<Call>()) {
+    if (op->is_intrinsic(Call::shift_right)) {
+      return {op->args[0], op->args[1]};
+    }
+  }
+  return {};
+}
+
+}  // namespace
+
+int bitwidth_of_range(const Interval &range, Type t) {
+  int64_t lo, hi;
+  if (!(t.is_int() || t.is_uint()) || !range.is_bounded() ||
+      !get_const_value(range.min, &lo) || !get_const_value(range.max, &hi)) {
+    return t.bits();
+  }
+
+  int bits = 1;
+  if (t.is_int()) {
+    while (bits < t.bits() &&
+           (lo < -((int64_t)1 << (bits - 1)) || hi > ((int64_t)1 << (bits - 1)) - 1)) {
+      bits++;
+    }
+  } else {
+    if (lo < 0) {
+      return t.bits();
+    }
+    while (bits < t.bits() && hi > ((int64_t)1 << bits) - 1) {
+      bits++;
+    }
+  }
+  return bits;
+}
+
+int minimum_bitwidth(const Expr &e, const Scope<Interval> &scope) {
+  if (!(e.type().is_int() || e.type().is_uint()) || e.type().bits() == 1) {
+    return e.type().bits();
+  }
+
+  // the alignment analysis only handles signed integers
+  ModulusRemainder mod_rem = e.type().is_int() ? modulus_remainder(e) : ModulusRemainder();
+  if (mod_rem.modulus == 0) {
+    return bitwidth_of_range(Interval::single_point(make_const(e.type(), mod_rem.remainder)), e.type());
+  }
+
+  Interval range = bounds_of_expr_in_scope(e, scope, FuncValueBounds(), true);
+  if (range.is_bounded()) {
+    range = Interval(simplify(range.min), simplify(range.max));
+  }
+  return bitwidth_of_range(align_range(range, mod_rem), e.type());
+}
+
+int datapath_bitwidth(const Expr &e, const Scope<Interval> &scope) {
+  if (is_low_bit_op(e)) {
+    int bits = minimum_bitwidth(e, scope);
+    if (const Call *op = e.as<Call>()) {
+      if (op->is_intrinsic(Call::shift_left)) {
+        // the shift amount is sliced to the width of the unit too
+        bits = std::max(bits, minimum_bitwidth(op->args[1], scope));
+      }
+    }
+    return bits;
+  }
+
+  vector<Expr> operands = value_operands(e);
+  if (operands.empty() || !(operands[0].type().is_int() || operands[0].type().is_uint())) {
+    return operands.empty() ? e.type().bits() : operands[0].type().bits();
+  }
+  int bits = 1;
+  for (const Expr &operand : operands) {
+    bits = std::max(bits, minimum_bitwidth(operand, scope));
+  }
+  return bits;
+}
+
+int unit_bitwidth(const Expr &e, int wire_bitwidth, const Scope<Interval> &scope) {
+  if (wire_bitwidth == 1 || e.type().is_float()) {
+    return wire_bitwidth;
+  }
+  int bits = datapath_bitwidth(e, scope);
+  return std::min(wire_bitwidth, std::max(bits, 1));
+}
+
+}  // namespace Internal
+}  // namespace Halide
@@ -0,0 +1,46 @@
+#ifndef HALIDE_HW_BITWIDTH_H
+#define HALIDE_HW_BITWIDTH_H
+
+/** \file
+ * Defines the range analysis that the hardware code generators use to size
+ * datapath units to the values they actually compute.
+ */
+
+#include "Interval.h"
+#include "IR.h"
+#include "Scope.h"
+
+namespace Halide {
+namespace Internal {
+
+/** The number of bits needed to hold every value in the range, including a
+ * sign bit for signed types. Returns the width of the type when the range
+ * is not bounded by constants. */
+int bitwidth_of_range(const Interval &range, Type t);
+
+/** The number of bits needed to hold every value of an integer expression,
+ * given the ranges of the variables (loop counters and lets) in scope. */
+int minimum_bitwidth(const Expr &e, const Scope<Interval> &scope);
+
+/** The width of the functional unit that computes the outermost operation
+ * of e, with its inputs sliced to that width and its result extended back
+ * to the width of e's type:
+ * - add, sub, mul, shift left, bitwise ops and mod by a power of two only
+ *   need the bits of their result, because the low bits of those results
+ *   only depend on the low bits of their operands
+ * - comparisons (including casts to bool), min, max, select and shifts
+ *   right (including division by a power of two) need the bits of their
+ *   widest operand
+ * - everything else, and floats, is computed at the width of the operands'
+ *   type */
+int datapath_bitwidth(const Expr &e, const Scope<Interval> &scope);
+
+/** The width of the unit built for e when its inputs arrive on wires of
+ * wire_bitwidth bits: the datapath bitwidth of e, never wider than the
+ * wires. Single bit wires and floats are never narrowed. */
+int unit_bitwidth(const Expr &e, int wire_bitwidth, const Scope<Interval> &scope);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
@@ -1,5 +1,10 @@
+#include <algorithm>
+
 #include "HWBuffer.h"
 #include "HWBufferUtils.h"
+#include "IROperator.h"
+#include "IRPrinter.h"
+#include "Simplify.h"
 
 using std::string;
 using std::vector;
@@ -112,12 +117,19 @@ std::ostream& operator<<(std::ostream& os, const HWBuffer& buffer) {
     os << "Ostream " << olac_pair.first << " Linear Access Pattern: " << std::endl
        << olac_pair.second;
   }
+  for (const auto& ostream_pair : buffer.ostreams) {
+    os << "Ostream " << ostream_pair.first << " Banking: "
+       << ostream_pair.second.banking << std::endl;
+  }
 
   os << "streaming loops: " << buffer.streaming_loops << std::endl
      << "compute level: " << buffer.compute_level << std::endl
      << "store level: " << buffer.store_level << std::endl
      << "is_inline=" << buffer.is_inlined << std::endl
      << "is_output=" << buffer.is_output << std::endl
+     << "min_capacity=" << buffer.min_capacity << std::endl
+     << "is_double_buffered=" << buffer.is_double_buffered << std::endl
+     << "memory_level=" << buffer.memory_level << std::endl
      << "input_streams=" << input_istreams << std::endl
      << "output_streams=" << output_ostreams << std::endl;
   //<< "num_inputs=" << num_inputs << std::endl
@@ -223,7 +235,436 @@ vector<int> HWBuffer::get_output_block(string os_name) {
     return output_blk;
 }
 
+std::ostream& operator<<(std::ostream& os, const BankingScheme& banking) {
+  switch (banking.partition) {
+  case BankingScheme::Unbanked:
+    os << "unbanked";
+    break;
+  case BankingScheme::Cyclic:
+    os << "cyclic banks=" << banking.num_banks << " coefficients=" << banking.coefficients;
+    break;
+  case BankingScheme::Block:
+    os << "block banks=" << banking.num_banks << " dim=" << banking.block_dim
+       << " block_size=" << banking.block_size;
+    break;
+  }
+  os << " port_banks=" << banking.port_banks;
+  return os;
+}
+
+namespace {
+
+int cyclic_bank(const vector<int>& index, const vector<int>& coefficients, int num_banks) {
+  int bank = 0;
+  for (size_t i = 0; i < index.size(); ++i) {
+    bank += coefficients.at(i) * index.at(i);
+  }
+  return bank % num_banks;
+}
+
+bool conflict_free(const vector<vector<int> >& taps, const vector<int>& coefficients, int num_banks) {
+  vector<bool> used(num_banks, false);
+  for (const auto& tap : taps) {
+    int bank = cyclic_bank(tap, coefficients, num_banks);
+    if (used.at(bank)) {
+      return false;
+    }
+    used.at(bank) = true;
+  }
+  return true;
+}
+
+}  // namespace
+
+BankingScheme bank_output_stream(const HWBuffer& kernel, const OutputStream& ostream) {
+  BankingScheme banking;
+  size_t num_dims = kernel.ldims.size();
+  banking.port_banks = vector<int>(ostream.oports.size(), 0);
+
+  // Taps read in the same cycle. Columns of the innermost dimension come
+  // from a shift register behind a single memory read.
+  vector<vector<int> > port_taps(ostream.oports.size());
+  std::set<vector<int> > tap_set;
+  for (const auto& oport_pair : ostream.oports) {
+    const Port& port = oport_pair.second;
+    if (port.mem_indices.size() != num_dims || port.stream_index < 0 ||
+        port.stream_index >= (int)port_taps.size()) {
+      return banking;
+    }
+    vector<int> tap(num_dims);
+    for (size_t i = 0; i < num_dims; ++i) {
+      tap.at(i) = id_const_value(port.mem_indices.at(i));
+      if (tap.at(i) < 0) {
+        return banking;
+      }
+    }
+    if (num_dims > 1) {
+      tap.at(0) = 0;
+    }
+    port_taps.at(port.stream_index) = tap;
+    tap_set.insert(tap);
+  }
+  vector<vector<int> > taps(tap_set.begin(), tap_set.end());
+
+  if (taps.size() <= 1) {
+    return banking;
+  }
+
+  // dimensions the taps are spread over, and the extent they cover
+  vector<size_t> spread_dims;
+  int max_banks = 1;
+  for (size_t i = 0; i < num_dims; ++i) {
+    int lo = taps.at(0).at(i), hi = lo;
+    for (const auto& tap : taps) {
+      lo = std::min(lo, tap.at(i));
+      hi = std::max(hi, tap.at(i));
+    }
+    if (hi > lo) {
+      spread_dims.push_back(i);
+      max_banks *= hi + 1;
+    }
+  }
+
+  // Cyclic: search bank counts upwards. The first spread dimension has
+  // coefficient 1 and the rest are enumerated. A mixed radix numbering of
+  // the tap box is always conflict free, so the search ends by max_banks.
+  for (int num_banks = taps.size(); num_banks <= max_banks && banking.partition == BankingScheme::Unbanked; ++num_banks) {
+    vector<int> free_coeffs(spread_dims.size() - 1, 0);
+    while (true) {
+      vector<int> coefficients(num_dims, 0);
+      coefficients.at(spread_dims.at(0)) = 1;
+      for (size_t i = 1; i < spread_dims.size(); ++i) {
+        coefficients.at(spread_dims.at(i)) = free_coeffs.at(i - 1);
+      }
+      if (conflict_free(taps, coefficients, num_banks)) {
+        banking.partition = BankingScheme::Cyclic;
+        banking.num_banks = num_banks;
+        banking.coefficients = coefficients;
+        break;
+      }
+
+      size_t idx = 0;
+      while (idx < free_coeffs.size() && ++free_coeffs.at(idx) == num_banks) {
+        free_coeffs.at(idx) = 0;
+        idx++;
+      }
+      if (idx == free_coeffs.size()) {
+        break;
+      }
+    }
+  }
+  internal_assert(banking.partition == BankingScheme::Cyclic)
+    << "no cyclic banking found for " << kernel.name << " to " << ostream.name << "\n";
+
+  // Block: taps spread along one dimension at least block_size apart land
+  // in different blocks wherever the stencil is. The bank of each port
+  // depends on where the stencil is in its block, so this is only used for
+  // stencils at a constant position along that dimension.
+  int block_origin = -1;
+  if (spread_dims.size() == 1) {
+    size_t dim = spread_dims.at(0);
+    const auto& odim = ostream.odims.at(dim);
+    const auto& ldim = kernel.ldims.at(dim);
+    if (ostream.odims.size() == num_dims && odim.output_min_pos.defined() && ldim.logical_min.defined()) {
+      block_origin = id_const_value(simplify(odim.output_min_pos - ldim.logical_min));
+    }
+  }
+  if (block_origin >= 0) {
+    size_t dim = spread_dims.at(0);
+    vector<int> offsets;
+    for (const auto& tap : taps) {
+      offsets.push_back(tap.at(dim));
+    }
+    std::sort(offsets.begin(), offsets.end());
+    int block_size = offsets.at(1) - offsets.at(0);
+    for (size_t i = 1; i < offsets.size(); ++i) {
+      block_size = std::min(block_size, offsets.at(i) - offsets.at(i - 1));
+    }
+    int logical = id_const_value(kernel.ldims.at(dim).logical_size);
+    int num_banks = logical < 0 ? -1 : (logical + block_size - 1) / block_size;
+    if (num_banks > 0 && num_banks < banking.num_banks) {
+      banking.partition = BankingScheme::Block;
+      banking.num_banks = num_banks;
+      banking.block_dim = dim;
+      banking.block_size = block_size;
+    }
+  }
+
+  for (size_t i = 0; i < port_taps.size(); ++i) {
+    const auto& tap = port_taps.at(i);
+    if (tap.empty()) {
+      continue;
+    } else if (banking.partition == BankingScheme::Cyclic) {
+      banking.port_banks.at(i) = cyclic_bank(tap, banking.coefficients, banking.num_banks);
+    } else {
+      banking.port_banks.at(i) = (block_origin + tap.at(banking.block_dim)) / banking.block_size;
+    }
+  }
+  return banking;
+}
+
+namespace {
+
+// The last window of a loop over one dimension to read coordinate c, or -1
+// if none does
+int last_window(int c, int range, int stride, int extent) {
+  int k = stride == 0 ? range - 1 : std::min(range - 1, c / stride);
+  return c - k * stride < extent ? k : -1;
+}
+
+// The reuse distance capacity when each loop level walks its own
+// dimension, innermost first. A word is then last read by the window with
+// the last index reaching it in every dimension, so the words freed by
+// each iteration and whether a word is read at all follow from each
+// dimension on its own. Runs in time linear in the iterations and words,
+// without per-word or per-iteration tables.
+int separable_reuse_capacity(const vector<int>& logical, const vector<int>& flat_stride,
+                             const vector<int>& stencil, const vector<int>& range,
+                             const vector<int>& stride, int64_t num_iters) {
+  size_t num_dims = logical.size();
+  // freed.at(i).at(k): the coordinates of dimension i last read by window k
+  vector<vector<int> > freed(num_dims);
+  vector<vector<bool> > read(num_dims);
+  for (size_t i = 0; i < num_dims; ++i) {
+    freed.at(i).assign(range.at(i), 0);
+    read.at(i).assign(logical.at(i), false);
+    for (int c = 0; c < logical.at(i); ++c) {
+      int k = last_window(c, range.at(i), stride.at(i), stencil.at(i));
+      if (k >= 0) {
+        freed.at(i).at(k) += 1;
+        read.at(i).at(c) = true;
+      }
+    }
+  }
+
+  // walk the words in raster order as the producer writes them
+  int64_t written = -1;
+  vector<int> coord(num_dims, 0);
+  vector<int> window(num_dims, 0);
+  int64_t live = 0;
+  int64_t max_live = 0;
+  for (int64_t t = 0; t < num_iters; ++t) {
+    int64_t needed = 0;
+    for (size_t i = 0; i < num_dims && needed >= 0; ++i) {
+      int min = window.at(i) * stride.at(i);
+      int max = std::min(min + stencil.at(i), logical.at(i)) - 1;
+      needed = min < logical.at(i) ? needed + (int64_t)max * flat_stride.at(i) : -1;
+    }
+
+    for (; written < needed; ++written) {
+      bool is_read = true;
+      for (size_t i = 0; i < num_dims; ++i) {
+        is_read = is_read && read.at(i).at(coord.at(i));
+      }
+      live += is_read ? 1 : 0;
+      for (size_t i = 0; i < num_dims && ++coord.at(i) == logical.at(i); ++i) {
+        coord.at(i) = 0;
+      }
+    }
+    max_live = std::max(max_live, live);
+
+    int64_t freed_words = 1;
+    for (size_t i = 0; i < num_dims; ++i) {
+      freed_words *= freed.at(i).at(window.at(i));
+    }
+    live -= freed_words;
+
+    for (size_t i = 0; i < num_dims && ++window.at(i) == range.at(i); ++i) {
+      window.at(i) = 0;
+    }
+  }
+  return (int)max_live;
+}
+
+}  // namespace
+
+int reuse_distance_capacity(const HWBuffer& kernel, const OutputStream& ostream) {
+  size_t num_dims = kernel.ldims.size();
+  if (ostream.odims.size() != num_dims) {
+    return -1;
+  }
+
+  vector<int> logical(num_dims), flat_stride(num_dims), stencil(num_dims);
+  int total_words = 1;
+  for (size_t i = 0; i < num_dims; ++i) {
+    logical.at(i) = id_const_value(kernel.ldims.at(i).logical_size);
+    stencil.at(i) = id_const_value(ostream.odims.at(i).output_stencil);
+    if (logical.at(i) <= 0 || stencil.at(i) <= 0) {
+      return -1;
+    }
+    stencil.at(i) = std::min(stencil.at(i), logical.at(i));
+    flat_stride.at(i) = total_words;
+    total_words *= logical.at(i);
+  }
+
+  size_t num_levels = ostream.linear_access.size();
+  if (num_levels == 0) {
+    return -1;
+  }
+  vector<int> range(num_levels), stride(num_levels), dim_ref(num_levels);
+  int64_t num_iters = 1;
+  for (size_t l = 0; l < num_levels; ++l) {
+    range.at(l) = id_const_value(ostream.linear_access.at(l).range);
+    stride.at(l) = id_const_value(ostream.linear_access.at(l).stride);
+    dim_ref.at(l) = id_const_value(ostream.linear_access.at(l).dim_ref);
+    if (range.at(l) <= 0 || stride.at(l) < 0 || dim_ref.at(l) < 0 || dim_ref.at(l) >= (int)num_dims) {
+      return -1;
+    }
+    num_iters *= range.at(l);
+  }
+
+  bool separable = num_levels == num_dims;
+  for (size_t l = 0; l < num_levels && separable; ++l) {
+    separable = dim_ref.at(l) == (int)l;
+  }
+  if (separable) {
+    return separable_reuse_capacity(logical, flat_stride, stencil, range, stride, num_iters);
+  }
+
+  // Otherwise simulate the accesses, which needs a table entry for every
+  // word and every iteration, so only for small buffers.
+  int window_words = 1;
+  for (int extent : stencil) {
+    window_words *= extent;
+  }
+  const int64_t max_simulated = 1 << 20;
+  if (num_iters > max_simulated || total_words > max_simulated ||
+      num_iters * window_words > 16 * max_simulated) {
+    return -1;
+  }
+
+  // last consumer iteration to read each word, and the furthest word in
+  // raster order each iteration needs
+  vector<int> last_read(total_words, -1);
+  vector<int> needed(num_iters, -1);
+  vector<int> level_idx(num_levels, 0);
+  vector<int> origin(num_dims), pos(num_dims);
+  for (int t = 0; t < num_iters; ++t) {
+    std::fill(origin.begin(), origin.end(), 0);
+    for (size_t l = 0; l < num_levels; ++l) {
+      origin.at(dim_ref.at(l)) += level_idx.at(l) * stride.at(l);
+    }
+
+    std::fill(pos.begin(), pos.end(), 0);
+    for (int w = 0; w < window_words; ++w) {
+      int addr = 0;
+      bool inside = true;
+      for (size_t i = 0; i < num_dims; ++i) {
+        int coord = origin.at(i) + pos.at(i);
+        inside = inside && coord < logical.at(i);
+        addr += coord * flat_stride.at(i);
+      }
+      if (inside) {
+        last_read.at(addr) = t;
+        needed.at(t) = std::max(needed.at(t), addr);
+      }
+      for (size_t i = 0; i < num_dims && ++pos.at(i) == stencil.at(i); ++i) {
+        pos.at(i) = 0;
+      }
+    }
+
+    for (size_t l = 0; l < num_levels && ++level_idx.at(l) == range.at(l); ++l) {
+      level_idx.at(l) = 0;
+    }
+  }
+
+  vector<int> freed_at(num_iters, 0);
+  for (int t : last_read) {
+    if (t >= 0) {
+      freed_at.at(t) += 1;
+    }
+  }
+
+  // words that are never read are dropped as they are written
+  int written = -1;
+  int live = 0;
+  int max_live = 0;
+  for (int t = 0; t < num_iters; ++t) {
+    for (int addr = written + 1; addr <= needed.at(t); ++addr) {
+      live += last_read.at(addr) >= 0 ? 1 : 0;
+    }
+    written = std::max(written, needed.at(t));
+    max_live = std::max(max_live, live);
+    live -= freed_at.at(t);
+  }
+  return max_live;
+}
+
+int reuse_distance_capacity(const HWBuffer& kernel) {
+  int logical_words = 1;
+  for (const auto& dim : kernel.ldims) {
+    int size = id_const_value(dim.logical_size);
+    if (size <= 0) {
+      return -1;
+    }
+    logical_words *= size;
+  }
+
+  // partial results are held for the whole accumulation
+  if (kernel.num_accum_iters > 0 || kernel.ostreams.count(kernel.name) > 0) {
+    return logical_words;
+  }
+
+  // Consumers are assumed to run rate matched, so the buffer holds the
+  // largest of their windows.
+  int capacity = 0;
+  for (const auto& ostream_pair : kernel.ostreams) {
+    int words = reuse_distance_capacity(kernel, ostream_pair.second);
+    if (words < 0) {
+      return logical_words;
+    }
+    capacity = std::max(capacity, words);
+  }
+  return kernel.ostreams.empty() ? logical_words : capacity;
+}
+
+vector<AccessDimSize> flatten_linear_access(const HWBuffer& kernel,
+                                            const vector<AccessDimSize>& linear_access) {
+  vector<int> flat_stride(kernel.ldims.size());
+  int total_words = 1;
+  for (size_t i = 0; i < kernel.ldims.size(); ++i) {
+    int size = id_const_value(kernel.ldims.at(i).logical_size);
+    if (size <= 0) {
+      return linear_access;
+    }
+    flat_stride.at(i) = total_words;
+    total_words *= size;
+  }
+
+  // flat stride of each level, or -1 if it is not statically known
+  auto level_flat_stride = [&](const AccessDimSize& level) {
+    int stride = id_const_value(level.stride);
+    int dim_ref = id_const_value(level.dim_ref);
+    if (id_const_value(level.range) <= 0 || stride < 0 ||
+        dim_ref < 0 || dim_ref >= (int)flat_stride.size()) {
+      return -1;
+    }
+    return stride * flat_stride.at(dim_ref);
+  };
+
+  vector<AccessDimSize> flat;
+  for (const auto& level : linear_access) {
+    if (!flat.empty()) {
+      auto& inner = flat.back();
+      int inner_stride = level_flat_stride(inner);
+      int outer_stride = level_flat_stride(level);
+      if (inner_stride >= 0 && outer_stride >= 0 &&
+          outer_stride == inner_stride * id_const_value(inner.range)) {
+        inner.range = Expr(id_const_value(inner.range) * id_const_value(level.range));
+        continue;
+      }
+    }
+    flat.push_back(level);
+  }
+  return flat;
+}
+
+void bank_hwbuffer(HWBuffer& kernel) {
+  for (auto& ostream_pair : kernel.ostreams) {
+    auto& ostream = ostream_pair.second;
+    ostream.banking = bank_output_stream(kernel, ostream);
+  }
+}
 
 }  // namespace Internal
 }  // namespace Halide
-
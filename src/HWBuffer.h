@@ -108,10 +108,29 @@ struct OutputDimSize {
   Expr output_max_pos;
 };
 
+// Partition of the buffer address space so that every port an output
+// stream reads in the same cycle is served by a different bank.
+//   cyclic: bank = (sum_i coefficients[i] * index[i]) % num_banks
+//   block:  bank = index[block_dim] / block_size
+// port_banks holds the bank of each port (by stream_index): for cyclic
+// banking relative to the bank of the stencil origin, and for block banking,
+// which is only used for stencils at a constant position along block_dim,
+// the bank (origin[block_dim] + tap) / block_size.
+struct BankingScheme {
+  enum Partition { Unbanked = 0, Cyclic, Block };
+  Partition partition = Unbanked;
+  int num_banks = 1;
+  std::vector<int> coefficients;
+  int block_dim = 0;
+  int block_size = 1;
+  std::vector<int> port_banks;
+};
+
 struct OutputStream {
   std::string name;
   std::vector<OutputDimSize> odims;
   std::map<std::vector<Expr>, Port, ExprVecCompare> oports;
+  BankingScheme banking;
   Stmt output_access_pattern;
   int num_stencil_acc_dim; // which loop level corresponds to the compute level
   std::map<std::string, Stride> stride_map;
@@ -176,6 +195,7 @@ std::ostream& operator<<(std::ostream& os, const std::vector<AccessDimSize>& vec
 std::ostream& operator<<(std::ostream& os, const HWBuffer& buffer);
 std::ostream& operator<<(std::ostream& os, const std::map<std::vector<Expr>, Port, ExprVecCompare> oports);
 std::ostream& operator<<(std::ostream& os, const Port port);
+std::ostream& operator<<(std::ostream& os, const BankingScheme& banking);
 
 struct HWBuffer {
   std::string name;
@@ -188,6 +208,9 @@ struct HWBuffer {
   bool is_inlined = false;
   bool is_output = false;
   int num_accum_iters = 0;
+  int min_capacity = -1;  // words live at once, from reuse distance analysis
+  bool is_double_buffered = false;  // ping-pong between consecutive tiles
+  MemoryType memory_level = MemoryType::Auto;  // Heap (off-chip), GLB, MemTile, Pond or Register
 
   // old parameters for the HWBuffer
   std::vector<InOutDimSize> dims;
@@ -222,6 +245,28 @@ struct HWBuffer {
 
 };
 
+// Minimum number of words an ostream needs on chip. The producer writes in
+// raster order only as far as each consumer iteration needs, and a word is
+// freed after its last read. Returns -1 if the access pattern is not
+// statically known.
+int reuse_distance_capacity(const HWBuffer& kernel, const OutputStream& ostream);
+int reuse_distance_capacity(const HWBuffer& kernel);
+
+// Find the partition with the fewest banks that keeps every ostream at one
+// stencil per cycle. In multidimensional buffers, taps that only differ in
+// the innermost dimension are served from shift registers, so only the
+// remaining taps are banked.
+BankingScheme bank_output_stream(const HWBuffer& kernel, const OutputStream& ostream);
+void bank_hwbuffer(HWBuffer& kernel);
+
+// Merge neighbouring levels of a linear access pattern that step through
+// the flattened buffer contiguously (the outer level's flat stride is the
+// inner level's flat stride times its range), so the address generator
+// counts through them with a single counter. The addresses generated are
+// unchanged.
+std::vector<AccessDimSize> flatten_linear_access(const HWBuffer& kernel,
+                                                 const std::vector<AccessDimSize>& linear_access);
+
 }  // namespace Internal
 }  // namespace Halide
 
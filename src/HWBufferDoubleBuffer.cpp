@@ -0,0 +1,169 @@
+#include "HWBufferDoubleBuffer.h"
+#include "Function.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "IRVisitor.h"
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace Halide {
+namespace Internal {
+
+namespace {
+
+// Tuple-valued functions are realized as one buffer per value, named f.0, f.1, ...
+string realized_func_name(const string &realize_name, const map<string, Function> &env) {
+  if (env.count(realize_name)) {
+    return realize_name;
+  }
+  size_t dot = realize_name.rfind('.');
+  if (dot != string::npos && env.count(realize_name.substr(0, dot))) {
+    return realize_name.substr(0, dot);
+  }
+  return "";
+}
+
+// Find the innermost loop around the producer of a buffer
+class FindTileLoop : public IRVisitor {
+  const string &name;
+  vector<const For *> loops;
+
+  using IRVisitor::visit;
+
+  void visit(const For *op) override {
+    loops.push_back(op);
+    IRVisitor::visit(op);
+    loops.pop_back();
+  }
+
+  void visit(const ProducerConsumer *op) override {
+    if (op->is_producer && op->name == name && tile_loop == nullptr && !loops.empty()) {
+      tile_loop = loops.back();
+    }
+    IRVisitor::visit(op);
+  }
+
+public:
+  const For *tile_loop = nullptr;
+
+  FindTileLoop(const string &name) : name(name) {}
+};
+
+// Index every access to the buffer with the parity of the tile loop
+class AddParityDimension : public IRMutator {
+  const string &name;
+  const string &loop_name;
+  bool in_tile_loop = false;
+
+  using IRMutator::visit;
+
+  Expr parity() const {
+    return Variable::make(Int(32), loop_name) % 2;
+  }
+
+  Stmt visit(const For *op) override {
+    if (op->name != loop_name) {
+      return IRMutator::visit(op);
+    }
+    bool old_in_tile_loop = in_tile_loop;
+    in_tile_loop = true;
+    Stmt body = mutate(op->body);
+    in_tile_loop = old_in_tile_loop;
+    return For::make(op->name, op->min, op->extent, op->for_type, op->device_api, body);
+  }
+
+  Stmt visit(const Provide *op) override {
+    if (op->name != name) {
+      return IRMutator::visit(op);
+    }
+    vector<Expr> values;
+    for (const auto &value : op->values) {
+      values.push_back(mutate(value));
+    }
+    vector<Expr> args;
+    for (const auto &arg : op->args) {
+      args.push_back(mutate(arg));
+    }
+    if (in_tile_loop) {
+      args.push_back(parity());
+    } else {
+      outside_access = true;
+    }
+    return Provide::make(op->name, values, args);
+  }
+
+  Expr visit(const Call *op) override {
+    if (op->name != name || op->call_type != Call::Halide) {
+      return IRMutator::visit(op);
+    }
+    vector<Expr> args;
+    for (const auto &arg : op->args) {
+      args.push_back(mutate(arg));
+    }
+    if (in_tile_loop) {
+      args.push_back(parity());
+    } else {
+      outside_access = true;
+    }
+    return Call::make(op->type, op->name, args, op->call_type,
+                      op->func, op->value_index, op->image, op->param);
+  }
+
+public:
+  bool outside_access = false;
+
+  AddParityDimension(const string &name, const string &loop_name)
+    : name(name), loop_name(loop_name) {}
+};
+
+class DoubleBufferRealizes : public IRMutator {
+  const map<string, Function> &env;
+
+  using IRMutator::visit;
+
+  Stmt visit(const Realize *op) override {
+    Stmt body = mutate(op->body);
+
+    string func_name = realized_func_name(op->name, env);
+    if (func_name.empty() || !env.at(func_name).schedule().is_double_buffered()) {
+      return Realize::make(op->name, op->types, op->memory_type, op->bounds, op->condition, body);
+    }
+
+    // The producer is named after the function, even for tuple-valued buffers
+    FindTileLoop finder(func_name);
+    body.accept(&finder);
+    if (finder.tile_loop == nullptr) {
+      user_warning << "Not double buffering " << op->name
+                   << ", because it is not stored outside the loop it is computed at.\n";
+      return Realize::make(op->name, op->types, op->memory_type, op->bounds, op->condition, body);
+    }
+
+    AddParityDimension add_parity(op->name, finder.tile_loop->name);
+    Stmt new_body = add_parity.mutate(body);
+    if (add_parity.outside_access) {
+      user_warning << "Not double buffering " << op->name
+                   << ", because it is accessed outside of its tile loop "
+                   << finder.tile_loop->name << ".\n";
+      return Realize::make(op->name, op->types, op->memory_type, op->bounds, op->condition, body);
+    }
+
+    debug(2) << "Double buffering " << op->name << " over loop " << finder.tile_loop->name << "\n";
+    Region bounds = op->bounds;
+    bounds.push_back(Range(0, 2));
+    return Realize::make(op->name, op->types, op->memory_type, bounds, op->condition, new_body);
+  }
+
+public:
+  DoubleBufferRealizes(const map<string, Function> &env) : env(env) {}
+};
+
+}  // namespace
+
+Stmt double_buffer_hwbuffers(Stmt s, const map<string, Function> &env) {
+  return DoubleBufferRealizes(env).mutate(s);
+}
+
+}  // namespace Internal
+}  // namespace Halide
@@ -0,0 +1,28 @@
+#ifndef HALIDE_HWBUFFER_DOUBLE_BUFFER_H
+#define HALIDE_HWBUFFER_DOUBLE_BUFFER_H
+
+/** \file
+ * Defines the lowering pass that gives double-buffered (Func::double_buffer)
+ * hardware buffers a second copy, selected by the parity of the tile loop.
+ */
+
+#include <map>
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Add an outermost dimension of extent 2 to the realization of each
+ * double-buffered function. Accesses inside the innermost loop around
+ * the function's producer (the tile loop) use the copy given by the
+ * parity of that loop's variable, so consecutive tiles no longer reuse
+ * the same storage and loading one can overlap computing the other.
+ * Double-buffered functions are never slid, so a tile doesn't read
+ * values left in the other copy by the previous one. */
+Stmt double_buffer_hwbuffers(Stmt s, const std::map<std::string, Function> &env);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
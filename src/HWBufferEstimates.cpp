@@ -0,0 +1,339 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "HWBufferEstimates.h"
+
+#include "Debug.h"
+#include "IROperator.h"
+#include "IRPrinter.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace {
+
+// Constant value of a buffer parameter, or -1 if it is not statically known
+int const_dim(const Expr& e) {
+  if (!e.defined()) {
+    return -1;
+  }
+  const int64_t* value = as_const_int(e);
+  return value == nullptr ? -1 : (int) *value;
+}
+
+int ceil_div(int a, int b) {
+  return b <= 0 ? 0 : (a + b - 1) / b;
+}
+
+// Extent of the output stencil in dimension i. Undefined stencils are
+// patched to a placeholder during extraction, so clamp to the logical size.
+int stencil_extent(const Expr& stencil, const HWBuffer& kernel, size_t i) {
+  int extent = const_dim(stencil);
+  if (i < kernel.ldims.size()) {
+    int logical = const_dim(kernel.ldims.at(i).logical_size);
+    if (logical > 0 && (extent < 0 || extent > logical)) {
+      extent = logical;
+    }
+  }
+  return extent < 1 ? 1 : extent;
+}
+
+int logical_words(const HWBuffer& kernel) {
+  int words = 1;
+  for (const auto& dim : kernel.ldims) {
+    int size = const_dim(dim.logical_size);
+    if (size < 0) {
+      return -1;
+    }
+    words *= size;
+  }
+  return words;
+}
+
+// Without a reuse distance result, a buffer is assumed to hold the window
+// of its outermost streamed dimension (one where the producer writes less
+// than the full logical extent) and every full line inside it, like a
+// line buffer.
+int capacity_words(const HWBuffer& kernel) {
+  int logical = logical_words(kernel);
+  if (logical < 0 || kernel.num_accum_iters > 0 || kernel.dims.size() != kernel.ldims.size()) {
+    return logical;
+  }
+
+  int streamed_dim = -1;
+  for (size_t i = 0; i < kernel.dims.size(); ++i) {
+    int chunk = const_dim(kernel.dims.at(i).input_chunk);
+    int size = const_dim(kernel.ldims.at(i).logical_size);
+    if (chunk > 0 && chunk < size) {
+      streamed_dim = i;
+    }
+  }
+  if (streamed_dim < 0) {
+    return logical;
+  }
+
+  int words = 1;
+  for (size_t i = 0; i < kernel.ldims.size(); ++i) {
+    if ((int) i == streamed_dim) {
+      int chunk = const_dim(kernel.dims.at(i).input_chunk);
+      words *= std::max(stencil_extent(kernel.dims.at(i).output_stencil, kernel, i), chunk);
+    } else {
+      words *= const_dim(kernel.ldims.at(i).logical_size);
+    }
+  }
+  return std::min(words, logical);
+}
+
+// Memory types that name a level of the accelerator's memory hierarchy
+bool is_hw_memory_level(MemoryType t) {
+  return t == MemoryType::Heap || t == MemoryType::GLB || t == MemoryType::MemTile ||
+    t == MemoryType::ROM || t == MemoryType::Pond || t == MemoryType::Register;
+}
+
+// Accesses per cycle that each memory tile of the buffer serves
+double accesses_per_bank(const HWBufferEstimate& est) {
+  return (double) (est.sram_reads_per_cycle + est.writes_per_cycle) / std::max(est.banks, 1);
+}
+
+int chunk_words(const HWBuffer& kernel) {
+  int words = 1;
+  for (const auto& dim : kernel.dims) {
+    int chunk = const_dim(dim.input_chunk);
+    words *= chunk < 1 ? 1 : chunk;
+  }
+  return words;
+}
+
+// A string as a quoted json string
+string json_string(const string& str) {
+  std::ostringstream quoted;
+  quoted << '"';
+  for (unsigned char c : str) {
+    if (c == '"' || c == '\\') {
+      quoted << '\\' << c;
+    } else if (c < 0x20) {
+      const char* hex = "0123456789abcdef";
+      quoted << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+    } else {
+      quoted << c;
+    }
+  }
+  quoted << '"';
+  return quoted.str();
+}
+
+}  // namespace
+
+std::ostream& operator<<(std::ostream& os, const HWBufferEstimate& est) {
+  os << "HWBuffer estimate: " << est.name << std::endl
+     << "  capacity=" << est.capacity_words << " words (logical=" << est.logical_words
+     << ", " << est.word_bytes << " bytes/word"
+     << (est.double_buffered ? ", double buffered" : "") << ")" << std::endl
+     << "  writes/cycle=" << est.writes_per_cycle
+     << "  window reads/cycle=" << est.window_reads_per_cycle
+     << "  sram reads/cycle=" << est.sram_reads_per_cycle << std::endl
+     << "  banks=" << est.banks << "  level=" << est.memory_level << std::endl
+     << "  offchip words/frame: read=" << est.offchip_read_words
+     << " write=" << est.offchip_write_words
+     << "  bytes/cycle=" << est.offchip_bytes_per_cycle << std::endl;
+  return os;
+}
+
+vector<HWBufferEstimate> estimate_hwbuffers(const HWXcel& xcel, const MemoryBankParams& bank) {
+  vector<HWBufferEstimate> estimates;
+
+  for (const auto& hwbuffer_pair : xcel.hwbuffers) {
+    const HWBuffer& kernel = hwbuffer_pair.second;
+    HWBufferEstimate est;
+    est.xcel = xcel.name;
+    est.name = kernel.name;
+    est.word_bytes = kernel.func.get_contents().defined() && kernel.func.outputs() > 0 ?
+      kernel.func.output_types().at(0).bytes() : ceil_div(bank.word_bits, 8);
+    est.logical_words = logical_words(kernel);
+
+    // Inlined buffers are wires, not memories
+    if (kernel.is_inlined) {
+      est.capacity_words = 0;
+      estimates.push_back(est);
+      continue;
+    }
+
+    est.capacity_words = kernel.min_capacity >= 0 ? kernel.min_capacity : capacity_words(kernel);
+    // The next tile is written while the current one is read
+    est.double_buffered = kernel.is_double_buffered;
+    if (est.double_buffered && est.capacity_words > 0) {
+      est.capacity_words *= 2;
+    }
+    est.writes_per_cycle = chunk_words(kernel);
+
+    int inner_chunk = kernel.dims.size() > 0 ? std::max(const_dim(kernel.dims.at(0).input_chunk), 1) : 1;
+    for (const auto& ostream_pair : kernel.ostreams) {
+      const auto& odims = ostream_pair.second.odims;
+      int window = 1;
+      int rows = 1;
+      for (size_t i = 0; i < odims.size(); ++i) {
+        int extent = stencil_extent(odims.at(i).output_stencil, kernel, i);
+        window *= extent;
+        rows *= i == 0 ? 1 : extent;
+      }
+      est.window_reads_per_cycle += window;
+      // Reuse along the innermost dimension is held in shift registers,
+      // so memory only supplies the new column of each row.
+      est.sram_reads_per_cycle += odims.size() > 0 ? std::min(window, rows * inner_chunk) : window;
+    }
+
+    // Update stages read-modify-write their partial results
+    if (kernel.num_accum_iters > 0) {
+      est.sram_reads_per_cycle += est.writes_per_cycle;
+    }
+
+    int words_per_entry = ceil_div(est.word_bytes * 8, bank.word_bits);
+    int capacity_banks = est.capacity_words < 0 ? 1 : ceil_div(est.capacity_words * words_per_entry, bank.words);
+    est.banks = std::max({1, capacity_banks,
+                          ceil_div(est.sram_reads_per_cycle, bank.read_ports),
+                          ceil_div(est.writes_per_cycle, bank.write_ports)});
+
+    if (est.logical_words > 0) {
+      if (xcel.isAcceleratorInput(kernel.name)) {
+        est.offchip_read_words = est.logical_words;
+      }
+      if (kernel.is_output) {
+        est.offchip_write_words = est.logical_words;
+      }
+      int frame_cycles = ceil_div(est.logical_words, est.writes_per_cycle);
+      est.offchip_bytes_per_cycle = frame_cycles == 0 ? 0 :
+        ((double) (est.offchip_read_words + est.offchip_write_words) * est.word_bytes) / frame_cycles;
+    }
+
+    // Only memory tiles (and ROMs, which are built from them) use banks
+    est.memory_level = kernel.memory_level;
+    if (est.memory_level != MemoryType::Auto && est.memory_level != MemoryType::MemTile &&
+        est.memory_level != MemoryType::ROM) {
+      est.banks = 0;
+    }
+
+    estimates.push_back(est);
+  }
+
+  return estimates;
+}
+
+void place_hwbuffers(HWXcel& xcel, const MemoryBankParams& bank, const MemoryLevelParams& levels) {
+  for (auto& hwbuffer_pair : xcel.hwbuffers) {
+    hwbuffer_pair.second.memory_level = MemoryType::Auto;
+  }
+  auto estimates = estimate_hwbuffers(xcel, bank);
+
+  int free_banks = levels.memtile_banks;
+  vector<const HWBufferEstimate*> memtile_buffers;
+  for (const auto& est : estimates) {
+    HWBuffer& kernel = xcel.hwbuffers.at(est.name);
+    if (kernel.is_inlined) {
+      continue;
+    }
+
+    MemoryType scheduled = kernel.func.get_contents().defined() ?
+      kernel.func.schedule().memory_type() : MemoryType::Auto;
+    bool known = est.capacity_words >= 0;
+    if (is_hw_memory_level(scheduled)) {
+      kernel.memory_level = scheduled;
+      if (scheduled == MemoryType::MemTile || scheduled == MemoryType::ROM) {
+        free_banks -= est.banks;
+      }
+    } else if (known && est.capacity_words <= levels.register_words) {
+      kernel.memory_level = MemoryType::Register;
+    } else if (known && est.capacity_words <= levels.pond_words &&
+               est.sram_reads_per_cycle <= levels.pond_read_ports &&
+               est.writes_per_cycle <= levels.pond_write_ports) {
+      kernel.memory_level = MemoryType::Pond;
+    } else {
+      memtile_buffers.push_back(&est);
+    }
+  }
+
+  // The busiest buffers per tile keep the memory tiles
+  std::stable_sort(memtile_buffers.begin(), memtile_buffers.end(),
+                   [](const HWBufferEstimate* a, const HWBufferEstimate* b) {
+                     return accesses_per_bank(*a) > accesses_per_bank(*b);
+                   });
+  for (const auto* est : memtile_buffers) {
+    HWBuffer& kernel = xcel.hwbuffers.at(est->name);
+    if (est->banks <= free_banks) {
+      kernel.memory_level = MemoryType::MemTile;
+      free_banks -= est->banks;
+    } else if (est->capacity_words >= 0 && est->capacity_words <= levels.glb_words) {
+      kernel.memory_level = MemoryType::GLB;
+    } else {
+      kernel.memory_level = MemoryType::Heap;
+    }
+  }
+
+  for (const auto& hwbuffer_pair : xcel.hwbuffers) {
+    debug(1) << "placed hwbuffer " << hwbuffer_pair.first << " in "
+             << hwbuffer_pair.second.memory_level << "\n";
+  }
+}
+
+void write_hwbuffer_estimates(const vector<HWXcel>& xcels, const string& filename,
+                              const MemoryBankParams& bank) {
+  std::ofstream file(filename);
+  if (!file.is_open()) {
+    user_warning << "Could not open " << filename << " to write the hwbuffer estimates\n";
+    return;
+  }
+
+  file << "{" << std::endl
+       << "  \"bank\": {\"words\": " << bank.words << ", \"word_bits\": " << bank.word_bits
+       << ", \"read_ports\": " << bank.read_ports << ", \"write_ports\": " << bank.write_ports << "}," << std::endl
+       << "  \"accelerators\": [" << std::endl;
+
+  for (size_t x = 0; x < xcels.size(); ++x) {
+    auto estimates = estimate_hwbuffers(xcels.at(x), bank);
+    int total_banks = 0;
+    int total_bytes = 0;
+    int offchip_bytes = 0;
+
+    file << "    {" << std::endl
+         << "      \"name\": " << json_string(xcels.at(x).name) << "," << std::endl
+         << "      \"hwbuffers\": [" << std::endl;
+    for (size_t i = 0; i < estimates.size(); ++i) {
+      const auto& est = estimates.at(i);
+      debug(2) << est;
+      total_banks += est.banks;
+      total_bytes += std::max(est.capacity_words, 0) * est.word_bytes;
+      offchip_bytes += (est.offchip_read_words + est.offchip_write_words) * est.word_bytes;
+
+      file << "        {\"name\": " << json_string(est.name)
+           << ", \"word_bytes\": " << est.word_bytes
+           << ", \"capacity_words\": " << est.capacity_words
+           << ", \"logical_words\": " << est.logical_words
+           << ", \"double_buffered\": " << (est.double_buffered ? "true" : "false")
+           << ", \"writes_per_cycle\": " << est.writes_per_cycle
+           << ", \"window_reads_per_cycle\": " << est.window_reads_per_cycle
+           << ", \"sram_reads_per_cycle\": " << est.sram_reads_per_cycle
+           << ", \"banks\": " << est.banks
+           << ", \"memory_level\": \"" << est.memory_level << "\""
+           << ", \"offchip_read_words\": " << est.offchip_read_words
+           << ", \"offchip_write_words\": " << est.offchip_write_words
+           << ", \"offchip_bytes_per_cycle\": " << est.offchip_bytes_per_cycle
+           << "}" << (i + 1 < estimates.size() ? "," : "") << std::endl;
+    }
+    file << "      ]," << std::endl
+         << "      \"total_banks\": " << total_banks << "," << std::endl
+         << "      \"total_capacity_bytes\": " << total_bytes << "," << std::endl
+         << "      \"offchip_bytes_per_frame\": " << offchip_bytes << std::endl
+         << "    }" << (x + 1 < xcels.size() ? "," : "") << std::endl;
+  }
+
+  file << "  ]" << std::endl
+       << "}" << std::endl;
+  file.close();
+}
+
+}  // namespace Internal
+}  // namespace Halide
@@ -0,0 +1,88 @@
+#ifndef HALIDE_HW_BUFFER_ESTIMATES_H
+#define HALIDE_HW_BUFFER_ESTIMATES_H
+
+/** \file
+ *
+ * Defines an analytical estimator for the memories implied by extracted
+ * hardware buffers. Each buffer is turned into a storage capacity, the
+ * number of reads and writes it services per cycle, the number of memory
+ * banks needed to provide those ports, and its off-chip traffic per frame.
+ * The estimates also drive the choice of memory level for each buffer.
+ *
+ */
+
+#include <string>
+#include <vector>
+
+#include "ExtractHWBuffers.h"
+
+namespace Halide {
+namespace Internal {
+
+// Parameters of a single memory bank on the target
+struct MemoryBankParams {
+  int words = 2048;
+  int word_bits = 16;
+  int read_ports = 1;
+  int write_ports = 1;
+};
+
+// On-chip memory levels below the memory tiles, and the budgets of the
+// levels that are shared by the whole accelerator
+struct MemoryLevelParams {
+  int register_words = 8;          // register file or shift registers, any number of reads
+  int pond_words = 32;
+  int pond_read_ports = 1;
+  int pond_write_ports = 1;
+  int memtile_banks = 16;          // memory tiles available to one accelerator
+  int glb_words = 128 * 1024;      // global buffer; larger buffers stay off-chip
+};
+
+struct HWBufferEstimate {
+  std::string xcel;
+  std::string name;
+  int word_bytes = 0;
+
+  // Words that must be held on chip at once. -1 if not statically known.
+  int capacity_words = -1;
+  int logical_words = -1;
+  bool double_buffered = false;  // capacity holds two tiles
+
+  // Accesses per cycle when one input chunk is written each cycle
+  int writes_per_cycle = 0;
+  int window_reads_per_cycle = 0;  // every element of every output stencil
+  int sram_reads_per_cycle = 0;    // after reuse along the innermost dimension
+
+  int banks = 0;  // memory tiles, when placed in them
+
+  MemoryType memory_level = MemoryType::Auto;
+
+  // Words moved between the accelerator and off-chip memory per frame
+  int offchip_read_words = 0;
+  int offchip_write_words = 0;
+  double offchip_bytes_per_cycle = 0;
+};
+
+std::vector<HWBufferEstimate> estimate_hwbuffers(const HWXcel& xcel,
+                                                 const MemoryBankParams& bank = MemoryBankParams());
+
+std::ostream& operator<<(std::ostream& os, const HWBufferEstimate& est);
+
+/** Choose the memory level of every buffer in the accelerator that the
+ * schedule did not place with Func::store_in. Buffers small enough for a
+ * register file or a pond go there, which leaves the memory tiles for
+ * line buffers. When the tiles run out, the buffers with the fewest
+ * accesses per tile move to the global buffer, or off-chip. */
+void place_hwbuffers(HWXcel& xcel, const MemoryBankParams& bank = MemoryBankParams(),
+                     const MemoryLevelParams& levels = MemoryLevelParams());
+
+/** Estimate every buffer in the accelerators and write the results as json.
+ * Lowering calls this when the environment variable HL_HWBUFFER_ESTIMATES
+ * names the file to write. */
+void write_hwbuffer_estimates(const std::vector<HWXcel>& xcels, const std::string& filename,
+                              const MemoryBankParams& bank = MemoryBankParams());
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
@@ -0,0 +1,336 @@
+#include <set>
+
+#include "HWLoopPerfection.h"
+#include "ExprUsesVar.h"
+#include "Func.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "IRVisitor.h"
+#include "Scope.h"
+#include "Simplify.h"
+#include "Substitute.h"
+
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace Halide {
+namespace Internal {
+
+namespace {
+
+void split_conjunction(const Expr &cond, vector<Expr> &terms) {
+  if (const And *op = cond.as<And>()) {
+    split_conjunction(op->a, terms);
+    split_conjunction(op->b, terms);
+  } else {
+    terms.push_back(cond);
+  }
+}
+
+Expr make_conjunction(const vector<Expr> &terms) {
+  Expr cond;
+  for (const Expr &term : terms) {
+    cond = cond.defined() ? (cond && term) : term;
+  }
+  return cond;
+}
+
+bool is_var(const Expr &e, const string &name) {
+  const Variable *var = e.as<Variable>();
+  return var != nullptr && var->name == name;
+}
+
+Stmt wrap_lets(const vector<const LetStmt *> &lets, Stmt s) {
+  for (auto it = lets.rbegin(); it != lets.rend(); ++it) {
+    s = LetStmt::make((*it)->name, (*it)->value, s);
+  }
+  return s;
+}
+
+class ProvidedFuncs : public IRVisitor {
+  using IRVisitor::visit;
+
+  void visit(const Provide *op) override {
+    names.insert(op->name);
+    IRVisitor::visit(op);
+  }
+
+public:
+  set<string> names;
+};
+
+// Whether a and b both write some function, so that splitting them into
+// separate loops would give that function two producers
+bool provide_same_func(const Stmt &a, const Stmt &b) {
+  ProvidedFuncs a_funcs, b_funcs;
+  a.accept(&a_funcs);
+  b.accept(&b_funcs);
+  for (const auto &name : a_funcs.names) {
+    if (b_funcs.names.count(name)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Move lets from above a nest of serial loops into its innermost body,
+// stopping at a loop whose bounds (or .loop_min/.loop_max symbols) need them
+Stmt sink_lets(const vector<const LetStmt *> &lets, Stmt s) {
+  const For *loop = s.as<For>();
+  bool can_sink = loop != nullptr && loop->for_type == ForType::Serial;
+  for (size_t i = 0; can_sink && i < lets.size(); i++) {
+    const LetStmt *let = lets[i];
+    can_sink = is_pure(let->value) &&
+      !expr_uses_var(let->value, loop->name) &&
+      !expr_uses_var(loop->min, let->name) &&
+      !expr_uses_var(loop->extent, let->name) &&
+      !starts_with(let->name, loop->name + ".");
+  }
+  if (lets.empty() || !can_sink) {
+    return wrap_lets(lets, s);
+  }
+  return For::make(loop->name, loop->min, loop->extent, loop->for_type, loop->device_api,
+                   sink_lets(lets, loop->body));
+}
+
+class PerfectLoopNests : public IRMutator {
+  const map<string, Function> &env;
+  bool in_xcel = false;
+  // loop variables, and the lets that depend on them
+  Scope<> varying;
+  // values of the enclosing lets that are constants
+  map<string, Expr> constant_lets;
+
+  using IRMutator::visit;
+
+  bool is_xcel_store_loop(const string &loop_name) const {
+    for (const auto &p : env) {
+      const auto &sched = p.second.schedule();
+      if (sched.is_accelerated() && sched.accelerate_store_level().match(loop_name)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool is_xcel_stored_at_outermost(const string &func_name) const {
+    if (!env.count(func_name)) {
+      return false;
+    }
+    const auto &sched = env.at(func_name).schedule();
+    return sched.is_accelerated() &&
+      sched.accelerate_store_level().var().name() == Var::outermost().name();
+  }
+
+  // A bound a loop can be clipped to: pure, and the same for every
+  // iteration of the surrounding loops, so the nest stays rectangular
+  bool is_fixed_bound(const Expr &e, const Scope<> &loop_vars) const {
+    return is_pure(e) && !expr_uses_vars(e, loop_vars) && !expr_uses_vars(e, varying);
+  }
+
+  // Narrow [lo, hi) to the iterations of loop var where the comparison holds
+  bool fold_into_bounds(const Expr &term, const string &var, const Scope<> &loop_vars,
+                        Expr &lo, Expr &hi) const {
+    if (const LT *op = term.as<LT>()) {
+      if (is_var(op->a, var) && is_fixed_bound(op->b, loop_vars)) {
+        hi = min(hi, op->b);
+        return true;
+      } else if (is_var(op->b, var) && is_fixed_bound(op->a, loop_vars)) {
+        lo = max(lo, op->a + 1);
+        return true;
+      }
+    } else if (const LE *op = term.as<LE>()) {
+      if (is_var(op->a, var) && is_fixed_bound(op->b, loop_vars)) {
+        hi = min(hi, op->b + 1);
+        return true;
+      } else if (is_var(op->b, var) && is_fixed_bound(op->a, loop_vars)) {
+        lo = max(lo, op->a);
+        return true;
+      }
+    } else if (const GT *op = term.as<GT>()) {
+      if (is_var(op->a, var) && is_fixed_bound(op->b, loop_vars)) {
+        lo = max(lo, op->b + 1);
+        return true;
+      } else if (is_var(op->b, var) && is_fixed_bound(op->a, loop_vars)) {
+        hi = min(hi, op->a);
+        return true;
+      }
+    } else if (const GE *op = term.as<GE>()) {
+      if (is_var(op->a, var) && is_fixed_bound(op->b, loop_vars)) {
+        lo = max(lo, op->b);
+        return true;
+      } else if (is_var(op->b, var) && is_fixed_bound(op->a, loop_vars)) {
+        hi = min(hi, op->a + 1);
+        return true;
+      }
+    } else if (const EQ *op = term.as<EQ>()) {
+      Expr bound = is_var(op->a, var) ? op->b : is_var(op->b, var) ? op->a : Expr();
+      if (bound.defined() && is_fixed_bound(bound, loop_vars)) {
+        lo = max(lo, bound);
+        hi = min(hi, bound + 1);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  Stmt perfect_loop(const For *op, Stmt body) {
+    // peel off the lets at the top of the loop body
+    vector<const LetStmt *> lets;
+    Stmt inner = body;
+    while (const LetStmt *let = inner.as<LetStmt>()) {
+      lets.push_back(let);
+      inner = let->body;
+    }
+
+    // hoist the pure lets that do not depend on the loop
+    Scope<> loop_vars;  // the loop variable and the lets that stay in the loop
+    loop_vars.push(op->name);
+    vector<const LetStmt *> outer_lets, inner_lets;
+    for (const LetStmt *let : lets) {
+      if (is_pure(let->value) && !expr_uses_vars(let->value, loop_vars) &&
+          !expr_uses_var(op->min, let->name) && !expr_uses_var(op->extent, let->name)) {
+        outer_lets.push_back(let);
+      } else {
+        inner_lets.push_back(let);
+        loop_vars.push(let->name);
+      }
+    }
+
+    if (const IfThenElse *guard = inner.as<IfThenElse>()) {
+      if (!guard->else_case.defined() || is_no_op(guard->else_case)) {
+        // hoist or fold each term of the guard, and keep the rest
+        vector<Expr> terms, outer_guards, inner_guards, folded;
+        split_conjunction(guard->condition, terms);
+        Expr lo = op->min;
+        Expr hi = op->min + op->extent;
+        for (const Expr &term : terms) {
+          if (is_pure(term) && !expr_uses_vars(term, loop_vars)) {
+            outer_guards.push_back(term);
+          } else if (op->for_type == ForType::Serial &&
+                     fold_into_bounds(term, op->name, loop_vars, lo, hi)) {
+            folded.push_back(term);
+          } else {
+            inner_guards.push_back(term);
+          }
+        }
+
+        // constant bounds must stay constant, rather than becoming min/max
+        // expressions the address generators cannot count through
+        Expr new_min = op->min;
+        Expr new_extent = op->extent;
+        if (!folded.empty()) {
+          new_min = simplify(substitute(constant_lets, lo));
+          new_extent = simplify(substitute(constant_lets, max(hi - lo, 0)));
+          if (is_const(op->min) && is_const(op->extent) &&
+              !(is_const(new_min) && is_const(new_extent))) {
+            inner_guards.insert(inner_guards.end(), folded.begin(), folded.end());
+            folded.clear();
+            new_min = op->min;
+            new_extent = op->extent;
+          }
+        }
+        bool clipped = !folded.empty();
+
+        if (!outer_guards.empty() || clipped) {
+          debug(3) << "Hoisting " << outer_guards.size() << " guard terms out of loop " << op->name
+                   << ", which now runs from " << new_min << " for " << new_extent << " iterations\n";
+          Stmt then_case = inner_guards.empty() ? guard->then_case :
+            IfThenElse::make(make_conjunction(inner_guards), guard->then_case);
+          Stmt loop = For::make(op->name, new_min, new_extent, op->for_type, op->device_api,
+                                wrap_lets(inner_lets, then_case));
+          // the guard may have hidden more lets and guards
+          loop = perfect_loop(loop.as<For>(), loop.as<For>()->body);
+          if (!outer_guards.empty()) {
+            loop = IfThenElse::make(make_conjunction(outer_guards), loop);
+          }
+          return wrap_lets(outer_lets, loop);
+        }
+
+      } else if (is_pure(guard->condition) && !expr_uses_vars(guard->condition, loop_vars) &&
+                 !provide_same_func(guard->then_case, guard->else_case)) {
+        // unswitch the loop on a guard with an else case, unless both
+        // loops would produce the same function
+        debug(3) << "Unswitching loop " << op->name << " on " << guard->condition << "\n";
+        Stmt then_loop = For::make(op->name, op->min, op->extent, op->for_type, op->device_api,
+                                   wrap_lets(inner_lets, guard->then_case));
+        Stmt else_loop = For::make(op->name, op->min, op->extent, op->for_type, op->device_api,
+                                   wrap_lets(inner_lets, guard->else_case));
+        then_loop = perfect_loop(then_loop.as<For>(), then_loop.as<For>()->body);
+        else_loop = perfect_loop(else_loop.as<For>(), else_loop.as<For>()->body);
+        return wrap_lets(outer_lets, IfThenElse::make(guard->condition, then_loop, else_loop));
+      }
+    }
+
+    if (outer_lets.empty() && (inner_lets.empty() || !inner.as<For>())) {
+      return body.same_as(op->body) ? Stmt(op) :
+        For::make(op->name, op->min, op->extent, op->for_type, op->device_api, body);
+    }
+    Stmt result = For::make(op->name, op->min, op->extent, op->for_type, op->device_api,
+                            sink_lets(inner_lets, inner));
+    return wrap_lets(outer_lets, result);
+  }
+
+  Stmt visit(const LetStmt *op) override {
+    bool varies = expr_uses_vars(op->value, varying);
+    if (varies) {
+      varying.push(op->name);
+    }
+    Expr value = simplify(substitute(constant_lets, op->value));
+    bool constant = is_const(value);
+    if (constant) {
+      constant_lets[op->name] = value;
+    }
+    Stmt body = mutate(op->body);
+    if (constant) {
+      constant_lets.erase(op->name);
+    }
+    if (varies) {
+      varying.pop(op->name);
+    }
+    return body.same_as(op->body) ? Stmt(op) : LetStmt::make(op->name, op->value, body);
+  }
+
+  Stmt visit(const ProducerConsumer *op) override {
+    if (in_xcel || !op->is_producer || !is_xcel_stored_at_outermost(op->name)) {
+      return IRMutator::visit(op);
+    }
+    in_xcel = true;
+    Stmt body = mutate(op->body);
+    in_xcel = false;
+    return ProducerConsumer::make(op->name, op->is_producer, body);
+  }
+
+  Stmt visit(const For *op) override {
+    bool is_store_loop = !in_xcel && is_xcel_store_loop(op->name);
+    bool perfect = in_xcel;
+    in_xcel = in_xcel || is_store_loop;
+
+    varying.push(op->name);
+    Stmt body = mutate(op->body);
+    varying.pop(op->name);
+
+    if (is_store_loop) {
+      in_xcel = false;
+    }
+    if (perfect) {
+      return perfect_loop(op, body);
+    }
+    return body.same_as(op->body) ? Stmt(op) :
+      For::make(op->name, op->min, op->extent, op->for_type, op->device_api, body);
+  }
+
+public:
+  PerfectLoopNests(const map<string, Function> &env) : env(env) {}
+};
+
+}  // namespace
+
+Stmt perfect_hw_loop_nests(Stmt s, const map<string, Function> &env) {
+  return PerfectLoopNests(env).mutate(s);
+}
+
+}  // namespace Internal
+}  // namespace Halide
@@ -0,0 +1,37 @@
+#ifndef HALIDE_HW_LOOP_PERFECTION_H
+#define HALIDE_HW_LOOP_PERFECTION_H
+
+/** \file
+ * Defines the lowering pass that reshapes the loop nests of accelerated
+ * pipelines into the perfectly nested, rectangular form that the hardware
+ * buffer address generators can count through.
+ */
+
+#include <map>
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Rewrite the loops inside each accelerator (within the accelerate
+ * store level) so fewer of them need per-iteration control logic:
+ * - guards that do not depend on a loop are hoisted out of it
+ * - a loop is unswitched on an invariant guard with an else case, unless
+ *   both cases write the same function
+ * - guards comparing a serial loop variable against a loop-invariant
+ *   bound are folded into the loop bounds, which peels off the boundary
+ *   iterations that do nothing; loops with constant bounds are only
+ *   clipped if the new bounds are constant too
+ * - pure lets that do not depend on a loop are hoisted out of it, and the
+ *   rest are sunk into the innermost loop so that no statements remain
+ *   between the loops of a nest
+ * The rewrite is semantics-preserving and leaves loops outside of
+ * accelerators untouched. Lowering runs it for targets with the
+ * perfect_hw_loops feature. */
+Stmt perfect_hw_loop_nests(Stmt s, const std::map<std::string, Function> &env);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
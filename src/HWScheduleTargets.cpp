@@ -0,0 +1,105 @@
+#include "HWScheduleTargets.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "IRVisitor.h"
+#include "Schedule.h"
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace Halide {
+namespace Internal {
+
+namespace {
+
+const char *hw_schedule_intrinsic = "hw_schedule";
+
+const Call *as_hw_schedule_call(const Evaluate *op) {
+  const Call *call = op->value.as<Call>();
+  if (call != nullptr && call->is_intrinsic() && call->name == hw_schedule_intrinsic) {
+    return call;
+  }
+  return nullptr;
+}
+
+class CollectHWScheduleTargets : public IRVisitor {
+  using IRVisitor::visit;
+
+  void visit(const Evaluate *op) override {
+    const Call *call = as_hw_schedule_call(op);
+    if (call == nullptr) {
+      IRVisitor::visit(op);
+      return;
+    }
+
+    internal_assert(call->args.size() >= 3 && call->args.size() % 2 == 1)
+      << "malformed hw_schedule call: " << Expr(call) << "\n";
+    const StringImm *func_name = call->args[0].as<StringImm>();
+    internal_assert(func_name != nullptr && is_const(call->args[1]) && is_const(call->args[2]));
+
+    HWScheduleTargets &t = targets[func_name->value];
+    t.initiation_interval = *as_const_int(call->args[1]);
+    t.critical_path_target = *as_const_int(call->args[2]);
+    for (size_t i = 3; i < call->args.size(); i += 2) {
+      const StringImm *op_name = call->args[i].as<StringImm>();
+      internal_assert(op_name != nullptr && is_const(call->args[i + 1]));
+      t.unit_limits[op_name->value] = *as_const_int(call->args[i + 1]);
+    }
+  }
+
+public:
+  map<string, HWScheduleTargets> targets;
+};
+
+class RemoveHWScheduleTargets : public IRMutator {
+  using IRMutator::visit;
+
+  Stmt visit(const Evaluate *op) override {
+    if (as_hw_schedule_call(op) != nullptr) {
+      return Evaluate::make(0);
+    }
+    return op;
+  }
+};
+
+}  // namespace
+
+HWScheduleTargets hw_schedule_targets(const Function &func) {
+  HWScheduleTargets t;
+  t.initiation_interval = func.schedule().hw_initiation_interval();
+  t.critical_path_target = func.schedule().hw_critical_path_target();
+  t.unit_limits = func.schedule().hw_unit_limits();
+  return t;
+}
+
+Stmt add_hw_schedule_targets(Stmt s, const vector<Function> &funcs) {
+  for (const Function &func : funcs) {
+    HWScheduleTargets t = hw_schedule_targets(func);
+    if (!t.defined()) {
+      continue;
+    }
+
+    vector<Expr> args({Expr(func.name()), t.initiation_interval, t.critical_path_target});
+    for (const auto &limit : t.unit_limits) {
+      args.push_back(Expr(limit.first));
+      args.push_back(limit.second);
+    }
+    Stmt call = Evaluate::make(Call::make(Handle(), hw_schedule_intrinsic, args, Call::Intrinsic));
+    s = Block::make(call, s);
+  }
+  return s;
+}
+
+map<string, HWScheduleTargets> collect_hw_schedule_targets(Stmt s) {
+  CollectHWScheduleTargets collector;
+  s.accept(&collector);
+  return collector.targets;
+}
+
+Stmt remove_hw_schedule_targets(Stmt s) {
+  return RemoveHWScheduleTargets().mutate(s);
+}
+
+}  // namespace Internal
+}  // namespace Halide
@@ -0,0 +1,50 @@
+#ifndef HALIDE_HWSCHEDULE_TARGETS_H
+#define HALIDE_HWSCHEDULE_TARGETS_H
+
+/** \file
+ * Carries the hardware scheduling targets of functions (see
+ * Func::hw_initiation_interval, Func::hw_unit_limit and
+ * Func::hw_critical_path) through lowering
+ * to the hardware code generators, as hw_schedule intrinsics.
+ */
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Function.h"
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** The hardware scheduling targets of one function. Zero means no target. */
+struct HWScheduleTargets {
+  int initiation_interval = 0;
+  int critical_path_target = 0;
+  std::map<std::string, int> unit_limits;
+
+  bool defined() const {
+    return initiation_interval > 0 || critical_path_target > 0 || !unit_limits.empty();
+  }
+};
+
+/** The targets set in the schedule of a function. */
+HWScheduleTargets hw_schedule_targets(const Function &func);
+
+/** Prepend a hw_schedule intrinsic for each of funcs with targets to the
+ * body of a hardware accelerator:
+ *   hw_schedule(func_name, initiation_interval, critical_path_target,
+ *               op_0, limit_0, ...) */
+Stmt add_hw_schedule_targets(Stmt s, const std::vector<Function> &funcs);
+
+/** The targets recorded by add_hw_schedule_targets in s, by function name. */
+std::map<std::string, HWScheduleTargets> collect_hw_schedule_targets(Stmt s);
+
+/** Remove the hw_schedule intrinsics from s. */
+Stmt remove_hw_schedule_targets(Stmt s);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
@@ -16,17 +16,36 @@ namespace Internal {
     public:
       std::map<std::string, int> cycleLatency;
       std::map<std::string, int> criticalPath;
+      // Maximum number of functional units of each operation type that
+      // a kernel may instantiate. Operations with no entry are unlimited.
+      std::map<std::string, int> unitLimits;
+
+      // Default delays, relative to a 16 bit add, for the critical
+      // path target set with Func::hw_critical_path
+      Techlib() :
+        criticalPath({{"add", 100}, {"sub", 100}, {"mul", 300},
+                      {"min", 150}, {"max", 150}, {"absd", 150}, {"sel", 50},
+                      {"eq", 100}, {"neq", 100}, {"lt", 100}, {"gt", 100}, {"lte", 100},
+                      {"and_bv", 20}, {"or_bv", 20}}) {}
   };
 
   class HardwareInfo {
     public:
       bool hasCriticalPathTarget;
       int criticalPathTarget;
+      // Requested initiation interval for innermost loops
+      bool hasTargetII;
+      int targetII;
       // Technology library
       Techlib techlib;
       HWInterfacePolicy interfacePolicy;
 
-      HardwareInfo() : interfacePolicy(HW_INTERFACE_POLICY_TOP) {}
+      HardwareInfo() :
+        hasCriticalPathTarget(false),
+        criticalPathTarget(0),
+        hasTargetII(false),
+        targetII(1),
+        interfacePolicy(HW_INTERFACE_POLICY_TOP) {}
 
       int criticalPath(const std::string& opname) const {
         if (techlib.criticalPath.count(opname) > 0) {
@@ -34,6 +53,17 @@ namespace Internal {
         }
         return 0;
       }
+
+      int unitLimit(const std::string& opname) const {
+        if (techlib.unitLimits.count(opname) > 0) {
+          return techlib.unitLimits.at(opname);
+        }
+        return 0;
+      }
+
+      bool usesModuloScheduling() const {
+        return hasTargetII || techlib.unitLimits.size() > 0;
+      }
   };
 
 
@@ -139,6 +139,12 @@ std::ostream &operator<<(std::ostream &out, const MemoryType &t) {
     case MemoryType::GLB:
         out << "GLB";
         break;
+    case MemoryType::MemTile:
+        out << "MemTile";
+        break;
+    case MemoryType::Pond:
+        out << "Pond";
+        break;
     }
     return out;
 }
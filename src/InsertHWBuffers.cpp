@@ -1,6 +1,7 @@
 #include "InsertHWBuffers.h"
 #include "HWBuffer.h"
 #include "HWBufferUtils.h"
+#include "HWScheduleTargets.h"
 
 #include "Bounds.h"
 #include "Debug.h"
@@ -589,7 +590,8 @@ Stmt add_hwbuffer(Stmt s, const HWBuffer &kernel, const HWXcel &xcel, const Scop
               hwbuffer_args.push_back(ostream.odims.at(i).output_block);
             }
 
-            const auto& out_lin_acc = ostream_p.second.linear_access;
+            // contiguous levels share a counter in the address generator
+            const auto out_lin_acc = flatten_linear_access(kernel, ostream_p.second.linear_access);
 
             hwbuffer_args.push_back(Expr(out_lin_acc.size()));
 
@@ -627,6 +629,27 @@ Stmt add_hwbuffer(Stmt s, const HWBuffer &kernel, const HWXcel &xcel, const Scop
         //internal_assert(num_ostreams < 2);
 
         hwbuffer_args.push_back(num_updates);
+
+        // banking for each ostream, in the same order as above
+        for (const auto& ostream_p : kernel.ostreams) {
+          if (ostream_p.first != kernel.name) {
+            const auto& banking = ostream_p.second.banking;
+            hwbuffer_args.push_back(Expr((int)banking.partition));
+            hwbuffer_args.push_back(banking.num_banks);
+            for (size_t i = 0; i < kernel.dims.size(); i++) {
+              hwbuffer_args.push_back(i < banking.coefficients.size() ? banking.coefficients.at(i) : 0);
+            }
+            hwbuffer_args.push_back(banking.block_dim);
+            hwbuffer_args.push_back(banking.block_size);
+            hwbuffer_args.push_back(Expr((int)banking.port_banks.size()));
+            for (int port_bank : banking.port_banks) {
+              hwbuffer_args.push_back(port_bank);
+            }
+          }
+        }
+        hwbuffer_args.push_back(kernel.min_capacity);
+        hwbuffer_args.push_back(Expr((int)kernel.is_double_buffered));
+        hwbuffer_args.push_back(Expr((int)kernel.memory_level));
         //for (const auto& ostream_p : kernel.ostreams) {
         //  if (ostream_p.first == kernel.name) { // let's do the updates
         //    hwbuffer_args.push_back(ostream_p.first);
@@ -1163,6 +1186,16 @@ class InsertHWBuffers : public IRMutator {
             //  new_body = add_hwbuffer(new_body, input_kernel, xcel, scope);
             //}
 
+            // pass the scheduling targets of the hardware kernels on to the code generator
+            vector<Function> xcel_funcs({xcel.func});
+            for (const auto &hwbuffer : xcel.hwbuffers) {
+                if (hwbuffer.second.func.get_contents().defined() &&
+                    hwbuffer.second.func.name() != xcel.func.name()) {
+                    xcel_funcs.push_back(hwbuffer.second.func);
+                }
+            }
+            new_body = add_hw_schedule_targets(new_body, xcel_funcs);
+
             //stmt = For::make(xcel.name + ".accelerator", 0, 1, ForType::Serial, DeviceAPI::Host, body);
             Stmt new_body_produce = ProducerConsumer::make_produce("_hls_target." + xcel.name, new_body);
             Stmt new_body_consume = ProducerConsumer::make_consume("_hls_target." + xcel.name, Evaluate::make(0));
@@ -466,6 +466,31 @@ void JITModule::memoization_cache_set_size(int64_t size) const {
     }
 }
 
+void JITModule::memoization_cache_set_disk_dir(const std::string &dir) const {
+    std::map<std::string, Symbol>::const_iterator f =
+        exports().find("halide_memoization_cache_set_disk_dir");
+    if (f != exports().end()) {
+        return (reinterpret_bits<void (*)(const char *)>(f->second.address))(dir.c_str());
+    }
+}
+
+int JITModule::memoization_cache_get_stats(halide_memoization_cache_shard_stats_t *stats, int max_shards) const {
+    std::map<std::string, Symbol>::const_iterator f =
+        exports().find("halide_memoization_cache_get_stats");
+    if (f != exports().end()) {
+        return (reinterpret_bits<int (*)(halide_memoization_cache_shard_stats_t *, int)>(f->second.address))(stats, max_shards);
+    }
+    return 0;
+}
+
+void JITModule::memoization_cache_cleanup() const {
+    std::map<std::string, Symbol>::const_iterator f =
+        exports().find("halide_memoization_cache_cleanup");
+    if (f != exports().end()) {
+        return (reinterpret_bits<void (*)()>(f->second.address))();
+    }
+}
+
 bool JITModule::compiled() const {
   return jit_module->execution_engine != nullptr;
 }
@@ -476,6 +501,8 @@ JITHandlers runtime_internal_handlers;
 JITHandlers default_handlers;
 JITHandlers active_handlers;
 int64_t default_cache_size;
+std::string default_cache_dir;
+bool default_cache_dir_set = false;
 
 void merge_handlers(JITHandlers &base, const JITHandlers &addins) {
     if (addins.custom_print) {
@@ -811,6 +838,9 @@ JITModule &make_module(llvm::Module *for_module, Target target,
             if (default_cache_size != 0) {
                 runtime.memoization_cache_set_size(default_cache_size);
             }
+            if (default_cache_dir_set) {
+                runtime.memoization_cache_set_disk_dir(default_cache_dir);
+            }
 
             runtime.jit_module->name = "MainShared";
         } else {
@@ -942,5 +972,25 @@ void JITSharedRuntime::memoization_cache_set_size(int64_t size) {
     }
 }
 
+void JITSharedRuntime::memoization_cache_set_disk_dir(const std::string &dir) {
+    std::lock_guard<std::mutex> lock(shared_runtimes_mutex);
+
+    default_cache_dir = dir;
+    default_cache_dir_set = true;
+    shared_runtimes(MainShared).memoization_cache_set_disk_dir(dir);
+}
+
+int JITSharedRuntime::memoization_cache_get_stats(halide_memoization_cache_shard_stats_t *stats, int max_shards) {
+    std::lock_guard<std::mutex> lock(shared_runtimes_mutex);
+
+    return shared_runtimes(MainShared).memoization_cache_get_stats(stats, max_shards);
+}
+
+void JITSharedRuntime::memoization_cache_cleanup() {
+    std::lock_guard<std::mutex> lock(shared_runtimes_mutex);
+
+    shared_runtimes(MainShared).memoization_cache_cleanup();
+}
+
 }  // namespace Internal
 }  // namespace Halide
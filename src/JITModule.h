@@ -115,6 +115,9 @@ struct JITModule {
 
     /** Encapsulate device (GPU) and buffer interactions. */
     void memoization_cache_set_size(int64_t size) const;
+    void memoization_cache_set_disk_dir(const std::string &dir) const;
+    int memoization_cache_get_stats(halide_memoization_cache_shard_stats_t *stats, int max_shards) const;
+    void memoization_cache_cleanup() const;
 
     /** Return true if compile_module has been called on this module. */
     bool compiled() const;
@@ -153,6 +156,23 @@ public:
      */
     static void memoization_cache_set_size(int64_t size);
 
+    /** Set the directory of the on-disk tier of the memoization cache,
+     * or disable the tier with an empty string. If you are compiling
+     * statically, call halide_memoization_cache_set_disk_dir() instead.
+     */
+    static void memoization_cache_set_disk_dir(const std::string &dir);
+
+    /** Get the statistics of the shards of the memoization cache, as
+     * halide_memoization_cache_get_stats() does. Returns 0 if no
+     * pipeline has been JIT compiled yet.
+     */
+    static int memoization_cache_get_stats(halide_memoization_cache_shard_stats_t *stats, int max_shards);
+
+    /** Release every entry of the memoization cache, as
+     * halide_memoization_cache_cleanup() does.
+     */
+    static void memoization_cache_cleanup();
+
     static void release_all();
 };
 
@@ -115,6 +115,7 @@ DECLARE_CPP_INITMOD(osx_opengl_context)
 DECLARE_CPP_INITMOD(osx_yield)
 DECLARE_CPP_INITMOD(posix_abort)
 DECLARE_CPP_INITMOD(posix_allocator)
+DECLARE_CPP_INITMOD(posix_pool_allocator)
 DECLARE_CPP_INITMOD(posix_clock)
 DECLARE_CPP_INITMOD(posix_error_handler)
 DECLARE_CPP_INITMOD(posix_get_symbol)
@@ -637,6 +638,9 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
     bool bits_64 = (t.bits == 64);
     bool debug = t.has_feature(Target::Debug);
     bool tsan = t.has_feature(Target::TSAN);
+    // The pooling allocator reports to the profiler, which isn't
+    // available on MIPS.
+    bool pool_allocator = t.has_feature(Target::PoolAllocator) && t.arch != Target::MIPS;
 
     vector<std::unique_ptr<llvm::Module>> modules;
 
@@ -644,7 +648,11 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
         if (module_type != ModuleJITInlined && module_type != ModuleAOTNoRuntime) {
             // OS-dependent modules
             if (t.os == Target::Linux) {
-                modules.push_back(get_initmod_posix_allocator(c, bits_64, debug));
+                if (pool_allocator) {
+                    modules.push_back(get_initmod_posix_pool_allocator(c, bits_64, debug));
+                } else {
+                    modules.push_back(get_initmod_posix_allocator(c, bits_64, debug));
+                }
                 modules.push_back(get_initmod_posix_error_handler(c, bits_64, debug));
                 modules.push_back(get_initmod_posix_print(c, bits_64, debug));
                 if (t.arch == Target::X86) {
@@ -663,7 +671,11 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
                 }
                 modules.push_back(get_initmod_posix_get_symbol(c, bits_64, debug));
             } else if (t.os == Target::OSX) {
-                modules.push_back(get_initmod_posix_allocator(c, bits_64, debug));
+                if (pool_allocator) {
+                    modules.push_back(get_initmod_posix_pool_allocator(c, bits_64, debug));
+                } else {
+                    modules.push_back(get_initmod_posix_allocator(c, bits_64, debug));
+                }
                 modules.push_back(get_initmod_posix_error_handler(c, bits_64, debug));
                 modules.push_back(get_initmod_posix_print(c, bits_64, debug));
                 modules.push_back(get_initmod_osx_clock(c, bits_64, debug));
@@ -679,7 +691,11 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
                 modules.push_back(get_initmod_osx_get_symbol(c, bits_64, debug));
                 modules.push_back(get_initmod_osx_host_cpu_count(c, bits_64, debug));
             } else if (t.os == Target::Android) {
-                modules.push_back(get_initmod_posix_allocator(c, bits_64, debug));
+                if (pool_allocator) {
+                    modules.push_back(get_initmod_posix_pool_allocator(c, bits_64, debug));
+                } else {
+                    modules.push_back(get_initmod_posix_allocator(c, bits_64, debug));
+                }
                 modules.push_back(get_initmod_posix_error_handler(c, bits_64, debug));
                 modules.push_back(get_initmod_posix_print(c, bits_64, debug));
                 if (t.arch == Target::ARM) {
@@ -698,7 +714,11 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
                 }
                 modules.push_back(get_initmod_posix_get_symbol(c, bits_64, debug));
             } else if (t.os == Target::Windows) {
-                modules.push_back(get_initmod_posix_allocator(c, bits_64, debug));
+                if (pool_allocator) {
+                    modules.push_back(get_initmod_posix_pool_allocator(c, bits_64, debug));
+                } else {
+                    modules.push_back(get_initmod_posix_allocator(c, bits_64, debug));
+                }
                 modules.push_back(get_initmod_posix_error_handler(c, bits_64, debug));
                 modules.push_back(get_initmod_posix_print(c, bits_64, debug));
                 modules.push_back(get_initmod_windows_clock(c, bits_64, debug));
@@ -715,7 +735,11 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
                     modules.push_back(get_initmod_mingw_math(c, bits_64, debug));
                 }
             } else if (t.os == Target::IOS) {
-                modules.push_back(get_initmod_posix_allocator(c, bits_64, debug));
+                if (pool_allocator) {
+                    modules.push_back(get_initmod_posix_pool_allocator(c, bits_64, debug));
+                } else {
+                    modules.push_back(get_initmod_posix_allocator(c, bits_64, debug));
+                }
                 modules.push_back(get_initmod_posix_error_handler(c, bits_64, debug));
                 modules.push_back(get_initmod_posix_print(c, bits_64, debug));
                 modules.push_back(get_initmod_posix_clock(c, bits_64, debug));
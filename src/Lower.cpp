@@ -32,8 +32,11 @@
 #include "FuseGPUThreadLoops.h"
 #include "FuzzFloatStores.h"
 #include "HexagonOffload.h"
+#include "HWBufferDoubleBuffer.h"
+#include "HWBufferEstimates.h"
 #include "HWBufferRename.h"
 #include "HWBufferSimplifications.h"
+#include "HWLoopPerfection.h"
 #include "IRMutator.h"
 #include "IROperator.h"
 #include "IRPrinter.h"
@@ -77,6 +80,7 @@
 #include "UnpackBuffers.h"
 #include "UnsafePromises.h"
 #include "UnrollLoops.h"
+#include "Util.h"
 #include "VaryingAttributes.h"
 #include "VectorizeLoops.h"
 #include "WrapCalls.h"
@@ -242,9 +246,23 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
         // hardware generation using the unified buffer
         vector<HWXcel> xcels;
 
+        if (t.has_feature(Target::PerfectHWLoops)) {
+          debug(1) << "Perfecting hardware loop nests...\n";
+          s = perfect_hw_loop_nests(s, env);
+          s_sliding = perfect_hw_loop_nests(s_sliding, env);
+          debug(2) << "Lowering after perfecting hardware loop nests:\n" << s << "\n\n";
+        }
+
         //std::cout << "extracting hw buffers" << std::endl << s << std::endl;
         xcels = extract_hw_accelerators(s_sliding, env, inlined_stages);
         synthesize_hwbuffers(s, env, xcels);
+        for (HWXcel &xcel : xcels) {
+          place_hwbuffers(xcel);
+        }
+        string estimates_path = get_env_variable("HL_HWBUFFER_ESTIMATES");
+        if (!estimates_path.empty()) {
+          write_hwbuffer_estimates(xcels, estimates_path);
+        }
 
         //std::cout << "----- Accelerators" << std::endl;
         //for (auto xcel : xcels) {
@@ -328,6 +346,7 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     //std::cout << "Before storage flattening...\n" << s << "\n\n";
 
     if (t.has_feature(Target::Clockwork)) {
+      s = double_buffer_hwbuffers(s, env);
       s = rename_hwbuffers(s, env);
     }
     
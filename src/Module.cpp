@@ -616,11 +616,10 @@ void Module::compile(const Outputs &output_files_arg) const {
       // Construct pipeline header file
       std::string hdr_filename = output_folder_name + name() + "_clockwork.h";
       std::ofstream hdr_file(hdr_filename);
-      Internal::CodeGen_C hdr_cg(hdr_file,
-                                 target().with_feature(Target::CPlusPlusMangling),
-                                 Internal::CodeGen_C::OutputKind::CHeader,
-                                 hdr_filename
-                                );
+      Internal::CodeGen_RDAI_Header hdr_cg(hdr_file,
+                                           target().with_feature(Target::CPlusPlusMangling),
+                                           name(),
+                                           hdr_filename);
       std::cout << "[INFO] Module.compile(): clockwork header file = " << hdr_filename << "\n";
       hdr_cg.compile(*this);
 
@@ -728,13 +727,14 @@ void compile_multitarget(const std::string &fn_name,
             user_error << "All Targets must have matching arch-bits-os for compile_multitarget.\n";
         }
         // Some features must match across all targets.
-        static const std::array<Target::Feature, 8> must_match_features = {{
+        static const std::array<Target::Feature, 9> must_match_features = {{
             Target::ASAN,
             Target::CPlusPlusMangling,
             Target::JIT,
             Target::Matlab,
             Target::MSAN,
             Target::NoRuntime,
+            Target::PoolAllocator,
             Target::TSAN,
             Target::UserContext,
         }};
@@ -222,10 +222,14 @@ struct FuncScheduleContents {
     bool is_accelerator_output;
     bool is_accelerate_call_output;
     bool is_linebuffered;
+    bool is_double_buffered;
     std::set<std::string> accelerate_inputs;
     std::string accelerate_exit;
     LoopLevel accelerate_compute_level, accelerate_store_level;
     std::map<std::string, int> fifo_depths;   // key is the name of the consumer
+    int hw_initiation_interval;               // zero if not set
+    int hw_critical_path_target;              // zero if not set
+    std::map<std::string, int> hw_unit_limits;   // key is the name of the operation
     std::map<std::string, Function> tap_funcs;
     std::map<std::string, Parameter> tap_params;
 
@@ -233,7 +237,8 @@ struct FuncScheduleContents {
       store_level(LoopLevel::inlined()), compute_level(LoopLevel::inlined()),
         memory_type(MemoryType::Auto), memoized(false), async(false), is_hw_kernel(false),
         is_accelerated(false), is_accelerator_input(false), is_accelerator_output(false),
-        is_accelerate_call_output(false), is_linebuffered(false) {};
+        is_accelerate_call_output(false), is_linebuffered(false), is_double_buffered(false),
+        hw_initiation_interval(0), hw_critical_path_target(0) {};
 
     // Pass an IRMutator through to all Exprs referenced in the FuncScheduleContents
     void mutate(IRMutator *mutator) {
@@ -351,11 +356,15 @@ FuncSchedule FuncSchedule::deep_copy(
     copy.contents->is_hw_kernel = contents->is_hw_kernel;
     copy.contents->is_accelerated = contents->is_accelerated;
     copy.contents->is_linebuffered = contents->is_linebuffered;
+    copy.contents->is_double_buffered = contents->is_double_buffered;
     copy.contents->accelerate_inputs = contents->accelerate_inputs;
     copy.contents->accelerate_exit = contents->accelerate_exit;
     copy.contents->accelerate_compute_level = contents->accelerate_compute_level;
     copy.contents->accelerate_store_level = contents->accelerate_store_level;
     copy.contents->fifo_depths = contents->fifo_depths;
+    copy.contents->hw_initiation_interval = contents->hw_initiation_interval;
+    copy.contents->hw_unit_limits = contents->hw_unit_limits;
+    copy.contents->hw_critical_path_target = contents->hw_critical_path_target;
     //copy.contents->is_kernel_buffer = contents->is_kernel_buffer;
     //copy.contents->is_kernel_buffer_slice = contents->is_kernel_buffer_slice;
     copy.contents->is_accelerator_input = contents->is_accelerator_input;
@@ -483,6 +492,14 @@ bool &FuncSchedule::is_linebuffered() {
     return contents->is_linebuffered;
 }
 
+bool FuncSchedule::is_double_buffered() const {
+    return contents->is_double_buffered;
+}
+
+bool &FuncSchedule::is_double_buffered() {
+    return contents->is_double_buffered;
+}
+
 bool FuncSchedule::is_accelerator_input() const{
     return contents->is_accelerator_input;
 }
@@ -539,6 +556,30 @@ std::map<std::string, int> &FuncSchedule::fifo_depths() {
     return contents->fifo_depths;
 }
 
+int FuncSchedule::hw_initiation_interval() const {
+    return contents->hw_initiation_interval;
+}
+
+int &FuncSchedule::hw_initiation_interval() {
+    return contents->hw_initiation_interval;
+}
+
+const std::map<std::string, int> &FuncSchedule::hw_unit_limits() const {
+    return contents->hw_unit_limits;
+}
+
+std::map<std::string, int> &FuncSchedule::hw_unit_limits() {
+    return contents->hw_unit_limits;
+}
+
+int FuncSchedule::hw_critical_path_target() const {
+    return contents->hw_critical_path_target;
+}
+
+int &FuncSchedule::hw_critical_path_target() {
+    return contents->hw_critical_path_target;
+}
+
 const std::string &FuncSchedule::accelerate_exit() const{
     return contents->accelerate_exit;
 }
@@ -464,6 +464,12 @@ public:
     bool &is_linebuffered();
     // @}
 
+    /** Function is a ping-pong buffered hw kernel? */
+    // @{
+    bool is_double_buffered() const;
+    bool &is_double_buffered();
+    // @}
+
     /** Is accelerated using hardware? */
     // @{
     bool is_accelerated() const;
@@ -498,6 +504,27 @@ public:
     std::map<std::string, int> &fifo_depths();
     // @}
 
+    /** The initiation interval requested for the hardware computing
+     * the function, or zero if none was. */
+    // @{
+    int hw_initiation_interval() const;
+    int &hw_initiation_interval();
+    // @}
+
+    /** The most functional units of each operation the hardware
+     * computing the function may use. */
+    // @{
+    const std::map<std::string, int> &hw_unit_limits() const;
+    std::map<std::string, int> &hw_unit_limits();
+    // @}
+
+    /** The longest combinational delay allowed between registers in
+     * the hardware computing the function, or zero if none was set. */
+    // @{
+    int hw_critical_path_target() const;
+    int &hw_critical_path_target();
+    // @}
+
     /** The output functions of the hardware accelerator pipeline. */
     // @{
     const std::string &accelerate_exit() const;
@@ -506,6 +506,13 @@ class SlidingWindow : public IRMutator {
             return IRMutator::visit(op);
         }
 
+        // A double-buffered function alternates between two copies on
+        // successive iterations, so an iteration can't reuse the values
+        // computed by the previous one.
+        if (sched.is_double_buffered()) {
+            return IRMutator::visit(op);
+        }
+
         Stmt new_body = op->body;
 
         debug(3) << "Doing sliding window analysis on realization of " << op->name << "\n";
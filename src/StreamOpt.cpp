@@ -403,6 +403,107 @@ Stmt add_linebuffer(Stmt s, const HWKernel &kernel) {
     return ret;
 }
 
+// Latency model for sizing the dispatch fifos.
+// Every kernel reads one stencil of each input stream and writes one
+// stencil_update per cycle, scanning dimension 0 innermost. A linebuffer
+// emits the window at a given offset in the store once it has read the
+// update containing the window's last pixel. Latencies are -1 where the
+// store bounds are not constant.
+int linebuffer_latency(const HWKernel &kernel, const vector<int> &offsets) {
+    int latency = 0;
+    int stride = 1;  // updates per step along dimension i
+    for (size_t i = 0; i < kernel.dims.size(); i++) {
+        const StencilDimSpecs &dim = kernel.dims[i];
+        Expr store_extent = simplify(dim.store_bound.max - dim.store_bound.min + 1);
+        if (dim.step <= 0 || !is_const(store_extent)) {
+            return -1;
+        }
+        latency += (offsets[i] + dim.size - dim.step) / dim.step * stride;
+        stride *= (int)*as_const_int(store_extent) / dim.step;
+    }
+    return latency;
+}
+
+// Cycles from the first update a kernel writes to the first window its
+// dispatch sends to the consumer
+int dispatch_latency(const HWKernel &kernel, const string &consumer) {
+    const auto it = kernel.consumer_stencils.find(consumer);
+    internal_assert(it != kernel.consumer_stencils.end());
+    internal_assert(it->second.size() == kernel.dims.size());
+    vector<int> offsets;
+    for (size_t i = 0; i < kernel.dims.size(); i++) {
+        Expr store_offset = simplify(it->second[i].store_bound.min -
+                                     kernel.dims[i].store_bound.min);
+        if (!is_const(store_offset)) {
+            return -1;
+        }
+        offsets.push_back((int)*as_const_int(store_offset));
+    }
+    return linebuffer_latency(kernel, offsets);
+}
+
+// Cycle at which a kernel starts: once the first window of every input
+// stream has arrived. Kernels without input streams start at cycle 0, and
+// kernels downstream of a stream with unknown latency at -1.
+int kernel_start_cycle(const HWKernelDAG &dag, const string &name, map<string, int> &start_cycles) {
+    if (start_cycles.count(name)) {
+        return start_cycles[name];
+    }
+    const auto it = dag.kernels.find(name);
+    internal_assert(it != dag.kernels.end());
+    int start = 0;
+    for (const string &producer_name : it->second.input_streams) {
+        const HWKernel &producer = dag.kernels.find(producer_name)->second;
+        int producer_start = kernel_start_cycle(dag, producer_name, start_cycles);
+        int latency = dispatch_latency(producer, name);
+        if (producer_start < 0 || latency < 0) {
+            start = -1;
+            break;
+        }
+        start = std::max(start, producer_start + latency);
+    }
+    start_cycles[name] = start;
+    return start;
+}
+
+// Size the fifo of each dispatch branch to hold the windows that arrive
+// before the consumer starts, which happens when the consumer waits on a
+// slower path (e.g. the input and its blur in an unsharp mask). With
+// shallower fifos the producer stalls, and a kernel feeding both paths
+// deadlocks. Depths set in the schedule (Func::fifo_depth) are kept as
+// lower bounds, and are used unchanged where the latency is not known.
+void size_dispatch_fifos(HWKernelDAG &dag) {
+    map<string, int> start_cycles;
+    for (const auto &p : dag.kernels) {
+        kernel_start_cycle(dag, p.first, start_cycles);
+    }
+
+    debug(4) << "dispatch fifo depths for " << dag.name << ":\n";
+    for (auto &p : dag.kernels) {
+        HWKernel &kernel = p.second;
+        if (kernel.is_inlined) {
+            // inlined kernels are not streamed into their consumers
+            continue;
+        }
+        for (const auto &c : kernel.consumer_stencils) {
+            int &depth = kernel.consumer_fifo_depths[c.first];
+            int latency = dispatch_latency(kernel, c.first);
+            if (start_cycles[kernel.name] < 0 || start_cycles[c.first] < 0 || latency < 0) {
+                debug(4) << "  " << kernel.name << ".stencil.stream.to." << c.first
+                         << ": depth " << depth << " (latency unknown)\n";
+                continue;
+            }
+            int arrival = start_cycles[kernel.name] + latency;
+            int slack = start_cycles[c.first] - arrival;
+            internal_assert(slack >= 0);
+            depth = std::max(depth, slack);
+            debug(4) << "  " << kernel.name << ".stencil.stream.to." << c.first
+                     << ": depth " << depth << " (first window at cycle " << arrival
+                     << ", consumer starts at cycle " << start_cycles[c.first] << ")\n";
+        }
+    }
+}
+
   Stmt find_pcblock(Stmt s) {
     Stmt stmt = s;
     while (const Block *block = stmt.as<Block>()) {
@@ -1063,7 +1164,9 @@ public:
 
 Stmt stream_opt(Stmt s, const HWKernelDAG &dag) {
     debug(3) << s << "\n";
-    s = StreamOpt(dag).mutate(s);
+    HWKernelDAG sized_dag = dag;
+    size_dispatch_fifos(sized_dag);
+    s = StreamOpt(sized_dag).mutate(s);
     debug(3) << s << "\n";
     return s;
 }
@@ -16,6 +16,13 @@ namespace Internal {
  */
 Stmt stream_opt(Stmt s, const HWKernelDAG &dag);
 
+/** Deepen the dispatch fifos of the kernels in dag to hold the windows
+ * that arrive before their consumers start. Depths already set are kept
+ * as lower bounds, and left unchanged where the store bounds are not
+ * constant.
+ */
+void size_dispatch_fifos(HWKernelDAG &dag);
+
 }
 }
 
@@ -315,7 +315,9 @@ const std::map<std::string, Target::Feature> feature_name_map = {
     {"clockwork", Target::Clockwork},
     {"use_extract_hw_kernel", Target::UseExtractHWKernel},
     {"bfloat_hardware", Target::BFloatHardware},
-    {"enable_ponds", Target::EnablePonds}
+    {"enable_ponds", Target::EnablePonds},
+    {"pool_allocator", Target::PoolAllocator},
+    {"perfect_hw_loops", Target::PerfectHWLoops}
     // NOTE: When adding features to this map, be sure to update
     // PyEnums.cpp and halide.cmake as well.
 };
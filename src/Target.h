@@ -111,6 +111,8 @@ struct Target {
         UseExtractHWKernel = halide_target_feature_use_extract_hw_kernel,
         BFloatHardware = halide_target_feature_bfloat_hardware,
         EnablePonds = halide_target_feature_enable_ponds,
+        PoolAllocator = halide_target_feature_pool_allocator,
+        PerfectHWLoops = halide_target_feature_perfect_hw_loops,
         FeatureEnd = halide_target_feature_end
     };
     Target() : os(OSUnknown), arch(ArchUnknown), bits(0) {}
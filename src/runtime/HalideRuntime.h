@@ -281,6 +281,26 @@ extern int halide_default_semaphore_release(struct halide_semaphore_t *, int n);
 extern bool halide_default_semaphore_try_acquire(struct halide_semaphore_t *, int n);
 // @}
 
+/** Versions of do_par_for and do_parallel_tasks that run on a
+ * work-stealing thread pool, for parallel loops with very cheap
+ * iterations. Each thread splits its loop ranges onto its own deque,
+ * and idle threads steal from the deques of others. Tasks with
+ * semaphores, min_threads or serial set are passed on to
+ * halide_default_do_parallel_tasks. Install them with
+ * halide_set_custom_parallel_runtime, or set the environment variable
+ * HL_THREAD_POOL=work_stealing to use them in place of the
+ * defaults. The pool uses the same number of threads as the default
+ * one, and is shut down by halide_shutdown_thread_pool. */
+// @{
+extern int halide_work_stealing_do_par_for(void *user_context,
+                                           halide_task_t task,
+                                           int min, int size, uint8_t *closure);
+extern int halide_work_stealing_do_parallel_tasks(void *user_context,
+                                                  int num_tasks,
+                                                  struct halide_parallel_task_t *tasks,
+                                                  void *task_parent);
+// @}
+
 struct halide_thread;
 
 /** Spawn a thread. Returns a handle to the thread for the purposes of
@@ -305,6 +325,28 @@ extern void halide_join_thread(struct halide_thread *);
  */
 extern int halide_set_num_threads(int n);
 
+/** Where the worker threads of Halide's thread pools may run. */
+typedef enum halide_thread_affinity_t {
+    /** Let the OS place and migrate threads freely. */
+    halide_thread_affinity_none = 0,
+    /** Pin each worker thread to its own core. */
+    halide_thread_affinity_core = 1,
+    /** Pin each worker thread to the cores of one NUMA node, spreading
+     * the workers across nodes the same way as for
+     * halide_thread_affinity_core. The work-stealing pool also prefers
+     * to steal from threads on the same node, so that neighbouring
+     * iterations of a parallel loop tend to run on one node. */
+    halide_thread_affinity_numa = 2
+} halide_thread_affinity_t;
+
+/** Set where worker threads may run. Returns the old setting. The
+ * default comes from the environment variable HL_THREAD_AFFINITY,
+ * which may be "none", "core" or "numa". Threads are placed when they
+ * are created, so this should be called before the first parallel
+ * loop runs, or after halide_shutdown_thread_pool. Threads are only
+ * pinned on Linux; elsewhere this has no effect. */
+extern halide_thread_affinity_t halide_set_thread_affinity(halide_thread_affinity_t affinity);
+
 /** Halide calls these functions to allocate and free memory. To
  * replace in AOT code, use the halide_set_custom_malloc and
  * halide_set_custom_free, or (on platforms that support weak
@@ -836,14 +878,31 @@ extern void halide_set_gpu_device(int n);
  * HL_GPU_DEVICE. */
 extern int halide_get_gpu_device(void *user_context);
 
-/** Set the soft maximum amount of memory, in bytes, that the LRU
+/** Set the soft maximum amount of memory, in bytes, that the
  *  cache will use to memoize Func results.  This is not a strict
  *  maximum in that concurrency and simultaneous use of memoized
  *  reults larger than the cache size can both cause it to
- *  temporariliy be larger than the size specified here.
+ *  temporariliy be larger than the size specified here. Entries are
+ *  evicted roughly in least recently used order, but among the least
+ *  recently used few, those that took the least time to compute per
+ *  byte are evicted first.
  */
 extern void halide_memoization_cache_set_size(int64_t size);
 
+/** Enable an on-disk second tier of the memoization cache, kept in the
+ *  given directory, which must already exist. Entries evicted from
+ *  memory are written to one file per cache key. Entries still held
+ *  when the cache is cleaned up are discarded. A lookup that misses in
+ *  memory maps the file for its key, if there is one with the right
+ *  shape, and returns buffers that point into the mapping instead of
+ *  copying the data. Pass NULL or an empty string to disable the tier.
+ *  By default, the directory is taken from the HL_MEMOIZATION_CACHE_DIR
+ *  environment variable, and the tier is disabled if it is unset. On
+ *  platforms without memory mapped files, the tier is never enabled
+ *  and this does nothing.
+ */
+extern void halide_memoization_cache_set_disk_dir(const char *dir);
+
 /** Given a cache key for a memoized result, currently constructed
  *  from the Func name and top-level Func name plus the arguments of
  *  the computation, determine if the result is in the cache and
@@ -906,6 +965,30 @@ extern void halide_memoization_cache_release(void *user_context, void *host);
  */
 extern void halide_memoization_cache_cleanup();
 
+/** Statistics for one shard of the memoization cache. The cache is
+ * split into shards by cache key hash, each with its own lock, hash
+ * table and least recently used order. */
+struct halide_memoization_cache_shard_stats_t {
+    /** The number of lookups that found, or did not find, an entry in
+     * memory. */
+    uint64_t hits, misses;
+    /** The number of entries evicted to keep the cache under its size. */
+    uint64_t evictions;
+    /** The number of misses in memory found in the on-disk tier, and
+     * the number of entries written to it. */
+    uint64_t disk_hits, spills;
+    /** The bytes of memoized data held by the shard. */
+    int64_t size;
+    /** The number of entries held, and of hash table buckets. */
+    int32_t entries, buckets;
+};
+
+/** Fill in the statistics of up to max_shards shards of the
+ * memoization cache, and return the total number of shards. Pass
+ * max_shards = 0 to just query the number of shards. */
+extern int halide_memoization_cache_get_stats(struct halide_memoization_cache_shard_stats_t *stats,
+                                              int max_shards);
+
 /** Create a unique file with a name of the form prefixXXXXXsuffix in an arbitrary
  * (but writable) directory; this is typically $TMP or /tmp, but the specific
  * location is not guaranteed. (Note that the exact form of the file name
@@ -1291,7 +1374,9 @@ typedef enum halide_target_feature_t {
     halide_target_feature_use_extract_hw_kernel = 65, ///< Enable old hwkernel functionality instead of unified buffer
     halide_target_feature_bfloat_hardware = 66, ///< Enable use of bfloat hardware in hardware accelerators as oppoosed to float
     halide_target_feature_enable_ponds = 67, ///< Enable Clockwork to map memories to ponds  in hardware accelerators in addition to memory tiles
-    halide_target_feature_end = 68 ///< A sentinel. Every target is considered to have this feature, and setting this feature does nothing.
+    halide_target_feature_pool_allocator = 68, ///< Use a pooling allocator with size classes as the default halide_malloc and halide_free.
+    halide_target_feature_perfect_hw_loops = 69, ///< Reshape the loops in hardware accelerators into perfect, rectangular nests before extracting hardware buffers
+    halide_target_feature_end = 70 ///< A sentinel. Every target is considered to have this feature, and setting this feature does nothing.
 } halide_target_feature_t;
 
 /** This function is called internally by Halide in some situations to determine
@@ -1780,6 +1865,14 @@ struct halide_profiler_state {
 
     /** Sampling thread reference to be joined at shutdown. */
     struct halide_thread *sampling_thread;
+
+    /** The memory held from the system by the runtime's pooling
+     * allocator, if the pool_allocator target feature is in use. Its
+     * current and peak memory are the resident and peak resident
+     * bytes of the pool, and its allocation count is the number of
+     * blocks requested from the system. Not part of the pipelines
+     * list, and never reset. */
+    struct halide_profiler_pipeline_stats *allocator;
 };
 
 /** Profiler func ids with special meanings. */
@@ -33,4 +33,42 @@ WEAK int halide_create_temp_file(void *user_context, const char *prefix, const c
     return 0;
 }
 
+extern void *mmap(void *, size_t, int, int, int, long);
+extern int munmap(void *, size_t);
+extern long lseek(int, long, int);
+
+#define PROT_READ 1
+#define PROT_WRITE 2
+#define MAP_PRIVATE 2
+#define SEEK_END 2
+
+WEAK bool halide_can_map_files() {
+    return true;
+}
+
+// Map a whole file copy-on-write, so the mapping can be written to
+// without changing the file.
+WEAK void *halide_map_file(void *user_context, const char *path, size_t *size) {
+    void *f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+    int fd = fileno(f);
+    long file_size = lseek(fd, 0, SEEK_END);
+    void *addr = NULL;
+    if (file_size > 0) {
+        addr = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (addr == (void *)-1) {
+            addr = NULL;
+        }
+    }
+    fclose(f);
+    *size = addr ? (size_t)file_size : 0;
+    return addr;
+}
+
+WEAK void halide_unmap_file(void *user_context, void *addr, size_t size) {
+    munmap(addr, size);
+}
+
 }  // extern "C"
@@ -80,6 +80,14 @@ struct CacheEntry {
     halide_dimension_t *computed_bounds;
     // The actual stored data.
     halide_buffer_t *buf;
+    // The total size of the stored data, and how long it took to
+    // compute, from the cache miss to the store.
+    uint64_t size_in_bytes;
+    int64_t compute_time_ns;
+    // If the entry was loaded from the on-disk tier, the mapping of
+    // its file, which holds the data of all the tuple buffers.
+    void *mapping;
+    size_t mapping_size;
 
     bool init(const uint8_t *cache_key, size_t cache_key_size,
               uint32_t key_hash,
@@ -93,6 +101,8 @@ struct CacheEntry {
 struct CacheBlockHeader {
     CacheEntry *entry;
     uint32_t hash;
+    // When the lookup that allocated this block missed.
+    int64_t miss_time_ns;
 };
 
 // Each host block has extra space to store a header just before the
@@ -121,6 +131,10 @@ WEAK bool CacheEntry::init(const uint8_t *cache_key, size_t cache_key_size,
     in_use_count = 0;
     tuple_count = tuples;
     dimensions = computed_bounds_buf->dimensions;
+    size_in_bytes = 0;
+    compute_time_ns = 0;
+    mapping = NULL;
+    mapping_size = 0;
 
     // Allocate all the necessary space (or die)
     size_t storage_bytes = 0;
@@ -165,6 +179,7 @@ WEAK bool CacheEntry::init(const uint8_t *cache_key, size_t cache_key_size,
         for (int j = 0; j < dimensions; j++) {
             buf[i].dim[j] = tuple_buffers[i]->dim[j];
         }
+        size_in_bytes += buf[i].size_in_bytes();
     }
     return true;
 }
@@ -172,7 +187,12 @@ WEAK bool CacheEntry::init(const uint8_t *cache_key, size_t cache_key_size,
 WEAK void CacheEntry::destroy() {
     for (uint32_t i = 0; i < tuple_count; i++) {
         halide_device_free(NULL, &buf[i]);
-        halide_free(NULL, get_pointer_to_header(buf[i].host));
+        if (mapping == NULL) {
+            halide_free(NULL, get_pointer_to_header(buf[i].host));
+        }
+    }
+    if (mapping != NULL) {
+        halide_unmap_file(NULL, mapping, mapping_size);
     }
     halide_free(NULL, metadata_storage);
 }
@@ -185,55 +205,105 @@ WEAK uint32_t djb_hash(const uint8_t *key, size_t key_size)  {
     return h;
 }
 
-WEAK halide_mutex memoization_lock = { { 0 } };
+// The cache is split into shards by key hash, each with its own lock,
+// hash table and LRU chain, so concurrent pipelines only contend when
+// their keys land in the same shard. The size limit is shared by all
+// the shards.
+const int kCacheShardBits = 4;
+const size_t kCacheShards = 1 << kCacheShardBits;
+
+// The hash table of each shard starts at this many buckets, and
+// doubles whenever it has more entries than buckets.
+const size_t kInitialHashTableSize = 16;
+
+// When pruning, the entry with the lowest compute time per byte among
+// this many of the least recently used entries is evicted first.
+const int kEvictionCandidates = 8;
 
-const size_t kHashTableSize = 256;
+struct CacheShard {
+    halide_mutex lock;
 
-WEAK CacheEntry *cache_entries[kHashTableSize];
+    CacheEntry **cache_entries;
+    size_t hash_table_size;
+    size_t entry_count;
+
+    CacheEntry *most_recently_used;
+    CacheEntry *least_recently_used;
+
+    int64_t current_size;
+
+    uint64_t hits, misses, evictions, disk_hits;
+    // Updated atomically, as spilling happens without the lock held.
+    uint64_t spills;
+};
 
-WEAK CacheEntry *most_recently_used = NULL;
-WEAK CacheEntry *least_recently_used = NULL;
+WEAK CacheShard cache_shards[kCacheShards];
 
 const uint64_t kDefaultCacheSize = 1 << 20;
 WEAK int64_t max_cache_size = kDefaultCacheSize;
+// The sum of the current_size of all the shards. Updated atomically.
 WEAK int64_t current_cache_size = 0;
 
+WEAK __attribute((always_inline)) bool cache_over_size() {
+    return __atomic_load_n(&current_cache_size, __ATOMIC_RELAXED) >
+        __atomic_load_n(&max_cache_size, __ATOMIC_RELAXED);
+}
+
+// The bucket index uses the low bits of the hash, so pick the shard
+// from the high bits of a scrambled copy.
+WEAK __attribute((always_inline)) size_t shard_index(uint32_t hash) {
+    return (hash * 2654435761u) >> (32 - kCacheShardBits);
+}
+
+WEAK __attribute((always_inline)) CacheShard &shard_for_hash(uint32_t hash) {
+    return cache_shards[shard_index(hash)];
+}
+
+WEAK __attribute((always_inline)) CacheEntry **bucket_for_hash(CacheShard &shard, uint32_t hash) {
+    return &shard.cache_entries[hash & (shard.hash_table_size - 1)];
+}
+
 #if CACHE_DEBUGGING
-WEAK void validate_cache() {
-    print(NULL) << "validating cache, "
-                << "current size " << current_cache_size
+WEAK void validate_cache(CacheShard &shard) {
+    print(NULL) << "validating cache shard " << (int)(&shard - cache_shards) << ", "
+                << "shard size " << shard.current_size
+                << ", current size " << current_cache_size
                 << " of maximum " << max_cache_size << "\n";
-    int entries_in_hash_table = 0;
-    for (size_t i = 0; i < kHashTableSize; i++) {
-        CacheEntry *entry = cache_entries[i];
+    size_t entries_in_hash_table = 0;
+    for (size_t i = 0; i < shard.hash_table_size; i++) {
+        CacheEntry *entry = shard.cache_entries[i];
         while (entry != NULL) {
             entries_in_hash_table++;
-            if (entry->more_recent == NULL && entry != most_recently_used) {
+            if (entry->more_recent == NULL && entry != shard.most_recently_used) {
                 halide_print(NULL, "cache invalid case 1\n");
                 __builtin_trap();
             }
-            if (entry->less_recent == NULL && entry != least_recently_used) {
+            if (entry->less_recent == NULL && entry != shard.least_recently_used) {
                 halide_print(NULL, "cache invalid case 2\n");
                 __builtin_trap();
             }
+            if (&shard_for_hash(entry->hash) != &shard) {
+                halide_print(NULL, "cache entry in wrong shard\n");
+                __builtin_trap();
+            }
             entry = entry->next;
         }
     }
-    int entries_from_mru = 0;
-    CacheEntry *mru_chain = most_recently_used;
+    size_t entries_from_mru = 0;
+    CacheEntry *mru_chain = shard.most_recently_used;
     while (mru_chain != NULL) {
         entries_from_mru++;
         mru_chain = mru_chain->less_recent;
     }
-    int entries_from_lru = 0;
-    CacheEntry *lru_chain = least_recently_used;
+    size_t entries_from_lru = 0;
+    CacheEntry *lru_chain = shard.least_recently_used;
     while (lru_chain != NULL) {
         entries_from_lru++;
         lru_chain = lru_chain->more_recent;
     }
-    print(NULL) << "hash entries " << entries_in_hash_table
-                << ", mru entries " << entries_from_mru
-                << ", lru entries " << entries_from_lru << "\n";
+    print(NULL) << "hash entries " << (uint64_t)entries_in_hash_table
+                << ", mru entries " << (uint64_t)entries_from_mru
+                << ", lru entries " << (uint64_t)entries_from_lru << "\n";
     if (entries_in_hash_table != entries_from_mru) {
         halide_print(NULL, "cache invalid case 3\n");
         __builtin_trap();
@@ -242,69 +312,522 @@ WEAK void validate_cache() {
         halide_print(NULL, "cache invalid case 4\n");
         __builtin_trap();
     }
-    if (current_cache_size < 0) {
+    if (entries_in_hash_table != shard.entry_count) {
+        halide_print(NULL, "cache invalid case 5\n");
+        __builtin_trap();
+    }
+    if (shard.current_size < 0) {
         halide_print(NULL, "cache size is negative\n");
         __builtin_trap();
     }
 }
 #endif
 
-WEAK void prune_cache() {
-#if CACHE_DEBUGGING
-    validate_cache();
-#endif
-    CacheEntry *prune_candidate = least_recently_used;
-    while (current_cache_size > max_cache_size &&
-           prune_candidate != NULL) {
-        CacheEntry *more_recent = prune_candidate->more_recent;
-
-        if (prune_candidate->in_use_count == 0) {
-            uint32_t h = prune_candidate->hash;
-            uint32_t index = h % kHashTableSize;
-
-            // Remove from hash table
-            CacheEntry *prev_hash_entry = cache_entries[index];
-            if (prev_hash_entry == prune_candidate) {
-                cache_entries[index] = prune_candidate->next;
-            } else {
-                while (prev_hash_entry != NULL && prev_hash_entry->next != prune_candidate) {
-                    prev_hash_entry = prev_hash_entry->next;
-                }
-                halide_assert(NULL, prev_hash_entry != NULL);
-                prev_hash_entry->next = prune_candidate->next;
-            }
+// Double the number of buckets in a shard. If the allocation fails,
+// the shard keeps its current buckets.
+WEAK void grow_hash_table(CacheShard &shard) {
+    size_t new_size = shard.hash_table_size * 2;
+    CacheEntry **new_entries = (CacheEntry **)halide_malloc(NULL, sizeof(CacheEntry *) * new_size);
+    if (!new_entries) {
+        return;
+    }
+    memset(new_entries, 0, sizeof(CacheEntry *) * new_size);
+    for (size_t i = 0; i < shard.hash_table_size; i++) {
+        CacheEntry *entry = shard.cache_entries[i];
+        while (entry != NULL) {
+            CacheEntry *next = entry->next;
+            CacheEntry **bucket = &new_entries[entry->hash & (new_size - 1)];
+            entry->next = *bucket;
+            *bucket = entry;
+            entry = next;
+        }
+    }
+    halide_free(NULL, shard.cache_entries);
+    shard.cache_entries = new_entries;
+    shard.hash_table_size = new_size;
+}
 
-            // Remove from less recent chain.
-            if (least_recently_used == prune_candidate) {
-                least_recently_used = more_recent;
-            }
-            if (more_recent != NULL) {
-                more_recent->less_recent = prune_candidate->less_recent;
-            }
+// Find the entry for a key whose computed bounds and tuple buffers
+// have the given shapes. Must be called with the shard locked.
+WEAK CacheEntry *find_entry(CacheShard &shard, uint32_t h, const uint8_t *cache_key, int32_t size,
+                            const halide_buffer_t *computed_bounds,
+                            int32_t tuple_count, halide_buffer_t **tuple_buffers) {
+    CacheEntry *entry = shard.cache_entries ? *bucket_for_hash(shard, h) : NULL;
+    while (entry != NULL) {
+        if (entry->hash == h && entry->key_size == (size_t)size &&
+            keys_equal(entry->key, cache_key, size) &&
+            buffer_has_shape(computed_bounds, entry->computed_bounds) &&
+            entry->tuple_count == (uint32_t)tuple_count) {
 
-            // Remove from more recent chain.
-            if (most_recently_used == prune_candidate) {
-                most_recently_used = prune_candidate->less_recent;
-            }
-            if (prune_candidate->less_recent != NULL) {
-                prune_candidate->less_recent = more_recent;
+            // Check all the tuple buffers have the same bounds (they should).
+            bool all_bounds_equal = true;
+            for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
+                all_bounds_equal = buffer_has_shape(tuple_buffers[i], entry->buf[i].dim);
             }
 
-            // Decrease cache used amount.
-            for (uint32_t i = 0; i < prune_candidate->tuple_count; i++) {
-                current_cache_size -= prune_candidate->buf[i].size_in_bytes();
+            if (all_bounds_equal) {
+                return entry;
             }
+        }
+        entry = entry->next;
+    }
+    return NULL;
+}
+
+// Hand out the data of an entry to a lookup, and make it the most
+// recently used. Must be called with the shard locked.
+WEAK void use_entry(CacheShard &shard, CacheEntry *entry,
+                    int32_t tuple_count, halide_buffer_t **tuple_buffers) {
+    if (entry != shard.most_recently_used) {
+        halide_assert(NULL, entry->more_recent != NULL);
+        if (entry->less_recent != NULL) {
+            entry->less_recent->more_recent = entry->more_recent;
+        } else {
+            halide_assert(NULL, shard.least_recently_used == entry);
+            shard.least_recently_used = entry->more_recent;
+        }
+        halide_assert(NULL, entry->more_recent != NULL);
+        entry->more_recent->less_recent = entry->less_recent;
+
+        entry->more_recent = NULL;
+        entry->less_recent = shard.most_recently_used;
+        if (shard.most_recently_used != NULL) {
+            shard.most_recently_used->more_recent = entry;
+        }
+        shard.most_recently_used = entry;
+    }
+
+    for (int32_t i = 0; i < tuple_count; i++) {
+        halide_buffer_t *buf = tuple_buffers[i];
+        *buf = entry->buf[i];
+    }
+
+    entry->in_use_count += tuple_count;
+}
+
+WEAK bool ensure_hash_table(CacheShard &shard) {
+    if (shard.cache_entries == NULL) {
+        shard.cache_entries = (CacheEntry **)halide_malloc(NULL, sizeof(CacheEntry *) * kInitialHashTableSize);
+        if (shard.cache_entries != NULL) {
+            memset(shard.cache_entries, 0, sizeof(CacheEntry *) * kInitialHashTableSize);
+            shard.hash_table_size = kInitialHashTableSize;
+        }
+    }
+    return shard.cache_entries != NULL;
+}
+
+// Add an entry to the shard as the most recently used. Must be called
+// with the shard locked, after ensure_hash_table has succeeded.
+WEAK void insert_entry(CacheShard &shard, CacheEntry *entry) {
+    if (shard.entry_count >= shard.hash_table_size) {
+        grow_hash_table(shard);
+    }
+
+    CacheEntry **bucket = bucket_for_hash(shard, entry->hash);
+    entry->next = *bucket;
+    entry->more_recent = NULL;
+    entry->less_recent = shard.most_recently_used;
+    if (shard.most_recently_used != NULL) {
+        shard.most_recently_used->more_recent = entry;
+    }
+    shard.most_recently_used = entry;
+    if (shard.least_recently_used == NULL) {
+        shard.least_recently_used = entry;
+    }
+    *bucket = entry;
+    shard.entry_count++;
+
+    shard.current_size += entry->size_in_bytes;
+    __atomic_add_fetch(&current_cache_size, (int64_t)entry->size_in_bytes, __ATOMIC_RELAXED);
+}
+
+// Remove an entry from the shard without destroying it. Must be
+// called with the shard locked.
+WEAK void unlink_entry(CacheShard &shard, CacheEntry *entry) {
+    // Remove from hash table
+    CacheEntry **prev_hash_entry = bucket_for_hash(shard, entry->hash);
+    while (*prev_hash_entry != NULL && *prev_hash_entry != entry) {
+        prev_hash_entry = &(*prev_hash_entry)->next;
+    }
+    halide_assert(NULL, *prev_hash_entry == entry);
+    *prev_hash_entry = entry->next;
+
+    // Remove from the recency chain.
+    if (entry->more_recent != NULL) {
+        entry->more_recent->less_recent = entry->less_recent;
+    } else {
+        halide_assert(NULL, shard.most_recently_used == entry);
+        shard.most_recently_used = entry->less_recent;
+    }
+    if (entry->less_recent != NULL) {
+        entry->less_recent->more_recent = entry->more_recent;
+    } else {
+        halide_assert(NULL, shard.least_recently_used == entry);
+        shard.least_recently_used = entry->more_recent;
+    }
+    entry->next = NULL;
+    entry->more_recent = NULL;
+    entry->less_recent = NULL;
+    shard.entry_count--;
+
+    // Decrease cache used amount.
+    shard.current_size -= entry->size_in_bytes;
+    __atomic_sub_fetch(&current_cache_size, (int64_t)entry->size_in_bytes, __ATOMIC_RELAXED);
+}
+
+// The optional second tier of the cache. Entries evicted from memory
+// are written to one file per key in this directory, and a lookup
+// that misses in memory maps the file back in, so the data is paged
+// in from the file rather than recomputed or copied. The directory
+// comes from HL_MEMOIZATION_CACHE_DIR, or from
+// halide_memoization_cache_set_disk_dir. The tier stays disabled on
+// platforms that can't map files.
+const size_t kMaxDiskCacheDirLength = 1024;
+WEAK char disk_cache_dir[kMaxDiskCacheDirLength];
+WEAK halide_mutex disk_cache_lock;
+// 0 until the directory is first configured, then 1 if the tier is
+// disabled and 2 if it is enabled.
+WEAK int disk_cache_state = 0;
+
+// Must be called with disk_cache_lock held.
+WEAK void set_disk_cache_dir(const char *dir) {
+    int state = 1;
+    if (dir != NULL && *dir != 0 && strlen(dir) < kMaxDiskCacheDirLength &&
+        halide_can_map_files()) {
+        strncpy(disk_cache_dir, dir, kMaxDiskCacheDirLength);
+        state = 2;
+    }
+    __atomic_store_n(&disk_cache_state, state, __ATOMIC_RELEASE);
+}
+
+WEAK bool disk_cache_enabled() {
+    int state = __atomic_load_n(&disk_cache_state, __ATOMIC_ACQUIRE);
+    if (state == 0) {
+        ScopedMutexLock lock(&disk_cache_lock);
+        if (disk_cache_state == 0) {
+            set_disk_cache_dir(getenv("HL_MEMOIZATION_CACHE_DIR"));
+        }
+        state = disk_cache_state;
+    }
+    return state == 2;
+}
+
+const size_t kMaxDiskCachePathLength = kMaxDiskCacheDirLength + 64;
+
+// Build the path of the file for a key. Different keys may map to the
+// same file, so the file holds the whole key to check against.
+WEAK bool disk_cache_path(const uint8_t *cache_key, int32_t size, const char *suffix, char *path) {
+    // 64-bit FNV-1a, so collisions between files are rare.
+    uint64_t h = 14695981039346656037ULL;
+    for (int32_t i = 0; i < size; i++) {
+        h = (h ^ cache_key[i]) * 1099511628211ULL;
+    }
+    char hex[17];
+    for (int i = 15; i >= 0; i--) {
+        hex[i] = "0123456789abcdef"[h & 0xf];
+        h >>= 4;
+    }
+    hex[16] = 0;
+
+    ScopedMutexLock lock(&disk_cache_lock);
+    if (disk_cache_state != 2) {
+        return false;
+    }
+    char *end = path + kMaxDiskCachePathLength;
+    char *dst = halide_string_to_string(path, end, disk_cache_dir);
+    dst = halide_string_to_string(dst, end, "/halide_memoized_");
+    dst = halide_string_to_string(dst, end, hex);
+    halide_string_to_string(dst, end, suffix);
+    return true;
+}
+
+// A spilled entry is stored as a DiskCacheHeader, the computed
+// bounds, a DiskCacheTuple and the allocated shape for each tuple
+// buffer, and the key, followed by the data of each tuple buffer. The
+// data is aligned and preceded by room for a CacheBlockHeader, so the
+// mapped file can be handed out like a buffer allocated by the cache.
+const uint32_t kDiskCacheMagic = 0x31434d48;  // "HMC1"
+const uint64_t kDiskCacheDataAlignment = 128;
+
+struct DiskCacheHeader {
+    uint32_t magic;
+    uint32_t key_size;
+    uint32_t tuple_count;
+    int32_t dimensions;
+    uint64_t file_size;
+    int64_t compute_time_ns;
+};
+
+struct DiskCacheTuple {
+    halide_type_t type;
+    uint32_t padding;
+    uint64_t data_offset;
+    uint64_t data_size;
+};
+
+WEAK __attribute((always_inline)) uint64_t disk_cache_data_offset(uint64_t cursor) {
+    uint64_t mask = kDiskCacheDataAlignment - 1;
+    return (cursor + header_bytes() + mask) & ~mask;
+}
+
+WEAK bool write_zeros(void *f, uint64_t bytes) {
+    static const uint8_t zeros[kDiskCacheDataAlignment] = {0};
+    while (bytes > 0) {
+        size_t n = bytes < sizeof(zeros) ? (size_t)bytes : sizeof(zeros);
+        if (fwrite(zeros, n, 1, f) != 1) {
+            return false;
+        }
+        bytes -= n;
+    }
+    return true;
+}
+
+WEAK bool write_entry(void *f, const CacheEntry *entry) {
+    uint64_t cursor = sizeof(DiskCacheHeader) +
+        sizeof(halide_dimension_t) * entry->dimensions +
+        (sizeof(DiskCacheTuple) + sizeof(halide_dimension_t) * entry->dimensions) * entry->tuple_count +
+        entry->key_size;
+    uint64_t file_size = cursor;
+    for (uint32_t i = 0; i < entry->tuple_count; i++) {
+        file_size = disk_cache_data_offset(file_size) + entry->buf[i].size_in_bytes();
+    }
+
+    DiskCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kDiskCacheMagic;
+    header.key_size = (uint32_t)entry->key_size;
+    header.tuple_count = entry->tuple_count;
+    header.dimensions = entry->dimensions;
+    header.file_size = file_size;
+    header.compute_time_ns = entry->compute_time_ns;
+    if (fwrite(&header, sizeof(header), 1, f) != 1 ||
+        (entry->dimensions > 0 &&
+         fwrite(entry->computed_bounds, sizeof(halide_dimension_t) * entry->dimensions, 1, f) != 1)) {
+        return false;
+    }
+
+    uint64_t data_offset = cursor;
+    for (uint32_t i = 0; i < entry->tuple_count; i++) {
+        DiskCacheTuple tuple;
+        memset(&tuple, 0, sizeof(tuple));
+        tuple.type = entry->buf[i].type;
+        tuple.data_offset = disk_cache_data_offset(data_offset);
+        tuple.data_size = entry->buf[i].size_in_bytes();
+        data_offset = tuple.data_offset + tuple.data_size;
+        if (fwrite(&tuple, sizeof(tuple), 1, f) != 1 ||
+            (entry->dimensions > 0 &&
+             fwrite(entry->buf[i].dim, sizeof(halide_dimension_t) * entry->dimensions, 1, f) != 1)) {
+            return false;
+        }
+    }
+    if (fwrite(entry->key, entry->key_size, 1, f) != 1) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < entry->tuple_count; i++) {
+        const halide_buffer_t &buf = entry->buf[i];
+        uint64_t offset = disk_cache_data_offset(cursor);
+        if (!write_zeros(f, offset - cursor)) {
+            return false;
+        }
+        size_t bytes = buf.size_in_bytes();
+        if (bytes > 0 && fwrite(buf.host, bytes, 1, f) != 1) {
+            return false;
+        }
+        cursor = offset + bytes;
+    }
+    return true;
+}
 
-            // Deallocate the entry.
-            prune_candidate->destroy();
-            halide_free(NULL, prune_candidate);
+// Write an entry that is no longer in the cache to the on-disk
+// tier. The file is written under a temporary name and then renamed,
+// so concurrent readers never map a partial file. Returns whether the
+// entry was written.
+WEAK bool spill_entry(CacheEntry *entry) {
+    if (entry->mapping != NULL || !disk_cache_enabled()) {
+        // Entries that came from disk are already there.
+        return false;
+    }
+    for (uint32_t i = 0; i < entry->tuple_count; i++) {
+        if (entry->buf[i].host == NULL || entry->buf[i].device_dirty()) {
+            return false;
         }
+    }
+
+    char path[kMaxDiskCachePathLength], temp_path[kMaxDiskCachePathLength];
+    // The address of the entry keeps the temporary names of concurrent
+    // spills of the same key distinct.
+    char suffix[32];
+    char *dst = halide_string_to_string(suffix, suffix + sizeof(suffix), ".");
+    dst = halide_uint64_to_string(dst, suffix + sizeof(suffix), (uint64_t)(uintptr_t)entry, 1);
+    halide_string_to_string(dst, suffix + sizeof(suffix), ".tmp");
+    if (!disk_cache_path(entry->key, entry->key_size, ".bin", path) ||
+        !disk_cache_path(entry->key, entry->key_size, suffix, temp_path)) {
+        return false;
+    }
+
+    void *f = fopen(temp_path, "wb");
+    if (!f) {
+        return false;
+    }
+    bool written = write_entry(f, entry);
+    written = (fclose(f) == 0) && written;
+    if (!written || rename(temp_path, path) != 0) {
+        remove(temp_path);
+        return false;
+    }
+    return true;
+}
 
-        prune_candidate = more_recent;
+// Map in the spilled entry for a key, if there is one with the
+// requested shape. On success the tuple buffers point into the
+// mapping, and the returned entry, which is not yet in any shard,
+// holds the mapping.
+WEAK CacheEntry *load_entry(void *user_context, uint32_t h, const uint8_t *cache_key, int32_t size,
+                            halide_buffer_t *computed_bounds,
+                            int32_t tuple_count, halide_buffer_t **tuple_buffers) {
+    char path[kMaxDiskCachePathLength];
+    if (!disk_cache_path(cache_key, size, ".bin", path)) {
+        return NULL;
+    }
+    size_t mapping_size = 0;
+    uint8_t *base = (uint8_t *)halide_map_file(user_context, path, &mapping_size);
+    if (base == NULL) {
+        return NULL;
+    }
+
+    // Check the file is for this key and shape before trusting any of
+    // its offsets.
+    const DiskCacheHeader *header = (const DiskCacheHeader *)base;
+    int32_t dimensions = computed_bounds->dimensions;
+    uint64_t cursor = sizeof(DiskCacheHeader) +
+        sizeof(halide_dimension_t) * dimensions +
+        (sizeof(DiskCacheTuple) + sizeof(halide_dimension_t) * dimensions) * tuple_count +
+        size;
+    bool valid = mapping_size >= sizeof(DiskCacheHeader) &&
+        header->magic == kDiskCacheMagic &&
+        header->file_size == mapping_size &&
+        header->key_size == (uint32_t)size &&
+        header->tuple_count == (uint32_t)tuple_count &&
+        header->dimensions == dimensions &&
+        cursor <= mapping_size;
+    if (valid) {
+        const halide_dimension_t *bounds = (const halide_dimension_t *)(header + 1);
+        valid = buffer_has_shape(computed_bounds, bounds) &&
+            keys_equal(base + cursor - size, cache_key, size);
+    }
+    const DiskCacheTuple *tuple = (const DiskCacheTuple *)(base + sizeof(DiskCacheHeader) +
+                                                           sizeof(halide_dimension_t) * dimensions);
+    for (int32_t i = 0; valid && i < tuple_count; i++) {
+        const halide_dimension_t *shape = (const halide_dimension_t *)(tuple + 1);
+        halide_buffer_t *buf = tuple_buffers[i];
+        valid = buffer_has_shape(buf, shape) &&
+            tuple->type == buf->type &&
+            tuple->data_size == buf->size_in_bytes() &&
+            tuple->data_offset % halide_malloc_alignment() == 0 &&
+            tuple->data_offset >= cursor + header_bytes() &&
+            tuple->data_offset + tuple->data_size <= mapping_size;
+        cursor = tuple->data_offset + tuple->data_size;
+        tuple = (const DiskCacheTuple *)(shape + dimensions);
+    }
+
+    CacheEntry *entry = NULL;
+    if (valid) {
+        entry = (CacheEntry *)halide_malloc(user_context, sizeof(CacheEntry));
+    }
+    if (entry != NULL) {
+        // The mapping is private, so the block headers can be written
+        // without changing the file.
+        tuple = (const DiskCacheTuple *)(base + sizeof(DiskCacheHeader) +
+                                         sizeof(halide_dimension_t) * dimensions);
+        for (int32_t i = 0; i < tuple_count; i++) {
+            tuple_buffers[i]->host = base + tuple->data_offset;
+            tuple = (const DiskCacheTuple *)((const halide_dimension_t *)(tuple + 1) + dimensions);
+        }
+        if (entry->init(cache_key, size, h, computed_bounds, tuple_count, tuple_buffers)) {
+            entry->mapping = base;
+            entry->mapping_size = mapping_size;
+            entry->compute_time_ns = header->compute_time_ns;
+            for (int32_t i = 0; i < tuple_count; i++) {
+                CacheBlockHeader *block = get_pointer_to_header(tuple_buffers[i]->host);
+                block->hash = h;
+                block->entry = entry;
+                block->miss_time_ns = 0;
+            }
+            return entry;
+        }
+        for (int32_t i = 0; i < tuple_count; i++) {
+            tuple_buffers[i]->host = NULL;
+        }
+        halide_free(user_context, entry);
+    }
+    halide_unmap_file(user_context, base, mapping_size);
+    return NULL;
+}
+
+// Evict entries from the shard until the whole cache fits, or nothing
+// more in this shard can be evicted. Must be called with the shard
+// locked. Entries that are cheap to recompute for their size go first,
+// among those that have not been used recently. The evicted entries
+// are returned linked through their next pointers, to be spilled and
+// destroyed once the lock is released.
+WEAK CacheEntry *prune_shard(CacheShard &shard) {
+#if CACHE_DEBUGGING
+    validate_cache(shard);
+#endif
+    CacheEntry *evicted = NULL;
+    while (cache_over_size()) {
+        CacheEntry *victim = NULL;
+        double victim_cost = 0;
+        int candidates = 0;
+        for (CacheEntry *entry = shard.least_recently_used;
+             entry != NULL && candidates < kEvictionCandidates;
+             entry = entry->more_recent) {
+            if (entry->in_use_count != 0) {
+                continue;
+            }
+            candidates++;
+            double cost = (double)entry->compute_time_ns / (double)(entry->size_in_bytes + 1);
+            if (victim == NULL || cost < victim_cost) {
+                victim = entry;
+                victim_cost = cost;
+            }
+        }
+        if (victim == NULL) {
+            break;
+        }
+        unlink_entry(shard, victim);
+        victim->next = evicted;
+        evicted = victim;
+        shard.evictions++;
     }
 #if CACHE_DEBUGGING
-    validate_cache();
+    validate_cache(shard);
 #endif
+    return evicted;
+}
+
+// Evict entries until the cache fits, starting with the given
+// shard. Only one shard is locked at a time, and the evicted entries
+// are spilled to disk with no lock held.
+WEAK void prune_cache(size_t first_shard) {
+    for (size_t i = 0; i < kCacheShards && cache_over_size(); i++) {
+        CacheShard &shard = cache_shards[(first_shard + i) % kCacheShards];
+        CacheEntry *evicted;
+        {
+            ScopedMutexLock lock(&shard.lock);
+            evicted = prune_shard(shard);
+        }
+        while (evicted != NULL) {
+            CacheEntry *next = evicted->next;
+            if (spill_entry(evicted)) {
+                __atomic_add_fetch(&shard.spills, 1, __ATOMIC_RELAXED);
+            }
+            evicted->destroy();
+            halide_free(NULL, evicted);
+            evicted = next;
+        }
+    }
 }
 
 }}} // namespace Halide::Runtime::Internal
@@ -316,78 +839,83 @@ WEAK void halide_memoization_cache_set_size(int64_t size) {
         size = kDefaultCacheSize;
     }
 
-    ScopedMutexLock lock(&memoization_lock);
+    __atomic_store_n(&max_cache_size, size, __ATOMIC_RELAXED);
+    prune_cache(0);
+}
 
-    max_cache_size = size;
-    prune_cache();
+WEAK void halide_memoization_cache_set_disk_dir(const char *dir) {
+    ScopedMutexLock lock(&disk_cache_lock);
+    set_disk_cache_dir(dir);
 }
 
 WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cache_key, int32_t size,
                                          halide_buffer_t *computed_bounds, int32_t tuple_count, halide_buffer_t **tuple_buffers) {
     uint32_t h = djb_hash(cache_key, size);
-    uint32_t index = h % kHashTableSize;
+    CacheShard &shard = shard_for_hash(h);
 
-    ScopedMutexLock lock(&memoization_lock);
+    {
+        ScopedMutexLock lock(&shard.lock);
 
 #if CACHE_DEBUGGING
-    debug_print_key(user_context, "halide_memoization_cache_lookup", cache_key, size);
+        debug_print_key(user_context, "halide_memoization_cache_lookup", cache_key, size);
 
-    debug_print_buffer(user_context, "computed_bounds", *computed_bounds);
+        debug_print_buffer(user_context, "computed_bounds", *computed_bounds);
 
-    {
-        for (int32_t i = 0; i < tuple_count; i++) {
-            halide_buffer_t *buf = tuple_buffers[i];
-            debug_print_buffer(user_context, "Allocation bounds", *buf);
+        {
+            for (int32_t i = 0; i < tuple_count; i++) {
+                halide_buffer_t *buf = tuple_buffers[i];
+                debug_print_buffer(user_context, "Allocation bounds", *buf);
+            }
         }
-    }
 #endif
 
-    CacheEntry *entry = cache_entries[index];
-    while (entry != NULL) {
-        if (entry->hash == h && entry->key_size == (size_t)size &&
-            keys_equal(entry->key, cache_key, size) &&
-            buffer_has_shape(computed_bounds, entry->computed_bounds) &&
-            entry->tuple_count == (uint32_t)tuple_count) {
-
-            // Check all the tuple buffers have the same bounds (they should).
-            bool all_bounds_equal = true;
-            for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
-                all_bounds_equal = buffer_has_shape(tuple_buffers[i], entry->buf[i].dim);
-            }
+        CacheEntry *entry = find_entry(shard, h, cache_key, size, computed_bounds, tuple_count, tuple_buffers);
+        if (entry != NULL) {
+            use_entry(shard, entry, tuple_count, tuple_buffers);
+            shard.hits++;
+            return 0;
+        }
 
-            if (all_bounds_equal) {
-                if (entry != most_recently_used) {
-                    halide_assert(user_context, entry->more_recent != NULL);
-                    if (entry->less_recent != NULL) {
-                        entry->less_recent->more_recent = entry->more_recent;
-                    } else {
-                        halide_assert(user_context, least_recently_used == entry);
-                        least_recently_used = entry->more_recent;
-                    }
-                    halide_assert(user_context, entry->more_recent != NULL);
-                    entry->more_recent->less_recent = entry->less_recent;
-
-                    entry->more_recent = NULL;
-                    entry->less_recent = most_recently_used;
-                    if (most_recently_used != NULL) {
-                        most_recently_used->more_recent = entry;
-                    }
-                    most_recently_used = entry;
-                }
+        shard.misses++;
+    }
 
-                for (int32_t i = 0; i < tuple_count; i++) {
-                    halide_buffer_t *buf = tuple_buffers[i];
-                    *buf = entry->buf[i];
+    // Look in the on-disk tier, without holding the lock while the
+    // file is mapped and checked.
+    if (disk_cache_enabled()) {
+        CacheEntry *loaded = load_entry(user_context, h, cache_key, size, computed_bounds, tuple_count, tuple_buffers);
+        if (loaded != NULL) {
+            bool hit = false;
+            {
+                ScopedMutexLock lock(&shard.lock);
+                // Another thread may have computed or loaded the same
+                // entry in the meantime.
+                CacheEntry *entry = find_entry(shard, h, cache_key, size, computed_bounds, tuple_count, tuple_buffers);
+                if (entry != NULL) {
+                    use_entry(shard, entry, tuple_count, tuple_buffers);
+                    shard.hits++;
+                    hit = true;
+                } else if (ensure_hash_table(shard)) {
+                    insert_entry(shard, loaded);
+                    loaded->in_use_count = tuple_count;
+                    loaded = NULL;
+                    shard.disk_hits++;
+                    hit = true;
                 }
-
-                entry->in_use_count += tuple_count;
-
+            }
+            if (loaded != NULL) {
+                loaded->destroy();
+                halide_free(user_context, loaded);
+            }
+            if (hit) {
+                prune_cache(shard_index(h));
                 return 0;
             }
         }
-        entry = entry->next;
     }
 
+    // Allocating the buffers to compute into doesn't need the lock.
+    halide_start_clock(user_context);
+    int64_t miss_time_ns = halide_current_time_ns(user_context);
     for (int32_t i = 0; i < tuple_count; i++) {
         halide_buffer_t *buf = tuple_buffers[i];
 
@@ -403,12 +931,9 @@ WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cach
         CacheBlockHeader *header = get_pointer_to_header(buf->host);
         header->hash = h;
         header->entry = NULL;
+        header->miss_time_ns = miss_time_ns;
     }
 
-#if CACHE_DEBUGGING
-    validate_cache();
-#endif
-
     return 1;
 }
 
@@ -417,107 +942,78 @@ WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache
                                         int32_t tuple_count, halide_buffer_t **tuple_buffers) {
     debug(user_context) << "halide_memoization_cache_store\n";
 
-    uint32_t h = get_pointer_to_header(tuple_buffers[0]->host)->hash;
+    CacheBlockHeader *first_header = get_pointer_to_header(tuple_buffers[0]->host);
+    uint32_t h = first_header->hash;
+    int64_t compute_time_ns = halide_current_time_ns(user_context) - first_header->miss_time_ns;
 
-    uint32_t index = h % kHashTableSize;
+    CacheShard &shard = shard_for_hash(h);
 
-    ScopedMutexLock lock(&memoization_lock);
+    {
+        ScopedMutexLock lock(&shard.lock);
 
 #if CACHE_DEBUGGING
-    debug_print_key(user_context, "halide_memoization_cache_store", cache_key, size);
+        debug_print_key(user_context, "halide_memoization_cache_store", cache_key, size);
 
-    debug_print_buffer(user_context, "computed_bounds", *computed_bounds);
+        debug_print_buffer(user_context, "computed_bounds", *computed_bounds);
 
-    {
-        for (int32_t i = 0; i < tuple_count; i++) {
-            halide_buffer_t *buf = tuple_buffers[i];
-            debug_print_buffer(user_context, "Allocation bounds", *buf);
+        {
+            for (int32_t i = 0; i < tuple_count; i++) {
+                halide_buffer_t *buf = tuple_buffers[i];
+                debug_print_buffer(user_context, "Allocation bounds", *buf);
+            }
         }
-    }
 #endif
 
-    CacheEntry *entry = cache_entries[index];
-    while (entry != NULL) {
-        if (entry->hash == h && entry->key_size == (size_t)size &&
-            keys_equal(entry->key, cache_key, size) &&
-            buffer_has_shape(computed_bounds, entry->computed_bounds) &&
-            entry->tuple_count == (uint32_t)tuple_count) {
-
-            bool all_bounds_equal = true;
-            bool no_host_pointers_equal = true;
-            {
-                for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
-                    halide_buffer_t *buf = tuple_buffers[i];
-                    all_bounds_equal = buffer_has_shape(tuple_buffers[i], entry->buf[i].dim);
-                    if (entry->buf[i].host == buf->host) {
-                        no_host_pointers_equal = false;
-                    }
-                }
+        CacheEntry *entry = find_entry(shard, h, cache_key, size, computed_bounds, tuple_count, tuple_buffers);
+        if (entry != NULL) {
+            for (int32_t i = 0; i < tuple_count; i++) {
+                halide_assert(user_context, entry->buf[i].host != tuple_buffers[i]->host);
             }
-            if (all_bounds_equal) {
-                halide_assert(user_context, no_host_pointers_equal);
-                // This entry is still in use by the caller. Mark it as having no cache entry
-                // so halide_memoization_cache_release can free the buffer.
-                for (int32_t i = 0; i < tuple_count; i++) {
-                    get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
+            // This entry is still in use by the caller. Mark it as having no cache entry
+            // so halide_memoization_cache_release can free the buffer.
+            for (int32_t i = 0; i < tuple_count; i++) {
+                get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
+            }
+            return 0;
+        }
 
-                }
-                return 0;
+        CacheEntry *new_entry = NULL;
+        bool inited = false;
+        if (ensure_hash_table(shard)) {
+            new_entry = (CacheEntry *)halide_malloc(NULL, sizeof(CacheEntry));
+            if (new_entry) {
+                inited = new_entry->init(cache_key, size, h, computed_bounds, tuple_count, tuple_buffers);
             }
         }
-        entry = entry->next;
-    }
+        if (!inited) {
+            // This entry is still in use by the caller. Mark it as having no cache entry
+            // so halide_memoization_cache_release can free the buffer.
+            for (int32_t i = 0; i < tuple_count; i++) {
+                get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
+            }
 
-    uint64_t added_size = 0;
-    {
-        for (int32_t i = 0; i < tuple_count; i++) {
-            halide_buffer_t *buf = tuple_buffers[i];
-            added_size += buf->size_in_bytes();
+            if (new_entry) {
+                halide_free(user_context, new_entry);
+            }
+            return 0;
         }
-    }
-    current_cache_size += added_size;
-    prune_cache();
+        new_entry->compute_time_ns = compute_time_ns;
 
-    CacheEntry *new_entry = (CacheEntry *)halide_malloc(NULL, sizeof(CacheEntry));
-    bool inited = false;
-    if (new_entry) {
-        inited = new_entry->init(cache_key, size, h, computed_bounds, tuple_count, tuple_buffers);
-    }
-    if (!inited) {
-        current_cache_size -= added_size;
+        insert_entry(shard, new_entry);
+        new_entry->in_use_count = tuple_count;
 
-        // This entry is still in use by the caller. Mark it as having no cache entry
-        // so halide_memoization_cache_release can free the buffer.
         for (int32_t i = 0; i < tuple_count; i++) {
-            get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
+            get_pointer_to_header(tuple_buffers[i]->host)->entry = new_entry;
         }
 
-        if (new_entry) {
-            halide_free(user_context, new_entry);
-        }
-        return 0;
-    }
-
-    new_entry->next = cache_entries[index];
-    new_entry->less_recent = most_recently_used;
-    if (most_recently_used != NULL) {
-        most_recently_used->more_recent = new_entry;
-    }
-    most_recently_used = new_entry;
-    if (least_recently_used == NULL) {
-        least_recently_used = new_entry;
+#if CACHE_DEBUGGING
+        validate_cache(shard);
+#endif
     }
-    cache_entries[index] = new_entry;
 
-    new_entry->in_use_count = tuple_count;
-
-    for (int32_t i = 0; i < tuple_count; i++) {
-        get_pointer_to_header(tuple_buffers[i]->host)->entry = new_entry;
-    }
+    // The new entry is in use, so it can't be evicted here.
+    prune_cache(shard_index(h));
 
-#if CACHE_DEBUGGING
-    validate_cache();
-#endif
     debug(user_context) << "Exiting halide_memoization_cache_store\n";
 
     return 0;
@@ -531,33 +1027,67 @@ WEAK void halide_memoization_cache_release(void *user_context, void *host) {
     if (entry == NULL) {
         halide_free(user_context, header);
     } else {
-        ScopedMutexLock lock(&memoization_lock);
+        CacheShard &shard = shard_for_hash(header->hash);
+        ScopedMutexLock lock(&shard.lock);
 
         halide_assert(user_context, entry->in_use_count > 0);
         entry->in_use_count--;
 #if CACHE_DEBUGGING
-        validate_cache();
+        validate_cache(shard);
 #endif
     }
 
     debug(user_context) << "Exited halide_memoization_cache_release.\n";
 }
 
+WEAK int halide_memoization_cache_get_stats(struct halide_memoization_cache_shard_stats_t *stats,
+                                            int max_shards) {
+    int shards = max_shards < (int)kCacheShards ? max_shards : (int)kCacheShards;
+    for (int i = 0; i < shards; i++) {
+        CacheShard &shard = cache_shards[i];
+        ScopedMutexLock lock(&shard.lock);
+        stats[i].hits = shard.hits;
+        stats[i].misses = shard.misses;
+        stats[i].evictions = shard.evictions;
+        stats[i].disk_hits = shard.disk_hits;
+        stats[i].spills = __atomic_load_n(&shard.spills, __ATOMIC_RELAXED);
+        stats[i].size = shard.current_size;
+        stats[i].entries = (int32_t)shard.entry_count;
+        stats[i].buckets = (int32_t)shard.hash_table_size;
+    }
+    return kCacheShards;
+}
+
 WEAK void halide_memoization_cache_cleanup() {
     debug(NULL) << "halide_memoization_cache_cleanup\n";
-    for (size_t i = 0; i < kHashTableSize; i++) {
-        CacheEntry *entry = cache_entries[i];
-        cache_entries[i] = NULL;
-        while (entry != NULL) {
-            CacheEntry *next = entry->next;
-            entry->destroy();
-            halide_free(NULL, entry);
-            entry = next;
+    for (size_t s = 0; s < kCacheShards; s++) {
+        CacheShard &shard = cache_shards[s];
+        for (size_t i = 0; i < shard.hash_table_size; i++) {
+            CacheEntry *entry = shard.cache_entries[i];
+            shard.cache_entries[i] = NULL;
+            while (entry != NULL) {
+                CacheEntry *next = entry->next;
+                entry->destroy();
+                halide_free(NULL, entry);
+                entry = next;
+            }
+        }
+        if (shard.cache_entries != NULL) {
+            halide_free(NULL, shard.cache_entries);
+            shard.cache_entries = NULL;
         }
+        shard.hash_table_size = 0;
+        shard.entry_count = 0;
+        shard.current_size = 0;
+        shard.hits = 0;
+        shard.misses = 0;
+        shard.evictions = 0;
+        shard.disk_hits = 0;
+        shard.spills = 0;
+        shard.most_recently_used = NULL;
+        shard.least_recently_used = NULL;
     }
     current_cache_size = 0;
-    most_recently_used = NULL;
-    least_recently_used = NULL;
 }
 
 namespace {
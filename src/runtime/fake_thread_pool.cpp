@@ -51,6 +51,10 @@ WEAK int halide_set_num_threads(int n) {
     return 1;
 }
 
+WEAK halide_thread_affinity_t halide_set_thread_affinity(halide_thread_affinity_t affinity) {
+    return halide_thread_affinity_none;
+}
+
 WEAK halide_do_task_t halide_set_custom_do_task(halide_do_task_t f) {
     halide_do_task_t result = custom_do_task;
     custom_do_task = f;
@@ -1,11 +1,114 @@
 #include "HalideRuntime.h"
+#include "runtime_internal.h"
 
 extern "C" {
 
 extern long sysconf(int);
+extern int sched_setaffinity(int pid, size_t cpusetsize, const void *mask);
+extern size_t fread(void *, size_t, size_t, void *);
 
 WEAK int halide_host_cpu_count() {
     return sysconf(84);
 }
 
 }
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// Enough for the kernel's default CONFIG_NR_CPUS on most distributions.
+#define MAX_AFFINITY_CPUS 1024
+#define MAX_NUMA_NODES 64
+
+struct cpu_mask_t {
+    uint64_t bits[MAX_AFFINITY_CPUS / 64];
+
+    void set(int cpu) {
+        if (cpu >= 0 && cpu < MAX_AFFINITY_CPUS) {
+            bits[cpu / 64] |= (uint64_t)1 << (cpu % 64);
+        }
+    }
+
+    bool test(int cpu) const {
+        return cpu >= 0 && cpu < MAX_AFFINITY_CPUS && (bits[cpu / 64] >> (cpu % 64)) & 1;
+    }
+};
+
+WEAK int parse_cpu_number(const char **p) {
+    int n = 0;
+    while (**p >= '0' && **p <= '9') {
+        n = n * 10 + (**p - '0');
+        (*p)++;
+    }
+    return n;
+}
+
+// Read the cpus of a NUMA node from sysfs, which lists them as ranges
+// like "0-7,16-23". Returns false if there is no such node, which
+// includes kernels built without NUMA support.
+WEAK bool numa_node_cpus(int node, cpu_mask_t *mask) {
+    char path[64];
+    char *end = path + sizeof(path);
+    char *dst = halide_string_to_string(path, end, "/sys/devices/system/node/node");
+    dst = halide_int64_to_string(dst, end, node, 1);
+    halide_string_to_string(dst, end, "/cpulist");
+
+    void *f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    char buf[1024];
+    size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[len] = 0;
+
+    memset(mask, 0, sizeof(cpu_mask_t));
+    const char *p = buf;
+    while (*p >= '0' && *p <= '9') {
+        int first = parse_cpu_number(&p);
+        int last = first;
+        if (*p == '-') {
+            p++;
+            last = parse_cpu_number(&p);
+        }
+        for (int cpu = first; cpu <= last && cpu < MAX_AFFINITY_CPUS; cpu++) {
+            mask->set(cpu);
+        }
+        if (*p == ',') {
+            p++;
+        }
+    }
+    return true;
+}
+
+WEAK int numa_node_of_cpu(int cpu, cpu_mask_t *node_cpus) {
+    for (int node = 0; node < MAX_NUMA_NODES; node++) {
+        if (numa_node_cpus(node, node_cpus) && node_cpus->test(cpu)) {
+            return node;
+        }
+    }
+    return -1;
+}
+
+}}}  // namespace Halide::Runtime::Internal
+
+using namespace Halide::Runtime::Internal;
+
+extern "C" {
+
+WEAK int halide_host_cpu_numa_node(int cpu) {
+    cpu_mask_t node_cpus;
+    int node = numa_node_of_cpu(cpu, &node_cpus);
+    return node < 0 ? 0 : node;
+}
+
+WEAK int halide_pin_current_thread(int cpu, bool whole_numa_node) {
+    cpu_mask_t mask;
+    if (!whole_numa_node || numa_node_of_cpu(cpu, &mask) < 0) {
+        memset(&mask, 0, sizeof(mask));
+        mask.set(cpu);
+    }
+    // A pid of zero means the calling thread.
+    return sched_setaffinity(0, sizeof(mask), &mask);
+}
+
+}
@@ -8,4 +8,14 @@ WEAK int halide_host_cpu_count() {
     return sysconf(58);
 }
 
+// Threads are not pinned on this platform, and all cpus are treated as
+// one NUMA node.
+WEAK int halide_host_cpu_numa_node(int cpu) {
+    return 0;
+}
+
+WEAK int halide_pin_current_thread(int cpu, bool whole_numa_node) {
+    return -1;
+}
+
 }
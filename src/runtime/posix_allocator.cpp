@@ -3,11 +3,199 @@
 
 #include "printer.h"
 
+#ifndef POOL_ALLOCATOR
+#define POOL_ALLOCATOR 0
+#endif
+
+#if POOL_ALLOCATOR
+#include "scoped_mutex_lock.h"
+#endif
+
 extern "C" {
 
 extern void *malloc(size_t);
 extern void free(void *);
 
+}
+
+#if POOL_ALLOCATOR
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// Requests are rounded up to one of two size classes per power of
+// two, from 1 << kMinSizeClassBits to 1 << kMaxSizeClassBits, and
+// freed blocks are kept on free lists to be reused by later
+// allocations, including those of later pipeline runs. Larger
+// requests go straight to malloc and free.
+const int kMinSizeClassBits = 6;
+const int kMaxSizeClassBits = 22;
+const int kNumSizeClasses = 2 * (kMaxSizeClassBits - kMinSizeClassBits) + 1;
+const size_t kMaxSizeClassBytes = (size_t)1 << kMaxSizeClassBits;
+
+// The free lists are split into stripes with a lock each. Halide
+// can't rely on thread-local storage in JIT-compiled code, so each
+// thread uses the stripe picked by the address of its stack instead,
+// which keeps the locks mostly uncontended.
+const int kPoolStripeBits = 4;
+const int kPoolStripes = 1 << kPoolStripeBits;
+
+// The most free bytes a stripe holds on to. Blocks freed beyond this
+// go back to the system.
+const uint64_t kMaxCachedBytesPerStripe = 16 << 20;
+
+struct pool_stripe {
+    halide_mutex lock;
+    // Free blocks are linked through their first word.
+    void *free_blocks[kNumSizeClasses];
+    uint64_t cached_bytes;
+};
+
+WEAK pool_stripe pool_stripes[kPoolStripes];
+
+WEAK __attribute((always_inline)) int size_class(size_t x) {
+    if (x <= ((size_t)1 << kMinSizeClassBits)) {
+        return 0;
+    }
+    // 1 << (bits - 1) < x <= 1 << bits
+    int bits = 64 - __builtin_clzll((uint64_t)(x - 1));
+    size_t three_quarters = (size_t)3 << (bits - 2);
+    return 2 * (bits - kMinSizeClassBits) - (x <= three_quarters ? 1 : 0);
+}
+
+WEAK __attribute((always_inline)) size_t size_class_bytes(int c) {
+    int bits = kMinSizeClassBits + (c + 1) / 2;
+    return (c & 1) ? (size_t)3 << (bits - 2) : (size_t)1 << bits;
+}
+
+WEAK __attribute((always_inline)) int current_stripe() {
+    // Threads run on separate stacks, so this is stable for a thread
+    // and differs between threads.
+    int local;
+    uint64_t a = (uint64_t)(uintptr_t)&local >> 16;
+    return (int)((a * 0x9E3779B97F4A7C15ULL) >> (64 - kPoolStripeBits));
+}
+
+// The bytes held from the system are reported to the profiler as the
+// memory of a pseudo-pipeline with a single Func, so that its current
+// and peak memory are the resident and peak resident bytes of the
+// pool.
+WEAK halide_profiler_func_stats pool_resident_stats;
+WEAK halide_profiler_pipeline_stats pool_profiler_stats;
+WEAK int pool_registered = 0;
+
+WEAK void register_pool_with_profiler() {
+    halide_profiler_state *s = halide_profiler_get_state();
+    ScopedMutexLock lock(&s->lock);
+    if (!pool_registered) {
+        pool_resident_stats.name = "resident";
+        pool_profiler_stats.name = "pool allocator";
+        pool_profiler_stats.funcs = &pool_resident_stats;
+        pool_profiler_stats.num_funcs = 1;
+        s->allocator = &pool_profiler_stats;
+        __atomic_store_n(&pool_registered, 1, __ATOMIC_RELEASE);
+    }
+}
+
+WEAK void *system_allocate(void *user_context, size_t bytes) {
+    // Allocate enough space for aligning the pointer we return, and
+    // for a header of two words just before it.
+    const size_t alignment = halide_malloc_alignment();
+    void *orig = malloc(bytes + alignment);
+    if (orig == NULL) {
+        return NULL;
+    }
+    void *ptr = (void *)(((size_t)orig + alignment + 2 * sizeof(void *) - 1) & ~(alignment - 1));
+    ((void **)ptr)[-1] = orig;
+    ((size_t *)ptr)[-2] = bytes;
+    if (!__atomic_load_n(&pool_registered, __ATOMIC_ACQUIRE)) {
+        register_pool_with_profiler();
+    }
+    halide_profiler_memory_allocate(user_context, &pool_profiler_stats, 0, bytes + alignment);
+    return ptr;
+}
+
+WEAK void system_free(void *user_context, void *ptr) {
+    size_t bytes = ((size_t *)ptr)[-2];
+    free(((void **)ptr)[-1]);
+    halide_profiler_memory_free(user_context, &pool_profiler_stats, 0, bytes + halide_malloc_alignment());
+}
+
+WEAK void *take_free_block(pool_stripe &stripe, int c) {
+    ScopedMutexLock lock(&stripe.lock);
+    void *ptr = stripe.free_blocks[c];
+    if (ptr != NULL) {
+        stripe.free_blocks[c] = *(void **)ptr;
+        stripe.cached_bytes -= size_class_bytes(c);
+    }
+    return ptr;
+}
+
+}}} // namespace Halide::Runtime::Internal
+
+using namespace Halide::Runtime::Internal;
+
+extern "C" {
+
+WEAK void *halide_default_malloc(void *user_context, size_t x) {
+    if (x > kMaxSizeClassBytes) {
+        return system_allocate(user_context, x);
+    }
+    int c = size_class(x);
+    int first = current_stripe();
+    void *ptr = take_free_block(pool_stripes[first], c);
+    // Blocks freed by other threads end up in their stripes, so look
+    // there before going to the system.
+    for (int i = 1; ptr == NULL && i < kPoolStripes; i++) {
+        pool_stripe &stripe = pool_stripes[(first + i) & (kPoolStripes - 1)];
+        if (__atomic_load_n(&stripe.cached_bytes, __ATOMIC_RELAXED) != 0) {
+            ptr = take_free_block(stripe, c);
+        }
+    }
+    if (ptr == NULL) {
+        ptr = system_allocate(user_context, size_class_bytes(c));
+    }
+    return ptr;
+}
+
+WEAK void halide_default_free(void *user_context, void *ptr) {
+    size_t bytes = ((size_t *)ptr)[-2];
+    if (bytes <= kMaxSizeClassBytes) {
+        int c = size_class(bytes);
+        pool_stripe &stripe = pool_stripes[current_stripe()];
+        ScopedMutexLock lock(&stripe.lock);
+        if (stripe.cached_bytes + bytes <= kMaxCachedBytesPerStripe) {
+            *(void **)ptr = stripe.free_blocks[c];
+            stripe.free_blocks[c] = ptr;
+            stripe.cached_bytes += bytes;
+            return;
+        }
+    }
+    system_free(user_context, ptr);
+}
+
+}
+
+namespace {
+
+__attribute__((destructor))
+WEAK void halide_allocator_cleanup() {
+    for (int i = 0; i < kPoolStripes; i++) {
+        pool_stripe &stripe = pool_stripes[i];
+        for (int c = 0; c < kNumSizeClasses; c++) {
+            void *ptr;
+            while ((ptr = take_free_block(stripe, c)) != NULL) {
+                system_free(NULL, ptr);
+            }
+        }
+    }
+}
+
+}
+
+#else
+
+extern "C" {
+
 WEAK void *halide_default_malloc(void *user_context, size_t x) {
     // Allocate enough space for aligning the pointer we return.
     const size_t alignment = halide_malloc_alignment();
@@ -28,6 +216,8 @@ WEAK void halide_default_free(void *user_context, void *ptr) {
 
 }
 
+#endif  // POOL_ALLOCATOR
+
 namespace Halide { namespace Runtime { namespace Internal {
 
 WEAK halide_malloc_t custom_malloc = halide_default_malloc;
@@ -0,0 +1,3 @@
+#define POOL_ALLOCATOR 1
+
+#include "posix_allocator.cpp"
@@ -9,7 +9,7 @@
 extern "C" {
 // Returns the address of the global halide_profiler state
 WEAK halide_profiler_state *halide_profiler_get_state() {
-    static halide_profiler_state s = {{{0}}, 1, 0, 0, 0, 0, NULL, NULL};
+    static halide_profiler_state s = {{{0}}, 1, 0, 0, 0, 0, NULL, NULL, NULL};
     return &s;
 }
 }
@@ -380,6 +380,16 @@ WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_st
             }
         }
     }
+
+    halide_profiler_pipeline_stats *a = s->allocator;
+    if (a && a->num_allocs) {
+        sstr.clear();
+        sstr << a->name << "\n"
+             << " system allocations: " << a->num_allocs
+             << "  resident: " << a->memory_current << " bytes"
+             << "  peak resident: " << a->memory_peak << " bytes\n";
+        halide_print(user_context, sstr.str());
+    }
 }
 
 WEAK void halide_profiler_report(void *user_context) {
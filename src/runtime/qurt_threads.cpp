@@ -32,6 +32,16 @@ int halide_host_cpu_count() {
     return 4;
 }
 
+// Threads are not pinned on this platform, and all cpus are treated as
+// one NUMA node.
+WEAK int halide_host_cpu_numa_node(int cpu) {
+    return 0;
+}
+
+WEAK int halide_pin_current_thread(int cpu, bool whole_numa_node) {
+    return -1;
+}
+
 #define STACK_SIZE 256*1024
 
 WEAK struct halide_thread *halide_spawn_thread(void (*f)(void *), void *closure) {
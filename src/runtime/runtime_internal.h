@@ -80,6 +80,7 @@ int close(int);
 size_t fwrite(const void *, size_t, size_t, void *);
 ssize_t write(int fd, const void *buf, size_t bytes);
 int remove(const char *pathname);
+int rename(const char *oldpath, const char *newpath);
 int ioctl(int fd, unsigned long request, ...);
 char *strncpy(char *dst, const char *src, size_t n);
 
@@ -133,6 +134,17 @@ WEAK int halide_profiler_pipeline_start(void *user_context,
                                         int num_funcs,
                                         const uint64_t *func_names);
 WEAK int halide_host_cpu_count();
+// The NUMA node a cpu belongs to, or 0 if that is unknown.
+WEAK int halide_host_cpu_numa_node(int cpu);
+// Restrict the calling thread to the given cpu, or to the cpus of its
+// NUMA node. Returns zero on success.
+WEAK int halide_pin_current_thread(int cpu, bool whole_numa_node);
+// Map a whole file into memory copy-on-write, or return NULL. Provided
+// by the *_tempfile modules, along with whether the platform supports
+// mapping files at all.
+WEAK bool halide_can_map_files();
+WEAK void *halide_map_file(void *user_context, const char *path, size_t *size);
+WEAK void halide_unmap_file(void *user_context, void *addr, size_t size);
 
 WEAK int halide_device_and_host_malloc(void *user_context, struct halide_buffer_t *buf,
                                        const struct halide_device_interface_t *device_interface);
@@ -96,6 +96,10 @@ struct work_queue_t {
     // The desired number threads doing work (HL_NUM_THREADS).
     int desired_threads_working;
 
+    // Where worker threads may run (HL_THREAD_AFFINITY), as a
+    // halide_thread_affinity_t plus one, or zero if not yet known.
+    int thread_affinity;
+
     // All fields after this must be zero in the initial state. See assert_zeroed
     // Field serves both to mark the offset in struct and as layout padding.
     int zero_marker;
@@ -163,6 +167,37 @@ struct work_queue_t {
 
 WEAK work_queue_t work_queue = {};
 
+// Must be called with work_queue.mutex held.
+WEAK halide_thread_affinity_t current_thread_affinity() {
+    if (work_queue.thread_affinity == 0) {
+        halide_thread_affinity_t affinity = halide_thread_affinity_none;
+        const char *affinity_str = getenv("HL_THREAD_AFFINITY");
+        if (affinity_str && strncmp(affinity_str, "core", 5) == 0) {
+            affinity = halide_thread_affinity_core;
+        } else if (affinity_str && strncmp(affinity_str, "numa", 5) == 0) {
+            affinity = halide_thread_affinity_numa;
+        }
+        work_queue.thread_affinity = affinity + 1;
+    }
+    return (halide_thread_affinity_t)(work_queue.thread_affinity - 1);
+}
+
+// The cpu a worker thread is placed on. The calling thread is not
+// pinned, so workers start at the second cpu.
+WEAK int worker_thread_cpu(int worker_index) {
+    int cpus = halide_host_cpu_count();
+    return cpus > 0 ? (worker_index + 1) % cpus : 0;
+}
+
+// Called by a worker thread when it starts. The affinity is read by the
+// thread that spawns the worker, under work_queue.mutex.
+WEAK void place_worker_thread(int worker_index, halide_thread_affinity_t affinity) {
+    if (affinity != halide_thread_affinity_none) {
+        halide_pin_current_thread(worker_thread_cpu(worker_index),
+                                  affinity == halide_thread_affinity_numa);
+    }
+}
+
 #if EXTENDED_DEBUG
 WEAK void print_job(work *job, const char *indent, const char *prefix = NULL) {
     if (prefix == NULL) {
@@ -415,6 +450,18 @@ WEAK void worker_thread(void *arg) {
     halide_mutex_unlock(&work_queue.mutex);
 }
 
+// The worker's index and affinity are packed into the argument of the
+// thread it runs on.
+WEAK void *pinned_worker_arg(int worker_index, halide_thread_affinity_t affinity) {
+    return (void *)(intptr_t)(worker_index * 4 + (int)affinity);
+}
+
+WEAK void pinned_worker_thread(void *arg) {
+    intptr_t packed = (intptr_t)arg;
+    place_worker_thread((int)(packed / 4), (halide_thread_affinity_t)(packed % 4));
+    worker_thread(NULL);
+}
+
 WEAK void enqueue_work_already_locked(int num_jobs, work *jobs, work *task_parent) {
     if (!work_queue.initialized) {
         work_queue.assert_zeroed();
@@ -485,8 +532,10 @@ WEAK void enqueue_work_already_locked(int num_jobs, work *jobs, work *task_paren
             // We might need to make some new threads, if work_queue.desired_threads_working has
             // increased, or if there aren't enough threads to complete this new task.
             work_queue.a_team_size++;
-            work_queue.threads[work_queue.threads_created++] =
-                halide_spawn_thread(worker_thread, NULL);
+            work_queue.threads[work_queue.threads_created] =
+                halide_spawn_thread(pinned_worker_thread,
+                                    pinned_worker_arg(work_queue.threads_created, current_thread_affinity()));
+            work_queue.threads_created++;
         }
         log_message("enqueue_work_already_locked top level job " << jobs[0].task.name << " with min_threads " << min_threads << " work_queue.threads_created " << work_queue.threads_created << " work_queue.threads_reserved " << work_queue.threads_reserved);
         if (job_has_acquires || job_may_block) {
@@ -555,6 +604,8 @@ WEAK halide_semaphore_release_t custom_semaphore_release = halide_default_semaph
 
 using namespace Halide::Runtime::Internal;
 
+#include "work_stealing_common.h"
+
 extern "C" {
 
 namespace {
@@ -580,6 +631,9 @@ WEAK int halide_default_do_par_for(void *user_context, halide_task_t f,
     if (size <= 0) {
         return 0;
     }
+    if (work_stealing_pool_enabled()) {
+        return halide_work_stealing_do_par_for(user_context, f, min, size, closure);
+    }
 
     work job;
     job.task.fn = NULL;
@@ -610,6 +664,10 @@ WEAK int halide_default_do_par_for(void *user_context, halide_task_t f,
 WEAK int halide_default_do_parallel_tasks(void *user_context, int num_tasks,
                                           struct halide_parallel_task_t *tasks,
                                           void *task_parent) {
+    if (work_stealing_pool_enabled() && can_work_steal(num_tasks, tasks)) {
+        return halide_work_stealing_do_parallel_tasks(user_context, num_tasks, tasks, task_parent);
+    }
+
     work *jobs = (work *)__builtin_alloca(sizeof(work) * num_tasks);
 
     for (int i = 0; i < num_tasks; i++) {
@@ -664,6 +722,14 @@ WEAK int halide_set_num_threads(int n) {
     return old;
 }
 
+WEAK halide_thread_affinity_t halide_set_thread_affinity(halide_thread_affinity_t affinity) {
+    halide_mutex_lock(&work_queue.mutex);
+    halide_thread_affinity_t old = current_thread_affinity();
+    work_queue.thread_affinity = affinity + 1;
+    halide_mutex_unlock(&work_queue.mutex);
+    return old;
+}
+
 WEAK void halide_shutdown_thread_pool() {
     if (work_queue.initialized) {
         // Wake everyone up and tell them the party's over and it's time
@@ -684,6 +750,9 @@ WEAK void halide_shutdown_thread_pool() {
         // Tidy up
         work_queue.reset();
     }
+    if (work_stealing_pool.threads_created) {
+        shutdown_work_stealing_pool();
+    }
 }
 
 struct halide_semaphore_impl_t {
@@ -43,4 +43,18 @@ WEAK int halide_create_temp_file(void *user_context, const char *prefix, const c
     return 0;
 }
 
+// Memory mapped files are not supported yet, so the on-disk tier of
+// the memoization cache is never enabled.
+WEAK bool halide_can_map_files() {
+    return false;
+}
+
+WEAK void *halide_map_file(void *user_context, const char *path, size_t *size) {
+    *size = 0;
+    return NULL;
+}
+
+WEAK void halide_unmap_file(void *user_context, void *addr, size_t size) {
+}
+
 }  // extern "C"
@@ -58,6 +58,16 @@ WEAK int halide_host_cpu_count() {
     }
 }
 
+// Threads are not pinned on this platform, and all cpus are treated as
+// one NUMA node.
+WEAK int halide_host_cpu_numa_node(int cpu) {
+    return 0;
+}
+
+WEAK int halide_pin_current_thread(int cpu, bool whole_numa_node) {
+    return -1;
+}
+
 WEAK halide_thread *halide_spawn_thread(void(*f)(void *), void *closure) {
     spawned_thread *t = (spawned_thread *)malloc(sizeof(spawned_thread));
     t->f = f;
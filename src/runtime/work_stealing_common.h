@@ -0,0 +1,562 @@
+// An alternative to the thread pool in thread_pool_common.h for
+// fine-grained data parallelism. The default pool keeps every job on
+// one stack behind one mutex, so each iteration of a parallel loop
+// costs a lock round trip. This pool instead gives each worker (and
+// each thread waiting on a parallel loop) its own Chase-Lev deque of
+// iteration ranges. Owners split ranges lazily, pushing the upper half
+// of each split for idle threads to steal at random, so the mutex is
+// only taken to put threads to sleep and to wake them up.
+//
+// Tasks that acquire semaphores, need a minimum number of threads or
+// must run serially are handed to the default pool, which keeps the
+// threads_reserved and semaphore rules that avoid deadlock for them.
+//
+// The pool is used when HL_THREAD_POOL=work_stealing is set, or when
+// halide_work_stealing_do_par_for and
+// halide_work_stealing_do_parallel_tasks are installed with
+// halide_set_custom_parallel_runtime.
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// Must be a power of two. Splitting stops when a deque is full, so
+// this only bounds how finely a range is split ahead of time.
+#define WS_DEQUE_SIZE 32
+
+// Workers, plus the threads waiting on (possibly nested) parallel loops.
+#define WS_MAX_DEQUES (2 * MAX_THREADS)
+
+// How many ranges each thread gets from a parallel loop, on average.
+#define WS_RANGES_PER_THREAD 8
+
+// How many rounds of failed steals before a thread goes to sleep.
+#define WS_SPIN_COUNT 64
+
+// The iterations of a parallel loop, or of a set of parallel tasks,
+// that an owner is waiting on.
+struct ws_group {
+    int remaining;
+    int exit_status;
+};
+
+struct ws_job {
+    // Exactly one of these is set.
+    halide_task_t task_fn;
+    halide_loop_task_t loop_fn;
+
+    void *user_context;
+    uint8_t *closure;
+    ws_group *group;
+
+    // Ranges are not split below this many iterations.
+    int grain;
+
+    // Storage for the ranges the job is split into.
+    struct ws_range *ranges;
+    int num_ranges, next_range;
+};
+
+struct ws_range {
+    ws_job *job;
+    int min, extent;
+};
+
+// A fixed size Chase-Lev deque. The owner pushes and takes at the
+// bottom, and thieves steal from the top. The counters only ever
+// increase, including across owners, so a thief holding a stale top
+// can never successfully claim a slot that has since been reused.
+struct ws_deque {
+    uintptr_t top;
+    char top_padding[64 - sizeof(uintptr_t)];
+    uintptr_t bottom;
+    ws_range *buffer[WS_DEQUE_SIZE];
+    int in_use;
+    // For worker deques, which worker owns it, how it is placed, and the
+    // NUMA node it is pinned to. Owners' deques have index and node -1
+    // and are not placed. The node is -1 unless workers are placed by
+    // NUMA node.
+    int worker_index, affinity, numa_node;
+    char padding[64 - 4 * sizeof(int)];
+
+    bool push(ws_range *r) {
+        using namespace Synchronization;
+        uintptr_t b, t;
+        atomic_load_relaxed(&bottom, &b);
+        atomic_load_acquire(&top, &t);
+        if ((intptr_t)(b - t) >= WS_DEQUE_SIZE) {
+            return false;
+        }
+        atomic_store_relaxed(&buffer[b & (WS_DEQUE_SIZE - 1)], &r);
+        b++;
+        atomic_store_release(&bottom, &b);
+        return true;
+    }
+
+    ws_range *take() {
+        using namespace Synchronization;
+        uintptr_t b, t;
+        atomic_load_relaxed(&bottom, &b);
+        b--;
+        atomic_store_relaxed(&bottom, &b);
+        atomic_thread_fence_sequentially_consistent();
+        atomic_load_relaxed(&top, &t);
+        ws_range *r = NULL;
+        if ((intptr_t)(b - t) >= 0) {
+            atomic_load_relaxed(&buffer[b & (WS_DEQUE_SIZE - 1)], &r);
+            if (b != t) {
+                return r;
+            }
+            // The last range. Race any thieves for it.
+            uintptr_t next = t + 1;
+            if (!atomic_cas_strong_sequentially_consistent(&top, &t, &next)) {
+                r = NULL;
+            }
+        }
+        b++;
+        atomic_store_relaxed(&bottom, &b);
+        return r;
+    }
+
+    ws_range *steal() {
+        using namespace Synchronization;
+        uintptr_t b, t;
+        atomic_load_acquire(&top, &t);
+        atomic_thread_fence_sequentially_consistent();
+        atomic_load_acquire(&bottom, &b);
+        if ((intptr_t)(b - t) <= 0) {
+            return NULL;
+        }
+        // Don't look at the range until the claim succeeds: if it
+        // fails, the range may already have been run and freed.
+        ws_range *r;
+        atomic_load_relaxed(&buffer[t & (WS_DEQUE_SIZE - 1)], &r);
+        uintptr_t next = t + 1;
+        if (!atomic_cas_strong_sequentially_consistent(&top, &t, &next)) {
+            return NULL;
+        }
+        return r;
+    }
+
+    bool empty() {
+        using namespace Synchronization;
+        uintptr_t b, t;
+        atomic_load_acquire(&top, &t);
+        atomic_load_acquire(&bottom, &b);
+        return (intptr_t)(b - t) <= 0;
+    }
+};
+
+struct work_stealing_pool_t {
+    // Protects the fields below, but not the deques.
+    halide_mutex mutex;
+
+    // Idle workers and owners waiting on their jobs sleep on this.
+    halide_cond wake;
+
+    // The number of threads asleep, or about to go to sleep. Read
+    // without the mutex by threads that have just pushed work.
+    int sleepers;
+
+    int threads_created;
+    halide_thread *threads[MAX_THREADS];
+
+    // One past the highest deque ever claimed, so thieves only look
+    // at deques that may have work.
+    int num_deques;
+
+    // 0 if HL_THREAD_POOL has not been read yet, 1 if the default
+    // pool is in use, and 2 if this one is.
+    int enabled;
+
+    bool shutdown;
+
+    ws_deque deques[WS_MAX_DEQUES];
+};
+
+WEAK work_stealing_pool_t work_stealing_pool = {};
+
+WEAK bool work_stealing_pool_enabled() {
+    if (work_stealing_pool.enabled == 0) {
+        const char *pool = getenv("HL_THREAD_POOL");
+        bool use_it = pool && strncmp(pool, "work_stealing", 14) == 0;
+        work_stealing_pool.enabled = use_it ? 2 : 1;
+    }
+    return work_stealing_pool.enabled == 2;
+}
+
+// Whether the tasks can run on the work-stealing pool, rather than
+// needing the deadlock avoidance of the default one.
+WEAK bool can_work_steal(int num_tasks, const halide_parallel_task_t *tasks) {
+    for (int i = 0; i < num_tasks; i++) {
+        if (tasks[i].num_semaphores != 0 || tasks[i].min_threads != 0 || tasks[i].serial) {
+            return false;
+        }
+    }
+    return true;
+}
+
+WEAK ws_deque *claim_deque() {
+    using namespace Synchronization;
+    for (int i = 0; i < WS_MAX_DEQUES; i++) {
+        ws_deque *d = work_stealing_pool.deques + i;
+        int expected = 0, desired = 1;
+        if (atomic_cas_weak_relacq_relaxed(&d->in_use, &expected, &desired)) {
+            int num_deques;
+            atomic_load_relaxed(&work_stealing_pool.num_deques, &num_deques);
+            int new_num_deques = i + 1;
+            while (num_deques < new_num_deques &&
+                   !atomic_cas_weak_relacq_relaxed(&work_stealing_pool.num_deques, &num_deques, &new_num_deques)) {
+            }
+            return d;
+        } else if (expected == 0) {
+            // Spurious failure of the weak exchange.
+            i--;
+        }
+    }
+    return NULL;
+}
+
+WEAK void release_deque(ws_deque *d) {
+    int zero = 0;
+    Synchronization::atomic_store_release(&d->in_use, &zero);
+}
+
+WEAK bool work_available() {
+    int num_deques;
+    Synchronization::atomic_load_acquire(&work_stealing_pool.num_deques, &num_deques);
+    for (int i = 0; i < num_deques; i++) {
+        if (!work_stealing_pool.deques[i].empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Wake sleeping threads after pushing a range. The fence orders the
+// push against the read of sleepers, and pairs with the fence a thread
+// does after announcing that it is going to sleep.
+WEAK void wake_sleepers() {
+    using namespace Synchronization;
+    atomic_thread_fence_sequentially_consistent();
+    int sleepers;
+    atomic_load_relaxed(&work_stealing_pool.sleepers, &sleepers);
+    if (sleepers > 0) {
+        halide_mutex_lock(&work_stealing_pool.mutex);
+        halide_cond_broadcast(&work_stealing_pool.wake);
+        halide_mutex_unlock(&work_stealing_pool.mutex);
+    }
+}
+
+// Sleep until there may be something to steal, or the group is done.
+// Workers pass a NULL group, and also wake up for shutdown.
+WEAK void sleep_until_work(ws_group *group) {
+    using namespace Synchronization;
+    halide_mutex_lock(&work_stealing_pool.mutex);
+    atomic_fetch_add_acquire_release(&work_stealing_pool.sleepers, 1);
+    atomic_thread_fence_sequentially_consistent();
+    int remaining = 0;
+    if (group) {
+        atomic_load_acquire(&group->remaining, &remaining);
+    }
+    bool done = group ? remaining == 0 : work_stealing_pool.shutdown;
+    if (!done && !work_available()) {
+        halide_cond_wait(&work_stealing_pool.wake, &work_stealing_pool.mutex);
+    }
+    atomic_fetch_add_acquire_release(&work_stealing_pool.sleepers, -1);
+    halide_mutex_unlock(&work_stealing_pool.mutex);
+}
+
+// Workers placed by NUMA node try the deques of their own node first.
+// Thieves take the oldest range in a deque, which is the largest, so
+// ranges only cross nodes in big contiguous pieces, and the smaller
+// pieces they are split into then stay on the node that stole them.
+WEAK ws_range *steal_range(ws_deque *self, uint32_t *rng) {
+    int num_deques;
+    Synchronization::atomic_load_acquire(&work_stealing_pool.num_deques, &num_deques);
+    // Xorshift, so each thread visits the victims in a different order.
+    uint32_t x = *rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *rng = x;
+    int start = (int)(x % (uint32_t)num_deques);
+    for (int pass = self->numa_node >= 0 ? 0 : 1; pass < 2; pass++) {
+        for (int i = 0; i < num_deques; i++) {
+            ws_deque *victim = work_stealing_pool.deques + (start + i) % num_deques;
+            if (victim == self || (pass == 0 && victim->numa_node != self->numa_node)) {
+                continue;
+            }
+            if (ws_range *r = victim->steal()) {
+                return r;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Run a range, first splitting off the upper half of it for thieves
+// while it is at least twice the grain of the job.
+WEAK void run_range(ws_deque *self, ws_range *r) {
+    using namespace Synchronization;
+    ws_job *job = r->job;
+    ws_group *group = job->group;
+    int min = r->min;
+    int extent = r->extent;
+
+    while (extent >= 2 * job->grain) {
+        int idx = atomic_fetch_add_acquire_release(&job->next_range, 1);
+        if (idx >= job->num_ranges) {
+            break;
+        }
+        int lower = extent / 2;
+        ws_range *upper = job->ranges + idx;
+        upper->job = job;
+        upper->min = min + lower;
+        upper->extent = extent - lower;
+        if (!self->push(upper)) {
+            break;
+        }
+        wake_sleepers();
+        extent = lower;
+    }
+
+    int exit_status;
+    atomic_load_relaxed(&group->exit_status, &exit_status);
+    int result = 0;
+    if (exit_status == 0) {
+        if (job->loop_fn) {
+            result = halide_do_loop_task(job->user_context, job->loop_fn, min, extent,
+                                         job->closure, NULL);
+        } else {
+            for (int i = min; i < min + extent && result == 0; i++) {
+                result = halide_do_task(job->user_context, job->task_fn, i, job->closure);
+            }
+        }
+    }
+    if (result != 0) {
+        int expected = 0;
+        atomic_cas_strong_sequentially_consistent(&group->exit_status, &expected, &result);
+    }
+
+    if (atomic_fetch_add_acquire_release(&group->remaining, -extent) == extent) {
+        // The group is done, and its owner may be asleep. The group
+        // may be gone as soon as the owner notices, so only touch the
+        // pool from here on.
+        halide_mutex_lock(&work_stealing_pool.mutex);
+        halide_cond_broadcast(&work_stealing_pool.wake);
+        halide_mutex_unlock(&work_stealing_pool.mutex);
+    }
+}
+
+// Run ranges from our own deque, or stolen from others, until the
+// group is done (or, for workers, the pool shuts down). Our own deque
+// is always empty on return.
+WEAK void work_stealing_loop(ws_deque *self, ws_group *group) {
+    using namespace Synchronization;
+    uint32_t rng = (uint32_t)(self - work_stealing_pool.deques) * 2654435761u + 1;
+    int idle = 0;
+    while (true) {
+        ws_range *r = self->take();
+        if (!r) {
+            if (group) {
+                int remaining;
+                atomic_load_acquire(&group->remaining, &remaining);
+                if (remaining == 0) {
+                    return;
+                }
+            } else {
+                bool shutdown;
+                atomic_load_relaxed(&work_stealing_pool.shutdown, &shutdown);
+                if (shutdown) {
+                    return;
+                }
+            }
+            r = steal_range(self, &rng);
+        }
+        if (r) {
+            run_range(self, r);
+            idle = 0;
+        } else if (++idle >= WS_SPIN_COUNT) {
+            sleep_until_work(group);
+            idle = 0;
+        }
+    }
+}
+
+WEAK void work_stealing_worker(void *arg) {
+    ws_deque *self = (ws_deque *)arg;
+    place_worker_thread(self->worker_index, (halide_thread_affinity_t)self->affinity);
+    work_stealing_loop(self, NULL);
+}
+
+// Spawn workers up to the number of threads the default pool would
+// use. Returns the number of threads, including the caller.
+WEAK int ensure_work_stealing_workers() {
+    // halide_set_num_threads and halide_set_thread_affinity write these
+    // under the work queue's mutex. Read them before taking the pool's,
+    // so the two locks are never held together.
+    halide_mutex_lock(&work_queue.mutex);
+    int desired = work_queue.desired_threads_working;
+    halide_thread_affinity_t affinity = current_thread_affinity();
+    halide_mutex_unlock(&work_queue.mutex);
+    if (desired == 0) {
+        desired = default_desired_num_threads();
+    }
+    desired = clamp_num_threads(desired);
+
+    halide_mutex_lock(&work_stealing_pool.mutex);
+    while (!work_stealing_pool.shutdown &&
+           work_stealing_pool.threads_created < desired - 1) {
+        ws_deque *d = claim_deque();
+        if (!d) {
+            break;
+        }
+        int worker_index = work_stealing_pool.threads_created;
+        d->worker_index = worker_index;
+        d->affinity = affinity;
+        d->numa_node = -1;
+        if (affinity == halide_thread_affinity_numa) {
+            d->numa_node = halide_host_cpu_numa_node(worker_thread_cpu(worker_index));
+        }
+        work_stealing_pool.threads[work_stealing_pool.threads_created++] =
+            halide_spawn_thread(work_stealing_worker, d);
+    }
+    int threads = work_stealing_pool.threads_created + 1;
+    halide_mutex_unlock(&work_stealing_pool.mutex);
+    return threads;
+}
+
+WEAK void init_work_stealing_job(ws_job *job, ws_group *group, int extent, int threads,
+                                 ws_range *ranges) {
+    int splits = threads * WS_RANGES_PER_THREAD;
+    job->group = group;
+    job->grain = (extent + splits - 1) / splits;
+    job->ranges = ranges;
+    job->num_ranges = (extent + job->grain - 1) / job->grain;
+    job->next_range = 0;
+}
+
+WEAK int work_stealing_num_ranges(int extent, int threads) {
+    int splits = threads * WS_RANGES_PER_THREAD;
+    int grain = (extent + splits - 1) / splits;
+    return (extent + grain - 1) / grain;
+}
+
+// Push a range for each job, and help out until they are all done.
+WEAK int run_work_stealing_jobs(int num_jobs, ws_job *jobs, ws_range *roots, ws_group *group) {
+    ws_deque *self = claim_deque();
+    if (self) {
+        self->worker_index = -1;
+        self->affinity = halide_thread_affinity_none;
+        self->numa_node = -1;
+    } else {
+        // Too many threads waiting on parallel loops at once. Run
+        // these ones in this thread.
+        for (int i = 0; i < num_jobs; i++) {
+            ws_range r = roots[i];
+            r.job->grain = r.extent;
+            run_range(NULL, &r);
+        }
+        return group->exit_status;
+    }
+    // Push in reverse, so that the first job is taken first.
+    for (int i = num_jobs - 1; i >= 0; i--) {
+        if (!self->push(roots + i)) {
+            run_range(self, roots + i);
+        }
+    }
+    wake_sleepers();
+    work_stealing_loop(self, group);
+    release_deque(self);
+    int exit_status;
+    Synchronization::atomic_load_acquire(&group->exit_status, &exit_status);
+    return exit_status;
+}
+
+WEAK void shutdown_work_stealing_pool() {
+    halide_mutex_lock(&work_stealing_pool.mutex);
+    work_stealing_pool.shutdown = true;
+    halide_cond_broadcast(&work_stealing_pool.wake);
+    halide_mutex_unlock(&work_stealing_pool.mutex);
+
+    for (int i = 0; i < work_stealing_pool.threads_created; i++) {
+        halide_join_thread(work_stealing_pool.threads[i]);
+    }
+
+    // The deque counters are left alone, so they stay monotonic.
+    for (int i = 0; i < WS_MAX_DEQUES; i++) {
+        release_deque(work_stealing_pool.deques + i);
+    }
+    work_stealing_pool.threads_created = 0;
+    work_stealing_pool.num_deques = 0;
+    work_stealing_pool.shutdown = false;
+}
+
+}}}  // namespace Halide::Runtime::Internal
+
+extern "C" {
+
+WEAK int halide_work_stealing_do_par_for(void *user_context, halide_task_t f,
+                                         int min, int size, uint8_t *closure) {
+    if (size <= 0) {
+        return 0;
+    }
+    int threads = ensure_work_stealing_workers();
+
+    ws_group group;
+    group.remaining = size;
+    group.exit_status = 0;
+
+    ws_job job;
+    job.task_fn = f;
+    job.loop_fn = NULL;
+    job.user_context = user_context;
+    job.closure = closure;
+    ws_range *ranges = (ws_range *)__builtin_alloca(sizeof(ws_range) * work_stealing_num_ranges(size, threads));
+    init_work_stealing_job(&job, &group, size, threads, ranges);
+
+    ws_range root;
+    root.job = &job;
+    root.min = min;
+    root.extent = size;
+    return run_work_stealing_jobs(1, &job, &root, &group);
+}
+
+WEAK int halide_work_stealing_do_parallel_tasks(void *user_context, int num_tasks,
+                                                struct halide_parallel_task_t *tasks,
+                                                void *task_parent) {
+    if (!can_work_steal(num_tasks, tasks)) {
+        return halide_default_do_parallel_tasks(user_context, num_tasks, tasks, task_parent);
+    }
+    int threads = ensure_work_stealing_workers();
+
+    ws_group group;
+    group.remaining = 0;
+    group.exit_status = 0;
+
+    ws_job *jobs = (ws_job *)__builtin_alloca(sizeof(ws_job) * num_tasks);
+    ws_range *roots = (ws_range *)__builtin_alloca(sizeof(ws_range) * num_tasks);
+    int num_jobs = 0;
+    for (int i = 0; i < num_tasks; i++) {
+        if (tasks[i].extent <= 0) {
+            continue;
+        }
+        ws_job *job = jobs + num_jobs;
+        job->task_fn = NULL;
+        job->loop_fn = tasks[i].fn;
+        job->user_context = user_context;
+        job->closure = tasks[i].closure;
+        ws_range *ranges = (ws_range *)__builtin_alloca(sizeof(ws_range) * work_stealing_num_ranges(tasks[i].extent, threads));
+        init_work_stealing_job(job, &group, tasks[i].extent, threads, ranges);
+        roots[num_jobs].job = job;
+        roots[num_jobs].min = tasks[i].min;
+        roots[num_jobs].extent = tasks[i].extent;
+        group.remaining += tasks[i].extent;
+        num_jobs++;
+    }
+    if (num_jobs == 0) {
+        return 0;
+    }
+    return run_work_stealing_jobs(num_jobs, jobs, roots, &group);
+}
+
+}
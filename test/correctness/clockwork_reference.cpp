@@ -0,0 +1,165 @@
+#include <stdio.h>
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "Halide.h"
+#include "test/common/halide_test_dirs.h"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+using std::string;
+
+using namespace Halide;
+
+string read_file(const string &filename) {
+    std::ifstream file(filename);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+// The text between two strings
+string between(const string &s, const string &start, const string &end) {
+    size_t begin = s.find(start);
+    if (begin == string::npos) {
+        return "";
+    }
+    begin += start.size();
+    return s.substr(begin, s.find(end, begin) - begin);
+}
+
+// Each line containing substr
+std::vector<string> lines_with(const string &s, const string &substr) {
+    std::vector<string> lines;
+    for (size_t pos = s.find(substr); pos != string::npos; pos = s.find(substr, pos + 1)) {
+        size_t begin = s.rfind('\n', pos) + 1;
+        lines.push_back(s.substr(begin, s.find('\n', pos) - begin));
+    }
+    return lines;
+}
+
+// A pointwise stage, whose rows can be computed on separate threads, and
+// a running sum down the columns, where each row reads the one before.
+Func running_sum(ImageParam input, bool hw) {
+    Func hw_input("hw_input"), brighten("brighten"), scan("scan");
+    Func hw_output("hw_output"), output("output");
+    Var x("x"), y("y"), xo("xo"), yo("yo"), xi("xi"), yi("yi");
+    RDom r(1, 7);
+
+    hw_input(x, y) = input(x, y);
+    brighten(x, y) = hw_input(x, y) * 2;
+    scan(x, y) = brighten(x, y);
+    scan(x, r) = scan(x, r - 1) + brighten(x, r);
+    hw_output(x, y) = scan(x, y);
+    output(x, y) = hw_output(x, y);
+
+    output.bound(x, 0, 8);
+    output.bound(y, 0, 8);
+    if (hw) {
+        hw_output.compute_root();
+        hw_output.tile(x, y, xo, yo, xi, yi, 8, 8)
+            .hw_accelerate(xi, xo);
+        brighten.compute_at(hw_output, xo);
+        scan.compute_at(hw_output, xo);
+        hw_input.stream_to_accelerator();
+    }
+    return output;
+}
+
+}  // namespace
+
+// The reference model emitted by the clockwork backend builds with just a
+// C++ compiler, and computes the same result as the pipeline on the CPU.
+int main(int argc, char **argv) {
+#ifdef _WIN32
+    printf("Test skipped on windows\n");
+#else
+    ImageParam input(UInt(16), 2, "input");
+    Buffer<uint16_t> in(8, 8);
+    for (int j = 0; j < in.height(); j++) {
+        for (int i = 0; i < in.width(); i++) {
+            in(i, j) = (uint16_t)(i * 7 + j * 13);
+        }
+    }
+    input.set(in);
+    Buffer<uint16_t> correct = running_sum(input, false).realize(8, 8);
+
+    string dir = Internal::get_test_tmp_dir() + "clockwork_reference/";
+    mkdir(dir.c_str(), 0755);
+    Target t = get_host_target().with_feature(Target::Clockwork);
+    Pipeline(running_sum(input, true)).compile_to_clockwork(dir + "running_sum.cpp", {input}, "running_sum", t);
+
+    // One top-level nest runs its iterations on separate threads, and the
+    // scan, whose rows depend on each other, runs on one
+    string reference = read_file(dir + "running_sum_reference.cpp");
+    int parallel = 0, serial = 0;
+    for (const string &line : lines_with(reference, "reference_for(")) {
+        if (line.find(", num_threads, ") != string::npos) {
+            parallel++;
+        } else if (line.find(", 1, ") != string::npos) {
+            serial++;
+        }
+    }
+    if (parallel == 0 || serial == 0) {
+        printf("%d parallel and %d serial nests in the reference model:\n%s\n",
+               parallel, serial, reference.c_str());
+        return -1;
+    }
+
+    // The model reads its inputs and writes its outputs as raw files
+    string main_source = read_file(dir + "clockwork_reference.cpp");
+    string input_file = between(main_source, "reference_read_raw(input_dir + \"/", "\"");
+    string output_file = between(main_source, "reference_write_raw(output_dir + \"/", "\"");
+    if (input_file.empty() || output_file.empty()) {
+        printf("The reference model has no raw input or output:\n%s\n", main_source.c_str());
+        return -1;
+    }
+    {
+        std::ofstream raw(dir + input_file, std::ios::binary);
+        raw.write((const char *)in.data(), in.size_in_bytes());
+    }
+
+    string source_dir = __FILE__;
+    source_dir = source_dir.substr(0, source_dir.rfind("test/correctness/"));
+    const char *cxx = getenv("CXX");
+    string compile = string(cxx ? cxx : "c++") +
+                     " -std=c++17 -O2 -DCLOCKWORK_REFERENCE -I" + dir +
+                     " -I" + source_dir + "apps/hardware_benchmarks/hw_support " +
+                     dir + "clockwork_reference.cpp -pthread -o " + dir + "clockwork_reference";
+    if (system(compile.c_str()) != 0) {
+        printf("Could not build the reference model: %s\n", compile.c_str());
+        return -1;
+    }
+    string run = "HL_NUM_THREADS=4 " + dir + "clockwork_reference " + dir + " " + dir;
+    if (system(run.c_str()) != 0) {
+        printf("The reference model failed: %s\n", run.c_str());
+        return -1;
+    }
+
+    Buffer<uint16_t> out(8, 8);
+    std::ifstream raw(dir + output_file, std::ios::binary);
+    raw.read((char *)out.data(), out.size_in_bytes());
+    if (raw.gcount() != (std::streamsize)out.size_in_bytes()) {
+        printf("%s holds %d of %d bytes\n", output_file.c_str(),
+               (int)raw.gcount(), (int)out.size_in_bytes());
+        return -1;
+    }
+    for (int j = 0; j < out.height(); j++) {
+        for (int i = 0; i < out.width(); i++) {
+            if (out(i, j) != correct(i, j)) {
+                printf("out(%d, %d) = %d instead of %d\n", i, j, out(i, j), correct(i, j));
+                return -1;
+            }
+        }
+    }
+#endif
+
+    printf("Success!\n");
+    return 0;
+}
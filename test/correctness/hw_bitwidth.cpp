@@ -0,0 +1,99 @@
+#include <stdio.h>
+
+#include "Halide.h"
+
+#include "HWBitwidth.h"
+
+namespace {
+
+using std::string;
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+void check_width(const string name, int width, int ref) {
+  if (width != ref) {
+    printf("FAIL: %s not correct: %d vs ref=%d\n", name.c_str(), width, ref);
+    abort();
+  }
+}
+
+Expr u16(int value) {
+  return make_const(UInt(16), value);
+}
+
+int bitwidth_test() {
+  Scope<Interval> scope;
+  scope.push("x", Interval(u16(0), u16(255)));
+  Expr x = Variable::make(UInt(16), "x");
+  Expr y = Variable::make(UInt(16), "y");
+
+  // 8 bit pixels widened to 16 bits for the datapath
+  Expr in0 = Call::make(UInt(8), "in.stencil", {0}, Call::Halide);
+  Expr in1 = Call::make(UInt(8), "in.stencil", {1}, Call::Halide);
+  Expr a = cast(UInt(16), in0);
+  Expr b = cast(UInt(16), in1);
+  Expr sa = cast(Int(16), in0);
+  Expr sb = cast(Int(16), in1);
+
+  check_width("loop variable", minimum_bitwidth(x, scope), 8);
+  check_width("constant", minimum_bitwidth(u16(5), scope), 3);
+  check_width("unbounded variable", minimum_bitwidth(y, scope), 16);
+  check_width("signed range", bitwidth_of_range(Interval(make_const(Int(16), -256), make_const(Int(16), 255)), Int(16)), 9);
+
+  // units that only need the bits of their result
+  check_width("add", datapath_bitwidth(a + b, scope), 9);
+  check_width("signed sub", datapath_bitwidth(sa - sb, scope), 9);
+  check_width("mul by constant", datapath_bitwidth(a * u16(3), scope), 10);
+  check_width("mul of pixels", datapath_bitwidth(a * b, scope), 16);
+  check_width("mul of loop variable", datapath_bitwidth(x * u16(4), scope), 10);
+  check_width("mod by power of two", datapath_bitwidth(Mod::make(a + b, u16(4)), scope), 2);
+  check_width("add at 8 bits", datapath_bitwidth(Add::make(in0, in1), scope), 8);
+  check_width("add of unbounded", datapath_bitwidth(y + a, scope), 16);
+
+  // units that need the bits of their widest operand
+  check_width("compare", datapath_bitwidth(LT::make(sa - sb, sa), scope), 9);
+  check_width("max", datapath_bitwidth(Max::make(a, b), scope), 8);
+  check_width("select", datapath_bitwidth(Select::make(LT::make(a, b), a + b, b), scope), 9);
+  check_width("div by power of two", datapath_bitwidth(Div::make(a, u16(4)), scope), 8);
+
+  // everything else keeps the width of its type
+  check_width("div", datapath_bitwidth(Div::make(a, u16(3)), scope), 16);
+  check_width("constant unit", datapath_bitwidth(u16(5), scope), 16);
+
+  return 0;
+}
+
+// The widths of the units the CoreIR backend builds for 16 bit wires
+int unit_width_test() {
+  Scope<Interval> scope;
+  Expr in0 = Call::make(UInt(16), "in.stencil", {0}, Call::Halide);
+  Expr in1 = Call::make(UInt(16), "in.stencil", {1}, Call::Halide);
+  Expr x = cast(UInt(16), Call::make(UInt(8), "in.stencil", {2}, Call::Halide));
+
+  // a compare of full width values stays 16 bits wide, rather than
+  // being sliced to the single bit of its result
+  check_width("16 bit compare", unit_bitwidth(NE::make(in0, u16(0)), 16, scope), 16);
+  check_width("16 bit gte", unit_bitwidth(GE::make(in0, in1), 16, scope), 16);
+  check_width("16 bit cast to bool", unit_bitwidth(Cast::make(Bool(), in0), 16, scope), 16);
+  check_width("8 bit cast to bool", unit_bitwidth(Cast::make(Bool(), x), 16, scope), 8);
+
+  // the unit is never wider than its wires
+  check_width("add at the wire width", unit_bitwidth(in0 + in1, 16, scope), 16);
+  check_width("single bit wires", unit_bitwidth(Cast::make(Bool(), in0), 1, scope), 1);
+
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  printf("Running datapath bitwidth tests\n");
+  if (bitwidth_test() != 0) { return -1; }
+
+  printf("Running functional unit width tests\n");
+  if (unit_width_test() != 0) { return -1; }
+
+  printf("Success!\n");
+  return 0;
+}
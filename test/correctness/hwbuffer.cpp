@@ -5,12 +5,15 @@
 #include "test/common/check_call_graphs.h"
 
 #include "ExtractHWBuffers.h"
+#include "HWBufferEstimates.h"
+#include "HWLoopPerfection.h"
 
 namespace {
 
 using std::map;
 using std::string;
 using std::to_string;
+using std::vector;
 using std::cout;
 using std::endl;
 
@@ -620,6 +623,7 @@ int doublebuffer_pipeline_hwbuffer_test(vector<int> ksizes, int imgsize, int til
       conv[i].update().unroll(r[i].x).unroll(r[i].y);
 		}
 
+    hw_input.double_buffer();
     hw_input.stream_to_accelerator();
 
     //// Run through compiler and find hardware buffer
@@ -631,6 +635,8 @@ int doublebuffer_pipeline_hwbuffer_test(vector<int> ksizes, int imgsize, int til
     auto xcel = hwxcels.at(0);
     h_assert(xcel.hwbuffers.size() == 2 + 2*num_conv, "Incorrect number of hwbuffers found");
     h_assert(xcel.hwbuffers.count("hw_input" + suffix) == 1, "Can't find hwbuffer named hw_input");
+    h_assert(xcel.hwbuffers.at("hw_input" + suffix).is_double_buffered, "hw_input should be double buffered");
+    h_assert(!xcel.hwbuffers.at("conv0" + suffix).is_double_buffered, "conv0 should not be double buffered");
     std::cout << "    done with hwbuffer creation of doublebuffer" << suffix << "\n";
       
     //// Create ref buffer and check the hardware buffers
@@ -942,6 +948,200 @@ int sampling_pipeline_hwbuffer_test(vector<SamplingParam> rates, int imgsize, in
   return 0;
 }
 
+// A consumer reads an output stencil every stride pixels; the buffer should
+// only hold the words between the newest write and the oldest pending read.
+int reuse_distance_hwbuffer_test(int ksize, int stride, int imgsize, int ref_capacity) {
+  int logsize = imgsize;
+  int range = (imgsize - ksize) / stride + 1;
+  auto dims = create_hwbuffer_sizes({logsize, logsize},
+                                    {ksize, ksize}, {ksize, ksize},
+                                    {1, 1}, {1, 1});
+  auto addrs = create_linear_addr({range, range},
+                                  {stride, stride}, {0, 1});
+  HWBuffer hwbuffer = HWBuffer("reuse_" + to_string(ksize) + "_" + to_string(stride), dims, addrs,
+                               {"xo", "y", "x"}, 0, 2,
+                               false, false,
+                               "input", "output");
+
+  int capacity = reuse_distance_capacity(hwbuffer);
+  check_param(hwbuffer.name + " reuse distance capacity", capacity, ref_capacity);
+  return 0;
+}
+
+// A reuse buffer read through a window_x by window_y stencil, holding capacity words
+HWBuffer window_hwbuffer(string name, int window_x, int window_y, int capacity) {
+  int imgsize = 64;
+  auto dims = create_hwbuffer_sizes({imgsize, imgsize},
+                                    {window_x, window_y}, {window_x, window_y},
+                                    {1, 1}, {1, 1});
+  auto addrs = create_linear_addr({imgsize - window_x + 1, imgsize - window_y + 1},
+                                  {1, 1}, {0, 1});
+  HWBuffer hwbuffer = HWBuffer(name, dims, addrs,
+                               {"xo", "y", "x"}, 0, 2,
+                               false, false,
+                               "input", "output");
+  hwbuffer.min_capacity = capacity;
+  return hwbuffer;
+}
+
+// Short reuse buffers go to registers and ponds, leaving the memory tiles
+// for line buffers until they run out.
+int placement_hwbuffer_test(int memtile_banks, MemoryType ref_linebuffer_level) {
+  HWXcel xcel;
+  xcel.name = "placement";
+  xcel.hwbuffers["shift"] = window_hwbuffer("shift", 3, 1, 3);
+  xcel.hwbuffers["pond"] = window_hwbuffer("pond", 16, 1, 16);
+  xcel.hwbuffers["linebuffer"] = window_hwbuffer("linebuffer", 3, 3, 2*64 + 3);
+
+  MemoryLevelParams levels;
+  levels.memtile_banks = memtile_banks;
+  place_hwbuffers(xcel, MemoryBankParams(), levels);
+
+  check_param("shift memory level", (int)xcel.hwbuffers.at("shift").memory_level, (int)MemoryType::Register);
+  check_param("pond memory level", (int)xcel.hwbuffers.at("pond").memory_level, (int)MemoryType::Pond);
+  check_param("linebuffer memory level", (int)xcel.hwbuffers.at("linebuffer").memory_level, (int)ref_linebuffer_level);
+  return 0;
+}
+
+// A guard on the row and a let between the loops make the nest imperfect;
+// both should be removed, leaving rows [0, 6) of a perfect 2D nest.
+int perfect_loop_nest_test() {
+  Func f("perfect");
+  Var x("x"), y("y"), xo("xo"), xi("xi");
+  f(x, y) = x + y;
+  f.split(x, xo, xi, 8).hw_accelerate(xi, xo);
+  map<string, Function> env = {{f.name(), f.function()}};
+
+  Expr row_var = Variable::make(Int(32), "perfect.s0.y");
+  Expr col_var = Variable::make(Int(32), "perfect.s0.x.xi");
+  Expr offset = Variable::make(Int(32), "offset");
+  Expr row = Variable::make(Int(32), "row");
+  Stmt store = Provide::make(f.name(), {row + offset + col_var}, {col_var, row_var});
+  Stmt inner = For::make("perfect.s0.x.xi", 0, 8, ForType::Serial, DeviceAPI::None, store);
+  Stmt guarded = IfThenElse::make(row_var < 6, LetStmt::make("row", row_var * 8, inner));
+  Stmt outer = For::make("perfect.s0.y", 0, 8, ForType::Serial, DeviceAPI::None,
+                         LetStmt::make("offset", 3, guarded));
+  Stmt s = For::make("perfect.s0.x.xo", 0, 1, ForType::Serial, DeviceAPI::None, outer);
+
+  s = perfect_hw_loop_nests(s, env);
+
+  const For *store_loop = s.as<For>();
+  h_assert(store_loop != nullptr, "store loop should be kept");
+  const LetStmt *offset_let = store_loop->body.as<LetStmt>();
+  h_assert(offset_let != nullptr && offset_let->name == "offset", "invariant let should be hoisted out of the nest");
+  const For *row_loop = offset_let->body.as<For>();
+  h_assert(row_loop != nullptr, "row guard should be removed");
+  check_param("row loop min", row_loop->min, Expr(0));
+  check_param("row loop extent", row_loop->extent, Expr(6));
+  const For *col_loop = row_loop->body.as<For>();
+  h_assert(col_loop != nullptr, "row loop should directly contain the column loop");
+  const LetStmt *row_let = col_loop->body.as<LetStmt>();
+  h_assert(row_let != nullptr && row_let->name == "row", "varying let should be sunk into the innermost loop");
+  return 0;
+}
+
+// Constant loop bounds stay constant: a guard against a constant let is
+// folded, while a guard against a parameter is kept. A guard with an else
+// case that writes the same function on both sides is not unswitched.
+int perfect_loop_bounds_test() {
+  Func f("bounded");
+  Var x("x"), y("y"), xo("xo"), xi("xi");
+  f(x, y) = x + y;
+  f.split(x, xo, xi, 8).hw_accelerate(xi, xo);
+  map<string, Function> env = {{f.name(), f.function()}};
+
+  Expr row_var = Variable::make(Int(32), "bounded.s0.y");
+  Expr col_var = Variable::make(Int(32), "bounded.s0.x.xi");
+  Expr rows = Variable::make(Int(32), "rows");
+  Expr n = Variable::make(Int(32), "n");
+  Stmt store = Provide::make(f.name(), {col_var}, {col_var, row_var});
+  Stmt inner = For::make("bounded.s0.x.xi", 0, 8, ForType::Serial, DeviceAPI::None, store);
+  auto xcel_nest = [&](Stmt body) {
+    Stmt outer = For::make("bounded.s0.y", 0, 8, ForType::Serial, DeviceAPI::None, body);
+    return For::make("bounded.s0.x.xo", 0, 1, ForType::Serial, DeviceAPI::None, outer);
+  };
+
+  Stmt s = LetStmt::make("rows", 6, xcel_nest(IfThenElse::make(row_var < rows, inner)));
+  s = perfect_hw_loop_nests(s, env);
+  const For *row_loop = s.as<LetStmt>()->body.as<For>()->body.as<For>();
+  h_assert(row_loop != nullptr && row_loop->body.as<For>() != nullptr, "guard on a constant let should be folded");
+  check_param("folded row loop extent", row_loop->extent, Expr(6));
+
+  s = perfect_hw_loop_nests(xcel_nest(IfThenElse::make(row_var < n, inner)), env);
+  row_loop = s.as<For>()->body.as<For>();
+  h_assert(row_loop->body.as<IfThenElse>() != nullptr, "guard on a parameter should be kept");
+  check_param("guarded row loop extent", row_loop->extent, Expr(8));
+
+  Stmt zero = For::make("bounded.s0.x.xi", 0, 8, ForType::Serial, DeviceAPI::None,
+                        Provide::make(f.name(), {0}, {col_var, row_var}));
+  s = perfect_hw_loop_nests(xcel_nest(IfThenElse::make(n > 0, inner, zero)), env);
+  row_loop = s.as<For>()->body.as<For>();
+  h_assert(row_loop != nullptr && row_loop->body.as<IfThenElse>() != nullptr,
+           "loop writing the same function on both sides should not be unswitched");
+  return 0;
+}
+
+// A raster scan over a whole buffer needs a single address counter,
+// while a scan over a window of it needs one per dimension.
+int flatten_linear_access_test() {
+  HWBuffer full = window_hwbuffer("full", 1, 1, 64*64);
+  auto flat = flatten_linear_access(full, full.ostreams.at("output").linear_access);
+  check_param("full scan levels", (int)flat.size(), 1);
+  check_param("full scan range", flat.at(0).range, Expr(64*64));
+  check_param("full scan stride", flat.at(0).stride, Expr(1));
+  check_param("full scan dim_ref", flat.at(0).dim_ref, Expr(0));
+
+  HWBuffer window = window_hwbuffer("window", 3, 3, 2*64 + 3);
+  flat = flatten_linear_access(window, window.ostreams.at("output").linear_access);
+  check_param("window scan levels", (int)flat.size(), 2);
+  return 0;
+}
+
+// A column of taps at the given rows of a buffer 12 rows tall, with the
+// stencil at row origin (undefined if it moves with the rows).
+BankingScheme bank_rows(vector<int> rows, Expr origin) {
+  auto dims = create_hwbuffer_sizes({64, 12}, {1, 8}, {1, 8}, {1, 1}, {1, 1});
+  auto addrs = create_linear_addr({64, 5}, {1, 1}, {0, 1});
+  HWBuffer hwbuffer = HWBuffer("banked", dims, addrs,
+                               {"xo", "y", "x"}, 0, 2,
+                               false, false,
+                               "input", "output");
+  OutputStream& ostream = hwbuffer.ostreams.at("output");
+  ostream.odims.at(1).output_min_pos = origin.defined() ? origin : Var("y");
+  for (size_t i = 0; i < rows.size(); ++i) {
+    Port port;
+    port.stream_index = i;
+    port.mem_indices = {Expr(0), Expr(rows.at(i))};
+    ostream.oports[{Expr(0), Expr(rows.at(i))}] = port;
+  }
+  return bank_output_stream(hwbuffer, ostream);
+}
+
+void check_banking(const string& name, const BankingScheme& banking,
+                   BankingScheme::Partition partition, int num_banks, vector<int> port_banks) {
+  check_param(name + " partition", (int)banking.partition, (int)partition);
+  check_param(name + " banks", banking.num_banks, num_banks);
+  check_param(name + " ports", (int)banking.port_banks.size(), (int)port_banks.size());
+  for (size_t i = 0; i < port_banks.size(); ++i) {
+    check_param(name + " bank of port " + to_string(i), banking.port_banks.at(i), port_banks.at(i));
+  }
+}
+
+// Adjacent rows are banked cyclically. Rows 0, 3 and 7 need five cyclic
+// banks, but four blocks of three rows when the stencil stays put, with
+// the ports mapped from where the stencil is in its block.
+int banking_test() {
+  check_banking("adjacent rows", bank_rows({0, 1, 2}, 0), BankingScheme::Cyclic, 3, {0, 1, 2});
+  check_banking("block at row 0", bank_rows({0, 3, 7}, 0), BankingScheme::Block, 4, {0, 1, 2});
+  check_banking("block at row 2", bank_rows({0, 3, 7}, 2), BankingScheme::Block, 4, {0, 1, 3});
+  check_banking("moving stencil", bank_rows({0, 3, 7}, Expr()), BankingScheme::Cyclic, 5, {0, 3, 2});
+
+  BankingScheme block = bank_rows({0, 3, 7}, 2);
+  check_param("block dim", block.block_dim, 1);
+  check_param("block size", block.block_size, 3);
+  return 0;
+}
+
 }  // namespace
 
 int main(int argc, char **argv) {
@@ -1013,6 +1213,33 @@ int main(int argc, char **argv) {
     if (sampling_pipeline_hwbuffer_test({Dn(3),Up(6),Dn(5),Dn(2),Up(4)}, 64, 64) != 0) { return -1; }
     //if (sampling_pipeline_hwbuffer_test({Dn(3),Up(6),Up(4),Dn(5),Dn(2)}, 64, 64) != 0) { return -1; }
 
+    printf("Running reuse distance hwbuffer tests\n");
+    printf("  checking capacities...\n");
+    // line buffer: ksize-1 full rows plus ksize pixels
+    if (reuse_distance_hwbuffer_test(3, 1, 66, 2*66 + 3) != 0) { return -1; }
+    if (reuse_distance_hwbuffer_test(5, 1, 64, 4*64 + 5) != 0) { return -1; }
+    // downsample: skipped pixels are never stored
+    if (reuse_distance_hwbuffer_test(1, 2, 64, 1) != 0) { return -1; }
+    if (reuse_distance_hwbuffer_test(2, 2, 64, 64 + 2) != 0) { return -1; }
+    // large images are analyzed without simulating every access
+    if (reuse_distance_hwbuffer_test(3, 1, 4096, 2*4096 + 3) != 0) { return -1; }
+
+    printf("Running memory placement hwbuffer tests\n");
+    printf("  checking memory levels...\n");
+    // a 3x3 line buffer reads 3 rows per cycle, so it needs 3 memory tiles
+    if (placement_hwbuffer_test(16, MemoryType::MemTile) != 0) { return -1; }
+    if (placement_hwbuffer_test(2, MemoryType::GLB) != 0) { return -1; }
+
+    printf("Running loop perfection hwbuffer tests\n");
+    printf("  checking loop nests and address counters...\n");
+    if (perfect_loop_nest_test() != 0) { return -1; }
+    if (perfect_loop_bounds_test() != 0) { return -1; }
+    if (flatten_linear_access_test() != 0) { return -1; }
+
+    printf("Running banking hwbuffer tests\n");
+    printf("  checking memory banks...\n");
+    if (banking_test() != 0) { return -1; }
+
     printf("Running multi-pixel hwbuffer tests\n");
     printf("  checking hwbuffers...\n");
     // 1 pixel/cycle
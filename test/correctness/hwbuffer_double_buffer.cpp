@@ -0,0 +1,68 @@
+#include <stdio.h>
+
+#include "Halide.h"
+
+namespace {
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+// Find the number of copies of a buffer allocated by the pipeline
+class CountCopies : public IRMutator {
+    const std::string &name;
+
+    using IRMutator::visit;
+
+    Stmt visit(const Allocate *op) override {
+        if (op->name == name && !op->extents.empty()) {
+            const int64_t *extent = as_const_int(op->extents.back());
+            copies = extent ? (int)*extent : -1;
+        }
+        return IRMutator::visit(op);
+    }
+
+public:
+    int copies = 0;
+
+    CountCopies(const std::string &name) : name(name) {}
+};
+
+}  // namespace
+
+// A double-buffered function stored outside its tile loop alternates
+// between two copies. Consecutive tiles overlap, so the function must
+// not be slid: the previous tile's values are in the other copy.
+int main(int argc, char **argv) {
+    Func f("f"), g("g");
+    Var x("x"), y("y"), xo("xo"), yo("yo"), xi("xi"), yi("yi");
+
+    f(x, y) = x * 3 + y * 5;
+    g(x, y) = f(x, y) + f(x + 1, y) + f(x, y + 1);
+
+    g.tile(x, y, xo, yo, xi, yi, 8, 8);
+    f.store_root().compute_at(g, xo).double_buffer();
+
+    CountCopies *counter = new CountCopies(f.name());
+    g.add_custom_lowering_pass(counter);
+
+    Target t = get_jit_target_from_environment().with_feature(Target::Clockwork);
+    Buffer<int> out = g.realize(64, 64, t);
+
+    if (counter->copies != 2) {
+        printf("f was allocated with %d copies instead of 2\n", counter->copies);
+        return -1;
+    }
+
+    for (int j = 0; j < out.height(); j++) {
+        for (int i = 0; i < out.width(); i++) {
+            int correct = (i * 3 + j * 5) + ((i + 1) * 3 + j * 5) + (i * 3 + (j + 1) * 5);
+            if (out(i, j) != correct) {
+                printf("out(%d, %d) = %d instead of %d\n", i, j, out(i, j), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
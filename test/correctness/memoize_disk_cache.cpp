@@ -0,0 +1,209 @@
+#include "Halide.h"
+#include "HalideRuntime.h"
+#include "test/common/halide_test_dirs.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace Halide;
+
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+int call_count = 0;
+
+extern "C" DLLEXPORT int count_calls_with_arg(uint8_t val, halide_buffer_t *out) {
+    if (!out->is_bounds_query()) {
+        call_count++;
+        Halide::Runtime::Buffer<uint8_t>(*out).fill(val);
+    }
+    return 0;
+}
+
+#ifndef _WIN32
+
+halide_memoization_cache_shard_stats_t cache_totals() {
+    int shards = Internal::JITSharedRuntime::memoization_cache_get_stats(nullptr, 0);
+    std::vector<halide_memoization_cache_shard_stats_t> stats(shards);
+    Internal::JITSharedRuntime::memoization_cache_get_stats(stats.data(), shards);
+    halide_memoization_cache_shard_stats_t t = {};
+    for (const auto &s : stats) {
+        t.hits += s.hits;
+        t.misses += s.misses;
+        t.evictions += s.evictions;
+        t.disk_hits += s.disk_hits;
+        t.spills += s.spills;
+        t.size += s.size;
+        t.entries += s.entries;
+    }
+    return t;
+}
+
+// The names of the files in a directory.
+std::vector<std::string> list_dir(const std::string &dir) {
+    std::vector<std::string> names;
+    DIR *d = opendir(dir.c_str());
+    if (d) {
+        while (dirent *e = readdir(d)) {
+            std::string name = e->d_name;
+            if (name != "." && name != "..") {
+                names.push_back(name);
+            }
+        }
+        closedir(d);
+    }
+    return names;
+}
+
+// Whether the directory holds just the given number of complete
+// entries, and no partially written ones.
+bool check_spilled(const std::string &dir, size_t expected) {
+    std::vector<std::string> names = list_dir(dir);
+    for (const std::string &name : names) {
+        if (name.size() < 4 || name.compare(name.size() - 4, 4, ".bin") != 0) {
+            printf("Unexpected file %s in the on-disk tier\n", name.c_str());
+            return false;
+        }
+    }
+    if (names.size() != expected) {
+        printf("%d files in the on-disk tier instead of %d\n", (int)names.size(), (int)expected);
+        return false;
+    }
+    return true;
+}
+
+#endif
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+    printf("Test skipped on windows due to use of dirent\n");
+#else
+    std::string dir = Internal::get_test_tmp_dir() + "memoize_disk_cache_" + std::to_string(getpid());
+    if (mkdir(dir.c_str(), 0755) != 0) {
+        printf("Could not create %s\n", dir.c_str());
+        return -1;
+    }
+
+    Param<uint8_t> val;
+
+    Func count_calls;
+    count_calls.define_extern("count_calls_with_arg", {val}, UInt(8), 2);
+    count_calls.compute_root().memoize();
+
+    Func f;
+    Var x, y;
+    f(x, y) = count_calls(x, y);
+
+    const int size = 64;
+    auto run = [&](uint8_t v) {
+        val.set(v);
+        Buffer<uint8_t> out = f.realize(size, size);
+        for (int j = 0; j < size; j++) {
+            for (int i = 0; i < size; i++) {
+                if (out(i, j) != v) {
+                    printf("out(%d, %d) = %d instead of %d\n", i, j, out(i, j), v);
+                    exit(-1);
+                }
+            }
+        }
+    };
+
+    // Room in memory for one entry, so computing a second spills the
+    // first to disk.
+    Internal::JITSharedRuntime::memoization_cache_set_disk_dir(dir);
+    Internal::JITSharedRuntime::memoization_cache_set_size(size * size);
+
+    run(1);
+    run(2);
+    halide_memoization_cache_shard_stats_t t = cache_totals();
+    if (call_count != 2 || t.evictions != 1 || t.spills != 1 || t.entries != 1) {
+        printf("After two keys: %d calls, %d evictions, %d spills, %d entries\n",
+               call_count, (int)t.evictions, (int)t.spills, t.entries);
+        return -1;
+    }
+    if (!check_spilled(dir, 1)) {
+        return -1;
+    }
+
+    // The first key is now found on disk rather than recomputed, and
+    // spills the second to make room.
+    run(1);
+    t = cache_totals();
+    if (call_count != 2 || t.disk_hits != 1 || t.spills != 2) {
+        printf("After reloading: %d calls, %d disk hits, %d spills\n",
+               call_count, (int)t.disk_hits, (int)t.spills);
+        return -1;
+    }
+    if (!check_spilled(dir, 2)) {
+        return -1;
+    }
+
+    // Cleaning up releases everything held in memory, including the
+    // mapped entry. Only evicted entries reach the on-disk tier, so it
+    // still holds the two spilled above for the next run.
+    Internal::JITSharedRuntime::memoization_cache_cleanup();
+    t = cache_totals();
+    if (t.entries != 0 || t.size != 0 || t.hits != 0 || t.misses != 0 || t.spills != 0) {
+        printf("After cleanup: %d entries, %lld bytes, %d spills\n",
+               t.entries, (long long)t.size, (int)t.spills);
+        return -1;
+    }
+    if (!check_spilled(dir, 2)) {
+        return -1;
+    }
+    run(2);
+    run(1);
+    t = cache_totals();
+    if (call_count != 2 || t.disk_hits != 2) {
+        printf("After cleanup and reloading: %d calls, %d disk hits\n",
+               call_count, (int)t.disk_hits);
+        return -1;
+    }
+
+    // An entry still in memory when the cache is cleaned up is
+    // discarded rather than spilled, and computed again.
+    Internal::JITSharedRuntime::memoization_cache_cleanup();
+    run(3);
+    Internal::JITSharedRuntime::memoization_cache_cleanup();
+    if (!check_spilled(dir, 2)) {
+        return -1;
+    }
+    run(3);
+    t = cache_totals();
+    if (call_count != 4 || t.disk_hits != 0) {
+        printf("After discarding a live entry: %d calls, %d disk hits\n",
+               call_count, (int)t.disk_hits);
+        return -1;
+    }
+
+    // With the tier disabled, evicted entries are recomputed.
+    Internal::JITSharedRuntime::memoization_cache_cleanup();
+    Internal::JITSharedRuntime::memoization_cache_set_disk_dir("");
+    run(1);
+    if (call_count != 5) {
+        printf("A disabled on-disk tier was used\n");
+        return -1;
+    }
+
+    Internal::JITSharedRuntime::memoization_cache_cleanup();
+    // Return cache size to default.
+    Internal::JITSharedRuntime::memoization_cache_set_size(0);
+
+    for (const std::string &name : list_dir(dir)) {
+        unlink((dir + "/" + name).c_str());
+    }
+    rmdir(dir.c_str());
+#endif
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,208 @@
+#include "Halide.h"
+#include "HalideRuntime.h"
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+using namespace Halide;
+
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+// An external function whose cost is set by its second argument, so
+// entries of the same size differ in how long they took to compute.
+
+int call_count = 0;
+
+extern "C" DLLEXPORT int slow_calls(uint8_t val, int32_t slow, halide_buffer_t *out) {
+    if (!out->is_bounds_query()) {
+        call_count++;
+        if (slow) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        Halide::Runtime::Buffer<uint8_t>(*out).fill(val);
+    }
+    return 0;
+}
+
+typedef std::vector<halide_memoization_cache_shard_stats_t> CacheStats;
+
+CacheStats cache_stats() {
+    int shards = Internal::JITSharedRuntime::memoization_cache_get_stats(nullptr, 0);
+    CacheStats stats(shards);
+    Internal::JITSharedRuntime::memoization_cache_get_stats(stats.data(), shards);
+    return stats;
+}
+
+halide_memoization_cache_shard_stats_t total(const CacheStats &stats) {
+    halide_memoization_cache_shard_stats_t t = {};
+    for (const auto &s : stats) {
+        t.hits += s.hits;
+        t.misses += s.misses;
+        t.evictions += s.evictions;
+        t.size += s.size;
+        t.entries += s.entries;
+    }
+    return t;
+}
+
+// The shard that gained an entry between two snapshots, or -1.
+int new_entry_shard(const CacheStats &before, const CacheStats &after) {
+    for (size_t i = 0; i < after.size(); i++) {
+        if (after[i].entries > before[i].entries) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+const int size = 64;
+const int64_t entry_size = size * size;
+
+int main(int argc, char **argv) {
+    Param<uint8_t> val;
+    Param<int32_t> slow;
+
+    Func calls;
+    calls.define_extern("slow_calls", {val, slow}, UInt(8), 2);
+    calls.compute_root().memoize();
+
+    Func f;
+    Var x, y;
+    f(x, y) = calls(x, y);
+
+    auto run = [&](int v, bool s) {
+        val.set((uint8_t)v);
+        slow.set(s ? 1 : 0);
+        Buffer<uint8_t> out = f.realize(size, size);
+        if (out(0, 0) != v) {
+            printf("Wrong output %d instead of %d\n", out(0, 0), v);
+            exit(-1);
+        }
+    };
+
+    Internal::JITSharedRuntime::memoization_cache_set_size(64 * 1024 * 1024);
+
+    // Distinct keys spread over the shards, and each is counted as a
+    // miss, then as a hit. Remember which shard each key went to.
+    const int keys = 64;
+    std::vector<int> shard_of(keys);
+    CacheStats stats;
+    for (int v = 0; v < keys; v++) {
+        CacheStats before = cache_stats();
+        run(v, false);
+        stats = cache_stats();
+        shard_of[v] = new_entry_shard(before, stats);
+        if (shard_of[v] < 0) {
+            printf("Key %d was not added to the cache\n", v);
+            return -1;
+        }
+    }
+    if (stats.size() < 2) {
+        printf("The cache has %d shards\n", (int)stats.size());
+        return -1;
+    }
+
+    halide_memoization_cache_shard_stats_t t = total(stats);
+    if (t.misses != keys || t.hits != 0 || t.evictions != 0 ||
+        t.entries != keys || t.size != keys * entry_size || call_count != keys) {
+        printf("After the first pass: %d misses, %d hits, %d evictions, %d entries, "
+               "%lld bytes, %d calls\n",
+               (int)t.misses, (int)t.hits, (int)t.evictions, t.entries,
+               (long long)t.size, call_count);
+        return -1;
+    }
+    int shards_used = 0;
+    for (const auto &s : stats) {
+        if (s.entries > 0) {
+            shards_used++;
+        }
+        if (s.entries > keys / 4) {
+            printf("A shard holds %d of %d entries\n", s.entries, keys);
+            return -1;
+        }
+        if (s.entries > s.buckets) {
+            printf("A shard holds %d entries in %d buckets\n", s.entries, s.buckets);
+            return -1;
+        }
+        if (s.size != s.entries * entry_size) {
+            printf("A shard holds %d entries in %lld bytes\n", s.entries, (long long)s.size);
+            return -1;
+        }
+    }
+    if (shards_used < (int)stats.size() / 2) {
+        printf("Only %d of %d shards are used\n", shards_used, (int)stats.size());
+        return -1;
+    }
+
+    for (int v = 0; v < keys; v++) {
+        run(v, false);
+    }
+    t = total(cache_stats());
+    if (t.misses != keys || t.hits != keys || call_count != keys) {
+        printf("After the second pass: %d misses, %d hits, %d calls\n",
+               (int)t.misses, (int)t.hits, call_count);
+        return -1;
+    }
+
+    // Find a slow key that shares its shard with a cheap one. Eviction
+    // weighs the entries of one shard against each other.
+    int slow_key = -1, cheap_key = -1;
+    for (int v = 0; v < keys && cheap_key < 0; v++) {
+        CacheStats before = cache_stats();
+        run(v, true);
+        int shard = new_entry_shard(before, cache_stats());
+        for (int c = 0; c < keys; c++) {
+            if (shard_of[c] == shard) {
+                slow_key = v;
+                cheap_key = c;
+                break;
+            }
+        }
+    }
+    if (cheap_key < 0) {
+        printf("No slow key shares a shard with a cheap one\n");
+        return -1;
+    }
+
+    // With just the two, the slow entry least recently used, shrinking
+    // the cache to one entry evicts the cheap one.
+    Internal::JITSharedRuntime::memoization_cache_cleanup();
+    t = total(cache_stats());
+    if (t.hits != 0 || t.misses != 0 || t.entries != 0 || t.size != 0) {
+        printf("The cache is not empty after cleanup\n");
+        return -1;
+    }
+    run(slow_key, true);
+    run(cheap_key, false);
+    Internal::JITSharedRuntime::memoization_cache_set_size(entry_size);
+    t = total(cache_stats());
+    if (t.evictions != 1 || t.entries != 1) {
+        printf("Shrinking the cache made %d evictions, leaving %d entries\n",
+               (int)t.evictions, t.entries);
+        return -1;
+    }
+
+    call_count = 0;
+    run(slow_key, true);
+    if (call_count != 0) {
+        printf("The slow entry was evicted before the cheap one\n");
+        return -1;
+    }
+    run(cheap_key, false);
+    if (call_count != 1) {
+        printf("The cheap entry was not evicted\n");
+        return -1;
+    }
+
+    Internal::JITSharedRuntime::memoization_cache_cleanup();
+    // Return cache size to default.
+    Internal::JITSharedRuntime::memoization_cache_set_size(0);
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,151 @@
+#include <stdio.h>
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "Halide.h"
+#include "test/common/halide_test_dirs.h"
+
+namespace {
+
+using std::string;
+
+using namespace Halide;
+
+string read_file(const string &filename) {
+    std::ifstream file(filename);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+int count(const string &s, const string &substr) {
+    int n = 0;
+    for (size_t pos = s.find(substr); pos != string::npos; pos = s.find(substr, pos + 1)) {
+        n++;
+    }
+    return n;
+}
+
+// The text between two strings, starting from pos
+string between(const string &s, const string &start, const string &end, size_t pos = 0) {
+    size_t begin = s.find(start, pos);
+    if (begin == string::npos) {
+        return "";
+    }
+    begin += start.size();
+    return s.substr(begin, s.find(end, begin) - begin);
+}
+
+// The start of each line containing substr
+std::vector<size_t> lines_with(const string &s, const string &substr) {
+    std::vector<size_t> lines;
+    for (size_t pos = s.find(substr); pos != string::npos; pos = s.find(substr, pos + 1)) {
+        lines.push_back(s.rfind('\n', pos) + 1);
+    }
+    return lines;
+}
+
+// Whether the block open at from is still open at to
+bool in_scope(const string &s, size_t from, size_t to) {
+    int depth = 0;
+    for (size_t i = from; i < to; i++) {
+        if (s[i] == '{') {
+            depth++;
+        } else if (s[i] == '}' && --depth < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+// Two accelerators where the second reads the output of the first share
+// one device memory object, and the second run waits on the first inside
+// the session instead of on the host.
+int main(int argc, char **argv) {
+    ImageParam input(UInt(16), 2, "input");
+    Func hw_input("hw_input"), hw_output("hw_output");
+    Func hw_input2("hw_input2"), hw_output2("hw_output2"), output("output");
+    Var x("x"), y("y"), xo("xo"), yo("yo"), xi("xi"), yi("yi");
+
+    hw_input(x, y) = input(x, y);
+    hw_output(x, y) = hw_input(x, y) * 2;
+    hw_input2(x, y) = hw_output(x, y);
+    hw_output2(x, y) = hw_input2(x, y) + 1;
+    output(x, y) = hw_output2(x, y);
+
+    output.bound(x, 0, 8);
+    output.bound(y, 0, 8);
+    hw_output.compute_root();
+    hw_output.tile(x, y, xo, yo, xi, yi, 8, 8)
+        .hw_accelerate(xi, xo);
+    hw_input.stream_to_accelerator();
+    hw_output2.compute_root();
+    hw_output2.tile(x, y, xo, yo, xi, yi, 8, 8)
+        .hw_accelerate(xi, xo);
+    hw_input2.stream_to_accelerator();
+
+    string dir = Internal::get_test_tmp_dir();
+    Target t = get_host_target().with_feature(Target::Clockwork);
+    Pipeline(output).compile_to_clockwork(dir + "rdai_chain.cpp", {input}, "rdai_chain", t);
+    string source = read_file(dir + "rdai_chain.cpp");
+
+    // The input of the second accelerator is the output memory object of
+    // the first
+    string y_stencil = between(source, "// Chain ", " to the accelerator output ");
+    string x_stencil = between(source, " to the accelerator output ", "\n");
+    if (x_stencil.empty() || y_stencil.empty()) {
+        printf("The accelerators are not chained:\n%s\n", source.c_str());
+        return -1;
+    }
+
+    if (count(source, "RDAI_MemObject *" + x_stencil + " = RDAI_mem_shared_allocate(") != 1 ||
+        count(source, "RDAI_mem_free(" + x_stencil + ")") != 1) {
+        printf("%s is not allocated and freed once:\n%s\n", x_stencil.c_str(), source.c_str());
+        return -1;
+    }
+    if (count(source, "RDAI_MemObject *" + y_stencil + " = RDAI_mem_shared_allocate(") != 0 ||
+        count(source, "RDAI_mem_free(" + y_stencil + ")") != 0) {
+        printf("%s has its own memory object:\n%s\n", y_stencil.c_str(), source.c_str());
+        return -1;
+    }
+
+    // Neither copy through the host is left
+    if (count(source, "// Provision buffer " + y_stencil) != 0 ||
+        count(source, x_stencil + "_host") != 0 ||
+        count(source, y_stencil + "_host") != 0) {
+        printf("The chained buffer is copied on the host:\n%s\n", source.c_str());
+        return -1;
+    }
+
+    // The second run depends on the first
+    std::vector<size_t> submits = lines_with(source, "_session.submit(");
+    if (submits.size() != 2) {
+        printf("The source submits %d runs instead of 2:\n%s\n", (int)submits.size(), source.c_str());
+        return -1;
+    }
+    const string run_decl = "std::shared_future<RDAI_Status> ";
+    string x_run = between(source, run_decl, " = ", submits[0]);
+    string y_submit = between(source, run_decl, "\n", submits[1]);
+    if (y_submit.find(", {" + x_run + "});") == string::npos) {
+        printf("The second run does not wait on %s: %s\n", x_run.c_str(), y_submit.c_str());
+        return -1;
+    }
+
+    // The alias is declared while the root is in scope, and the root is
+    // freed after its last reader was submitted
+    size_t allocate = source.find("RDAI_MemObject *" + x_stencil + " = RDAI_mem_shared_allocate(");
+    size_t alias = source.find("RDAI_MemObject *" + y_stencil + " = " + x_stencil + ";");
+    size_t freed = source.find("RDAI_mem_free(" + x_stencil + ")");
+    if (alias == string::npos || !(allocate < alias && alias < freed && submits[1] < freed) ||
+        !in_scope(source, allocate, freed)) {
+        printf("%s is not declared and freed in order:\n%s\n", y_stencil.c_str(), source.c_str());
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
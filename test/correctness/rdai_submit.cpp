@@ -0,0 +1,74 @@
+#include <stdio.h>
+
+#include <fstream>
+#include <sstream>
+
+#include "Halide.h"
+#include "test/common/halide_test_dirs.h"
+
+namespace {
+
+using std::string;
+
+using namespace Halide;
+
+string read_file(const string &filename) {
+    std::ifstream file(filename);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+bool contains(const string &s, const string &substr) {
+    return s.find(substr) != string::npos;
+}
+
+}  // namespace
+
+// The RDAI host code of a pipeline with an accelerator declares its
+// asynchronous entry point in the header, and fails when a device run does.
+int main(int argc, char **argv) {
+    ImageParam input(UInt(16), 2, "input");
+    Func hw_input("hw_input"), hw_output("hw_output"), output("output");
+    Var x("x"), y("y"), xo("xo"), yo("yo"), xi("xi"), yi("yi");
+
+    hw_input(x, y) = input(x, y);
+    hw_output(x, y) = hw_input(x, y) * 2;
+    output(x, y) = hw_output(x, y);
+
+    output.bound(x, 0, 8);
+    output.bound(y, 0, 8);
+    hw_output.compute_root();
+    hw_output.tile(x, y, xo, yo, xi, yi, 8, 8)
+        .hw_accelerate(xi, xo);
+    hw_input.stream_to_accelerator();
+
+    string dir = Internal::get_test_tmp_dir();
+    Target t = get_host_target().with_feature(Target::Clockwork);
+    Pipeline(output).compile_to_clockwork(dir + "rdai_submit.cpp", {input}, "rdai_submit", t);
+
+    // C code including the header must not see the std::future prototype
+    string header = read_file(dir + "rdai_submit_clockwork.h");
+    if (!contains(header, "#ifdef __cplusplus\n"
+                          "#include <future>\n"
+                          "std::future<int> rdai_submit_clockwork_submit(struct halide_buffer_t *arg0, "
+                          "struct halide_buffer_t *arg1);\n"
+                          "#endif\n")) {
+        printf("header does not declare rdai_submit_clockwork_submit:\n%s\n", header.c_str());
+        return -1;
+    }
+
+    string source = read_file(dir + "rdai_submit.cpp");
+    if (!contains(source, "std::future<int> rdai_submit_clockwork_submit(")) {
+        printf("source does not define rdai_submit_clockwork_submit\n");
+        return -1;
+    }
+    if (!contains(source, "_status.status_code != RDAI_STATUS_OK") ||
+        !contains(source, "return halide_error_code_device_run_failed;")) {
+        printf("source does not return the status of the device run:\n%s\n", source.c_str());
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include <stdio.h>
+
+#include "Halide.h"
+
+#include "ExtractHWKernelDAG.h"
+#include "StreamOpt.h"
+
+namespace {
+
+using std::string;
+using std::vector;
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+// A 2D stencil of the given size stored over [0, max] in both dimensions
+vector<StencilDimSpecs> stencil(int size, Expr min, Expr max) {
+    vector<StencilDimSpecs> dims(2);
+    for (StencilDimSpecs &dim : dims) {
+        dim.size = size;
+        dim.step = 1;
+        dim.min_pos = 0;
+        dim.store_bound = Interval(min, max);
+    }
+    return dims;
+}
+
+HWKernel kernel(const string &name, int size, Expr store_max) {
+    HWKernel k(Function(name), name);
+    k.dims = stencil(size, 0, store_max);
+    return k;
+}
+
+// input -> blur -> out, where out also reads input directly, so the
+// window of input sent to out waits for the linebuffer of blur:
+//   blur starts once input has written 2 rows and 3 pixels (130 cycles),
+//   out starts once blur has done the same (260 cycles).
+HWKernelDAG unsharp_dag(Expr blur_store_max) {
+    HWKernelDAG dag;
+    dag.name = "unsharp";
+
+    HWKernel input = kernel("input", 3, 63);
+    input.consumer_stencils["blur"] = stencil(3, 0, 63);
+    input.consumer_stencils["out"] = stencil(3, 0, 63);
+    input.consumer_fifo_depths["blur"] = 4;
+
+    HWKernel blur = kernel("blur", 3, blur_store_max);
+    blur.input_streams = {"input"};
+    blur.consumer_stencils["out"] = stencil(3, 0, blur_store_max);
+    blur.consumer_fifo_depths["out"] = 2;
+
+    HWKernel out = kernel("out", 1, 63);
+    out.is_output = true;
+    out.input_streams = {"input", "blur"};
+
+    dag.kernels["input"] = input;
+    dag.kernels["blur"] = blur;
+    dag.kernels["out"] = out;
+    return dag;
+}
+
+bool check_depth(const HWKernelDAG &dag, const string &producer, const string &consumer, int expected) {
+    int depth = dag.kernels.at(producer).consumer_fifo_depths.at(consumer);
+    if (depth != expected) {
+        printf("%s: fifo from %s to %s has depth %d instead of %d\n",
+               dag.name.c_str(), producer.c_str(), consumer.c_str(), depth, expected);
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    HWKernelDAG dag = unsharp_dag(63);
+    size_dispatch_fifos(dag);
+    if (!check_depth(dag, "input", "blur", 4) ||
+        !check_depth(dag, "input", "out", 130) ||
+        !check_depth(dag, "blur", "out", 2)) {
+        return -1;
+    }
+
+    // Without constant store bounds on blur, the start of out is not
+    // known, and the fifos into it keep their depths
+    HWKernelDAG unknown = unsharp_dag(Variable::make(Int(32), "blur.extent") - 1);
+    size_dispatch_fifos(unknown);
+    if (!check_depth(unknown, "input", "blur", 4) ||
+        !check_depth(unknown, "input", "out", 0) ||
+        !check_depth(unknown, "blur", "out", 2)) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
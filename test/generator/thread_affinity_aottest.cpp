@@ -0,0 +1,51 @@
+#include "HalideRuntime.h"
+#include "HalideBuffer.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <thread>
+
+#include "thread_affinity.h"
+
+using namespace Halide::Runtime;
+
+// Pinning more worker threads than the host has cores must neither
+// fail nor hang the thread pool: the surplus workers share cores.
+int main(int argc, char **argv) {
+    int cores = std::max(1, (int)std::thread::hardware_concurrency());
+    int threads = 4 * cores + 3;
+
+    const halide_thread_affinity_t affinities[] = {halide_thread_affinity_core,
+                                                   halide_thread_affinity_numa,
+                                                   halide_thread_affinity_none};
+    const char *names[] = {"core", "numa", "none"};
+
+    Buffer<int32_t> out(256, 64);
+    for (int a = 0; a < 3; a++) {
+        // Workers are placed as they are created, so start a new pool.
+        halide_shutdown_thread_pool();
+        halide_set_thread_affinity(affinities[a]);
+        halide_set_num_threads(threads);
+
+        for (int i = 0; i < 20; i++) {
+            out.fill(-1);
+            int ret = thread_affinity(out);
+            if (ret) {
+                printf("Non zero exit code with %s affinity: %d\n", names[a], ret);
+                return -1;
+            }
+            for (int y = 0; y < out.height(); y++) {
+                for (int x = 0; x < out.width(); x++) {
+                    if (out(x, y) != x + y * 256) {
+                        printf("out(%d, %d) = %d with %s affinity\n", x, y, out(x, y), names[a]);
+                        return -1;
+                    }
+                }
+            }
+        }
+    }
+    halide_shutdown_thread_pool();
+
+    printf("Success\n");
+    return 0;
+}
@@ -0,0 +1,20 @@
+#include "Halide.h"
+
+namespace {
+
+class ThreadAffinity : public Halide::Generator<ThreadAffinity> {
+public:
+    Output<Buffer<int32_t>> output{"output", 2};
+
+    void generate() {
+        // A job with nested parallelism, to keep every worker busy
+        Var x, y;
+
+        output(x, y) = x + y * 256;
+        output.parallel(x).parallel(y);
+    }
+};
+
+}  // namespace
+
+HALIDE_REGISTER_GENERATOR(ThreadAffinity, thread_affinity)
@@ -0,0 +1,61 @@
+#include "Halide.h"
+#include <cstdio>
+#include "halide_benchmark.h"
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+int main(int argc, char **argv) {
+    // A parallel loop where each iteration allocates and frees its own
+    // scratch buffers on the heap. The tile size is a parameter, so
+    // the scratch buffers can't go on the stack.
+    Param<int> tile;
+    Var x, y, xo, xi;
+    Func in, blur_x, blur_y;
+    in(x, y) = cast<float>(x * 3 + y * 7);
+    blur_x(x, y) = in(x - 1, y) + in(x, y) + in(x + 1, y);
+    blur_y(x, y) = blur_x(x, y - 1) + blur_x(x, y) + blur_x(x, y + 1);
+
+    blur_y.split(x, xo, xi, tile, TailStrategy::RoundUp).parallel(y).vectorize(xi, 8);
+    blur_x.compute_at(blur_y, xo).vectorize(x, 8);
+    in.compute_at(blur_y, xo).vectorize(x, 8);
+
+    tile.set(64);
+    Pipeline p(blur_y);
+    const int width = 4096, height = 1024;
+    Buffer<float> reference = p.realize(width, height);
+
+    double times[2];
+    const char *names[] = {"malloc", "pool allocator"};
+    for (int i = 0; i < 2; i++) {
+        Target t = get_jit_target_from_environment();
+        if (i == 1) {
+            t = t.with_feature(Target::PoolAllocator);
+        }
+        // The allocator is part of the shared runtime, so restart it
+        // for the new target.
+        p.invalidate_cache();
+        Halide::Internal::JITSharedRuntime::release_all();
+        p.compile_jit(t);
+        Buffer<float> out = p.realize(width, height);
+        for (int yi = 0; yi < height; yi++) {
+            for (int xi = 0; xi < width; xi++) {
+                if (out(xi, yi) != reference(xi, yi)) {
+                    printf("%s computed out(%d, %d) = %f instead of %f\n",
+                           names[i], xi, yi, out(xi, yi), reference(xi, yi));
+                    return -1;
+                }
+            }
+        }
+        times[i] = benchmark([&]() { p.realize(out); });
+        printf("%s: %f ms\n", names[i], times[i] * 1e3);
+    }
+
+    if (times[1] > times[0] * 2) {
+        printf("The pool allocator is much slower than malloc\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
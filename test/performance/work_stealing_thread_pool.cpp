@@ -0,0 +1,62 @@
+#include "Halide.h"
+#include <cstdio>
+#include "halide_benchmark.h"
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+// Switch thread pools and thread counts via the environment, and
+// restart the runtime so it reads them again.
+void use_thread_pool(Pipeline &p, const char *pool, int threads) {
+    static char pool_buf[64], threads_buf[32];
+    snprintf(pool_buf, sizeof(pool_buf), "HL_THREAD_POOL=%s", pool);
+    snprintf(threads_buf, sizeof(threads_buf), "HL_NUM_THREADS=%d", threads);
+    putenv(pool_buf);
+    putenv(threads_buf);
+    p.invalidate_cache();
+    Halide::Internal::JITSharedRuntime::release_all();
+    p.compile_jit();
+}
+
+int main(int argc, char **argv) {
+    // A parallel loop with many iterations that each do very little
+    // work, so the cost of handing out iterations dominates.
+    Func f;
+    Var x, y;
+    f(x, y) = x * y + (x ^ y);
+    f.parallel(y);
+
+    Pipeline p(f);
+    const int width = 16, height = 100000;
+
+    Buffer<int> reference = p.realize(width, height);
+
+    for (int t = 1; t <= 16; t *= 2) {
+        double times[2];
+        const char *pools[] = {"default", "work_stealing"};
+        for (int i = 0; i < 2; i++) {
+            use_thread_pool(p, pools[i], t);
+            Buffer<int> out = p.realize(width, height);
+            for (int yi = 0; yi < height; yi++) {
+                for (int xi = 0; xi < width; xi++) {
+                    if (out(xi, yi) != reference(xi, yi)) {
+                        printf("%s thread pool computed out(%d, %d) = %d instead of %d\n",
+                               pools[i], xi, yi, out(xi, yi), reference(xi, yi));
+                        return -1;
+                    }
+                }
+            }
+            times[i] = benchmark([&]() { p.realize(out); });
+        }
+
+        printf("%d threads: default %f ms, work stealing %f ms (%.2fx)\n",
+               t, times[0] * 1e3, times[1] * 1e3, times[0] / times[1]);
+        if (times[1] > times[0] * 2) {
+            printf("Work stealing thread pool is much slower than the default with %d threads\n", t);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}